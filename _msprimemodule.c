@@ -39,6 +39,10 @@ static gsl_error_handler_t *old_gsl_error_handler;
 static PyObject *MsprimeInputError;
 static PyObject *MsprimeLibraryError;
 
+/* Signals are only handled on the main thread, which we assume is the
+ * thread that imports the module. */
+static unsigned long main_thread_ident;
+
 /* A lightweight wrapper for a table collection. This serves only as a wrapper
  * around a pointer and a way move to data in-and-out of the low level structures
  * via the canonical dictionary encoding.
@@ -48,12 +52,14 @@ static PyObject *MsprimeLibraryError;
 typedef struct {
     PyObject_HEAD
     tsk_table_collection_t *tables;
+    PyThread_type_lock lock;
 } LightweightTableCollection;
 
 typedef struct {
     PyObject_HEAD
     unsigned long seed;
     gsl_rng* rng;
+    PyThread_type_lock lock;
 } RandomGenerator;
 
 typedef struct {
@@ -89,6 +95,7 @@ typedef struct {
     RandomGenerator *random_generator;
     IntervalMap *rate_map;
     PyObject *model;
+    PyThread_type_lock lock;
 } MutationGenerator;
 
 typedef struct {
@@ -99,9 +106,14 @@ typedef struct {
 typedef struct {
     PyObject_HEAD
     msp_t *sim;
+    /* Summary statistics sink; NULL unless statistics only were requested */
+    branch_stats_t *branch_stats;
     RecombinationMap *recombination_map;
     RandomGenerator *random_generator;
     LightweightTableCollection *tables;
+    /* The simulator this one was cloned from, if any */
+    PyObject *source;
+    PyThread_type_lock lock;
 } Simulator;
 
 static void
@@ -122,6 +134,75 @@ handle_input_error(const char *section, int err)
     PyErr_Format(MsprimeInputError, "Input error in %s: %s", section, msp_strerror(err));
 }
 
+/* Objects whose C structures are used with the GIL released have a lock,
+ * which must be held while the structures are in use. To avoid deadlock,
+ * locks are always acquired in the order Simulator or MutationGenerator,
+ * LightweightTableCollection, RandomGenerator. Mutation models that are
+ * not thread safe have no lock and are only used with the GIL held. */
+static int
+alloc_lock(PyThread_type_lock *lock)
+{
+    int ret = 0;
+
+    if (*lock == NULL) {
+        *lock = PyThread_allocate_lock();
+        if (*lock == NULL) {
+            PyErr_NoMemory();
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static void
+free_lock(PyThread_type_lock *lock)
+{
+    if (*lock != NULL) {
+        PyThread_free_lock(*lock);
+        *lock = NULL;
+    }
+}
+
+/* Acquire the lock, releasing the GIL while we wait so that the thread
+ * holding the lock can make progress. */
+static void
+acquire_lock(PyThread_type_lock lock)
+{
+    if (!PyThread_acquire_lock(lock, NOWAIT_LOCK)) {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+static void
+release_lock(PyThread_type_lock lock)
+{
+    PyThread_release_lock(lock);
+}
+
+static int
+cmp_lock(const void *a, const void *b)
+{
+    const uintptr_t ia = (uintptr_t) *(const PyThread_type_lock *) a;
+    const uintptr_t ib = (uintptr_t) *(const PyThread_type_lock *) b;
+    return (ia > ib) - (ia < ib);
+}
+
+/* Acquire the specified distinct locks in order of address, so that callers
+ * locking overlapping sets of objects at the same level cannot deadlock.
+ * The array is sorted in place. */
+static void
+acquire_locks(PyThread_type_lock *locks, size_t num_locks)
+{
+    size_t j;
+
+    qsort(locks, num_locks, sizeof(*locks), cmp_lock);
+    for (j = 0; j < num_locks; j++) {
+        acquire_lock(locks[j]);
+    }
+}
+
 static int
 double_PyArray_converter(PyObject *in, PyObject **converted)
 {
@@ -1241,8 +1322,11 @@ out:
     return ret;
 }
 
+/* If owner is NULL the columns are copied. Otherwise the column arrays are
+ * views onto the table memory and keep the owner alive, so no data is copied
+ * when handing tables to tskit; the owner must not modify the tables. */
 static int
-write_table_arrays(tsk_table_collection_t *tables, PyObject *dict)
+write_table_arrays(tsk_table_collection_t *tables, PyObject *dict, PyObject *owner)
 {
     struct table_col {
         const char *name;
@@ -1256,6 +1340,7 @@ write_table_arrays(tsk_table_collection_t *tables, PyObject *dict)
     };
     int ret = -1;
     PyObject *array = NULL;
+    PyObject *view = NULL;
     PyObject *table_dict = NULL;
     size_t j;
     struct table_col *col;
@@ -1394,9 +1479,28 @@ write_table_arrays(tsk_table_collection_t *tables, PyObject *dict)
         }
         col = table_descs[j].cols;
         while (col->name != NULL) {
-            array = PyArray_SimpleNewFromData(1, &col->num_rows, col->type, col->data);
-            if (array == NULL) {
-                goto out;
+            if (owner == NULL) {
+                view = PyArray_SimpleNewFromData(
+                        1, &col->num_rows, col->type, col->data);
+                if (view == NULL) {
+                    goto out;
+                }
+                array = PyArray_NewCopy((PyArrayObject *) view, NPY_ANYORDER);
+                Py_DECREF(view);
+                view = NULL;
+                if (array == NULL) {
+                    goto out;
+                }
+            } else {
+                array = PyArray_SimpleNewFromData(
+                        1, &col->num_rows, col->type, col->data);
+                if (array == NULL) {
+                    goto out;
+                }
+                Py_INCREF(owner);
+                if (PyArray_SetBaseObject((PyArrayObject *) array, owner) != 0) {
+                    goto out;
+                }
             }
             if (PyDict_SetItemString(table_dict, col->name, array) != 0) {
                 goto out;
@@ -1418,9 +1522,11 @@ out:
     return ret;
 }
 
-/* Returns a dictionary encoding of the specified table collection */
+/* Returns a dictionary encoding of the specified table collection. If owner
+ * is not NULL the column arrays share memory with the tables, which must
+ * stay valid and unchanged for as long as the owner object is alive. */
 static PyObject*
-dump_tables_dict(tsk_table_collection_t *tables)
+dump_tables_dict(tsk_table_collection_t *tables, PyObject *owner)
 {
     PyObject *ret = NULL;
     PyObject *dict = NULL;
@@ -1441,7 +1547,7 @@ dump_tables_dict(tsk_table_collection_t *tables)
     Py_DECREF(val);
     val = NULL;
 
-    err = write_table_arrays(tables, dict);
+    err = write_table_arrays(tables, dict, owner);
     if (err != 0) {
         goto out;
     }
@@ -1453,11 +1559,185 @@ out:
     return ret;
 }
 
+/* A msp_replicate_template_t along with the memory it refers to. The
+ * provenance strings are borrowed from the Python objects that they were
+ * parsed from, which must outlive the template. */
+typedef struct {
+    msp_replicate_template_t template;
+    char *population_metadata;
+    tsk_size_t *population_metadata_offset;
+} replicate_template_t;
+
+static void
+replicate_template_free(replicate_template_t *self)
+{
+    PyMem_Free(self->population_metadata);
+    PyMem_Free(self->population_metadata_offset);
+    self->population_metadata = NULL;
+    self->population_metadata_offset = NULL;
+}
+
+/* Parses the provenance record and timestamp strings (either both or
+ * neither of which may be None) and the optional sequence of population
+ * metadata bytes into the specified template. */
+static int
+replicate_template_init(replicate_template_t *self, PyObject *provenance_record,
+        PyObject *provenance_timestamp, PyObject *population_metadata)
+{
+    int ret = -1;
+    PyObject *seq = NULL;
+    PyObject *item;
+    const char *str;
+    char *buff;
+    Py_ssize_t length, num_populations, j;
+    tsk_size_t total_length;
+
+    memset(self, 0, sizeof(*self));
+    if ((provenance_record == Py_None) != (provenance_timestamp == Py_None)) {
+        PyErr_SetString(PyExc_ValueError,
+            "Must specify both provenance_record and provenance_timestamp");
+        goto out;
+    }
+    if (provenance_record != Py_None) {
+        str = PyUnicode_AsUTF8AndSize(provenance_record, &length);
+        if (str == NULL) {
+            goto out;
+        }
+        self->template.provenance_record = str;
+        self->template.provenance_record_length = (tsk_size_t) length;
+        str = PyUnicode_AsUTF8AndSize(provenance_timestamp, &length);
+        if (str == NULL) {
+            goto out;
+        }
+        self->template.provenance_timestamp = str;
+        self->template.provenance_timestamp_length = (tsk_size_t) length;
+    }
+    if (population_metadata != Py_None) {
+        seq = PySequence_Fast(population_metadata,
+                "population_metadata must be a sequence of bytes");
+        if (seq == NULL) {
+            goto out;
+        }
+        num_populations = PySequence_Fast_GET_SIZE(seq);
+        self->population_metadata_offset = PyMem_Malloc(
+                (num_populations + 1) * sizeof(*self->population_metadata_offset));
+        if (self->population_metadata_offset == NULL) {
+            PyErr_NoMemory();
+            goto out;
+        }
+        total_length = 0;
+        for (j = 0; j < num_populations; j++) {
+            item = PySequence_Fast_GET_ITEM(seq, j);
+            if (!PyBytes_Check(item)) {
+                PyErr_SetString(PyExc_TypeError,
+                    "population_metadata must be a sequence of bytes");
+                goto out;
+            }
+            self->population_metadata_offset[j] = total_length;
+            total_length += (tsk_size_t) PyBytes_GET_SIZE(item);
+        }
+        self->population_metadata_offset[num_populations] = total_length;
+        /* Allocate at least one byte so that the buffer is never NULL */
+        self->population_metadata = PyMem_Malloc(total_length + 1);
+        if (self->population_metadata == NULL) {
+            PyErr_NoMemory();
+            goto out;
+        }
+        buff = self->population_metadata;
+        for (j = 0; j < num_populations; j++) {
+            item = PySequence_Fast_GET_ITEM(seq, j);
+            memcpy(buff, PyBytes_AS_STRING(item), PyBytes_GET_SIZE(item));
+            buff += PyBytes_GET_SIZE(item);
+        }
+        self->template.population_metadata = self->population_metadata;
+        self->template.population_metadata_offset = self->population_metadata_offset;
+        self->template.num_populations = (tsk_size_t) num_populations;
+    }
+    ret = 0;
+out:
+    if (ret != 0) {
+        replicate_template_free(self);
+    }
+    Py_XDECREF(seq);
+    return ret;
+}
+
 /*===================================================================
  * LightweightTableCollection
  *===================================================================
  */
 
+#define TABLE_COLLECTION_CAPSULE_NAME "_msprime.table_collection"
+
+static void
+table_collection_capsule_destructor(PyObject *capsule)
+{
+    tsk_table_collection_t *tables
+        = PyCapsule_GetPointer(capsule, TABLE_COLLECTION_CAPSULE_NAME);
+
+    if (tables != NULL) {
+        tsk_table_collection_free(tables);
+        PyMem_RawFree(tables);
+    }
+}
+
+/* Returns the dictionary encoding of the specified tables, which must have
+ * been allocated with PyMem_RawMalloc. Ownership passes to the column
+ * arrays, and the tables are freed along with the last of them. */
+static PyObject *
+adopt_tables_dict(tsk_table_collection_t *tables)
+{
+    PyObject *ret = NULL;
+    PyObject *capsule = NULL;
+
+    capsule = PyCapsule_New(tables, TABLE_COLLECTION_CAPSULE_NAME,
+            table_collection_capsule_destructor);
+    if (capsule == NULL) {
+        tsk_table_collection_free(tables);
+        PyMem_RawFree(tables);
+        goto out;
+    }
+    ret = dump_tables_dict(tables, capsule);
+out:
+    Py_XDECREF(capsule);
+    return ret;
+}
+
+/* Moves the contents of the tables into a new collection and returns its
+ * dictionary encoding. The column buffers are handed over as they are, and
+ * the tables are left empty with the same sequence length.
+ */
+static PyObject *
+LightweightTableCollection_move_tables_dict(LightweightTableCollection *self)
+{
+    PyObject *ret = NULL;
+    tsk_table_collection_t *moved = NULL;
+    tsk_table_collection_t tmp;
+    int err;
+
+    moved = PyMem_RawMalloc(sizeof(*moved));
+    if (moved == NULL) {
+        PyErr_NoMemory();
+        goto out;
+    }
+    err = tsk_table_collection_init(moved, 0);
+    if (err != 0) {
+        tsk_table_collection_free(moved);
+        PyMem_RawFree(moved);
+        handle_tskit_library_error(err);
+        goto out;
+    }
+    /* Swap by value so that anything holding a pointer to self->tables
+     * (e.g. a Simulator) still sees a valid, empty collection. */
+    tmp = *self->tables;
+    *self->tables = *moved;
+    *moved = tmp;
+    self->tables->sequence_length = moved->sequence_length;
+    ret = adopt_tables_dict(moved);
+out:
+    return ret;
+}
+
 static int
 LightweightTableCollection_check_state(LightweightTableCollection *self)
 {
@@ -1477,6 +1757,7 @@ LightweightTableCollection_dealloc(LightweightTableCollection* self)
         PyMem_Free(self->tables);
         self->tables = NULL;
     }
+    free_lock(&self->lock);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -1492,6 +1773,9 @@ LightweightTableCollection_init(LightweightTableCollection *self, PyObject *args
     if (!PyArg_ParseTupleAndKeywords(args, kwds, "|d", kwlist, &sequence_length)) {
         goto out;
     }
+    if (alloc_lock(&self->lock) != 0) {
+        goto out;
+    }
     self->tables = PyMem_Malloc(sizeof(*self->tables));
     if (self->tables == NULL) {
         PyErr_NoMemory();
@@ -1509,14 +1793,27 @@ out:
 }
 
 static PyObject *
-LightweightTableCollection_asdict(LightweightTableCollection *self)
+LightweightTableCollection_asdict(LightweightTableCollection *self, PyObject *args,
+        PyObject *kwds)
 {
     PyObject *ret = NULL;
+    static char *kwlist[] = {"move", NULL};
+    int move = 0;
 
     if (LightweightTableCollection_check_state(self) != 0) {
         goto out;
     }
-    ret = dump_tables_dict(self->tables);
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &move)) {
+        goto out;
+    }
+    acquire_lock(self->lock);
+    if (move) {
+        ret = LightweightTableCollection_move_tables_dict(self);
+    } else {
+        /* The tables can be changed after this returns, so copy them */
+        ret = dump_tables_dict(self->tables, NULL);
+    }
+    release_lock(self->lock);
 out:
     return ret;
 }
@@ -1528,15 +1825,64 @@ LightweightTableCollection_fromdict(LightweightTableCollection *self, PyObject *
     PyObject *ret = NULL;
     PyObject *dict = NULL;
 
+    if (LightweightTableCollection_check_state(self) != 0) {
+        goto out;
+    }
     if (!PyArg_ParseTuple(args, "O!", &PyDict_Type, &dict)) {
         goto out;
     }
+    acquire_lock(self->lock);
     err = parse_table_collection_dict(self->tables, dict);
+    release_lock(self->lock);
+    if (err != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("");
+out:
+    return ret;
+}
+
+static PyObject *
+LightweightTableCollection_stamp_replicate(LightweightTableCollection *self,
+        PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    static char *kwlist[] = {"replicate_index", "provenance_record",
+        "provenance_timestamp", "population_metadata", NULL};
+    PyObject *provenance_record = Py_None;
+    PyObject *provenance_timestamp = Py_None;
+    PyObject *population_metadata = Py_None;
+    replicate_template_t template;
+    Py_ssize_t replicate_index;
+    int err;
+
+    memset(&template, 0, sizeof(template));
+    if (LightweightTableCollection_check_state(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "n|OOO", kwlist, &replicate_index,
+            &provenance_record, &provenance_timestamp, &population_metadata)) {
+        goto out;
+    }
+    if (replicate_index < 0) {
+        PyErr_SetString(PyExc_ValueError, "replicate_index must be >= 0");
+        goto out;
+    }
+    if (replicate_template_init(&template, provenance_record, provenance_timestamp,
+            population_metadata) != 0) {
+        goto out;
+    }
+    acquire_lock(self->lock);
+    err = msp_stamp_replicate_tables(self->tables, &template.template,
+            (size_t) replicate_index);
+    release_lock(self->lock);
     if (err != 0) {
+        handle_library_error(err);
         goto out;
     }
     ret = Py_BuildValue("");
 out:
+    replicate_template_free(&template);
     return ret;
 }
 
@@ -1546,9 +1892,17 @@ static PyMemberDef LightweightTableCollection_members[] = {
 
 static PyMethodDef LightweightTableCollection_methods[] = {
     {"asdict", (PyCFunction) LightweightTableCollection_asdict,
-        METH_NOARGS, "Returns the tables encoded as a dictionary."},
+        METH_VARARGS|METH_KEYWORDS,
+        "Returns the tables encoded as a dictionary of arrays copied from "
+        "the tables. If move is True, the column buffers are handed over "
+        "to the arrays instead and the tables are left empty."},
     {"fromdict", (PyCFunction) LightweightTableCollection_fromdict,
         METH_VARARGS, "Populates the internal tables using the specified dictionary."},
+    {"stamp_replicate", (PyCFunction) LightweightTableCollection_stamp_replicate,
+        METH_VARARGS|METH_KEYWORDS,
+        "Adds the provenance record for the specified replicate, substituting "
+        "the index for REPLICATE_INDEX_PLACEHOLDER, and replaces the population "
+        "metadata."},
     {NULL}  /* Sentinel */
 };
 
@@ -1588,6 +1942,7 @@ RandomGenerator_dealloc(RandomGenerator* self)
         gsl_rng_free(self->rng);
         self->rng = NULL;
     }
+    free_lock(&self->lock);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -1607,6 +1962,9 @@ RandomGenerator_init(RandomGenerator *self, PyObject *args, PyObject *kwds)
             "seeds must be greater than 0 and less than 2^32");
         goto out;
     }
+    if (alloc_lock(&self->lock) != 0) {
+        goto out;
+    }
     self->seed = seed;
     self->rng = gsl_rng_alloc(gsl_rng_default);
     gsl_rng_set(self->rng, self->seed);
@@ -1628,11 +1986,38 @@ out:
     return ret;
 }
 
+static PyObject *
+RandomGenerator_set_seed(RandomGenerator *self, PyObject *args)
+{
+    PyObject *ret = NULL;
+    unsigned long long seed = 0;
+
+    if (RandomGenerator_check_state(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTuple(args, "K", &seed)) {
+        goto out;
+    }
+    if (seed == 0 || seed >= (1ULL<<32)) {
+        PyErr_Format(PyExc_ValueError,
+            "seeds must be greater than 0 and less than 2^32");
+        goto out;
+    }
+    /* Simulators using this generator may be running in other threads. */
+    acquire_lock(self->lock);
+    self->seed = seed;
+    gsl_rng_set(self->rng, self->seed);
+    release_lock(self->lock);
+    ret = Py_BuildValue("");
+out:
+    return ret;
+}
+
 static PyObject *
 RandomGenerator_flat(RandomGenerator *self, PyObject *args)
 {
     PyObject *ret = NULL;
-    double a, b;
+    double a, b, value;
 
     if (RandomGenerator_check_state(self) != 0) {
         goto out;
@@ -1640,7 +2025,10 @@ RandomGenerator_flat(RandomGenerator *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "dd", &a, &b)) {
         goto out;
     }
-    ret = Py_BuildValue("d", gsl_ran_flat(self->rng, a, b));
+    acquire_lock(self->lock);
+    value = gsl_ran_flat(self->rng, a, b);
+    release_lock(self->lock);
+    ret = Py_BuildValue("d", value);
 out:
     return ret;
 }
@@ -1650,6 +2038,7 @@ RandomGenerator_poisson(RandomGenerator *self, PyObject *args)
 {
     PyObject *ret = NULL;
     double mu;
+    unsigned int value;
 
     if (RandomGenerator_check_state(self) != 0) {
         goto out;
@@ -1657,7 +2046,10 @@ RandomGenerator_poisson(RandomGenerator *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "d", &mu)) {
         goto out;
     }
-    ret = Py_BuildValue("I", gsl_ran_poisson(self->rng, mu));
+    acquire_lock(self->lock);
+    value = gsl_ran_poisson(self->rng, mu);
+    release_lock(self->lock);
+    ret = Py_BuildValue("I", value);
 out:
     return ret;
 }
@@ -1666,7 +2058,7 @@ static PyObject *
 RandomGenerator_uniform_int(RandomGenerator *self, PyObject *args)
 {
     PyObject *ret = NULL;
-    unsigned long n;
+    unsigned long n, value;
 
     if (RandomGenerator_check_state(self) != 0) {
         goto out;
@@ -1674,7 +2066,10 @@ RandomGenerator_uniform_int(RandomGenerator *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "k", &n)) {
         goto out;
     }
-    ret = Py_BuildValue("k", gsl_rng_uniform_int(self->rng, n));
+    acquire_lock(self->lock);
+    value = gsl_rng_uniform_int(self->rng, n);
+    release_lock(self->lock);
+    ret = Py_BuildValue("k", value);
 out:
     return ret;
 }
@@ -1686,6 +2081,8 @@ static PyMemberDef RandomGenerator_members[] = {
 static PyMethodDef RandomGenerator_methods[] = {
     {"get_seed", (PyCFunction) RandomGenerator_get_seed,
         METH_NOARGS, "Returns the random seed for this generator."},
+    {"set_seed", (PyCFunction) RandomGenerator_set_seed,
+        METH_VARARGS, "Reseeds this generator with the specified seed."},
     {"flat", (PyCFunction) RandomGenerator_flat,
         METH_VARARGS, "Interface for gsl_ran_flat"},
     {"poisson", (PyCFunction) RandomGenerator_poisson,
@@ -2282,6 +2679,7 @@ MutationGenerator_dealloc(MutationGenerator* self)
     Py_XDECREF(self->random_generator);
     Py_XDECREF(self->rate_map);
     Py_XDECREF(self->model);
+    free_lock(&self->lock);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -2309,6 +2707,9 @@ MutationGenerator_init(MutationGenerator *self, PyObject *args, PyObject *kwds)
             &py_model)) {
         goto out;
     }
+    if (alloc_lock(&self->lock) != 0) {
+        goto out;
+    }
     self->random_generator = random_generator;
     Py_INCREF(self->random_generator);
     if (RandomGenerator_check_state(self->random_generator) != 0) {
@@ -2374,18 +2775,48 @@ MutationGenerator_generate(MutationGenerator *self, PyObject *args, PyObject *kw
     int discrete = 0;
     double start_time = -DBL_MAX;
     double end_time = DBL_MAX;
-    static char *kwlist[] = {"tables", "keep", "start_time", "end_time", "discrete", NULL};
+    Py_ssize_t num_chunks = 0;
+    Py_ssize_t num_threads = 1;
+    bool locked = false;
+    static char *kwlist[] = {"tables", "keep", "start_time", "end_time", "discrete",
+        "num_chunks", "num_threads", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!|iddi", kwlist,
-            &LightweightTableCollectionType, &tables, &keep, &start_time, &end_time, &discrete)) {
+    if (MutationGenerator_check_state(self) != 0) {
         goto out;
     }
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!|iddinn", kwlist,
+            &LightweightTableCollectionType, &tables, &keep, &start_time, &end_time,
+            &discrete, &num_chunks, &num_threads)) {
+        goto out;
+    }
+    if (LightweightTableCollection_check_state(tables) != 0) {
+        goto out;
+    }
+    if (num_chunks < 0) {
+        PyErr_SetString(PyExc_ValueError, "num_chunks must be >= 0");
+        goto out;
+    }
+    if (num_threads < 1) {
+        PyErr_SetString(PyExc_ValueError, "num_threads must be >= 1");
+        goto out;
+    }
+    acquire_lock(self->lock);
+    acquire_lock(tables->lock);
+    acquire_lock(self->random_generator->lock);
+    locked = true;
     err = mutgen_set_time_interval(self->mutgen, start_time, end_time);
     if (err != 0) {
         handle_library_error(err);
         goto out;
     }
-    if (MutationGenerator_check_state(self) != 0) {
+    err = mutgen_set_num_chunks(self->mutgen, (size_t) num_chunks);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    err = mutgen_set_num_threads(self->mutgen, (size_t) num_threads);
+    if (err != 0) {
+        handle_library_error(err);
         goto out;
     }
     if (keep) {
@@ -2394,13 +2825,26 @@ MutationGenerator_generate(MutationGenerator *self, PyObject *args, PyObject *kw
     if (discrete) {
         flags |= MSP_DISCRETE_SITES;
     }
-    err = mutgen_generate(self->mutgen, tables->tables, flags);
+    if (self->mutgen->model->thread_safe) {
+        Py_BEGIN_ALLOW_THREADS
+        err = mutgen_generate(self->mutgen, tables->tables, flags);
+        Py_END_ALLOW_THREADS
+    } else {
+        /* The model has state that changes as alleles are chosen and it may be
+         * shared with other generators, so we keep the GIL to use it alone. */
+        err = mutgen_generate(self->mutgen, tables->tables, flags);
+    }
     if (err != 0) {
         handle_library_error(err);
         goto out;
     }
     ret = Py_BuildValue("");
 out:
+    if (locked) {
+        release_lock(self->random_generator->lock);
+        release_lock(tables->lock);
+        release_lock(self->lock);
+    }
     return ret;
 }
 
@@ -2717,6 +3161,23 @@ Simulator_check_sim(Simulator *self)
     return ret;
 }
 
+/* Lock the simulator along with the tables and random generator it uses */
+static void
+Simulator_acquire_locks(Simulator *self)
+{
+    acquire_lock(self->lock);
+    acquire_lock(self->tables->lock);
+    acquire_lock(self->random_generator->lock);
+}
+
+static void
+Simulator_release_locks(Simulator *self)
+{
+    release_lock(self->random_generator->lock);
+    release_lock(self->tables->lock);
+    release_lock(self->lock);
+}
+
 static int
 Simulator_parse_population_configuration(Simulator *self, PyObject *py_pop_config)
 {
@@ -3364,12 +3825,47 @@ Simulator_dealloc(Simulator* self)
         PyMem_Free(self->sim);
         self->sim = NULL;
     }
+    if (self->branch_stats != NULL) {
+        branch_stats_free(self->branch_stats);
+        PyMem_Free(self->branch_stats);
+        self->branch_stats = NULL;
+    }
     Py_XDECREF(self->random_generator);
     Py_XDECREF(self->recombination_map);
     Py_XDECREF(self->tables);
+    /* Clones share configuration with their source, so it goes last */
+    Py_XDECREF(self->source);
+    free_lock(&self->lock);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
+static int
+Simulator_alloc_branch_stats(Simulator *self)
+{
+    int ret = -1;
+    int err;
+
+    self->branch_stats = PyMem_Malloc(sizeof(branch_stats_t));
+    if (self->branch_stats == NULL) {
+        PyErr_NoMemory();
+        goto out;
+    }
+    err = branch_stats_alloc(self->branch_stats, (uint32_t) self->sim->num_samples,
+            recomb_map_get_sequence_length(&self->sim->recomb_map));
+    if (err != 0) {
+        handle_input_error("branch statistics", err);
+        goto out;
+    }
+    err = msp_set_branch_stats(self->sim, self->branch_stats);
+    if (err != 0) {
+        handle_input_error("branch statistics", err);
+        goto out;
+    }
+    ret = 0;
+out:
+    return ret;
+}
+
 static int
 Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
 {
@@ -3380,7 +3876,7 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
         "demographic_events", "model", "avl_node_block_size", "segment_block_size",
         "node_mapping_block_size", "store_migrations", "start_time",
         "store_full_arg", "num_labels", "gene_conversion_rate",
-        "gene_conversion_track_length", NULL};
+        "gene_conversion_track_length", "branch_statistics", NULL};
     PyObject *py_samples = NULL;
     PyObject *migration_matrix = NULL;
     PyObject *population_configuration = NULL;
@@ -3400,14 +3896,17 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
     Py_ssize_t num_populations = 1;
     int store_migrations = 0;
     int store_full_arg = 0;
+    int branch_statistics = 0;
     double start_time = -1;
     double gene_conversion_rate = 0;
     double gene_conversion_track_length = 1.0;
 
     self->sim = NULL;
+    self->branch_stats = NULL;
     self->random_generator = NULL;
     self->recombination_map = NULL;
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!O!O!|O!OOO!O!nnnidindd", kwlist,
+    self->source = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!O!O!|O!OOO!O!nnnidinddi", kwlist,
             &PyList_Type, &py_samples,
             &RecombinationMapType, &recombination_map,
             &RandomGeneratorType, &random_generator,
@@ -3421,7 +3920,8 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
             &avl_node_block_size, &segment_block_size,
             &node_mapping_block_size, &store_migrations, &start_time,
             &store_full_arg, &num_labels,
-            &gene_conversion_rate, &gene_conversion_track_length)) {
+            &gene_conversion_rate, &gene_conversion_track_length,
+            &branch_statistics)) {
         goto out;
     }
     self->random_generator = random_generator;
@@ -3430,6 +3930,9 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
     Py_INCREF(self->random_generator);
     Py_INCREF(self->recombination_map);
     Py_INCREF(self->tables);
+    if (alloc_lock(&self->lock) != 0) {
+        goto out;
+    }
 
     if (RandomGenerator_check_state(self->random_generator) != 0) {
         goto out;
@@ -3547,6 +4050,11 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
         }
     }
     msp_set_store_full_arg(self->sim, store_full_arg);
+    if (branch_statistics) {
+        if (Simulator_alloc_branch_stats(self) != 0) {
+            goto out;
+        }
+    }
 
     sim_ret = msp_initialise(self->sim);
     if (sim_ret != 0) {
@@ -4063,6 +4571,33 @@ out:
     return ret;
 }
 
+static PyObject *
+Simulator_get_branch_statistics(Simulator *self, void *closure)
+{
+    PyObject *ret = NULL;
+    PyObject *arr = NULL;
+    npy_intp size;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    if (self->branch_stats == NULL) {
+        ret = Py_BuildValue("");
+        goto out;
+    }
+    size = (npy_intp) branch_stats_get_summary_size(self->branch_stats);
+    arr = PyArray_SimpleNew(1, &size, NPY_FLOAT64);
+    if (arr == NULL) {
+        goto out;
+    }
+    branch_stats_get_summary(self->branch_stats, PyArray_DATA((PyArrayObject *) arr));
+    ret = arr;
+    arr = NULL;
+out:
+    Py_XDECREF(arr);
+    return ret;
+}
+
 static PyObject *
 Simulator_get_migration_matrix(Simulator *self, void *closure)
 {
@@ -4186,6 +4721,21 @@ Simulator_get_tables(Simulator *self, void *closure)
     return Py_BuildValue("O", self->tables);
 }
 
+/* Polled by msp_run while the GIL is released, so that the simulation
+ * stops promptly on CTRL-C; the pending exception is raised when we return.
+ * Only installed on the main thread, as signal handlers do not run on other
+ * threads and taking the GIL there would serialise the workers. */
+static int
+Simulator_check_interrupt(msp_t *MSP_UNUSED(sim), void *MSP_UNUSED(arg))
+{
+    int ret;
+    PyGILState_STATE gil_state = PyGILState_Ensure();
+
+    ret = PyErr_CheckSignals();
+    PyGILState_Release(gil_state);
+    return ret;
+}
+
 static PyObject *
 Simulator_run(Simulator *self, PyObject *args, PyObject *kwds)
 {
@@ -4211,13 +4761,23 @@ Simulator_run(Simulator *self, PyObject *args, PyObject *kwds)
         goto out;
     }
 
+    Simulator_acquire_locks(self);
+    if (PyThread_get_thread_ident() == main_thread_ident) {
+        msp_set_interrupt_handler(self->sim, Simulator_check_interrupt, NULL);
+    }
     Py_BEGIN_ALLOW_THREADS
     status = msp_run(self->sim, end_time, max_events);
     Py_END_ALLOW_THREADS
+    msp_set_interrupt_handler(self->sim, NULL, NULL);
+    Simulator_release_locks(self);
     if (status < 0) {
         handle_library_error(status);
         goto out;
     }
+    if (status == MSP_EXIT_INTERRUPTED) {
+        /* The exception raised by the signal handler is pending */
+        goto out;
+    }
     ret = Py_BuildValue("i", status);
 out:
     return ret;
@@ -4229,8 +4789,15 @@ Simulator_finalise_tables(Simulator *self)
     PyObject *ret = NULL;
     int status;
 
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
     /* finalise the tables so that any uncoalesced segments are recorded */
+    Simulator_acquire_locks(self);
+    Py_BEGIN_ALLOW_THREADS
     status = msp_finalise_tables(self->sim);
+    Py_END_ALLOW_THREADS
+    Simulator_release_locks(self);
     if (status != 0) {
         handle_library_error(status);
         goto out;
@@ -4249,7 +4816,11 @@ Simulator_reset(Simulator *self)
     if (Simulator_check_sim(self) != 0) {
         goto out;
     }
+    Simulator_acquire_locks(self);
+    Py_BEGIN_ALLOW_THREADS
     status = msp_reset(self->sim);
+    Py_END_ALLOW_THREADS
+    Simulator_release_locks(self);
     if (status < 0) {
         handle_library_error(status);
         goto out;
@@ -4413,6 +4984,9 @@ static PyGetSetDef Simulator_getsetters[] = {
     {"avl_node_block_size",
             (getter) Simulator_get_avl_node_block_size, NULL,
             "The avl_node block size" },
+    {"branch_statistics",
+            (getter) Simulator_get_branch_statistics, NULL,
+            "The branch statistics summary, or None if they are not accumulated" },
     {"breakpoints",
             (getter) Simulator_get_breakpoints, NULL,
             "The recombination breakpoints in physical coordinates" },
@@ -4538,6 +5112,9 @@ msprime_log_likelihood_arg(PyObject *self, PyObject *args, PyObject *kwds)
             &LightweightTableCollectionType, &tables, &Ne, &recombination_rate)) {
         goto out;
     }
+    if (LightweightTableCollection_check_state(tables) != 0) {
+        goto out;
+    }
 
     if (recombination_rate < 0) {
         PyErr_SetString(PyExc_ValueError, "recombination_rate must be >= 0");
@@ -4546,13 +5123,19 @@ msprime_log_likelihood_arg(PyObject *self, PyObject *args, PyObject *kwds)
 
     /* Note: this will be inefficient here if we're building indexes for large
      * tables. */
+    acquire_lock(tables->lock);
+    Py_BEGIN_ALLOW_THREADS
     err = tsk_treeseq_init(&ts, tables->tables, TSK_BUILD_INDEXES);
+    Py_END_ALLOW_THREADS
+    release_lock(tables->lock);
     if (err != 0) {
         handle_tskit_library_error(err);
         goto out;
     }
 
+    Py_BEGIN_ALLOW_THREADS
     err = msp_log_likelihood_arg(&ts, recombination_rate, Ne, &ret_likelihood);
+    Py_END_ALLOW_THREADS
     if (err != 0) {
         handle_library_error(err);
         goto out;
@@ -4563,6 +5146,360 @@ out:
     return ret;
 }
 
+static PyObject *
+msprime_clone_simulator(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    static char *kwlist[] = {"simulator", "random_generator", "tables", NULL};
+    Simulator *source = NULL;
+    RandomGenerator *random_generator = NULL;
+    LightweightTableCollection *tables = NULL;
+    Simulator *clone = NULL;
+    int err;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!O!", kwlist,
+            &SimulatorType, &source,
+            &RandomGeneratorType, &random_generator,
+            &LightweightTableCollectionType, &tables)) {
+        goto out;
+    }
+    if (Simulator_check_sim(source) != 0
+            || RandomGenerator_check_state(random_generator) != 0
+            || LightweightTableCollection_check_state(tables) != 0) {
+        goto out;
+    }
+    if (tables == source->tables || random_generator == source->random_generator) {
+        PyErr_SetString(PyExc_ValueError,
+            "A clone must not share tables or a random generator with its source");
+        goto out;
+    }
+    clone = (Simulator *) SimulatorType.tp_alloc(&SimulatorType, 0);
+    if (clone == NULL) {
+        goto out;
+    }
+    clone->random_generator = random_generator;
+    clone->recombination_map = source->recombination_map;
+    clone->tables = tables;
+    clone->source = (PyObject *) source;
+    Py_INCREF(clone->random_generator);
+    Py_INCREF(clone->recombination_map);
+    Py_INCREF(clone->tables);
+    Py_INCREF(clone->source);
+    if (alloc_lock(&clone->lock) != 0) {
+        goto out;
+    }
+    clone->sim = PyMem_Malloc(sizeof(msp_t));
+    if (clone->sim == NULL) {
+        PyErr_NoMemory();
+        goto out;
+    }
+    acquire_lock(source->lock);
+    acquire_lock(tables->lock);
+    err = msp_clone(clone->sim, source->sim, tables->tables, random_generator->rng);
+    release_lock(tables->lock);
+    release_lock(source->lock);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    /* Each clone accumulates its own statistics */
+    if (source->branch_stats != NULL) {
+        if (Simulator_alloc_branch_stats(clone) != 0) {
+            goto out;
+        }
+    }
+    ret = (PyObject *) clone;
+    clone = NULL;
+out:
+    Py_XDECREF(clone);
+    return ret;
+}
+
+typedef struct {
+    tsk_table_collection_t **tables;
+    double *summaries;
+    size_t summary_size;
+    size_t start;
+    const msp_replicate_template_t *template;
+} replicate_results_t;
+
+/* Stamps and keeps the tables for each replicate, or copies its summary
+ * statistics into the results matrix; called without the GIL. */
+static int
+collect_replicate(size_t replicate, tsk_table_collection_t *tables,
+        const double *summary, void *arg)
+{
+    int ret = 0;
+    replicate_results_t *results = (replicate_results_t *) arg;
+    tsk_table_collection_t *dest = NULL;
+
+    if (tables == NULL) {
+        memcpy(results->summaries + (replicate - results->start) * results->summary_size,
+            summary, results->summary_size * sizeof(*summary));
+        goto out;
+    }
+    ret = msp_stamp_replicate_tables(tables, results->template, replicate);
+    if (ret != 0) {
+        goto out;
+    }
+    dest = PyMem_RawMalloc(sizeof(*dest));
+    if (dest == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    *dest = *tables;
+    memset(tables, 0, sizeof(*tables));
+    results->tables[replicate - results->start] = dest;
+out:
+    return ret;
+}
+
+static PyObject *
+msprime_run_replicates(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    PyObject *py_sims = NULL;
+    PyObject *list = NULL;
+    PyObject *dict = NULL;
+    PyArrayObject *summaries = NULL;
+    npy_intp dims[2];
+    static char *kwlist[] = {"simulators", "start", "num_replicates", "random_seed",
+        "end_time", "provenance_record", "provenance_timestamp",
+        "population_metadata", NULL};
+    PyObject *provenance_record = Py_None;
+    PyObject *provenance_timestamp = Py_None;
+    PyObject *population_metadata = Py_None;
+    replicate_template_t template;
+    Simulator **sims = NULL;
+    msp_t **msps = NULL;
+    PyThread_type_lock *locks = NULL;
+    tsk_table_collection_t **tables = NULL;
+    replicate_results_t results;
+    Py_ssize_t num_sims = 0;
+    Py_ssize_t num_replicates, start;
+    unsigned long seed;
+    double end_time = DBL_MAX;
+    Py_ssize_t j, k;
+    bool locked = false;
+    int err;
+
+    memset(&template, 0, sizeof(template));
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!nnk|dOOO", kwlist,
+            &PyList_Type, &py_sims, &start, &num_replicates, &seed, &end_time,
+            &provenance_record, &provenance_timestamp, &population_metadata)) {
+        goto out;
+    }
+    if (replicate_template_init(&template, provenance_record, provenance_timestamp,
+            population_metadata) != 0) {
+        goto out;
+    }
+    num_sims = PyList_Size(py_sims);
+    if (num_sims < 1) {
+        PyErr_SetString(PyExc_ValueError, "Must specify at least one simulator");
+        goto out;
+    }
+    if (start < 0 || num_replicates < 0) {
+        PyErr_SetString(PyExc_ValueError, "Replicate indexes must be >= 0");
+        goto out;
+    }
+    if (end_time < 0) {
+        PyErr_SetString(PyExc_ValueError, "end_time must be > 0");
+        goto out;
+    }
+    sims = PyMem_Malloc(num_sims * sizeof(*sims));
+    msps = PyMem_Malloc(num_sims * sizeof(*msps));
+    locks = PyMem_Malloc(3 * num_sims * sizeof(*locks));
+    tables = PyMem_Calloc(GSL_MAX(num_replicates, 1), sizeof(*tables));
+    if (sims == NULL || msps == NULL || locks == NULL || tables == NULL) {
+        PyErr_NoMemory();
+        goto out;
+    }
+    for (j = 0; j < num_sims; j++) {
+        sims[j] = (Simulator *) PyList_GetItem(py_sims, j);
+        if (!PyObject_TypeCheck(sims[j], &SimulatorType)) {
+            PyErr_SetString(PyExc_TypeError, "Must be a list of Simulators");
+            goto out;
+        }
+        if (Simulator_check_sim(sims[j]) != 0) {
+            goto out;
+        }
+        for (k = 0; k < j; k++) {
+            if (sims[j] == sims[k] || sims[j]->tables == sims[k]->tables
+                    || sims[j]->random_generator == sims[k]->random_generator) {
+                PyErr_SetString(PyExc_ValueError,
+                    "Simulators must not share tables or random generators");
+                goto out;
+            }
+        }
+        msps[j] = sims[j]->sim;
+        locks[j] = sims[j]->lock;
+        locks[num_sims + j] = sims[j]->tables->lock;
+        locks[2 * num_sims + j] = sims[j]->random_generator->lock;
+    }
+    /* Take the locks in the usual order: all simulators, then all tables,
+     * then all random generators. Within each level they are taken in
+     * order of address, as another call may list the same objects in a
+     * different order. */
+    acquire_locks(locks, (size_t) num_sims);
+    acquire_locks(locks + num_sims, (size_t) num_sims);
+    acquire_locks(locks + 2 * num_sims, (size_t) num_sims);
+    locked = true;
+    memset(&results, 0, sizeof(results));
+    results.tables = tables;
+    results.start = (size_t) start;
+    results.template = &template.template;
+    if (sims[0]->branch_stats != NULL) {
+        results.summary_size = branch_stats_get_summary_size(sims[0]->branch_stats);
+        dims[0] = num_replicates;
+        dims[1] = (npy_intp) results.summary_size;
+        summaries = (PyArrayObject *) PyArray_SimpleNew(2, dims, NPY_FLOAT64);
+        if (summaries == NULL) {
+            goto out;
+        }
+        results.summaries = PyArray_DATA(summaries);
+    }
+    Py_BEGIN_ALLOW_THREADS
+    err = msp_run_replicates(msps, (size_t) num_sims, (size_t) start,
+            (size_t) num_replicates, seed, end_time, collect_replicate, &results);
+    Py_END_ALLOW_THREADS
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    if (summaries != NULL) {
+        ret = (PyObject *) summaries;
+        summaries = NULL;
+        goto out;
+    }
+
+    list = PyList_New(num_replicates);
+    if (list == NULL) {
+        goto out;
+    }
+    for (j = 0; j < num_replicates; j++) {
+        dict = adopt_tables_dict(tables[j]);
+        tables[j] = NULL;
+        if (dict == NULL) {
+            goto out;
+        }
+        PyList_SET_ITEM(list, j, dict);
+    }
+    ret = list;
+    list = NULL;
+out:
+    if (locked) {
+        for (j = 3 * num_sims; j > 0; j--) {
+            release_lock(locks[j - 1]);
+        }
+    }
+    if (tables != NULL) {
+        for (j = 0; j < num_replicates; j++) {
+            if (tables[j] != NULL) {
+                tsk_table_collection_free(tables[j]);
+                PyMem_RawFree(tables[j]);
+            }
+        }
+    }
+    PyMem_Free(sims);
+    PyMem_Free(msps);
+    PyMem_Free(locks);
+    PyMem_Free(tables);
+    replicate_template_free(&template);
+    Py_XDECREF(list);
+    Py_XDECREF(summaries);
+    return ret;
+}
+
+static PyObject *
+msprime_write_ms_replicate(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    PyObject *fileobj = NULL;
+    PyObject *py_breakpoints = Py_None;
+    PyArrayObject *breakpoints_array = NULL;
+    LightweightTableCollection *tables = NULL;
+    static char *kwlist[] = {"output", "tables", "precision", "breakpoints",
+        "trees", "segsites", NULL};
+    const double *breakpoints = NULL;
+    size_t num_breakpoints = 0;
+    int precision;
+    int trees = 0;
+    int segsites = 0;
+    tsk_flags_t options = 0;
+    FILE *file = NULL;
+    int err;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO!i|Oii", kwlist,
+            &fileobj, &LightweightTableCollectionType, &tables, &precision,
+            &py_breakpoints, &trees, &segsites)) {
+        goto out;
+    }
+    if (LightweightTableCollection_check_state(tables) != 0) {
+        goto out;
+    }
+    if (precision < 0) {
+        PyErr_SetString(PyExc_ValueError, "precision must be >= 0");
+        goto out;
+    }
+    if (py_breakpoints != Py_None) {
+        breakpoints_array = (PyArrayObject *) PyArray_FROMANY(py_breakpoints,
+                NPY_FLOAT64, 1, 1, NPY_ARRAY_IN_ARRAY);
+        if (breakpoints_array == NULL) {
+            goto out;
+        }
+        breakpoints = PyArray_DATA(breakpoints_array);
+        num_breakpoints = (size_t) PyArray_DIMS(breakpoints_array)[0];
+    }
+    if (trees) {
+        options |= MSP_MS_OUTPUT_TREES;
+    }
+    if (segsites) {
+        options |= MSP_MS_OUTPUT_SEGSITES;
+    }
+    file = make_file(fileobj, "w");
+    if (file == NULL) {
+        goto out;
+    }
+    /* ms output for large samples is big, so write it in large blocks */
+    if (setvbuf(file, NULL, _IOFBF, 1 << 16) != 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        goto out;
+    }
+    acquire_lock(tables->lock);
+    Py_BEGIN_ALLOW_THREADS
+    err = msp_write_ms_replicate(tables->tables, file, breakpoints, num_breakpoints,
+            precision, options);
+    Py_END_ALLOW_THREADS
+    release_lock(tables->lock);
+    if (fclose(file) != 0 && err == 0) {
+        err = MSP_ERR_IO;
+    }
+    file = NULL;
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    ret = Py_BuildValue("");
+out:
+    if (file != NULL) {
+        (void) fclose(file);
+    }
+    Py_XDECREF(breakpoints_array);
+    return ret;
+}
+
+static PyObject *
+msprime_derive_seed(PyObject *self, PyObject *args)
+{
+    unsigned long seed;
+    unsigned long long stream;
+
+    if (!PyArg_ParseTuple(args, "kK", &seed, &stream)) {
+        return NULL;
+    }
+    return Py_BuildValue("k", msp_derive_seed(seed, (uint64_t) stream));
+}
+
 static PyObject *
 msprime_get_gsl_version(PyObject *self)
 {
@@ -4589,6 +5526,20 @@ static PyMethodDef msprime_methods[] = {
     {"log_likelihood_arg", (PyCFunction) msprime_log_likelihood_arg,
             METH_VARARGS|METH_KEYWORDS,
             "Computes the log-likelihood of an ARG." },
+    {"clone_simulator", (PyCFunction) msprime_clone_simulator,
+            METH_VARARGS|METH_KEYWORDS,
+            "Returns a copy of the specified initialised simulator that uses the "
+            "specified random generator and tables." },
+    {"run_replicates", (PyCFunction) msprime_run_replicates,
+            METH_VARARGS|METH_KEYWORDS,
+            "Runs the specified range of replicates on the simulators, in parallel, "
+            "and returns the table dictionaries in replicate order, or a matrix of "
+            "summary statistics if the simulators accumulate branch statistics." },
+    {"write_ms_replicate", (PyCFunction) msprime_write_ms_replicate,
+            METH_VARARGS|METH_KEYWORDS,
+            "Writes the replicate in the tables to the output in ms format." },
+    {"derive_seed", (PyCFunction) msprime_derive_seed, METH_VARARGS,
+            "Returns the seed derived from a seed for the specified stream." },
     {"get_gsl_version", (PyCFunction) msprime_get_gsl_version, METH_NOARGS,
             "Returns the version of GSL we are linking against." },
     {"restore_gsl_error_handler", (PyCFunction) msprime_restore_gsl_error_handler,
@@ -4615,6 +5566,7 @@ PyInit__msprime(void)
         return NULL;
     }
     import_array();
+    main_thread_ident = PyThread_get_thread_ident();
 
     /* LightweightTableCollection type */
     if (PyType_Ready(&LightweightTableCollectionType) < 0) {
@@ -4710,6 +5662,15 @@ PyInit__msprime(void)
     PyModule_AddIntConstant(module, "EXIT_COALESCENCE", MSP_EXIT_COALESCENCE);
     PyModule_AddIntConstant(module, "EXIT_MAX_EVENTS", MSP_EXIT_MAX_EVENTS);
     PyModule_AddIntConstant(module, "EXIT_MAX_TIME", MSP_EXIT_MAX_TIME);
+    PyModule_AddIntConstant(module, "EXIT_INTERRUPTED", MSP_EXIT_INTERRUPTED);
+    PyModule_AddStringConstant(
+        module, "REPLICATE_INDEX_PLACEHOLDER", MSP_REPLICATE_INDEX_PLACEHOLDER);
+
+    PyModule_AddIntConstant(module, "BRANCH_STATS_SEGREGATING_SITES",
+        MSP_BRANCH_STATS_SEGREGATING_SITES);
+    PyModule_AddIntConstant(module, "BRANCH_STATS_DIVERSITY", MSP_BRANCH_STATS_DIVERSITY);
+    PyModule_AddIntConstant(module, "BRANCH_STATS_TMRCA", MSP_BRANCH_STATS_TMRCA);
+    PyModule_AddIntConstant(module, "BRANCH_STATS_AFS", MSP_BRANCH_STATS_AFS);
 
     /* The function unset_gsl_error_handler should be called at import time,
      * ensuring we capture the value of the handler. However, just in case
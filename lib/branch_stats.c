@@ -0,0 +1,418 @@
+/*
+** Copyright (C) 2020 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Branch length statistics computed directly from the edges of a simulation
+ * as they are recorded, so that replicates that only need summary statistics
+ * never have to build a tree sequence.
+ *
+ * For each node we keep the number of samples below it over each interval
+ * of the genome that it is ancestral to. When the edges for a parent are
+ * added, the intervals of each child that they cover give the number of
+ * samples subtended by the branch, and are combined to give the intervals
+ * of the parent. Intervals in which all samples have coalesced record the
+ * TMRCA and are dropped. Child intervals are removed as they are inherited,
+ * so that we only hold the ancestry of the current lineages.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <gsl/gsl_minmax.h>
+
+#include "msprime.h"
+
+static int
+cmp_branch_stats_event(const void *a, const void *b)
+{
+    const branch_stats_event_t *ia = (const branch_stats_event_t *) a;
+    const branch_stats_event_t *ib = (const branch_stats_event_t *) b;
+    return (ia->position > ib->position) - (ia->position < ib->position);
+}
+
+void
+branch_stats_print_state(branch_stats_t *self, FILE *out)
+{
+    size_t j, k;
+    branch_stats_ancestry_t *ancestry;
+
+    fprintf(out, "Branch stats state\n");
+    fprintf(out, "num_samples = %d\n", (int) self->num_samples);
+    fprintf(out, "sequence_length = %f\n", self->sequence_length);
+    fprintf(out, "total_branch_length = %f\n", self->total_branch_length);
+    fprintf(out, "pairwise_branch_length = %f\n", self->pairwise_branch_length);
+    fprintf(out, "root_time = %f\n", self->root_time);
+    fprintf(out, "afs =");
+    for (j = 0; j <= self->num_samples; j++) {
+        fprintf(out, " %f", self->afs[j]);
+    }
+    fprintf(out, "\nancestry:\n");
+    for (j = 0; j < self->max_nodes; j++) {
+        ancestry = &self->ancestry[j];
+        if (ancestry->num_intervals > 0) {
+            fprintf(out, "\t%d:", (int) j);
+            for (k = 0; k < ancestry->num_intervals; k++) {
+                fprintf(out, " (%f, %f, %d)", ancestry->intervals[k].left,
+                    ancestry->intervals[k].right, (int) ancestry->intervals[k].count);
+            }
+            fprintf(out, "\n");
+        }
+    }
+}
+
+int MSP_WARN_UNUSED
+branch_stats_alloc(branch_stats_t *self, uint32_t num_samples, double sequence_length)
+{
+    int ret = 0;
+
+    memset(self, 0, sizeof(*self));
+    if (num_samples < 2 || sequence_length <= 0) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    self->num_samples = num_samples;
+    self->sequence_length = sequence_length;
+    self->afs = calloc(num_samples + 1, sizeof(*self->afs));
+    if (self->afs == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+out:
+    return ret;
+}
+
+int
+branch_stats_free(branch_stats_t *self)
+{
+    size_t j;
+
+    if (self->ancestry != NULL) {
+        for (j = 0; j < self->max_nodes; j++) {
+            msp_safe_free(self->ancestry[j].intervals);
+        }
+    }
+    msp_safe_free(self->ancestry);
+    msp_safe_free(self->afs);
+    msp_safe_free(self->events);
+    msp_safe_free(self->remainder);
+    return 0;
+}
+
+/* Clears the statistics and ancestry, keeping the memory for reuse by the
+ * next replicate. */
+void
+branch_stats_reset(branch_stats_t *self)
+{
+    size_t j;
+
+    self->total_branch_length = 0;
+    self->pairwise_branch_length = 0;
+    self->root_time = 0;
+    memset(self->afs, 0, (self->num_samples + 1) * sizeof(*self->afs));
+    for (j = 0; j < self->max_nodes; j++) {
+        self->ancestry[j].num_intervals = 0;
+    }
+}
+
+/* Ensures that the array has space for at least size items. */
+static int MSP_WARN_UNUSED
+branch_stats_expand(void **array, size_t *max_size, size_t size, size_t item_size)
+{
+    int ret = 0;
+    size_t new_size = *max_size;
+    void *p;
+
+    if (size > *max_size) {
+        while (new_size < size) {
+            new_size = new_size == 0 ? 64 : 2 * new_size;
+        }
+        p = realloc(*array, new_size * item_size);
+        if (p == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        *array = p;
+        *max_size = new_size;
+    }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+branch_stats_expand_nodes(branch_stats_t *self, size_t num_nodes)
+{
+    int ret = 0;
+    size_t old_max = self->max_nodes;
+
+    ret = branch_stats_expand((void **) &self->ancestry, &self->max_nodes, num_nodes,
+        sizeof(*self->ancestry));
+    if (ret != 0) {
+        goto out;
+    }
+    memset(self->ancestry + old_max, 0,
+        (self->max_nodes - old_max) * sizeof(*self->ancestry));
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+branch_stats_push_event(branch_stats_t *self, size_t *num_events, double left,
+    double right, uint32_t count)
+{
+    int ret = branch_stats_expand((void **) &self->events, &self->max_events,
+        *num_events + 2, sizeof(*self->events));
+
+    if (ret == 0) {
+        self->events[*num_events].position = left;
+        self->events[*num_events].delta = count;
+        self->events[*num_events + 1].position = right;
+        self->events[*num_events + 1].delta = -(int64_t) count;
+        *num_events += 2;
+    }
+    return ret;
+}
+
+/* Appends the interval to the ancestry, merging it with the last interval
+ * if they abut and have the same count. */
+static int MSP_WARN_UNUSED
+branch_stats_append_interval(
+    branch_stats_ancestry_t *ancestry, double left, double right, uint32_t count)
+{
+    int ret = 0;
+    branch_stats_interval_t *last = NULL;
+
+    if (ancestry->num_intervals > 0) {
+        last = &ancestry->intervals[ancestry->num_intervals - 1];
+    }
+    if (last != NULL && last->right == left && last->count == count) {
+        last->right = right;
+    } else {
+        ret = branch_stats_expand((void **) &ancestry->intervals,
+            &ancestry->max_intervals, ancestry->num_intervals + 1,
+            sizeof(*ancestry->intervals));
+        if (ret != 0) {
+            goto out;
+        }
+        last = &ancestry->intervals[ancestry->num_intervals];
+        last->left = left;
+        last->right = right;
+        last->count = count;
+        ancestry->num_intervals++;
+    }
+out:
+    return ret;
+}
+
+static void
+branch_stats_add_branch(branch_stats_t *self, uint32_t count, double area)
+{
+    const double n = self->num_samples;
+
+    assert(count > 0 && count < self->num_samples);
+    self->total_branch_length += area;
+    self->pairwise_branch_length += area * count * (n - count);
+    self->afs[count] += area;
+}
+
+/* Accounts for the branch above the child over [left, right), removing this
+ * part of the child's ancestry and adding it to the events for the parent. */
+static int MSP_WARN_UNUSED
+branch_stats_inherit(branch_stats_t *self, tsk_id_t child, double left, double right,
+    double branch_length, size_t *num_events)
+{
+    int ret = 0;
+    branch_stats_ancestry_t *ancestry = &self->ancestry[child];
+    branch_stats_interval_t *x;
+    branch_stats_interval_t *remainder;
+    size_t j, num_remainder;
+    double l, r;
+
+    /* Trimming intervals at the ends of the edge can split at most one
+     * interval in two */
+    ret = branch_stats_expand((void **) &self->remainder, &self->max_remainder,
+        ancestry->num_intervals + 1, sizeof(*self->remainder));
+    if (ret != 0) {
+        goto out;
+    }
+    remainder = self->remainder;
+    num_remainder = 0;
+    for (j = 0; j < ancestry->num_intervals; j++) {
+        x = &ancestry->intervals[j];
+        l = GSL_MAX(x->left, left);
+        r = GSL_MIN(x->right, right);
+        if (l < r) {
+            branch_stats_add_branch(self, x->count, branch_length * (r - l));
+            ret = branch_stats_push_event(self, num_events, l, r, x->count);
+            if (ret != 0) {
+                goto out;
+            }
+            if (x->left < l) {
+                remainder[num_remainder] = *x;
+                remainder[num_remainder].right = l;
+                num_remainder++;
+            }
+            if (r < x->right) {
+                remainder[num_remainder] = *x;
+                remainder[num_remainder].left = r;
+                num_remainder++;
+            }
+        } else {
+            remainder[num_remainder] = *x;
+            num_remainder++;
+        }
+    }
+    ret = branch_stats_expand((void **) &ancestry->intervals, &ancestry->max_intervals,
+        num_remainder, sizeof(*ancestry->intervals));
+    if (ret != 0) {
+        goto out;
+    }
+    memcpy(ancestry->intervals, remainder, num_remainder * sizeof(*remainder));
+    ancestry->num_intervals = num_remainder;
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+branch_stats_add_parent_edges(branch_stats_t *self, tsk_table_collection_t *tables,
+    const tsk_edge_t *edges, size_t num_edges)
+{
+    int ret = 0;
+    const tsk_id_t parent = edges[0].parent;
+    const double *node_time = tables->nodes.time;
+    const tsk_flags_t *node_flags = tables->nodes.flags;
+    branch_stats_ancestry_t *ancestry;
+    branch_stats_interval_t *x;
+    const tsk_edge_t *edge;
+    size_t j, k, num_events;
+    double branch_length, last_position;
+    int64_t count;
+
+    ret = branch_stats_expand_nodes(self, tables->nodes.num_rows);
+    if (ret != 0) {
+        goto out;
+    }
+    ancestry = &self->ancestry[parent];
+    num_events = 0;
+    /* The parent may already have inherited some ancestry in an earlier call */
+    for (j = 0; j < ancestry->num_intervals; j++) {
+        x = &ancestry->intervals[j];
+        ret = branch_stats_push_event(self, &num_events, x->left, x->right, x->count);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    ancestry->num_intervals = 0;
+
+    for (j = 0; j < num_edges; j++) {
+        edge = &edges[j];
+        assert(edge->parent == parent);
+        branch_length = node_time[parent] - node_time[edge->child];
+        if (node_flags[edge->child] & TSK_NODE_IS_SAMPLE) {
+            branch_stats_add_branch(
+                self, 1, branch_length * (edge->right - edge->left));
+            ret = branch_stats_push_event(
+                self, &num_events, edge->left, edge->right, 1);
+        } else {
+            ret = branch_stats_inherit(self, edge->child, edge->left, edge->right,
+                branch_length, &num_events);
+        }
+        if (ret != 0) {
+            goto out;
+        }
+    }
+
+    /* Sweep along the genome summing the counts of the children */
+    qsort(self->events, num_events, sizeof(*self->events), cmp_branch_stats_event);
+    count = 0;
+    last_position = 0;
+    for (j = 0; j < num_events; j = k) {
+        if (count > 0 && self->events[j].position > last_position) {
+            assert(count <= (int64_t) self->num_samples);
+            if (count == (int64_t) self->num_samples) {
+                self->root_time
+                    += node_time[parent] * (self->events[j].position - last_position);
+            } else {
+                ret = branch_stats_append_interval(ancestry, last_position,
+                    self->events[j].position, (uint32_t) count);
+                if (ret != 0) {
+                    goto out;
+                }
+            }
+        }
+        last_position = self->events[j].position;
+        for (k = j; k < num_events && self->events[k].position == last_position; k++) {
+            count += self->events[k].delta;
+        }
+    }
+    assert(count == 0);
+out:
+    return ret;
+}
+
+/* Adds the specified edges, which must be grouped by parent, to the
+ * statistics. The edges of a child must be added before it is used as a
+ * parent, as is the case for the edges recorded by a simulation. */
+int MSP_WARN_UNUSED
+branch_stats_add_edges(branch_stats_t *self, tsk_table_collection_t *tables,
+    const tsk_edge_t *edges, size_t num_edges)
+{
+    int ret = 0;
+    size_t j, k;
+
+    for (j = 0; j < num_edges; j = k) {
+        k = j + 1;
+        while (k < num_edges && edges[k].parent == edges[j].parent) {
+            k++;
+        }
+        ret = branch_stats_add_parent_edges(self, tables, edges + j, k - j);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+size_t
+branch_stats_get_summary_size(branch_stats_t *self)
+{
+    return MSP_BRANCH_STATS_AFS + (size_t) self->num_samples + 1;
+}
+
+/* Writes the span-normalised statistics to the summary, which must have
+ * space for branch_stats_get_summary_size values. These are the branch
+ * versions of the statistics, so that the expected number of segregating
+ * sites, for example, is the mutation rate times the sequence length times
+ * summary[MSP_BRANCH_STATS_SEGREGATING_SITES]. Parts of the genome that have
+ * not coalesced contribute nothing to the TMRCA. */
+void
+branch_stats_get_summary(branch_stats_t *self, double *summary)
+{
+    const double L = self->sequence_length;
+    const double n = self->num_samples;
+    size_t j;
+
+    summary[MSP_BRANCH_STATS_SEGREGATING_SITES] = self->total_branch_length / L;
+    summary[MSP_BRANCH_STATS_DIVERSITY]
+        = self->pairwise_branch_length / (n * (n - 1) / 2) / L;
+    summary[MSP_BRANCH_STATS_TMRCA] = self->root_time / L;
+    for (j = 0; j <= self->num_samples; j++) {
+        summary[MSP_BRANCH_STATS_AFS + j] = self->afs[j] / L;
+    }
+}
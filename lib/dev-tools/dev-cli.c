@@ -708,6 +708,13 @@ get_configuration(gsl_rng *rng, msp_t *msp, tsk_table_collection_t *tables,
     if (ret != 0) {
         fatal_msprime_error(ret, __LINE__);
     }
+    if (config_lookup_int(config, "max_merger_table_lineages", &int_tmp)
+            == CONFIG_TRUE) {
+        ret = msp_set_max_merger_table_lineages(msp, (size_t) int_tmp);
+        if (ret != 0) {
+            fatal_msprime_error(ret, __LINE__);
+        }
+    }
     if (config_lookup_int(config, "store_migrations", &int_tmp) == CONFIG_FALSE) {
         fatal_error("store_migrations is a required parameter");
     }
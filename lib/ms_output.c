@@ -0,0 +1,245 @@
+/*
+** Copyright (C) 2020 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Output of simulated replicates in the text format used by Hudson's ms.
+ * Each replicate is written as the "//" separator line, optionally
+ * followed by the trees in newick format and by the segregating sites,
+ * their positions and the haplotype matrix. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "msprime.h"
+
+/* Writes the tree rooted at root in newick format, labelling leaves
+ * with their node IDs plus one as ms does. The traversal is iterative,
+ * so that deep trees cannot overflow the call stack. */
+static void
+ms_output_write_newick(tsk_tree_t *tree, const double *time, tsk_id_t root,
+    int precision, FILE *out)
+{
+    const tsk_id_t *parent = tree->parent;
+    const tsk_id_t *left_child = tree->left_child;
+    const tsk_id_t *right_sib = tree->right_sib;
+    tsk_id_t u = root;
+    bool descend = true;
+
+    while (true) {
+        if (descend) {
+            if (left_child[u] != TSK_NULL) {
+                fputc('(', out);
+                u = left_child[u];
+                continue;
+            }
+            fprintf(out, "%d", (int) u + 1);
+        }
+        if (u == root) {
+            break;
+        }
+        fprintf(out, ":%.*f", precision, time[parent[u]] - time[u]);
+        if (right_sib[u] != TSK_NULL) {
+            fputc(',', out);
+            u = right_sib[u];
+            descend = true;
+        } else {
+            fputc(')', out);
+            u = parent[u];
+            descend = false;
+        }
+    }
+    fputs(";\n", out);
+}
+
+/* Sets the column of the haplotype matrix for the specified site, by
+ * applying its mutations in order to the samples below them. */
+static int MSP_WARN_UNUSED
+ms_output_set_site_states(tsk_tree_t *tree, const tsk_site_t *site,
+    const tsk_id_t *sample_index, size_t num_samples, tsk_id_t *stack,
+    char *haplotypes, size_t row_length)
+{
+    int ret = 0;
+    const tsk_id_t *left_child = tree->left_child;
+    const tsk_id_t *right_sib = tree->right_sib;
+    const tsk_mutation_t *mutation;
+    char *column = haplotypes + site->id;
+    size_t j, num_stack;
+    tsk_id_t u, v;
+    char state;
+
+    if (site->ancestral_state_length != 1) {
+        ret = MSP_ERR_MS_OUTPUT_ALLELE_LENGTH;
+        goto out;
+    }
+    for (j = 0; j < num_samples; j++) {
+        column[j * row_length] = site->ancestral_state[0];
+    }
+    for (j = 0; j < site->mutations_length; j++) {
+        mutation = &site->mutations[j];
+        if (mutation->derived_state_length != 1) {
+            ret = MSP_ERR_MS_OUTPUT_ALLELE_LENGTH;
+            goto out;
+        }
+        state = mutation->derived_state[0];
+        stack[0] = mutation->node;
+        num_stack = 1;
+        while (num_stack > 0) {
+            num_stack--;
+            u = stack[num_stack];
+            if (sample_index[u] != TSK_NULL) {
+                column[(size_t) sample_index[u] * row_length] = state;
+            }
+            for (v = left_child[u]; v != TSK_NULL; v = right_sib[v]) {
+                stack[num_stack] = v;
+                num_stack++;
+            }
+        }
+    }
+out:
+    return ret;
+}
+
+/* Writes the replicate in the specified tables in ms format. If
+ * MSP_MS_OUTPUT_TREES is set, the trees are written one per line. When
+ * breakpoints is not NULL, each tree is preceded by the length of the
+ * interval it covers in square brackets, and is repeated for each of the
+ * breakpoints (which must end with the sequence length) within it. This
+ * gives the output of ms for recombinations that do not change the tree.
+ * If MSP_MS_OUTPUT_SEGSITES is set, the sites, their positions relative
+ * to the sequence length and the sample haplotypes are written; all
+ * alleles must be single characters. */
+int MSP_WARN_UNUSED
+msp_write_ms_replicate(tsk_table_collection_t *tables, FILE *out,
+    const double *breakpoints, size_t num_breakpoints, int precision,
+    tsk_flags_t options)
+{
+    int ret = 0;
+    tsk_treeseq_t ts;
+    tsk_tree_t tree;
+    const size_t num_nodes = tables->nodes.num_rows;
+    const size_t num_sites = tables->sites.num_rows;
+    const size_t row_length = num_sites + 1;
+    tsk_id_t *sample_index = NULL;
+    tsk_id_t *stack = NULL;
+    char *haplotypes = NULL;
+    size_t num_samples = 0;
+    size_t j, k;
+    double left;
+
+    memset(&ts, 0, sizeof(ts));
+    memset(&tree, 0, sizeof(tree));
+    if (precision < 0) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    ret = tsk_treeseq_init(&ts, tables, TSK_BUILD_INDEXES);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    ret = tsk_tree_init(&tree, &ts, 0);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    sample_index = malloc((num_nodes + 1) * sizeof(*sample_index));
+    stack = malloc((num_nodes + 1) * sizeof(*stack));
+    if (sample_index == NULL || stack == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < num_nodes; j++) {
+        sample_index[j] = TSK_NULL;
+        if (tables->nodes.flags[j] & TSK_NODE_IS_SAMPLE) {
+            sample_index[j] = (tsk_id_t) num_samples;
+            num_samples++;
+        }
+    }
+    if (options & MSP_MS_OUTPUT_SEGSITES) {
+        haplotypes = malloc((num_samples * row_length + 1) * sizeof(*haplotypes));
+        if (haplotypes == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        for (j = 0; j < num_samples; j++) {
+            haplotypes[j * row_length + num_sites] = '\n';
+        }
+    }
+
+    fputs("\n//\n", out);
+    k = 0;
+    for (ret = tsk_tree_first(&tree); ret == 1; ret = tsk_tree_next(&tree)) {
+        if (options & MSP_MS_OUTPUT_TREES) {
+            if (tree.left_root == TSK_NULL || tree.right_sib[tree.left_root] != TSK_NULL) {
+                ret = MSP_ERR_MS_OUTPUT_MULTIPLE_ROOTS;
+                goto out;
+            }
+            if (breakpoints == NULL) {
+                ms_output_write_newick(
+                    &tree, tables->nodes.time, tree.left_root, precision, out);
+            } else {
+                left = tree.left;
+                while (k < num_breakpoints && breakpoints[k] <= tree.right) {
+                    fprintf(out, "[%d]", (int) (breakpoints[k] - left));
+                    left = breakpoints[k];
+                    k++;
+                    ms_output_write_newick(
+                        &tree, tables->nodes.time, tree.left_root, precision, out);
+                }
+            }
+        }
+        if (haplotypes != NULL) {
+            for (j = 0; j < tree.sites_length; j++) {
+                ret = ms_output_set_site_states(&tree, &tree.sites[j], sample_index,
+                    num_samples, stack, haplotypes, row_length);
+                if (ret != 0) {
+                    goto out;
+                }
+            }
+        }
+    }
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    if (options & MSP_MS_OUTPUT_SEGSITES) {
+        fprintf(out, "segsites: %d\n", (int) num_sites);
+        if (num_sites == 0) {
+            fputc('\n', out);
+        } else {
+            fputs("positions: ", out);
+            for (j = 0; j < num_sites; j++) {
+                fprintf(out, "%.*f ", precision,
+                    tables->sites.position[j] / tables->sequence_length);
+            }
+            fputc('\n', out);
+            fwrite(haplotypes, sizeof(*haplotypes), num_samples * row_length, out);
+        }
+    }
+    if (ferror(out)) {
+        ret = MSP_ERR_IO;
+        goto out;
+    }
+out:
+    tsk_tree_free(&tree);
+    tsk_treeseq_free(&ts);
+    msp_safe_free(sample_index);
+    msp_safe_free(stack);
+    msp_safe_free(haplotypes);
+    return ret;
+}
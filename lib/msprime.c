@@ -20,6 +20,7 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <limits.h>
 #include <math.h>
 
 #include <gsl/gsl_rng.h>
@@ -35,6 +36,10 @@
 #include "fenwick.h"
 #include "msprime.h"
 
+#ifdef MSP_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 /* State machine for the simulator object. */
 #define MSP_STATE_NEW 0
 #define MSP_STATE_INITIALISED 1
@@ -74,12 +79,12 @@ ran_inc_beta_its(gsl_rng *r, double a, double b, double upper_bound)
  * The rejection method is quicker for a moderate number of rejections, but if
  * the acceptance probability is low, we instead choose inverse transform
  * sampling. The acceptance probability for ran_inc_beta_rej() is equivalent to
- * the upper bound used with ran_inc_beta_its().
+ * the upper bound used with ran_inc_beta_its(), and must be supplied by the
+ * caller as ub = gsl_sf_beta_inc(a, b, x) so that it can be precomputed.
  */
 static double
-ran_inc_beta(gsl_rng *r, double a, double b, double x)
+ran_inc_beta(gsl_rng *r, double a, double b, double x, double ub)
 {
-    double ub = gsl_sf_beta_inc(a, b, x);
     if (ub < 0.1) {
         return ran_inc_beta_its(r, a, b, ub);
     } else {
@@ -139,6 +144,23 @@ cmp_sampling_event(const void *a, const void *b)
     return (ia->time > ib->time) - (ia->time < ib->time);
 }
 
+/* Edges with the same parent time are sorted by parent, child and left
+ * coordinate, as required by tskit. */
+static int
+cmp_edge(const void *a, const void *b)
+{
+    const tsk_edge_t *ia = (const tsk_edge_t *) a;
+    const tsk_edge_t *ib = (const tsk_edge_t *) b;
+    int ret = (ia->parent > ib->parent) - (ia->parent < ib->parent);
+    if (ret == 0) {
+        ret = (ia->child > ib->child) - (ia->child < ib->child);
+    }
+    if (ret == 0) {
+        ret = (ia->left > ib->left) - (ia->left < ib->left);
+    }
+    return ret;
+}
+
 static int
 cmp_pointer(const void *a, const void *b)
 {
@@ -147,6 +169,14 @@ cmp_pointer(const void *a, const void *b)
     return (ia > ib) - (ia < ib);
 }
 
+static int
+cmp_uint32(const void *a, const void *b)
+{
+    const uint32_t ia = *(const uint32_t *) a;
+    const uint32_t ib = *(const uint32_t *) b;
+    return (ia > ib) - (ia < ib);
+}
+
 static void
 segment_init(void **obj, size_t id)
 {
@@ -229,6 +259,67 @@ msp_set_store_full_arg(msp_t *self, bool store_full_arg)
     return 0;
 }
 
+/* Place mutations using the specified generator on each edge as it is
+ * recorded, instead of in a separate pass over the finished tables. The
+ * mutations are written to the tables by msp_finalise_tables. */
+int
+msp_set_mutation_generator(msp_t *self, mutgen_t *mutgen, int flags)
+{
+    int ret = 0;
+
+    if (self->state != MSP_STATE_NEW) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    self->mutgen = mutgen;
+    self->mutation_flags = flags;
+out:
+    return ret;
+}
+
+/* Statistics are accumulated into branch_stats from the edges of each
+ * replicate as they are recorded, and are reset along with the simulation.
+ * Simulations starting from existing tables are not supported, since the
+ * statistics need the ancestry of every node. */
+int
+msp_set_branch_stats(msp_t *self, branch_stats_t *branch_stats)
+{
+    int ret = 0;
+
+    if (self->state == MSP_STATE_SIMULATING) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    if (self->from_ts != NULL) {
+        ret = MSP_ERR_UNSUPPORTED_OPERATION;
+        goto out;
+    }
+    if (branch_stats != NULL
+        && (branch_stats->num_samples != self->num_samples
+               || branch_stats->sequence_length
+                      != recomb_map_get_sequence_length(&self->recomb_map))) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    self->branch_stats = branch_stats;
+    if (branch_stats != NULL) {
+        branch_stats_reset(branch_stats);
+    }
+out:
+    return ret;
+}
+
+/* Sets a handler that msp_run calls every MSP_INTERRUPT_POLL_INTERVAL
+ * events, so that long runs can be stopped without chunking them into
+ * many calls. May be changed at any time; a NULL handler disables polling. */
+int
+msp_set_interrupt_handler(msp_t *self, msp_interrupt_handler_t handler, void *handler_arg)
+{
+    self->interrupt_handler = handler;
+    self->interrupt_handler_arg = handler_arg;
+    return 0;
+}
+
 int
 msp_set_dimensions(msp_t *self, size_t num_populations, size_t num_labels)
 {
@@ -411,6 +502,35 @@ out:
     return ret;
 }
 
+static void
+msp_free_merger_tables(msp_t *self)
+{
+    size_t n;
+
+    if (self->merger_size_dist != NULL) {
+        for (n = 0; n <= self->max_merger_table_lineages; n++) {
+            if (self->merger_size_dist[n] != NULL) {
+                gsl_ran_discrete_free(self->merger_size_dist[n]);
+            }
+        }
+    }
+    msp_safe_free(self->merger_size_dist);
+    msp_safe_free(self->merger_rate);
+}
+
+/* Multiple merger event sizes are sampled directly from precomputed tables
+ * when there are at most max_lineages lineages in a population. Larger
+ * populations use rejection sampling. Setting max_lineages to zero disables
+ * the tables.
+ */
+int
+msp_set_max_merger_table_lineages(msp_t *self, size_t max_lineages)
+{
+    msp_free_merger_tables(self);
+    self->max_merger_table_lineages = max_lineages;
+    return 0;
+}
+
 int
 msp_set_avl_node_block_size(msp_t *self, size_t block_size)
 {
@@ -621,10 +741,22 @@ msp_free(msp_t *self)
     demographic_event_t *de = self->demographic_events_head;
     demographic_event_t *tmp;
 
-    while (de != NULL) {
-        tmp = de->next;
-        free(de);
-        de = tmp;
+    if (self->source == NULL) {
+        while (de != NULL) {
+            tmp = de->next;
+            free(de);
+            de = tmp;
+        }
+        msp_safe_free(self->samples);
+        msp_safe_free(self->sampling_events);
+        recomb_map_free(&self->recomb_map);
+        if (self->from_ts != NULL) {
+            tsk_treeseq_free(self->from_ts);
+            free(self->from_ts);
+        }
+        msp_safe_free(self->initial_segments);
+        msp_safe_free(self->initial_chain_heads);
+        msp_safe_free(self->initial_overlaps);
     }
     for (j = 0; j < self->num_labels; j++) {
         if (self->links != NULL) {
@@ -645,17 +777,13 @@ msp_free(msp_t *self)
     msp_safe_free(self->num_migration_events);
     msp_safe_free(self->initial_populations);
     msp_safe_free(self->populations);
-    msp_safe_free(self->samples);
-    msp_safe_free(self->sampling_events);
     msp_safe_free(self->buffered_edges);
+    msp_safe_free(self->scratch);
+    msp_safe_free(self->merge_queue);
+    msp_free_merger_tables(self);
     /* free the object heaps */
     object_heap_free(&self->avl_node_heap);
     object_heap_free(&self->node_mapping_heap);
-    recomb_map_free(&self->recomb_map);
-    if (self->from_ts != NULL) {
-        tsk_treeseq_free(self->from_ts);
-        free(self->from_ts);
-    }
     if (self->model.free != NULL) {
         self->model.free(&self->model);
     }
@@ -666,6 +794,26 @@ msp_free(msp_t *self)
     return ret;
 }
 
+/* Returns a scratch buffer of at least the specified number of bytes. The
+ * buffer is owned by the simulator and reused, so its contents are only
+ * valid until the next call. */
+static void *MSP_WARN_UNUSED
+msp_get_scratch(msp_t *self, size_t size)
+{
+    void *p;
+
+    if (size > self->scratch_size) {
+        size = GSL_MAX(size, 2 * self->scratch_size);
+        p = realloc(self->scratch, size);
+        if (p == NULL) {
+            return NULL;
+        }
+        self->scratch = p;
+        self->scratch_size = size;
+    }
+    return self->scratch;
+}
+
 static inline avl_node_t *MSP_WARN_UNUSED
 msp_alloc_avl_node(msp_t *self)
 {
@@ -1308,6 +1456,19 @@ msp_flush_edges(msp_t *self)
                 ret = msp_set_tsk_error(ret);
                 goto out;
             }
+            if (self->mutgen != NULL) {
+                ret = mutgen_stream_edge(self->mutgen, self->tables, (tsk_id_t) ret);
+                if (ret != 0) {
+                    goto out;
+                }
+            }
+        }
+        if (self->branch_stats != NULL) {
+            ret = branch_stats_add_edges(
+                self->branch_stats, self->tables, self->buffered_edges, num_edges);
+            if (ret != 0) {
+                goto out;
+            }
         }
         self->num_buffered_edges = 0;
     }
@@ -1406,18 +1567,16 @@ out:
     return ret;
 }
 
+/* Moves the specified segment chain, which must not be in any population's
+ * ancestors, into the specified population and label. */
 static int MSP_WARN_UNUSED
-msp_move_individual(msp_t *self, avl_node_t *node, avl_tree_t *source,
-    population_id_t dest_pop, label_id_t dest_label)
+msp_move_segment_chain(
+    msp_t *self, segment_t *ind, population_id_t dest_pop, label_id_t dest_label)
 {
     int ret = 0;
-    segment_t *ind, *x, *y, *new_ind;
+    segment_t *x, *y, *new_ind;
     double recomb_mass;
 
-    ind = (segment_t *) node->item;
-    avl_unlink_node(source, node);
-    msp_free_avl_node(self, node);
-
     if (self->store_full_arg) {
         ret = msp_store_node(
             self, MSP_NODE_IS_MIG_EVENT, self->time, dest_pop, TSK_NULL);
@@ -1465,6 +1624,17 @@ out:
     return ret;
 }
 
+static int MSP_WARN_UNUSED
+msp_move_individual(msp_t *self, avl_node_t *node, avl_tree_t *source,
+    population_id_t dest_pop, label_id_t dest_label)
+{
+    segment_t *ind = (segment_t *) node->item;
+
+    avl_unlink_node(source, node);
+    msp_free_avl_node(self, node);
+    return msp_move_segment_chain(self, ind, dest_pop, dest_label);
+}
+
 /*
  * Inserts a population ID into the set of non-empty populations.
  */
@@ -1643,16 +1813,25 @@ msp_set_segment_mass(msp_t *self, segment_t *seg, segment_t *tail_seg)
  * chain to the mass spanned by the segment, exlusive of its
  * endpoints.
  */
-static void
-msp_set_single_segment_mass(msp_t *self, segment_t *seg)
+static double
+msp_get_single_segment_mass(
+    msp_t *self, double left, double right, double left_mass, double right_mass)
 {
     double mass;
     if (recomb_map_get_discrete(&self->recomb_map)) {
         /* Exclude the left endpoint because breakpoints can't happen there */
-        mass = recomb_map_mass_between(&self->recomb_map, seg->left + 1, seg->right);
+        mass = recomb_map_mass_between(&self->recomb_map, left + 1, right);
     } else {
-        mass = seg->right_mass - seg->left_mass;
+        mass = right_mass - left_mass;
     }
+    return mass;
+}
+
+static void
+msp_set_single_segment_mass(msp_t *self, segment_t *seg)
+{
+    double mass = msp_get_single_segment_mass(
+        self, seg->left, seg->right, seg->left_mass, seg->right_mass);
 
     fenwick_set_value(&self->links[seg->label], seg->id, mass);
 }
@@ -2861,10 +3040,68 @@ msp_priority_queue_pop(msp_t *self, avl_tree_t *Q)
     return seg;
 }
 
+/* Binary min-heap of segments ordered by cmp_segment_queue. This is used
+ * as the priority queue for the k-way merge in msp_merge_ancestors, where
+ * each segment chain has at most one segment in the queue at any time.
+ */
+static inline bool
+segment_queue_less(const segment_t *a, const segment_t *b)
+{
+    return a->left < b->left || (a->left == b->left && a->id < b->id);
+}
+
+static void
+segment_queue_push(segment_t **queue, size_t *size, segment_t *seg)
+{
+    size_t j = *size;
+    size_t parent;
+
+    while (j > 0) {
+        parent = (j - 1) / 2;
+        if (!segment_queue_less(seg, queue[parent])) {
+            break;
+        }
+        queue[j] = queue[parent];
+        j = parent;
+    }
+    queue[j] = seg;
+    (*size)++;
+}
+
+static segment_t *
+segment_queue_pop(segment_t **queue, size_t *size)
+{
+    segment_t *ret = queue[0];
+    segment_t *last;
+    size_t j, child;
+    size_t n = *size - 1;
+
+    last = queue[n];
+    j = 0;
+    while (true) {
+        child = 2 * j + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && segment_queue_less(queue[child + 1], queue[child])) {
+            child++;
+        }
+        if (!segment_queue_less(queue[child], last)) {
+            break;
+        }
+        queue[j] = queue[child];
+        j = child;
+    }
+    queue[j] = last;
+    *size = n;
+    return ret;
+}
+
 /* Merge the specified set of ancestors into a single ancestor. This is a
  * generalisation of the msp_common_ancestor_event method where we allow
  * any number of ancestors to merge. The AVL tree is a priority queue in
- * sorted by left coordinate.
+ * sorted by left coordinate. The AVL tree is emptied on entry, and the
+ * merge then proceeds using a flat binary heap of segments.
  */
 static int MSP_WARN_UNUSED
 msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
@@ -2877,42 +3114,61 @@ msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
     node_id_t v;
     uint32_t j, h;
     double l, r, r_max, next_l, next_l_mass, l_min;
-    avl_node_t *node;
+    avl_node_t *node, *next;
     node_mapping_t *nm, search;
-    segment_t *x, *z, *alpha;
-    segment_t **H = NULL;
-
-    H = malloc(avl_count(Q) * sizeof(segment_t *));
-    if (H == NULL) {
-        ret = MSP_ERR_NO_MEMORY;
-        goto out;
+    segment_t *x, *z, *alpha, *head;
+    segment_t **H;
+    segment_t **queue;
+    size_t queue_size = 0;
+    size_t max_size;
+    size_t num_chains = avl_count(Q);
+
+    /* H and the queue are each bounded by the number of chains. */
+    if (self->merge_queue == NULL || 2 * num_chains > self->max_merge_queue_size) {
+        max_size = GSL_MAX(2 * num_chains, 2 * self->max_merge_queue_size);
+        max_size = GSL_MAX(max_size, 64);
+        H = realloc(self->merge_queue, max_size * sizeof(segment_t *));
+        if (H == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->merge_queue = H;
+        self->max_merge_queue_size = max_size;
+    }
+    H = self->merge_queue;
+    queue = H + num_chains;
+    /* The AVL tree is already in sorted order, so it is a valid heap */
+    for (node = Q->head; node != NULL; node = next) {
+        next = node->next;
+        queue[queue_size] = (segment_t *) node->item;
+        queue_size++;
+        avl_unlink_node(Q, node);
+        msp_free_avl_node(self, node);
     }
     r_max = 0; /* keep compiler happy */
     l_min = 0;
     z = NULL;
-    while (avl_count(Q) > 0) {
+    while (queue_size > 0) {
         h = 0;
-        node = Q->head;
-        l = ((segment_t *) node->item)->left;
+        l = queue[0]->left;
         r_max = self->sequence_length;
-        while (node != NULL && ((segment_t *) node->item)->left == l) {
-            H[h] = (segment_t *) node->item;
+        while (queue_size > 0 && queue[0]->left == l) {
+            H[h] = segment_queue_pop(queue, &queue_size);
             r_max = GSL_MIN(r_max, H[h]->right);
             h++;
-            msp_free_avl_node(self, node);
-            avl_unlink_node(Q, node);
-            node = node->next;
         }
+        head = NULL;
         next_l = 0;
-        if (node != NULL) {
-            next_l = ((segment_t *) node->item)->left;
-            next_l_mass = ((segment_t *) node->item)->left_mass;
+        if (queue_size > 0) {
+            head = queue[0];
+            next_l = head->left;
+            next_l_mass = head->left_mass;
             r_max = GSL_MIN(r_max, next_l);
         }
         alpha = NULL;
         if (h == 1) {
             x = H[0];
-            if (node != NULL && next_l < x->right) {
+            if (head != NULL && next_l < x->right) {
                 alpha = msp_alloc_segment(self, x->left, next_l, x->left_mass,
                     next_l_mass, x->value, x->population_id, x->label, NULL, NULL);
                 if (alpha == NULL) {
@@ -2927,10 +3183,7 @@ msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
                 alpha->next = NULL;
             }
             if (x != NULL) {
-                ret = msp_priority_queue_insert(self, Q, x);
-                if (ret != 0) {
-                    goto out;
-                }
+                segment_queue_push(queue, &queue_size, x);
             }
         } else {
             if (!coalescence) {
@@ -3004,10 +3257,7 @@ msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
                     msp_set_segment_left_endpoint(self, x, r);
                 }
                 if (x != NULL) {
-                    ret = msp_priority_queue_insert(self, Q, x);
-                    if (ret != 0) {
-                        goto out;
-                    }
+                    segment_queue_push(queue, &queue_size, x);
                 } else {
                     /* If we've fully coalesced, we stop tracking the segment in
                        the pedigree. */
@@ -3079,9 +3329,6 @@ msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
     }
     ret = 0;
 out:
-    if (H != NULL) {
-        free(H);
-    }
     return ret;
 }
 
@@ -3167,79 +3414,20 @@ out:
     return ret;
 }
 
-static inline int
-msp_allocate_root_segments(msp_t *self, tsk_tree_t *tree, double left, double right,
-    segment_t *restrict *root_segments_head, segment_t *restrict *root_segments_tail)
-{
-    int ret = 0;
-    tsk_table_collection_t *tables = self->from_ts->tables;
-    const population_id_t *node_population = tables->nodes.population;
-    population_id_t population;
-    node_id_t root;
-    segment_t *seg, *tail;
-    label_id_t label = 0; /* For now only support label 0 */
-
-    for (root = tree->left_root; root != TSK_NULL; root = tree->right_sib[root]) {
-        population = node_population[root];
-        /* Reference integrity has alreay been checked, but the null population
-         * is still possibile */
-        if (population == TSK_NULL) {
-            ret = MSP_ERR_POPULATION_OUT_OF_BOUNDS;
-            goto out;
-        }
-        if (root_segments_head[root] == NULL) {
-            seg = msp_alloc_segment(self, left, right,
-                recomb_map_position_to_mass(&self->recomb_map, left),
-                recomb_map_position_to_mass(&self->recomb_map, right), root, population,
-                label, NULL, NULL);
-            if (seg == NULL) {
-                ret = MSP_ERR_NO_MEMORY;
-                goto out;
-            }
-            root_segments_head[root] = seg;
-            root_segments_tail[root] = seg;
-        } else {
-            tail = root_segments_tail[root];
-            if (tail->right == left) {
-                tail->right = right;
-                tail->right_mass = recomb_map_position_to_mass(&self->recomb_map, right);
-            } else {
-                seg = msp_alloc_segment(self, left, right,
-                    recomb_map_position_to_mass(&self->recomb_map, left),
-                    recomb_map_position_to_mass(&self->recomb_map, right), root,
-                    population, label, tail, NULL);
-                if (seg == NULL) {
-                    ret = MSP_ERR_NO_MEMORY;
-                    goto out;
-                }
-                tail->next = seg;
-                root_segments_tail[root] = seg;
-            }
-        }
-    }
-out:
-    return ret;
-}
-
+/* Restores the initial segment chains and overlap counts captured from
+ * from_ts by msp_initialise_from_ts. */
 static int
 msp_reset_from_ts(msp_t *self)
 {
     int ret = 0;
-    int t_iter;
-    tsk_tree_t t;
-    node_id_t root;
-    segment_t *seg;
-    uint32_t num_roots, overlap, last_overlap;
-    size_t num_nodes = self->tables->nodes.num_rows;
-    segment_t **root_segments_head = calloc(num_nodes, sizeof(*root_segments_head));
-    segment_t **root_segments_tail = calloc(num_nodes, sizeof(*root_segments_tail));
+    size_t j;
+    initial_segment_t *init;
+    segment_t **segs;
+    segment_t *seg, *prev;
+    label_id_t label = 0; /* For now only support label 0 */
 
-    ret = tsk_tree_init(&t, self->from_ts, 0);
-    if (ret != 0) {
-        ret = msp_set_tsk_error(ret);
-        goto out;
-    }
-    if (root_segments_head == NULL || root_segments_tail == NULL) {
+    segs = msp_get_scratch(self, GSL_MAX(self->num_initial_segments, 1) * sizeof(*segs));
+    if (segs == NULL) {
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
@@ -3249,55 +3437,38 @@ msp_reset_from_ts(msp_t *self)
         ret = msp_set_tsk_error(ret);
         goto out;
     }
-
-    last_overlap = UINT32_MAX;
-    for (t_iter = tsk_tree_first(&t); t_iter == 1; t_iter = tsk_tree_next(&t)) {
-        num_roots = (uint32_t) tsk_tree_get_num_roots(&t);
-        overlap = 0;
-        if (num_roots > 1) {
-            overlap = num_roots;
-            ret = msp_allocate_root_segments(
-                self, &t, t.left, t.right, root_segments_head, root_segments_tail);
-            if (ret != 0) {
-                goto out;
-            }
+    /* Segments are allocated in the order they were captured, so that
+     * they are assigned the same IDs on each reset */
+    for (j = 0; j < self->num_initial_segments; j++) {
+        init = &self->initial_segments[j];
+        prev = init->prev == TSK_NULL ? NULL : segs[init->prev];
+        seg = msp_alloc_segment(self, init->left, init->right, init->left_mass,
+            init->right_mass, init->value, init->population_id, label, prev, NULL);
+        if (seg == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
         }
-        if (overlap != last_overlap) {
-            ret = msp_insert_overlap_count(self, t.left, overlap);
-            if (ret != 0) {
-                goto out;
-            }
+        if (prev != NULL) {
+            prev->next = seg;
         }
+        fenwick_set_value(&self->links[label], seg->id, init->mass);
+        segs[j] = seg;
     }
-    if (t_iter != 0) {
-        ret = msp_set_tsk_error(t_iter);
-        goto out;
-    }
-
-    ret = msp_insert_overlap_count(self, self->sequence_length, UINT32_MAX);
-    if (ret != 0) {
-        goto out;
+    for (j = 0; j < self->num_initial_overlaps; j++) {
+        ret = msp_insert_overlap_count(
+            self, self->initial_overlaps[j].left, self->initial_overlaps[j].value);
+        if (ret != 0) {
+            goto out;
+        }
     }
-
     /* Insert the segment chains into the algorithm state */
-    for (root = 0; root < (node_id_t) num_nodes; root++) {
-        seg = root_segments_head[root];
-        if (seg != NULL) {
-            ret = msp_insert_individual(self, seg);
-            if (ret != 0) {
-                goto out;
-            }
-            msp_set_single_segment_mass(self, seg);
-            for (seg = seg->next; seg != NULL; seg = seg->next) {
-                msp_set_segment_mass(self, seg, seg->prev);
-            }
+    for (j = 0; j < self->num_initial_chains; j++) {
+        ret = msp_insert_individual(self, segs[self->initial_chain_heads[j]]);
+        if (ret != 0) {
+            goto out;
         }
     }
-
 out:
-    tsk_tree_free(&t);
-    msp_safe_free(root_segments_head);
-    msp_safe_free(root_segments_tail);
     return ret;
 }
 
@@ -3428,6 +3599,7 @@ msp_reset(msp_t *self)
         pop->growth_rate = initial_pop->growth_rate;
         pop->initial_size = initial_pop->initial_size;
         pop->start_time = self->time;
+        pop->timescale = 0;
     }
     if (self->from_ts == NULL) {
         ret = msp_reset_from_samples(self);
@@ -3441,6 +3613,9 @@ msp_reset(msp_t *self)
     memcpy(
         self->migration_matrix, self->initial_migration_matrix, N * N * sizeof(double));
     self->next_sampling_event = 0;
+    if (self->branch_stats != NULL) {
+        branch_stats_reset(self->branch_stats);
+    }
     self->num_re_events = 0;
     self->num_gc_events = 0;
     self->num_ca_events = 0;
@@ -3448,6 +3623,12 @@ msp_reset(msp_t *self)
     self->num_trapped_re_events = 0;
     self->num_multiple_re_events = 0;
     memset(self->num_migration_events, 0, N * N * sizeof(size_t));
+    if (self->mutgen != NULL) {
+        ret = mutgen_stream_begin(self->mutgen, self->tables, self->mutation_flags);
+        if (ret != 0) {
+            goto out;
+        }
+    }
     self->state = MSP_STATE_INITIALISED;
 out:
     return ret;
@@ -3504,47 +3685,187 @@ out:
 }
 
 static int MSP_WARN_UNUSED
-msp_initialise_from_ts(msp_t *self)
+msp_add_initial_segment(msp_t *self, double left, double right, node_id_t value,
+    population_id_t population_id, tsk_id_t prev, size_t *max_segments)
 {
     int ret = 0;
-    double root_time;
-    uint32_t num_samples;
-    size_t num_nodes = self->tables->nodes.num_rows;
-    population_id_t pop;
-    size_t j;
+    initial_segment_t *tmp, *seg;
 
-    if (self->num_populations != self->tables->populations.num_rows) {
-        ret = MSP_ERR_INCOMPATIBLE_FROM_TS;
-        goto out;
-    }
-    /* Find the maximum time among the existing nodes */
-    num_samples = 0;
-    root_time = 0.0;
-    for (j = 0; j < num_nodes; j++) {
-        root_time = GSL_MAX(self->tables->nodes.time[j], root_time);
-        /* TODO we can catch ancient samples here and insert them as sampling
-         * events, if we wish to support this. */
-        if (self->tables->nodes.flags[j] & TSK_NODE_IS_SAMPLE) {
-            num_samples++;
-        }
-        pop = self->tables->nodes.population[j];
-        if (pop < 0 || pop >= (population_id_t) self->num_populations) {
-            ret = MSP_ERR_POPULATION_OUT_OF_BOUNDS;
+    if (self->num_initial_segments == *max_segments) {
+        *max_segments = GSL_MAX(2 * *max_segments, 1024);
+        tmp = realloc(self->initial_segments, *max_segments * sizeof(*tmp));
+        if (tmp == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
             goto out;
         }
+        self->initial_segments = tmp;
     }
-    if (self->start_time < 0) {
-        self->start_time = root_time;
-    } else {
-        if (root_time > self->start_time) {
-            ret = MSP_ERR_BAD_START_TIME_FROM_TS;
-            goto out;
+    seg = &self->initial_segments[self->num_initial_segments];
+    seg->left = left;
+    seg->right = right;
+    seg->value = value;
+    seg->population_id = population_id;
+    seg->prev = prev;
+    self->num_initial_segments++;
+out:
+    return ret;
+}
+
+/* Computes the initial segment chains and overlap counts from the roots
+ * of the trees in from_ts. These are the same for every replicate, so we
+ * compute them once here and restore them in msp_reset_from_ts. */
+static int MSP_WARN_UNUSED
+msp_capture_initial_state_from_ts(msp_t *self)
+{
+    int ret = 0;
+    int t_iter;
+    tsk_tree_t t;
+    node_id_t root;
+    population_id_t population;
+    uint32_t num_roots, overlap, last_overlap;
+    size_t j, max_segments = 0;
+    size_t num_nodes = self->tables->nodes.num_rows;
+    const population_id_t *node_population = self->from_ts->tables->nodes.population;
+    tsk_id_t *head = malloc(num_nodes * sizeof(*head));
+    tsk_id_t *tail = malloc(num_nodes * sizeof(*tail));
+    initial_segment_t *seg;
+    recomb_map_t *recomb_map = &self->recomb_map;
+
+    ret = tsk_tree_init(&t, self->from_ts, 0);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    /* There is at most one overlap count per tree, plus the sentinel */
+    self->initial_overlaps = malloc(
+        (tsk_treeseq_get_num_trees(self->from_ts) + 1) * sizeof(node_mapping_t));
+    self->initial_chain_heads = malloc(num_nodes * sizeof(tsk_id_t));
+    if (head == NULL || tail == NULL || self->initial_overlaps == NULL
+        || self->initial_chain_heads == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < num_nodes; j++) {
+        head[j] = TSK_NULL;
+        tail[j] = TSK_NULL;
+    }
+
+    last_overlap = UINT32_MAX;
+    for (t_iter = tsk_tree_first(&t); t_iter == 1; t_iter = tsk_tree_next(&t)) {
+        num_roots = (uint32_t) tsk_tree_get_num_roots(&t);
+        overlap = 0;
+        if (num_roots > 1) {
+            overlap = num_roots;
+            for (root = t.left_root; root != TSK_NULL; root = t.right_sib[root]) {
+                population = node_population[root];
+                /* Reference integrity has alreay been checked, but the null
+                 * population is still possibile */
+                if (population == TSK_NULL) {
+                    ret = MSP_ERR_POPULATION_OUT_OF_BOUNDS;
+                    goto out;
+                }
+                if (tail[root] != TSK_NULL
+                    && self->initial_segments[tail[root]].right == t.left) {
+                    self->initial_segments[tail[root]].right = t.right;
+                } else {
+                    ret = msp_add_initial_segment(
+                        self, t.left, t.right, root, population, tail[root], &max_segments);
+                    if (ret != 0) {
+                        goto out;
+                    }
+                    tail[root] = (tsk_id_t) self->num_initial_segments - 1;
+                    if (head[root] == TSK_NULL) {
+                        head[root] = tail[root];
+                    }
+                }
+            }
+        }
+        if (overlap != last_overlap) {
+            self->initial_overlaps[self->num_initial_overlaps].left = t.left;
+            self->initial_overlaps[self->num_initial_overlaps].value = overlap;
+            self->num_initial_overlaps++;
+        }
+    }
+    if (t_iter != 0) {
+        ret = msp_set_tsk_error(t_iter);
+        goto out;
+    }
+    self->initial_overlaps[self->num_initial_overlaps].left = self->sequence_length;
+    self->initial_overlaps[self->num_initial_overlaps].value = UINT32_MAX;
+    self->num_initial_overlaps++;
+
+    /* Compute the masses now that the segment coordinates are final */
+    for (j = 0; j < self->num_initial_segments; j++) {
+        seg = &self->initial_segments[j];
+        seg->left_mass = recomb_map_position_to_mass(recomb_map, seg->left);
+        seg->right_mass = recomb_map_position_to_mass(recomb_map, seg->right);
+        if (seg->prev == TSK_NULL) {
+            seg->mass = msp_get_single_segment_mass(
+                self, seg->left, seg->right, seg->left_mass, seg->right_mass);
+        } else {
+            /* The previous segment in the chain always has a smaller index */
+            seg->mass = seg->right_mass - self->initial_segments[seg->prev].right_mass;
+        }
+    }
+    for (root = 0; root < (node_id_t) num_nodes; root++) {
+        if (head[root] != TSK_NULL) {
+            self->initial_chain_heads[self->num_initial_chains] = head[root];
+            self->num_initial_chains++;
+        }
+    }
+out:
+    tsk_tree_free(&t);
+    msp_safe_free(head);
+    msp_safe_free(tail);
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+msp_initialise_from_ts(msp_t *self)
+{
+    int ret = 0;
+    double root_time;
+    uint32_t num_samples;
+    size_t num_nodes = self->tables->nodes.num_rows;
+    population_id_t pop;
+    size_t j;
+
+    if (self->num_populations != self->tables->populations.num_rows) {
+        ret = MSP_ERR_INCOMPATIBLE_FROM_TS;
+        goto out;
+    }
+    /* Find the maximum time among the existing nodes */
+    num_samples = 0;
+    root_time = 0.0;
+    for (j = 0; j < num_nodes; j++) {
+        root_time = GSL_MAX(self->tables->nodes.time[j], root_time);
+        /* TODO we can catch ancient samples here and insert them as sampling
+         * events, if we wish to support this. */
+        if (self->tables->nodes.flags[j] & TSK_NODE_IS_SAMPLE) {
+            num_samples++;
+        }
+        pop = self->tables->nodes.population[j];
+        if (pop < 0 || pop >= (population_id_t) self->num_populations) {
+            ret = MSP_ERR_POPULATION_OUT_OF_BOUNDS;
+            goto out;
+        }
+    }
+    if (self->start_time < 0) {
+        self->start_time = root_time;
+    } else {
+        if (root_time > self->start_time) {
+            ret = MSP_ERR_BAD_START_TIME_FROM_TS;
+            goto out;
         }
     }
     if (num_samples < 2) {
         ret = MSP_ERR_INSUFFICIENT_SAMPLES;
         goto out;
     }
+    ret = msp_capture_initial_state_from_ts(self);
+    if (ret != 0) {
+        goto out;
+    }
 out:
     return ret;
 }
@@ -3702,12 +4023,148 @@ out:
     return ret;
 }
 
+/* Returns true if the merger tables were built for the current model. */
+static bool
+msp_merger_tables_current(msp_t *self)
+{
+    simulation_model_t *model = &self->model;
+    simulation_model_t *built = &self->merger_table_model;
+    bool ret = false;
+
+    if (self->merger_size_dist != NULL && built->type == model->type) {
+        if (model->type == MSP_MODEL_BETA) {
+            ret = built->params.beta_coalescent.alpha
+                      == model->params.beta_coalescent.alpha
+                  && built->params.beta_coalescent.truncation_point
+                         == model->params.beta_coalescent.truncation_point;
+        } else if (model->type == MSP_MODEL_DIRAC) {
+            ret = built->params.dirac_coalescent.psi == model->params.dirac_coalescent.psi
+                  && built->params.dirac_coalescent.c == model->params.dirac_coalescent.c;
+        }
+    }
+    return ret;
+}
+
+/* Computes the rates of beta coalescent mergers of k = 2, ..., n of the
+ * n lineages, storing the rate for k in weight[k - 2]. The rate for k is
+ * choose(n, k) E[x^(k - 2) (1 - x)^(n - k)], where x has the (truncated)
+ * Beta(2 - alpha, alpha) distribution. */
+static void
+msp_compute_beta_merger_weights(msp_t *self, uint32_t n, double *weight)
+{
+    beta_coalescent_t *params = &self->model.params.beta_coalescent;
+    double alpha = params->alpha;
+    double ln_norm = gsl_sf_lnbeta(2 - alpha, alpha);
+    double a, b;
+    uint32_t k;
+
+    for (k = 2; k <= n; k++) {
+        a = k - alpha;
+        b = n - k + alpha;
+        weight[k - 2] = exp(gsl_sf_lnchoose(n, k) + gsl_sf_lnbeta(a, b) - ln_norm);
+        if (params->truncation_point < 1) {
+            weight[k - 2] *= gsl_sf_beta_inc(a, b, params->truncation_point)
+                             / params->truncation_beta_inc;
+        }
+    }
+}
+
+/* Computes the rates of Dirac coalescent events with n lineages. The
+ * rate of binary mergers is stored in weight[0] and the rate of multiple
+ * merger events involving k = 2, ..., n lineages in weight[k - 1]. */
+static void
+msp_compute_dirac_merger_weights(msp_t *self, uint32_t n, double *weight)
+{
+    double psi = self->model.params.dirac_coalescent.psi;
+    double c = self->model.params.dirac_coalescent.c;
+    uint32_t k;
+
+    weight[0] = 0.5 * n * (n - 1.0);
+    for (k = 2; k <= n; k++) {
+        weight[k - 1] = c * gsl_ran_binomial_pdf(k, psi, n);
+    }
+}
+
+/* Builds the tables used to sample the type of multiple merger events directly
+ * for each number of lineages up to max_merger_table_lineages. The
+ * merger_rate[n] is the total rate of events with n lineages, on the same
+ * scale as the lambda used in the rejection samplers. */
+static int MSP_WARN_UNUSED
+msp_update_merger_tables(msp_t *self)
+{
+    int ret = 0;
+    size_t N = self->max_merger_table_lineages;
+    uint32_t n, k, num_types;
+    double total, scale;
+    double *weight = NULL;
+
+    if (N < 2
+        || (self->model.type != MSP_MODEL_BETA && self->model.type != MSP_MODEL_DIRAC)
+        || msp_merger_tables_current(self)) {
+        goto out;
+    }
+    msp_free_merger_tables(self);
+    self->merger_rate = calloc(N + 1, sizeof(*self->merger_rate));
+    self->merger_size_dist = calloc(N + 1, sizeof(*self->merger_size_dist));
+    weight = malloc(N * sizeof(*weight));
+    if (self->merger_rate == NULL || self->merger_size_dist == NULL || weight == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (n = 2; n <= N; n++) {
+        if (self->model.type == MSP_MODEL_BETA) {
+            msp_compute_beta_merger_weights(self, n, weight);
+            num_types = n - 1;
+            /* Same scaling as msp_beta_get_common_ancestor_waiting_time */
+            scale = 8;
+        } else {
+            msp_compute_dirac_merger_weights(self, n, weight);
+            num_types = n;
+            scale = 2;
+        }
+        total = 0;
+        for (k = 0; k < num_types; k++) {
+            total += weight[k];
+        }
+        self->merger_rate[n] = scale * total;
+        self->merger_size_dist[n] = gsl_ran_discrete_preproc(num_types, weight);
+        if (self->merger_size_dist[n] == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+    }
+    memcpy(&self->merger_table_model, &self->model, sizeof(self->model));
+out:
+    if (ret != 0) {
+        msp_free_merger_tables(self);
+    }
+    msp_safe_free(weight);
+    return ret;
+}
+
+/* Returns true if the merger size of an event in a population with n
+ * lineages should be sampled from the precomputed tables */
+static inline bool
+msp_use_merger_tables(msp_t *self, uint32_t n)
+{
+    return n <= self->max_merger_table_lineages && self->merger_size_dist != NULL;
+}
+
+/* Returns true if the interrupt handler is due to be polled after this
+ * many events and asks for the simulation to stop. */
+static inline bool
+msp_interrupted(msp_t *self, unsigned long events)
+{
+    return self->interrupt_handler != NULL
+           && (events & (MSP_INTERRUPT_POLL_INTERVAL - 1)) == 0
+           && self->interrupt_handler(self, self->interrupt_handler_arg) != 0;
+}
+
 /* The main event loop for continuous time coalescent models. Runs until either
  * coalescence; or the time of a simulated event would have exceeded the
- * specified max_time; or for a specified number of events. The num_events
- * parameter is provided so that higher-level code can run the simulation for
- * smaller time chunks. This is used in the Python interface to check for
- * interrupts, so that long-running simulations can be killed using CTRL-C.
+ * specified max_time; or for a specified number of events; or the interrupt
+ * handler asks us to stop. The num_events parameter is provided so that
+ * higher-level code can run the simulation for smaller time chunks.
  *
  * Returns:
  * MSP_EXIT_COALESCENCE if the simulation completed to coalescence
@@ -3715,6 +4172,7 @@ out:
  *    of events was reached.
  * MSP_EXIT_MAX_TIME if the simulation stopped because the maximum time would
  *    have been exceeded by an event.
+ * MSP_EXIT_INTERRUPTED if the interrupt handler returned non-zero.
  * A negative value if an error occured.
  */
 static int MSP_WARN_UNUSED
@@ -3738,6 +4196,10 @@ msp_run_coalescent(msp_t *self, double max_time, unsigned long max_events)
     if (ret != 0) {
         goto out;
     }
+    ret = msp_update_merger_tables(self);
+    if (ret != 0) {
+        goto out;
+    }
 
     while (msp_get_num_ancestors(self) > 0) {
         if (events == max_events) {
@@ -3745,6 +4207,10 @@ msp_run_coalescent(msp_t *self, double max_time, unsigned long max_events)
             break;
         }
         events++;
+        if (msp_interrupted(self, events)) {
+            ret = MSP_EXIT_INTERRUPTED;
+            break;
+        }
 
         recomb_mass = fenwick_get_total(&self->links[label]);
         /* Recombination */
@@ -3952,6 +4418,7 @@ msp_pedigree_climb(msp_t *self)
     segment_t *merged_segment = NULL;
     segment_t *u[2]; // Will need to update for different ploidy
     avl_tree_t *segments = NULL;
+    unsigned long events = 0;
     /* avl_node_t *node; */
 
     assert(self->num_populations == 1);
@@ -3963,7 +4430,13 @@ msp_pedigree_climb(msp_t *self)
     while (avl_count(&self->pedigree->ind_heap) > 0) {
         /* NOTE: We don't yet support early termination - need to properly
          handle moving segments back into population (or possibly keep them
-         there in the first place) before we can handle that */
+         there in the first place) before we can handle that. If we are
+         interrupted the climb is left incomplete and cannot be resumed. */
+        events++;
+        if (msp_interrupted(self, events)) {
+            ret = MSP_EXIT_INTERRUPTED;
+            goto out;
+        }
         ret = msp_pedigree_pop_ind(self, &ind);
         if (ret != 0) {
             goto out;
@@ -4291,6 +4764,10 @@ msp_run_dtwf(msp_t *self, double max_time, unsigned long max_events)
             break;
         }
         events++;
+        if (msp_interrupted(self, events)) {
+            ret = MSP_EXIT_INTERRUPTED;
+            break;
+        }
         if (self->time + 1 >= max_time) {
             ret = MSP_EXIT_MAX_TIME;
             goto out;
@@ -4528,6 +5005,7 @@ static int
 msp_run_sweep(msp_t *self)
 {
     int ret = 0;
+    int err;
     simulation_model_t *model = &self->model;
     size_t curr_step = 0;
     size_t num_steps;
@@ -4573,6 +5051,12 @@ msp_run_sweep(msp_t *self)
 
     while (msp_get_num_ancestors(self) > 0 && curr_step < num_steps) {
         events++;
+        if (msp_interrupted(self, events)) {
+            /* The sweep cannot be resumed part way through, but we still
+             * move the lineages back to label 0. */
+            ret = MSP_EXIT_INTERRUPTED;
+            break;
+        }
         /* Set pop sizes & rec_rates */
         for (j = 0; j < self->num_labels; j++) {
             label = (label_id_t) j;
@@ -4635,6 +5119,13 @@ msp_run_sweep(msp_t *self)
         }
         /*msp_print_state(self, stdout);*/
     }
+    if (ret == MSP_EXIT_INTERRUPTED) {
+        err = msp_sweep_finalise(self);
+        if (err != 0) {
+            ret = err;
+        }
+        goto out;
+    }
     /* Check if any demographic events should have happened during the
      * event and raise an error if so. This is to keep computing population
      * sizes simple */
@@ -4695,6 +5186,10 @@ msp_run(msp_t *self, double max_time, unsigned long max_events)
     } else if (self->model.type == MSP_MODEL_DTWF) {
         ret = msp_run_dtwf(self, max_time, max_events);
     } else if (self->model.type == MSP_MODEL_WF_PED) {
+        if (self->branch_stats != NULL) {
+            ret = MSP_ERR_UNSUPPORTED_OPERATION;
+            goto out;
+        }
         if (self->pedigree == NULL || self->pedigree->state != MSP_PED_STATE_UNCLIMBED) {
             ret = MSP_ERR_BAD_STATE;
             goto out;
@@ -4747,10 +5242,12 @@ msp_insert_uncoalesced_edges(msp_t *self)
     avl_node_t *a;
     segment_t *seg;
     node_id_t node;
-    int64_t edge_start;
+    size_t j, edge_start, num_tail_edges;
+    tsk_edge_t *tail;
+    tsk_edge_t edge;
     tsk_node_table_t *nodes = &self->tables->nodes;
+    tsk_edge_table_t *edges = &self->tables->edges;
     const double current_time = self->time;
-    tsk_bookmark_t bookmark;
 
     for (pop = 0; pop < (population_id_t) self->num_populations; pop++) {
         for (label = 0; label < (label_id_t) self->num_labels; label++) {
@@ -4783,42 +5280,63 @@ msp_insert_uncoalesced_edges(msp_t *self)
                 for (seg = (segment_t *) a->item; seg != NULL; seg = seg->next) {
                     if (seg->value != node) {
                         assert(nodes->time[node] > nodes->time[seg->value]);
-                        ret = tsk_edge_table_add_row(&self->tables->edges, seg->left,
-                            seg->right, node, seg->value);
+                        ret = tsk_edge_table_add_row(
+                            edges, seg->left, seg->right, node, seg->value);
                         if (ret < 0) {
                             ret = msp_set_tsk_error(ret);
                             goto out;
                         }
+                        if (self->mutgen != NULL) {
+                            ret = mutgen_stream_edge(
+                                self->mutgen, self->tables, (tsk_id_t) ret);
+                            if (ret != 0) {
+                                goto out;
+                            }
+                        }
+                        if (self->branch_stats != NULL) {
+                            edge.left = seg->left;
+                            edge.right = seg->right;
+                            edge.parent = node;
+                            edge.child = seg->value;
+                            ret = branch_stats_add_edges(
+                                self->branch_stats, self->tables, &edge, 1);
+                            if (ret != 0) {
+                                goto out;
+                            }
+                        }
                     }
                 }
             }
         }
     }
 
-    /* Find the first edge with parent == current time */
-    edge_start = ((int64_t) self->tables->edges.num_rows) - 1;
-    while (edge_start >= 0
-           && nodes->time[self->tables->edges.parent[edge_start]] == current_time) {
+    /* The edges before those with parent time equal to the current time are
+     * already sorted, and all edges we have added have this parent time. We
+     * therefore only need to sort this tail of the edge table by parent, child
+     * and left coordinate, and the other tables are unaffected. */
+    edge_start = edges->num_rows;
+    while (edge_start > 0 && nodes->time[edges->parent[edge_start - 1]] == current_time) {
         edge_start--;
     }
-    memset(&bookmark, 0, sizeof(bookmark));
-    if (edge_start > 0) {
-        bookmark.edges = (tsk_size_t) edge_start;
-    }
-    /* FIXME!!! This is a *horrible* ugly hack to work around sort not accepting
-     * migrations. We know the migrations are sorted, so we shouldn't need to
-     * sort them anyway, so we should be able to set bookmark.migrations =
-     * tables.migrations.num_rows.
-     * See https://github.com/tskit-dev/tskit/issues/117
-     */
-    tsk_size_t tmp_count = self->tables->migrations.num_rows;
-    self->tables->migrations.num_rows = 0;
-    ret = tsk_table_collection_sort(self->tables, &bookmark, 0);
-    self->tables->migrations.num_rows = tmp_count;
-    if (ret != 0) {
-        ret = msp_set_tsk_error(ret);
+    num_tail_edges = edges->num_rows - edge_start;
+    tail = msp_get_scratch(self, GSL_MAX(num_tail_edges, 1) * sizeof(*tail));
+    if (tail == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
+    for (j = 0; j < num_tail_edges; j++) {
+        tail[j].left = edges->left[edge_start + j];
+        tail[j].right = edges->right[edge_start + j];
+        tail[j].parent = edges->parent[edge_start + j];
+        tail[j].child = edges->child[edge_start + j];
+    }
+    qsort(tail, num_tail_edges, sizeof(*tail), cmp_edge);
+    for (j = 0; j < num_tail_edges; j++) {
+        edges->left[edge_start + j] = tail[j].left;
+        edges->right[edge_start + j] = tail[j].right;
+        edges->parent[edge_start + j] = tail[j].parent;
+        edges->child[edge_start + j] = tail[j].child;
+    }
 out:
     return ret;
 }
@@ -4834,10 +5352,405 @@ msp_finalise_tables(msp_t *self)
             goto out;
         }
     }
+    /* The streamed mutations are only written once, so that finalising a
+     * completed simulation again leaves the tables unchanged. */
+    if (self->mutgen != NULL && self->mutgen->streaming) {
+        ret = mutgen_stream_end(self->mutgen, self->tables);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+/* Returns the seed for the specified stream derived from the specified seed,
+ * using the splitmix64 finaliser. Derived seeds are non-zero and fit in 32
+ * bits, so they are valid seeds for any gsl_rng type. */
+unsigned long
+msp_derive_seed(unsigned long seed, uint64_t stream)
+{
+    uint64_t z = (uint64_t) seed + (stream + 1) * UINT64_C(0x9E3779B97F4A7C15);
+
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    z = (z ^ (z >> 31)) & UINT64_C(0xFFFFFFFF);
+    return (unsigned long) (z == 0 ? 1 : z);
+}
+
+/* Runs a single replicate on the specified simulator and copies the
+ * finished tables into dest, which must not be initialised, or the summary
+ * statistics into summary if the simulator has a branch stats sink. */
+static int MSP_WARN_UNUSED
+msp_run_replicate(msp_t *self, unsigned long seed, double max_time,
+    tsk_table_collection_t *dest, double *summary)
+{
+    int ret;
+
+    gsl_rng_set(self->rng, seed);
+    ret = msp_reset(self);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_run(self, max_time, ULONG_MAX);
+    if (ret < 0) {
+        goto out;
+    }
+    if (ret == MSP_EXIT_INTERRUPTED) {
+        ret = MSP_ERR_INTERRUPTED;
+        goto out;
+    }
+    ret = msp_finalise_tables(self);
+    if (ret != 0) {
+        goto out;
+    }
+    if (self->branch_stats != NULL) {
+        branch_stats_get_summary(self->branch_stats, summary);
+    } else {
+        ret = tsk_table_collection_copy(self->tables, dest, 0);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+typedef struct {
+    tsk_table_collection_t tables;
+    double *summary;
+    bool full;
+    int ret;
+} msp_replicate_slot_t;
+
+typedef struct {
+    size_t start;
+    size_t end;
+    unsigned long seed;
+    double max_time;
+    msp_replicate_callback_t callback;
+    void *callback_arg;
+    /* Non-zero if the simulators produce summary statistics, not tables */
+    size_t summary_size;
+    /* Finished replicates are delivered in order through a ring of slots;
+     * replicate j uses slot (j - start) % num_slots. */
+    msp_replicate_slot_t *slots;
+    size_t num_slots;
+    size_t next_replicate;
+    size_t next_delivered;
+    bool aborted;
+#ifdef MSP_HAVE_PTHREADS
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+} msp_replicate_queue_t;
+
+/* Hands the results in the slot to the callback and releases them. */
+static int
+msp_replicate_queue_deliver(
+    msp_replicate_queue_t *self, size_t replicate, msp_replicate_slot_t *slot)
+{
+    int ret = slot->ret;
+
+    if (ret == 0) {
+        if (self->summary_size > 0) {
+            ret = self->callback(replicate, NULL, slot->summary, self->callback_arg);
+        } else {
+            ret = self->callback(replicate, &slot->tables, NULL, self->callback_arg);
+        }
+    }
+    tsk_table_collection_free(&slot->tables);
+    memset(&slot->tables, 0, sizeof(slot->tables));
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+msp_replicate_queue_run_sequential(msp_replicate_queue_t *self, msp_t *sim)
+{
+    int ret = 0;
+    msp_replicate_slot_t *slot = &self->slots[0];
+    size_t j;
+
+    for (j = self->start; j < self->end; j++) {
+        slot->ret = msp_run_replicate(sim, msp_derive_seed(self->seed, j),
+            self->max_time, &slot->tables, slot->summary);
+        ret = msp_replicate_queue_deliver(self, j, slot);
+        if (ret != 0) {
+            goto out;
+        }
+    }
 out:
     return ret;
 }
 
+#ifdef MSP_HAVE_PTHREADS
+
+typedef struct {
+    msp_replicate_queue_t *queue;
+    msp_t *sim;
+} msp_replicate_worker_t;
+
+static void *
+msp_replicate_worker(void *arg)
+{
+    msp_replicate_worker_t *worker = (msp_replicate_worker_t *) arg;
+    msp_replicate_queue_t *self = worker->queue;
+    msp_replicate_slot_t *slot;
+    size_t j;
+    int ret;
+
+    pthread_mutex_lock(&self->mutex);
+    while (true) {
+        /* Don't run further ahead than the consumer has slots for */
+        while (!self->aborted && self->next_replicate < self->end
+               && self->next_replicate >= self->next_delivered + self->num_slots) {
+            pthread_cond_wait(&self->cond, &self->mutex);
+        }
+        if (self->aborted || self->next_replicate == self->end) {
+            break;
+        }
+        j = self->next_replicate;
+        self->next_replicate++;
+        slot = &self->slots[(j - self->start) % self->num_slots];
+        pthread_mutex_unlock(&self->mutex);
+
+        ret = msp_run_replicate(worker->sim, msp_derive_seed(self->seed, j),
+            self->max_time, &slot->tables, slot->summary);
+
+        pthread_mutex_lock(&self->mutex);
+        slot->ret = ret;
+        slot->full = true;
+        pthread_cond_broadcast(&self->cond);
+    }
+    pthread_mutex_unlock(&self->mutex);
+    return NULL;
+}
+
+/* Runs the workers in their own threads while the calling thread delivers
+ * the results in replicate order. */
+static int MSP_WARN_UNUSED
+msp_replicate_queue_run_threaded(
+    msp_replicate_queue_t *self, msp_t **sims, size_t num_sims)
+{
+    int ret = 0;
+    msp_replicate_worker_t *workers = NULL;
+    pthread_t *threads = NULL;
+    bool *started = NULL;
+    bool any_started = false;
+    msp_replicate_slot_t *slot;
+    size_t j;
+
+    workers = malloc(num_sims * sizeof(*workers));
+    threads = malloc(num_sims * sizeof(*threads));
+    started = calloc(num_sims, sizeof(*started));
+    if (workers == NULL || threads == NULL || started == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < num_sims; j++) {
+        workers[j].queue = self;
+        workers[j].sim = sims[j];
+        started[j]
+            = pthread_create(&threads[j], NULL, msp_replicate_worker, &workers[j]) == 0;
+        any_started = any_started || started[j];
+    }
+    if (!any_started) {
+        ret = msp_replicate_queue_run_sequential(self, sims[0]);
+        goto out;
+    }
+    for (j = self->start; j < self->end; j++) {
+        slot = &self->slots[(j - self->start) % self->num_slots];
+        pthread_mutex_lock(&self->mutex);
+        while (!slot->full) {
+            pthread_cond_wait(&self->cond, &self->mutex);
+        }
+        pthread_mutex_unlock(&self->mutex);
+
+        ret = msp_replicate_queue_deliver(self, j, slot);
+
+        pthread_mutex_lock(&self->mutex);
+        slot->full = false;
+        self->next_delivered++;
+        self->aborted = ret != 0;
+        pthread_cond_broadcast(&self->cond);
+        pthread_mutex_unlock(&self->mutex);
+        if (ret != 0) {
+            break;
+        }
+    }
+    for (j = 0; j < num_sims; j++) {
+        if (started[j]) {
+            pthread_join(threads[j], NULL);
+        }
+    }
+    /* Replicates finished after the run was stopped are discarded */
+    for (j = 0; j < self->num_slots; j++) {
+        tsk_table_collection_free(&self->slots[j].tables);
+    }
+out:
+    msp_safe_free(workers);
+    msp_safe_free(threads);
+    msp_safe_free(started);
+    return ret;
+}
+
+#endif
+
+/* Runs replicates [start, start + num_replicates) of a simulation on the
+ * specified simulators, which must be distinct, initialised and identically
+ * configured, each with its own random generator. Each replicate is seeded
+ * with msp_derive_seed(seed, replicate index), so the results do not depend
+ * on the number of simulators used. The simulators run concurrently where
+ * threads are available, at most num_sims replicates ahead of delivery, and
+ * the finished tables are passed to the callback in replicate order from the
+ * calling thread. The tables are freed when the callback returns; it may
+ * keep them by moving them out by value. If the simulators have branch stats
+ * sinks, which must then all have the same size, only the summary statistics
+ * are passed to the callback and the tables are NULL. A non-zero return from
+ * the callback stops the run and is returned.
+ */
+int MSP_WARN_UNUSED
+msp_run_replicates(msp_t **sims, size_t num_sims, size_t start, size_t num_replicates,
+    unsigned long seed, double max_time, msp_replicate_callback_t callback,
+    void *callback_arg)
+{
+    int ret = 0;
+    msp_replicate_queue_t queue;
+    double *summaries = NULL;
+    size_t j;
+
+    memset(&queue, 0, sizeof(queue));
+    if (num_sims == 0 || callback == NULL) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    if (sims[0]->branch_stats != NULL) {
+        queue.summary_size = branch_stats_get_summary_size(sims[0]->branch_stats);
+    }
+    for (j = 0; j < num_sims; j++) {
+        if (sims[j]->state == MSP_STATE_NEW) {
+            ret = MSP_ERR_BAD_STATE;
+            goto out;
+        }
+        if ((sims[j]->branch_stats == NULL) != (queue.summary_size == 0)
+            || (sims[j]->branch_stats != NULL
+                   && branch_stats_get_summary_size(sims[j]->branch_stats)
+                          != queue.summary_size)) {
+            ret = MSP_ERR_BAD_PARAM_VALUE;
+            goto out;
+        }
+    }
+    queue.start = start;
+    queue.end = start + num_replicates;
+    queue.next_replicate = start;
+    queue.next_delivered = start;
+    queue.seed = seed;
+    queue.max_time = max_time;
+    queue.callback = callback;
+    queue.callback_arg = callback_arg;
+    queue.num_slots = num_sims;
+    queue.slots = calloc(queue.num_slots, sizeof(*queue.slots));
+    summaries = malloc(GSL_MAX(queue.num_slots * queue.summary_size, 1) * sizeof(double));
+    if (queue.slots == NULL || summaries == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < queue.num_slots; j++) {
+        queue.slots[j].summary = summaries + j * queue.summary_size;
+    }
+#ifdef MSP_HAVE_PTHREADS
+    if (num_sims > 1 && num_replicates > 1) {
+        pthread_mutex_init(&queue.mutex, NULL);
+        pthread_cond_init(&queue.cond, NULL);
+        ret = msp_replicate_queue_run_threaded(&queue, sims, num_sims);
+        pthread_cond_destroy(&queue.cond);
+        pthread_mutex_destroy(&queue.mutex);
+        goto out;
+    }
+#endif
+    ret = msp_replicate_queue_run_sequential(&queue, sims[0]);
+out:
+    msp_safe_free(queue.slots);
+    msp_safe_free(summaries);
+    return ret;
+}
+
+/* Adds the provenance record for the specified replicate to the tables,
+ * substituting the replicate index for the placeholder, and replaces the
+ * population table with one carrying the template metadata. This lets
+ * callers running many small replicates encode these once rather than
+ * once per replicate. */
+int MSP_WARN_UNUSED
+msp_stamp_replicate_tables(tsk_table_collection_t *tables,
+    const msp_replicate_template_t *replicate_template, size_t replicate)
+{
+    int ret = 0;
+    tsk_id_t tsk_ret;
+    const msp_replicate_template_t *t = replicate_template;
+    const char *placeholder = MSP_REPLICATE_INDEX_PLACEHOLDER;
+    const size_t placeholder_length = strlen(placeholder);
+    const tsk_size_t *offset = t->population_metadata_offset;
+    char index[32];
+    char *record = NULL;
+    size_t record_length = 0;
+    size_t index_length, j, k;
+
+    if (offset != NULL && tables->populations.num_rows != t->num_populations) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    if (t->provenance_record != NULL) {
+        index_length
+            = (size_t) snprintf(index, sizeof(index), "%lu", (unsigned long) replicate);
+        /* Every placeholder is replaced by a number no longer than itself */
+        record = malloc(t->provenance_record_length + 1);
+        if (record == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        j = 0;
+        while (j < t->provenance_record_length) {
+            if (t->provenance_record_length - j >= placeholder_length
+                && memcmp(t->provenance_record + j, placeholder, placeholder_length)
+                       == 0) {
+                memcpy(record + record_length, index, index_length);
+                record_length += index_length;
+                j += placeholder_length;
+            } else {
+                record[record_length] = t->provenance_record[j];
+                record_length++;
+                j++;
+            }
+        }
+        tsk_ret = tsk_provenance_table_add_row(&tables->provenances,
+            t->provenance_timestamp, t->provenance_timestamp_length, record,
+            (tsk_size_t) record_length);
+        if (tsk_ret < 0) {
+            ret = msp_set_tsk_error((int) tsk_ret);
+            goto out;
+        }
+    }
+    if (offset != NULL) {
+        ret = tsk_population_table_clear(&tables->populations);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+        for (k = 0; k < t->num_populations; k++) {
+            tsk_ret = tsk_population_table_add_row(&tables->populations,
+                t->population_metadata + offset[k], offset[k + 1] - offset[k]);
+            if (tsk_ret < 0) {
+                ret = msp_set_tsk_error((int) tsk_ret);
+                goto out;
+            }
+        }
+    }
+out:
+    msp_safe_free(record);
+    return ret;
+}
+
 int
 msp_debug_demography(msp_t *self, double *end_time)
 {
@@ -5186,6 +6099,7 @@ msp_change_single_population_parameters(msp_t *self, size_t population_id, doubl
     } else {
         pop->initial_size = initial_size;
     }
+    pop->timescale = 0;
     /* Do not change the growth_rate unless it is specified */
     if (!gsl_isnan(growth_rate)) {
         pop->growth_rate = growth_rate;
@@ -5371,6 +6285,99 @@ out:
     return ret;
 }
 
+/* Inserts the specified value into the open addressing hash table of
+ * 2^bits entries used by msp_random_subset, returning false if it is
+ * already present. Empty entries are UINT32_MAX. */
+static bool
+subset_table_insert(uint32_t *table, uint32_t bits, uint32_t value)
+{
+    uint32_t mask = (uint32_t) ((1ULL << bits) - 1);
+    uint32_t h = (value * 2654435769U) >> (32 - bits);
+
+    while (table[h] != UINT32_MAX) {
+        if (table[h] == value) {
+            return false;
+        }
+        h = (h + 1) & mask;
+    }
+    table[h] = value;
+    return true;
+}
+
+/* Chooses a uniformly random subset of k of the integers 0, ..., n - 1,
+ * storing them in increasing order in the specified array, which must have
+ * space for k values. We use Floyd's algorithm, which needs only k random
+ * draws, tracking the values chosen so far in the specified hash table of
+ * 2^table_bits >= 2k entries. The subset is then sorted.
+ */
+static void
+msp_random_subset(
+    msp_t *self, uint32_t n, uint32_t k, uint32_t *subset, uint32_t *table, uint32_t table_bits)
+{
+    uint32_t j, t, m;
+
+    memset(table, 0xff, sizeof(*table) << table_bits);
+    m = 0;
+    for (j = n - k; j < n; j++) {
+        t = (uint32_t) gsl_rng_uniform_int(self->rng, (unsigned long) j + 1);
+        if (!subset_table_insert(table, table_bits, t)) {
+            /* j cannot have been chosen yet, as all previous draws were < j */
+            t = j;
+            subset_table_insert(table, table_bits, t);
+        }
+        subset[m] = t;
+        m++;
+    }
+    assert(m == k);
+    qsort(subset, k, sizeof(*subset), cmp_uint32);
+}
+
+/* Removes each lineage in the specified population with probability p,
+ * returning the removed AVL nodes in the specified array, which is stored
+ * in the scratch buffer. Rather than testing every lineage we draw the number
+ * of lineages to remove and then choose these uniformly.
+ */
+static int MSP_WARN_UNUSED
+msp_sample_lineages(msp_t *self, avl_tree_t *pop, double p, avl_node_t ***nodes,
+    uint32_t *num_nodes)
+{
+    int ret = 0;
+    uint32_t n = avl_count(pop);
+    uint32_t j, k, table_bits;
+    uint32_t *subset, *table;
+    avl_node_t **chosen;
+    void *scratch;
+
+    k = n == 0 ? 0 : gsl_ran_binomial(self->rng, p, n);
+    table_bits = 1;
+    while ((1ULL << table_bits) < 2ULL * k) {
+        table_bits++;
+    }
+    assert(table_bits <= 32);
+    scratch = msp_get_scratch(self, GSL_MAX(k, 1) * sizeof(*chosen)
+                                        + GSL_MAX(k, 1) * sizeof(*subset)
+                                        + (sizeof(*table) << table_bits));
+    if (scratch == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    chosen = (avl_node_t **) scratch;
+    subset = (uint32_t *) (chosen + GSL_MAX(k, 1));
+    table = subset + GSL_MAX(k, 1);
+    msp_random_subset(self, n, k, subset, table, table_bits);
+    /* Unlink from the highest index down so that the remaining indexes
+     * are unaffected. */
+    for (j = k; j > 0; j--) {
+        chosen[j - 1] = avl_at(pop, subset[j - 1]);
+        assert(chosen[j - 1] != NULL);
+        avl_unlink_node(pop, chosen[j - 1]);
+    }
+    *nodes = chosen;
+    *num_nodes = k;
+out:
+    return ret;
+}
+
 /* Mass migration */
 
 static int
@@ -5381,8 +6388,10 @@ msp_mass_migration(msp_t *self, demographic_event_t *event)
     population_id_t dest = event->params.mass_migration.destination;
     double p = event->params.mass_migration.proportion;
     population_id_t N = (population_id_t) self->num_populations;
-    avl_node_t *node, *next;
+    avl_node_t **nodes;
     avl_tree_t *pop;
+    segment_t *ind;
+    uint32_t j, num_nodes;
     label_id_t label = 0; /* For now only support label 0 */
 
     /* This should have been caught on adding the event */
@@ -5394,16 +6403,17 @@ msp_mass_migration(msp_t *self, demographic_event_t *event)
      * Move lineages from source to dest with probability p.
      */
     pop = &self->populations[source].ancestors[label];
-    node = pop->head;
-    while (node != NULL) {
-        next = node->next;
-        if (gsl_rng_uniform(self->rng) < p) {
-            ret = msp_move_individual(self, node, pop, dest, label);
-            if (ret != 0) {
-                goto out;
-            }
+    ret = msp_sample_lineages(self, pop, p, &nodes, &num_nodes);
+    if (ret != 0) {
+        goto out;
+    }
+    for (j = 0; j < num_nodes; j++) {
+        ind = (segment_t *) nodes[j]->item;
+        msp_free_avl_node(self, nodes[j]);
+        ret = msp_move_segment_chain(self, ind, dest, label);
+        if (ret != 0) {
+            goto out;
         }
-        node = next;
     }
 out:
     return ret;
@@ -5463,9 +6473,10 @@ msp_simple_bottleneck(msp_t *self, demographic_event_t *event)
     population_id_t population_id = event->params.simple_bottleneck.population_id;
     double p = event->params.simple_bottleneck.proportion;
     population_id_t N = (population_id_t) self->num_populations;
-    avl_node_t *node, *next, *q_node;
+    avl_node_t **nodes;
+    avl_node_t *q_node;
     avl_tree_t *pop, Q;
-    segment_t *u;
+    uint32_t j, num_nodes;
     label_id_t label = 0; /* For now only support label 0 */
 
     /* This should have been caught on adding the event */
@@ -5483,23 +6494,15 @@ msp_simple_bottleneck(msp_t *self, demographic_event_t *event)
      * during this simple_bottleneck.
      */
     pop = &self->populations[population_id].ancestors[label];
-    node = pop->head;
-    while (node != NULL) {
-        next = node->next;
-        if (gsl_rng_uniform(self->rng) < p) {
-            u = (segment_t *) node->item;
-            avl_unlink_node(pop, node);
-            msp_free_avl_node(self, node);
-            q_node = msp_alloc_avl_node(self);
-            if (q_node == NULL) {
-                ret = MSP_ERR_NO_MEMORY;
-                goto out;
-            }
-            avl_init_node(q_node, u);
-            q_node = avl_insert_node(&Q, q_node);
-            assert(q_node != NULL);
-        }
-        node = next;
+    ret = msp_sample_lineages(self, pop, p, &nodes, &num_nodes);
+    if (ret != 0) {
+        goto out;
+    }
+    /* The nodes have been unlinked, so we can reuse them for the queue */
+    for (j = 0; j < num_nodes; j++) {
+        avl_init_node(nodes[j], nodes[j]->item);
+        q_node = avl_insert_node(&Q, nodes[j]);
+        assert(q_node != NULL);
     }
     ret = msp_merge_ancestors(self, &Q, population_id, label, NULL, TSK_NULL);
 out:
@@ -5555,16 +6558,14 @@ msp_instantaneous_bottleneck(msp_t *self, demographic_event_t *event)
     population_id_t population_id = event->params.instantaneous_bottleneck.population_id;
     double T2 = event->params.instantaneous_bottleneck.strength;
     population_id_t N = (population_id_t) self->num_populations;
-    node_id_t *lineages = NULL;
-    node_id_t *pi = NULL;
-    avl_node_t **avl_nodes = NULL;
-    avl_tree_t *sets = NULL;
-    node_id_t u, parent;
+    node_id_t *lineages, *pi;
+    avl_node_t **avl_nodes;
+    avl_tree_t *sets;
+    node_id_t u, v, root, parent;
     uint32_t j, k, n, num_roots;
     double rate, t;
     avl_tree_t *pop;
     avl_node_t *node, *set_node;
-    segment_t *individual;
     label_id_t label = 0; /* For now only support label 0 */
 
     /* This should have been caught on adding the event */
@@ -5578,14 +6579,17 @@ msp_instantaneous_bottleneck(msp_t *self, demographic_event_t *event)
     }
     pop = &self->populations[population_id].ancestors[label];
     n = avl_count(pop);
-    lineages = malloc(n * sizeof(node_id_t));
-    avl_nodes = malloc(n * sizeof(avl_node_t *));
-    pi = malloc(2 * n * sizeof(node_id_t));
-    sets = malloc(2 * n * sizeof(avl_tree_t));
-    if (lineages == NULL || avl_nodes == NULL || pi == NULL || sets == NULL) {
+    /* Carve the working arrays out of the scratch buffer, with the most
+     * strictly aligned types first. */
+    sets = msp_get_scratch(self, 2 * n * sizeof(avl_tree_t) + n * sizeof(avl_node_t *)
+                                     + 3 * n * sizeof(node_id_t) + 1);
+    if (sets == NULL) {
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
+    avl_nodes = (avl_node_t **) (sets + 2 * n);
+    pi = (node_id_t *) (avl_nodes + n);
+    lineages = pi + 2 * n;
     for (u = 0; u < (node_id_t) n; u++) {
         lineages[u] = u;
     }
@@ -5633,26 +6637,26 @@ msp_instantaneous_bottleneck(msp_t *self, demographic_event_t *event)
 
     /* Assign each lineage to the set corresponding to a given root.
      * For any root < n, this lineages has not been affected, so we
-     * leave it alone.
+     * leave it alone. We compress the paths to the root as we go so
+     * that each internal node is traversed only once.
      */
     for (j = 0; j < n; j++) {
+        root = (node_id_t) j;
+        while (pi[root] != TSK_NULL) {
+            root = pi[root];
+        }
         u = (node_id_t) j;
-        while (pi[u] != TSK_NULL) {
-            u = pi[u];
-        }
-        if (u >= (node_id_t) n) {
-            /* Remove this node from the population, and add it into the
-             * set for the root at u */
-            individual = (segment_t *) avl_nodes[j]->item;
-            avl_unlink_node(pop, avl_nodes[j]);
-            msp_free_avl_node(self, avl_nodes[j]);
-            set_node = msp_alloc_avl_node(self);
-            if (set_node == NULL) {
-                ret = MSP_ERR_NO_MEMORY;
-                goto out;
-            }
-            avl_init_node(set_node, individual);
-            set_node = avl_insert_node(&sets[u], set_node);
+        while (u != root && pi[u] != root) {
+            v = pi[u];
+            pi[u] = root;
+            u = v;
+        }
+        if (root >= (node_id_t) n) {
+            /* Move this node from the population into the set for the root */
+            set_node = avl_nodes[j];
+            avl_unlink_node(pop, set_node);
+            avl_init_node(set_node, set_node->item);
+            set_node = avl_insert_node(&sets[root], set_node);
             assert(set_node != NULL);
         }
     }
@@ -5666,18 +6670,6 @@ msp_instantaneous_bottleneck(msp_t *self, demographic_event_t *event)
         }
     }
 out:
-    if (lineages != NULL) {
-        free(lineages);
-    }
-    if (pi != NULL) {
-        free(pi);
-    }
-    if (sets != NULL) {
-        free(sets);
-    }
-    if (avl_nodes != NULL) {
-        free(avl_nodes);
-    }
     return ret;
 }
 
@@ -5906,7 +6898,13 @@ msp_dirac_get_common_ancestor_waiting_time(
     population_t *pop = &self->populations[pop_id];
     unsigned int n = (unsigned int) avl_count(&pop->ancestors[label]);
     double c = self->model.params.dirac_coalescent.c;
-    double lambda = 2 * (gsl_sf_choose(n, 2) + c);
+    double lambda;
+
+    if (msp_use_merger_tables(self, n)) {
+        lambda = self->merger_rate[n];
+    } else {
+        lambda = 2 * (gsl_sf_choose(n, 2) + c);
+    }
 
     return msp_dirac_get_common_ancestor_waiting_time_from_rate(self, pop, lambda);
 }
@@ -5921,12 +6919,22 @@ msp_dirac_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t
     segment_t *x, *y;
     double nC2, p;
     double psi = self->model.params.dirac_coalescent.psi;
+    bool binary_merger;
 
     ancestors = &self->populations[pop_id].ancestors[label];
     n = avl_count(ancestors);
-    nC2 = gsl_sf_choose(n, 2);
-    p = (nC2 / (nC2 + self->model.params.dirac_coalescent.c));
-    if (gsl_rng_uniform(self->rng) < p) {
+    if (msp_use_merger_tables(self, n)) {
+        /* Type 0 is a binary merger; type j > 0 a multiple merger of j + 1 */
+        j = (uint32_t) gsl_ran_discrete(self->rng, self->merger_size_dist[n]);
+        binary_merger = j == 0;
+        num_participants = j + 1;
+    } else {
+        nC2 = gsl_sf_choose(n, 2);
+        p = (nC2 / (nC2 + self->model.params.dirac_coalescent.c));
+        binary_merger = gsl_rng_uniform(self->rng) < p;
+        num_participants = 0;
+    }
+    if (binary_merger) {
         /* Choose x and y */
         n = avl_count(ancestors);
         j = (uint32_t) gsl_rng_uniform_int(self->rng, n);
@@ -5947,7 +6955,9 @@ msp_dirac_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t
         for (j = 0; j < 4; j++) {
             avl_init_tree(&Q[j], cmp_segment_queue, NULL);
         }
-        num_participants = gsl_ran_binomial(self->rng, psi, n);
+        if (!msp_use_merger_tables(self, n)) {
+            num_participants = gsl_ran_binomial(self->rng, psi, n);
+        }
         ret = msp_multi_merger_common_ancestor_event(
             self, ancestors, Q, num_participants);
         if (ret < 0) {
@@ -5971,16 +6981,22 @@ out:
  * Beta coalescent
  **************************************************************/
 
+/* The timescale depends only on the model parameters and the population
+ * size, so we cache it in the population until the size changes. The
+ * factor that depends only on the model parameters is computed in
+ * msp_set_simulation_model_beta.
+ */
 static double
 beta_compute_timescale(msp_t *self, population_t *pop)
 {
-    double alpha = self->model.params.beta_coalescent.alpha;
-    double truncation_point = self->model.params.beta_coalescent.truncation_point;
-    double pop_size = pop->initial_size;
-    double m = 2 + exp(alpha * log(2) + (1 - alpha) * log(3) - log(alpha - 1));
-    double timescale = exp(alpha * log(m) + (alpha - 1) * log(pop_size) - log(alpha))
-                       / gsl_sf_beta_inc(2 - alpha, alpha, truncation_point);
-    return timescale;
+    beta_coalescent_t *params = &self->model.params.beta_coalescent;
+    double alpha = params->alpha;
+
+    if (pop->timescale == 0) {
+        pop->timescale
+            = params->timescale_factor * exp((alpha - 1) * log(pop->initial_size));
+    }
+    return pop->timescale;
 }
 
 /* Given the specified rate, return the waiting time until the next common ancestor
@@ -6019,11 +7035,16 @@ msp_beta_get_common_ancestor_waiting_time(
     msp_t *self, population_id_t pop_id, label_id_t label)
 {
     population_t *pop = &self->populations[pop_id];
-    unsigned int n = (unsigned int) avl_count(&pop->ancestors[label]);
+    double n = (double) avl_count(&pop->ancestors[label]);
     /* Factor of 4 because only 1/4 of binary events result in a merger due to
      * diploidy, and 2 for consistency with the hudson model */
-    double lambda = 8 * gsl_sf_choose(n, 2);
-    double result
+    double lambda = 4 * n * (n - 1.0);
+    double result;
+
+    if (msp_use_merger_tables(self, (uint32_t) n)) {
+        lambda = self->merger_rate[(uint32_t) n];
+    }
+    result
         = msp_beta_get_common_ancestor_waiting_time_from_rate(self, pop, lambda);
     return result;
 }
@@ -6072,56 +7093,93 @@ out:
     return ret;
 }
 
-static int MSP_WARN_UNUSED
-msp_beta_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t label)
+/* Returns the probability of accepting a proposed beta coalescent event
+ * with the specified value of beta_x when there are n lineages.
+ */
+static double
+beta_compute_acceptance_probability(uint32_t n, double beta_x)
 {
-    int ret = 0;
-    uint32_t j, n, num_participants;
-    avl_tree_t *ancestors, Q[4]; /* MSVC won't let us use num_pots here */
-    double beta_x, u, increment;
-
-    for (j = 0; j < 4; j++) {
-        avl_init_tree(&Q[j], cmp_segment_queue, NULL);
-    }
-    ancestors = &self->populations[pop_id].ancestors[label];
-    n = avl_count(ancestors);
-    beta_x = ran_inc_beta(self->rng, 2.0 - self->model.params.beta_coalescent.alpha,
-        self->model.params.beta_coalescent.alpha,
-        self->model.params.beta_coalescent.truncation_point);
+    double u, term, even_sum, odd_sum;
+    double nC2 = 0.5 * n * (n - 1.0);
+    uint32_t j;
 
-    /* We calculate the probability of accepting the event */
     if (beta_x > 1e-9) {
         u = (n - 1) * log(1 - beta_x) + log(1 + (n - 1) * beta_x);
-        u = exp(log(1 - exp(u)) - 2 * log(beta_x) - gsl_sf_lnchoose(n, 2));
+        u = exp(log(1 - exp(u)) - 2 * log(beta_x) - log(nC2));
     } else {
         /* For very small values of beta_x we need a polynomial expansion
-         * for numerical stability */
-        u = 0;
-        for (j = 2; j <= n; j += 2) {
-            increment = (j - 1) * exp(gsl_sf_lnchoose(n, j) + (j - 2) * log(beta_x));
-            if (increment / u < 1e-12) {
-                /* We truncate the expansion adaptively once the increment
-                 * becomes negligible. */
-                break;
+         * for numerical stability. The terms are
+         *     t_j = (j - 1) * choose(n, j) * beta_x^(j - 2) / choose(n, 2),
+         * so that t_2 = 1 and each subsequent term can be obtained from the
+         * previous one using the ratio of the binomial coefficients. This
+         * avoids evaluating any special functions in the expansion.
+         */
+        even_sum = 0;
+        term = 1;
+        for (j = 2; j <= n; j++) {
+            if (j % 2 == 0) {
+                if (even_sum > 0 && term / even_sum < 1e-12) {
+                    /* We truncate the expansion adaptively once the increment
+                     * becomes negligible. */
+                    break;
+                }
+                even_sum += term;
             }
-            u += increment;
+            term *= beta_x * ((double) (n - j) / (j + 1.0)) * ((double) j / (j - 1.0));
         }
-        for (j = 3; j <= n; j += 2) {
-            increment = (j - 1) * exp(gsl_sf_lnchoose(n, j) + (j - 2) * log(beta_x));
-            if (increment / u < 1e-12) {
-                break;
+        odd_sum = 0;
+        term = 1;
+        for (j = 2; j <= n; j++) {
+            if (j % 2 == 1) {
+                if (term / even_sum < 1e-12) {
+                    break;
+                }
+                odd_sum += term;
             }
-            u -= increment;
+            term *= beta_x * ((double) (n - j) / (j + 1.0)) * ((double) j / (j - 1.0));
         }
-        u /= gsl_sf_choose(n, 2);
+        u = even_sum - odd_sum;
     }
+    return u;
+}
 
-    if (gsl_rng_uniform(self->rng) < u) {
-        do {
-            /* Rejection sampling for the number of participants */
-            num_participants = 2 + gsl_ran_binomial(self->rng, beta_x, n - 2);
-        } while (gsl_rng_uniform(self->rng) > 1 / gsl_sf_choose(num_participants, 2));
+static int MSP_WARN_UNUSED
+msp_beta_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t label)
+{
+    int ret = 0;
+    uint32_t j, n, num_participants;
+    avl_tree_t *ancestors, Q[4]; /* MSVC won't let us use num_pots here */
+    beta_coalescent_t *params = &self->model.params.beta_coalescent;
+    double beta_x, u;
+    bool accept;
 
+    for (j = 0; j < 4; j++) {
+        avl_init_tree(&Q[j], cmp_segment_queue, NULL);
+    }
+    ancestors = &self->populations[pop_id].ancestors[label];
+    n = avl_count(ancestors);
+    if (msp_use_merger_tables(self, n)) {
+        /* Every event is accepted, so we sample the size directly */
+        accept = true;
+        num_participants
+            = 2 + (uint32_t) gsl_ran_discrete(self->rng, self->merger_size_dist[n]);
+    } else {
+        beta_x = ran_inc_beta(self->rng, 2.0 - params->alpha, params->alpha,
+            params->truncation_point, params->truncation_beta_inc);
+        /* We calculate the probability of accepting the event */
+        u = beta_compute_acceptance_probability(n, beta_x);
+        accept = gsl_rng_uniform(self->rng) < u;
+        num_participants = 0;
+        if (accept) {
+            do {
+                /* Rejection sampling for the number of participants */
+                num_participants = 2 + gsl_ran_binomial(self->rng, beta_x, n - 2);
+            } while (gsl_rng_uniform(self->rng)
+                     > 2.0 / (num_participants * (num_participants - 1.0)));
+        }
+    }
+
+    if (accept) {
         ret = msp_multi_merger_common_ancestor_event(
             self, ancestors, Q, num_participants);
         if (ret < 0) {
@@ -6245,6 +7303,7 @@ static int
 msp_set_simulation_model(msp_t *self, int model)
 {
     int ret = 0;
+    uint32_t j;
 
     if (model != MSP_MODEL_HUDSON && model != MSP_MODEL_SMC
         && model != MSP_MODEL_SMC_PRIME && model != MSP_MODEL_DIRAC
@@ -6259,6 +7318,10 @@ msp_set_simulation_model(msp_t *self, int model)
         }
     }
     self->model.type = model;
+    /* Any cached timescales are specific to the previous model */
+    for (j = 0; j < self->num_populations; j++) {
+        self->populations[j].timescale = 0;
+    }
 
     self->get_common_ancestor_waiting_time = msp_std_get_common_ancestor_waiting_time;
     self->common_ancestor_event = msp_std_common_ancestor_event;
@@ -6326,6 +7389,8 @@ int
 msp_set_simulation_model_beta(msp_t *self, double alpha, double truncation_point)
 {
     int ret = 0;
+    double m;
+    beta_coalescent_t *params;
 
     if (alpha <= 1.0 || alpha >= 2.0) {
         ret = MSP_ERR_BAD_BETA_MODEL_ALPHA;
@@ -6342,8 +7407,13 @@ msp_set_simulation_model_beta(msp_t *self, double alpha, double truncation_point
         goto out;
     }
 
-    self->model.params.beta_coalescent.alpha = alpha;
-    self->model.params.beta_coalescent.truncation_point = truncation_point;
+    params = &self->model.params.beta_coalescent;
+    params->alpha = alpha;
+    params->truncation_point = truncation_point;
+    params->truncation_beta_inc = gsl_sf_beta_inc(2 - alpha, alpha, truncation_point);
+    m = 2 + exp(alpha * log(2) + (1 - alpha) * log(3) - log(alpha - 1));
+    params->timescale_factor
+        = exp(alpha * log(m) - log(alpha)) / params->truncation_beta_inc;
     self->get_common_ancestor_waiting_time = msp_beta_get_common_ancestor_waiting_time;
     self->common_ancestor_event = msp_beta_common_ancestor_event;
 out:
@@ -6397,3 +7467,123 @@ msp_set_simulation_model_sweep_genic_selection(msp_t *self, double position,
 out:
     return ret;
 }
+
+/**************************************************************
+ * Cloning
+ **************************************************************/
+
+/* Initialises self as a copy of the specified initialised simulator, ready
+ * to run with the specified tables and random generator. The configuration
+ * that does not change while simulating (recombination map, samples,
+ * demographic events and the initial state derived from from_ts) is shared
+ * with the source, which must therefore not be modified or freed while any
+ * of its clones are in use. Everything else, including the populations and
+ * migration matrices, is copied. When simulating from an existing tree
+ * sequence the tables are replaced by a copy of its tables; otherwise they
+ * are overwritten when the clone is reset. Pedigree simulations and attached
+ * mutation generators are not cloned.
+ */
+int MSP_WARN_UNUSED
+msp_clone(
+    msp_t *self, const msp_t *source, tsk_table_collection_t *tables, gsl_rng *rng)
+{
+    int ret = 0;
+    size_t N = source->num_populations;
+    size_t j;
+
+    memset(self, 0, sizeof(*self));
+    if (rng == NULL || tables == NULL) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    if (source->state == MSP_STATE_NEW) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    if (source->pedigree != NULL) {
+        ret = MSP_ERR_UNSUPPORTED_OPERATION;
+        goto out;
+    }
+    /* Clones of clones share with the original */
+    if (source->source != NULL) {
+        source = source->source;
+    }
+    self->source = source;
+    self->rng = rng;
+    self->tables = tables;
+
+    /* Shared configuration */
+    self->recomb_map = source->recomb_map;
+    self->num_samples = source->num_samples;
+    self->samples = source->samples;
+    self->sampling_events = source->sampling_events;
+    self->num_sampling_events = source->num_sampling_events;
+    self->demographic_events_head = source->demographic_events_head;
+    self->demographic_events_tail = source->demographic_events_tail;
+    self->from_ts = source->from_ts;
+    self->from_position = source->from_position;
+    self->initial_segments = source->initial_segments;
+    self->num_initial_segments = source->num_initial_segments;
+    self->initial_chain_heads = source->initial_chain_heads;
+    self->num_initial_chains = source->num_initial_chains;
+    self->initial_overlaps = source->initial_overlaps;
+    self->num_initial_overlaps = source->num_initial_overlaps;
+
+    /* Copied configuration */
+    self->store_migrations = source->store_migrations;
+    self->store_full_arg = source->store_full_arg;
+    self->sequence_length = source->sequence_length;
+    self->gene_conversion_rate = source->gene_conversion_rate;
+    self->gene_conversion_track_length = source->gene_conversion_track_length;
+    self->start_time = source->start_time;
+    self->avl_node_block_size = source->avl_node_block_size;
+    self->node_mapping_block_size = source->node_mapping_block_size;
+    self->segment_block_size = source->segment_block_size;
+    self->max_merger_table_lineages = source->max_merger_table_lineages;
+    memcpy(&self->initial_model, &source->initial_model, sizeof(self->initial_model));
+    memcpy(&self->model, &source->initial_model, sizeof(self->model));
+    if (self->model.type == MSP_MODEL_DIRAC) {
+        self->get_common_ancestor_waiting_time
+            = msp_dirac_get_common_ancestor_waiting_time;
+        self->common_ancestor_event = msp_dirac_common_ancestor_event;
+    } else if (self->model.type == MSP_MODEL_BETA) {
+        self->get_common_ancestor_waiting_time
+            = msp_beta_get_common_ancestor_waiting_time;
+        self->common_ancestor_event = msp_beta_common_ancestor_event;
+    } else {
+        self->get_common_ancestor_waiting_time
+            = msp_std_get_common_ancestor_waiting_time;
+        self->common_ancestor_event = msp_std_common_ancestor_event;
+    }
+    ret = msp_set_dimensions(self, N, source->num_labels);
+    if (ret != 0) {
+        goto out;
+    }
+    for (j = 0; j < N; j++) {
+        self->initial_populations[j].initial_size
+            = source->initial_populations[j].initial_size;
+        self->initial_populations[j].growth_rate
+            = source->initial_populations[j].growth_rate;
+    }
+    memcpy(self->initial_migration_matrix, source->initial_migration_matrix,
+        N * N * sizeof(*self->initial_migration_matrix));
+    avl_init_tree(&self->breakpoints, cmp_node_mapping, NULL);
+    avl_init_tree(&self->overlap_counts, cmp_node_mapping, NULL);
+    avl_init_tree(&self->non_empty_populations, cmp_pointer, NULL);
+
+    if (self->from_ts != NULL) {
+        tsk_table_collection_free(tables);
+        ret = tsk_table_collection_copy(self->from_ts->tables, tables, 0);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+    }
+    ret = msp_alloc_memory_blocks(self);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_reset(self);
+out:
+    return ret;
+}
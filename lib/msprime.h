@@ -24,6 +24,7 @@
 #include <stdbool.h>
 
 #include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
 #include <tskit.h>
 
 #include "util.h"
@@ -45,18 +46,31 @@
 #define MSP_EXIT_COALESCENCE 0
 #define MSP_EXIT_MAX_EVENTS 1
 #define MSP_EXIT_MAX_TIME 2
+#define MSP_EXIT_INTERRUPTED 3
+
+/* The interrupt handler is polled once every this many events; must be
+ * a power of two. */
+#define MSP_INTERRUPT_POLL_INTERVAL 1024
 
 #define MSP_NODE_IS_RE_EVENT (1u << 17)
 #define MSP_NODE_IS_CA_EVENT (1u << 18)
 #define MSP_NODE_IS_MIG_EVENT (1u << 19)
 #define MSP_NODE_IS_CEN_EVENT (1u << 20)
 
+/* Sections of the ms format output */
+#define MSP_MS_OUTPUT_TREES (1 << 0)
+#define MSP_MS_OUTPUT_SEGSITES (1 << 1)
+
 /* Flags for verify */
 #define MSP_VERIFY_BREAKPOINTS (1 << 1)
 
 /* Flags for mutgen */
 #define MSP_KEEP_SITES 1
 #define MSP_DISCRETE_SITES 2
+/* Draw the total number of new mutations once and then sample their edges
+ * and positions, rather than drawing a count for every edge and rate map
+ * interval. Not used for existing sites kept with MSP_KEEP_SITES. */
+#define MSP_SINGLE_PASS_PLACEMENT 4
 
 /* Pedigree states */
 #define MSP_PED_STATE_UNCLIMBED 0
@@ -98,6 +112,21 @@ typedef struct {
     uint32_t value;
 } node_mapping_t;
 
+/* A segment of the initial ancestry derived from from_ts. These are
+ * captured once when the simulation is initialised and used to restore
+ * the initial state on reset. */
+typedef struct {
+    double left;
+    double right;
+    double left_mass;
+    double right_mass;
+    double mass;
+    node_id_t value;
+    population_id_t population_id;
+    /* Index of the previous segment in the chain, or -1 */
+    tsk_id_t prev;
+} initial_segment_t;
+
 typedef struct {
     population_id_t population_id;
     double time;
@@ -107,6 +136,9 @@ typedef struct {
     double initial_size;
     double growth_rate;
     double start_time;
+    /* Model specific time scaling for the current population size. This is
+     * computed lazily and must be set to zero whenever it becomes invalid. */
+    double timescale;
     avl_tree_t *ancestors;
     tsk_size_t num_potential_destinations;
     tsk_id_t *potential_destinations;
@@ -145,6 +177,9 @@ typedef struct {
 typedef struct {
     double alpha;
     double truncation_point;
+    /* Constants derived from alpha and truncation_point when the model is set */
+    double truncation_beta_inc;
+    double timescale_factor;
 } beta_coalescent_t;
 
 typedef struct {
@@ -200,6 +235,50 @@ typedef struct {
     bool discrete;
 } recomb_map_t;
 
+/* Branch length statistics accumulated as a simulation records its edges */
+typedef struct {
+    double left;
+    double right;
+    uint32_t count;
+} branch_stats_interval_t;
+
+typedef struct {
+    branch_stats_interval_t *intervals;
+    size_t num_intervals;
+    size_t max_intervals;
+} branch_stats_ancestry_t;
+
+typedef struct {
+    double position;
+    int64_t delta;
+} branch_stats_event_t;
+
+typedef struct {
+    uint32_t num_samples;
+    double sequence_length;
+    /* Sums of branch length times span */
+    double total_branch_length;
+    double pairwise_branch_length;
+    double root_time;
+    double *afs;
+    /* The number of samples below each node over the intervals that it
+     * is still ancestral to; indexed by node ID */
+    branch_stats_ancestry_t *ancestry;
+    size_t max_nodes;
+    /* Scratch space for combining the ancestry of a parent's children */
+    branch_stats_event_t *events;
+    size_t max_events;
+    branch_stats_interval_t *remainder;
+    size_t max_remainder;
+} branch_stats_t;
+
+/* The layout of the summary returned by branch_stats_get_summary. The
+ * allele frequency spectrum follows, with entries for 0 to n samples. */
+#define MSP_BRANCH_STATS_SEGREGATING_SITES 0
+#define MSP_BRANCH_STATS_DIVERSITY 1
+#define MSP_BRANCH_STATS_TMRCA 2
+#define MSP_BRANCH_STATS_AFS 3
+
 typedef struct _msp_t {
     gsl_rng *rng;
     /* input parameters */
@@ -216,6 +295,13 @@ typedef struct _msp_t {
     sample_t *samples;
     double start_time;
     tsk_treeseq_t *from_ts;
+    /* The initial segments and overlap counts derived from from_ts */
+    initial_segment_t *initial_segments;
+    size_t num_initial_segments;
+    tsk_id_t *initial_chain_heads;
+    size_t num_initial_chains;
+    node_mapping_t *initial_overlaps;
+    size_t num_initial_overlaps;
     simulation_model_t initial_model;
     double *initial_migration_matrix;
     population_t *initial_populations;
@@ -224,6 +310,13 @@ typedef struct _msp_t {
     size_t avl_node_block_size;
     size_t node_mapping_block_size;
     size_t segment_block_size;
+    /* Tables used to sample multiple merger sizes directly, indexed by the
+     * number of lineages. These are built for the model in merger_table_model
+     * and are used when there are at most max_merger_table_lineages lineages. */
+    size_t max_merger_table_lineages;
+    simulation_model_t merger_table_model;
+    double *merger_rate;
+    gsl_ran_discrete_t **merger_size_dist;
     /* Counters for statistics */
     size_t num_re_events;
     size_t num_ca_events;
@@ -263,14 +356,57 @@ typedef struct _msp_t {
     tsk_edge_t *buffered_edges;
     size_t num_buffered_edges;
     size_t max_buffered_edges;
+    /* Scratch memory reused by events that need temporary arrays. */
+    void *scratch;
+    size_t scratch_size;
+    segment_t **merge_queue;
+    size_t max_merge_queue_size;
     /* Methods for getting the waiting time until the next common ancestor
      * event and the event are defined by the simulation model */
     double (*get_common_ancestor_waiting_time)(
         struct _msp_t *self, population_id_t pop, label_id_t label);
     int (*common_ancestor_event)(
         struct _msp_t *selt, population_id_t pop, label_id_t label);
+    /* If not NULL, mutations are placed on edges as they are flushed */
+    struct _mutgen_t *mutgen;
+    int mutation_flags;
+    /* If not NULL, statistics are accumulated from edges as they are flushed */
+    branch_stats_t *branch_stats;
+    /* If not NULL, the simulator this one was cloned from, which owns the
+     * shared configuration */
+    const struct _msp_t *source;
+    /* If not NULL, polled periodically by msp_run; a non-zero return
+     * stops the simulation with MSP_EXIT_INTERRUPTED */
+    int (*interrupt_handler)(struct _msp_t *self, void *arg);
+    void *interrupt_handler_arg;
 } msp_t;
 
+typedef int (*msp_interrupt_handler_t)(msp_t *self, void *arg);
+
+/* Receives the finished tables, or the summary statistics if the simulators
+ * have branch stats sinks, for each replicate from msp_run_replicates */
+typedef int (*msp_replicate_callback_t)(size_t replicate,
+    tsk_table_collection_t *tables, const double *summary, void *arg);
+
+/* Occurrences of this string in a provenance record template are replaced
+ * by the replicate index; the quotes make it valid JSON before substitution */
+#define MSP_REPLICATE_INDEX_PLACEHOLDER "\"@@_MSPRIME_REPLICATE_INDEX_@@\""
+
+/* Provenance and population metadata written into the tables of each
+ * replicate by msp_stamp_replicate_tables. The strings are not owned. If
+ * population_metadata_offset is NULL the populations are left as they are;
+ * otherwise the metadata of population j is population_metadata[
+ * population_metadata_offset[j]:population_metadata_offset[j + 1]]. */
+typedef struct {
+    const char *provenance_timestamp;
+    tsk_size_t provenance_timestamp_length;
+    const char *provenance_record;
+    tsk_size_t provenance_record_length;
+    const char *population_metadata;
+    const tsk_size_t *population_metadata_offset;
+    tsk_size_t num_populations;
+} msp_replicate_template_t;
+
 /* Demographic events */
 typedef struct {
     population_id_t population_id;
@@ -341,24 +477,91 @@ typedef struct {
     bool new;
 } site_t;
 
+/* A new mutation placed on an edge, before its site and alleles are known */
+typedef struct {
+    double position;
+    double time;
+    tsk_id_t edge;
+} placed_mutation_t;
+
+/* Column buffers used to append new sites and mutations to the tables in
+ * a single operation. New sites never have metadata. */
+typedef struct {
+    size_t num_sites;
+    double *position;
+    tsk_size_t *ancestral_state_offset;
+    char *ancestral_state;
+    size_t max_ancestral_state_length;
+    size_t num_mutations;
+    tsk_id_t *site;
+    tsk_id_t *node;
+    tsk_id_t *parent;
+    tsk_size_t *derived_state_offset;
+    char *derived_state;
+    size_t max_derived_state_length;
+    tsk_size_t *metadata_offset;
+    char *metadata;
+    size_t max_metadata_length;
+} mutgen_columns_t;
+
+/* The new mutations in an interval of the genome. Chunks can be generated
+ * independently of each other, each using its own random stream. */
+typedef struct {
+    double left;
+    double right;
+    gsl_rng *rng;
+    placed_mutation_t *placed;
+    placed_mutation_t *placed_buffer;
+    size_t num_placed;
+    size_t max_placed;
+    mutation_t *site_mutations;
+    size_t max_site_mutations;
+    double *edge_mass;
+    size_t max_edges;
+    /* The edges referred to by the placed mutations */
+    const tsk_edge_table_t *edges;
+    /* Set by mutgen_seek_chunks if the chunk does not cover the whole genome:
+     * the positions in the edge insertion and removal orders of the tree at
+     * left, and the IDs of the edges overlapping [left, right) in table order. */
+    tsk_id_t start_insertion;
+    tsk_id_t start_removal;
+    tsk_id_t *overlap_edges;
+    size_t num_overlap_edges;
+    size_t max_overlap_edges;
+    mutgen_columns_t columns;
+    int ret;
+} mutgen_chunk_t;
+
 typedef struct {
     size_t num_alleles;
     char **alleles;
     tsk_size_t *allele_length;
     double *root_distribution;
     double *transition_matrix;
+    /* Alias tables for sampling from each row of the transition matrix */
+    double *alias_probability;
+    tsk_id_t *alias;
+    /* The index of each single byte allele, or -1 */
+    tsk_id_t *byte_allele_index;
 } mutation_matrix_t;
 
+#define SLIM_MUTATION_METADATA_SIZE 17 // = 4 + 4 + 4 + 4 + 1
+
 typedef struct {
     int32_t mutation_type_id; // following SLiM's MutationMetadataRec
     int64_t next_mutation_id; // following SLiM's slim_mutationid_t
     tsk_blkalloc_t allocator;
+    /* The packed MutationMetadataRec added for each mutation */
+    char metadata[SLIM_MUTATION_METADATA_SIZE];
 } slim_mutator_t;
 
 typedef struct {
     uint64_t start_allele;
     uint64_t next_allele;
     tsk_blkalloc_t allocator;
+    /* The unused part of the current batch of allele memory */
+    char *batch;
+    size_t batch_remaining;
 } infinite_alleles_t;
 
 typedef struct _mutation_model_t {
@@ -376,17 +579,37 @@ typedef struct _mutation_model_t {
         const char *parent_allele, tsk_size_t parent_allele_length,
         const char *parent_metadata, tsk_size_t parent_metadata_length,
         mutation_t *mutation);
+    /* True if alleles can be chosen concurrently from different threads */
+    bool thread_safe;
 } mutation_model_t;
 
-typedef struct {
+typedef struct _mutgen_t {
     gsl_rng *rng;
     interval_map_t *rate_map;
     double start_time;
     double end_time;
     size_t block_size;
     avl_tree_t sites;
+    /* With discrete sites, sites are indexed by position in site_index
+     * instead of the AVL tree if site_index_size is nonzero. */
+    site_t **site_index;
+    size_t site_index_size;
+    size_t max_site_index_size;
     tsk_blkalloc_t allocator;
     mutation_model_t *model;
+    /* Used when there are no existing sites to keep. If num_chunks is zero
+     * a single chunk covering the genome is driven by rng. */
+    mutgen_chunk_t *chunks;
+    size_t max_chunks;
+    /* Cumulative mutation mass of the rate map at each breakpoint */
+    double *map_mass;
+    size_t num_chunks;
+    size_t num_threads;
+    /* When streaming, mutations are placed on each edge as it is produced
+     * and recorded against a copy of the edge in stream_edges. */
+    bool streaming;
+    int stream_flags;
+    tsk_edge_table_t stream_edges;
 } mutgen_t;
 
 int msp_alloc(msp_t *self, size_t num_samples, sample_t *samples,
@@ -404,11 +627,16 @@ int msp_set_simulation_model_sweep_genic_selection(msp_t *self, double position,
 
 int msp_set_store_migrations(msp_t *self, bool store_migrations);
 int msp_set_store_full_arg(msp_t *self, bool store_full_arg);
+int msp_set_mutation_generator(msp_t *self, mutgen_t *mutgen, int flags);
+int msp_set_branch_stats(msp_t *self, branch_stats_t *branch_stats);
+int msp_set_interrupt_handler(
+    msp_t *self, msp_interrupt_handler_t handler, void *handler_arg);
 int msp_set_num_populations(msp_t *self, size_t num_populations);
 int msp_set_dimensions(msp_t *self, size_t num_populations, size_t num_labels);
 int msp_set_gene_conversion_rate(msp_t *self, double rate, double track_length);
 int msp_set_node_mapping_block_size(msp_t *self, size_t block_size);
 int msp_set_segment_block_size(msp_t *self, size_t block_size);
+int msp_set_max_merger_table_lineages(msp_t *self, size_t max_lineages);
 int msp_set_avl_node_block_size(msp_t *self, size_t block_size);
 int msp_set_migration_matrix(msp_t *self, size_t size, double *migration_matrix);
 int msp_set_population_configuration(
@@ -446,6 +674,14 @@ int msp_run(msp_t *self, double max_time, unsigned long max_events);
 int msp_debug_demography(msp_t *self, double *end_time);
 int msp_finalise_tables(msp_t *self);
 int msp_reset(msp_t *self);
+int msp_clone(
+    msp_t *self, const msp_t *source, tsk_table_collection_t *tables, gsl_rng *rng);
+unsigned long msp_derive_seed(unsigned long seed, uint64_t stream);
+int msp_run_replicates(msp_t **sims, size_t num_sims, size_t start, size_t num_replicates,
+    unsigned long seed, double max_time, msp_replicate_callback_t callback,
+    void *callback_arg);
+int msp_stamp_replicate_tables(tsk_table_collection_t *tables,
+    const msp_replicate_template_t *replicate_template, size_t replicate);
 int msp_print_state(msp_t *self, FILE *out);
 int msp_free(msp_t *self);
 void msp_verify(msp_t *self, int options);
@@ -536,10 +772,30 @@ void mutation_model_print_state(mutation_model_t *self, FILE *out);
 int mutgen_alloc(mutgen_t *self, gsl_rng *rng, interval_map_t *rate_map,
     mutation_model_t *model, size_t mutation_block_size);
 int mutgen_set_time_interval(mutgen_t *self, double start_time, double end_time);
+int mutgen_set_num_chunks(mutgen_t *self, size_t num_chunks);
+int mutgen_set_num_threads(mutgen_t *self, size_t num_threads);
 int mutgen_free(mutgen_t *self);
+int mutgen_trim(mutgen_t *self);
 int mutgen_generate(mutgen_t *self, tsk_table_collection_t *tables, int flags);
+int mutgen_stream_begin(mutgen_t *self, tsk_table_collection_t *tables, int flags);
+int mutgen_stream_edge(mutgen_t *self, tsk_table_collection_t *tables, tsk_id_t edge);
+int mutgen_stream_end(mutgen_t *self, tsk_table_collection_t *tables);
 void mutgen_print_state(mutgen_t *self, FILE *out);
 
+int branch_stats_alloc(
+    branch_stats_t *self, uint32_t num_samples, double sequence_length);
+int branch_stats_free(branch_stats_t *self);
+void branch_stats_reset(branch_stats_t *self);
+int branch_stats_add_edges(branch_stats_t *self, tsk_table_collection_t *tables,
+    const tsk_edge_t *edges, size_t num_edges);
+size_t branch_stats_get_summary_size(branch_stats_t *self);
+void branch_stats_get_summary(branch_stats_t *self, double *summary);
+void branch_stats_print_state(branch_stats_t *self, FILE *out);
+
+int msp_write_ms_replicate(tsk_table_collection_t *tables, FILE *out,
+    const double *breakpoints, size_t num_breakpoints, int precision,
+    tsk_flags_t options);
+
 /* Functions exposed here for unit testing. Not part of public API. */
 int msp_multi_merger_common_ancestor_event(
     msp_t *self, avl_tree_t *ancestors, avl_tree_t *Q, uint32_t k);
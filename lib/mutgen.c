@@ -26,6 +26,10 @@
 
 #include "msprime.h"
 
+#ifdef MSP_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 static int
 cmp_site(const void *a, const void *b)
 {
@@ -49,6 +53,26 @@ cmp_mutationp(const void *a, const void *b)
     return out;
 }
 
+static int
+cmp_placed_mutation(const void *a, const void *b)
+{
+    const placed_mutation_t *ia = (const placed_mutation_t *) a;
+    const placed_mutation_t *ib = (const placed_mutation_t *) b;
+    int out = (ia->position > ib->position) - (ia->position < ib->position);
+    if (out == 0) {
+        out = (ib->time > ia->time) - (ib->time < ia->time);
+    }
+    return out;
+}
+
+static int
+cmp_edge_id(const void *a, const void *b)
+{
+    const tsk_id_t *ia = (const tsk_id_t *) a;
+    const tsk_id_t *ib = (const tsk_id_t *) b;
+    return (*ia > *ib) - (*ia < *ib);
+}
+
 static void
 insert_mutation(site_t *site, mutation_t *new)
 {
@@ -117,6 +141,28 @@ out:
     return ret;
 }
 
+/* The maximum number of digits for an unsigned 64 bit integer is 20
+ * and one byte for the NULL terminator. */
+#define MAX_UINT_BUFF_SIZE 21
+
+/* Write the decimal digits of the specified value to dest, which must have
+ * space for MAX_UINT_BUFF_SIZE - 1 bytes, and return the number written.
+ * This is much faster than snprintf, and no NULL terminator is written. */
+static size_t
+encode_uint64(uint64_t value, char *dest)
+{
+    char tmp[MAX_UINT_BUFF_SIZE];
+    size_t j = MAX_UINT_BUFF_SIZE;
+
+    do {
+        j--;
+        tmp[j] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    memcpy(dest, tmp + j, MAX_UINT_BUFF_SIZE - j);
+    return MAX_UINT_BUFF_SIZE - j;
+}
+
 /**************************
  * Mutation matrix model */
 
@@ -205,12 +251,107 @@ out:
     return ret;
 }
 
+/* Build the alias table for sampling from the specified probabilities using
+ * Vose's method. */
+static int MSP_WARN_UNUSED
+mutation_matrix_build_alias_table(
+    size_t n, const double *probs, double *alias_probability, tsk_id_t *alias)
+{
+    int ret = 0;
+    double *scaled = malloc(n * sizeof(*scaled));
+    size_t *small = malloc(n * sizeof(*small));
+    size_t *large = malloc(n * sizeof(*large));
+    size_t j, s, l, num_small, num_large;
+
+    if (scaled == NULL || small == NULL || large == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    num_small = 0;
+    num_large = 0;
+    for (j = 0; j < n; j++) {
+        scaled[j] = probs[j] * (double) n;
+        alias[j] = (tsk_id_t) j;
+        if (scaled[j] < 1.0) {
+            small[num_small] = j;
+            num_small++;
+        } else {
+            large[num_large] = j;
+            num_large++;
+        }
+    }
+    while (num_small > 0 && num_large > 0) {
+        num_small--;
+        s = small[num_small];
+        l = large[num_large - 1];
+        alias_probability[s] = scaled[s];
+        alias[s] = (tsk_id_t) l;
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+        if (scaled[l] < 1.0) {
+            num_large--;
+            small[num_small] = l;
+            num_small++;
+        }
+    }
+    /* Anything left over has probability 1 up to rounding error */
+    while (num_large > 0) {
+        num_large--;
+        alias_probability[large[num_large]] = 1.0;
+    }
+    while (num_small > 0) {
+        num_small--;
+        alias_probability[small[num_small]] = 1.0;
+    }
+out:
+    msp_safe_free(scaled);
+    msp_safe_free(small);
+    msp_safe_free(large);
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutation_matrix_build_indexes(mutation_matrix_t *self)
+{
+    int ret = 0;
+    size_t n = self->num_alleles;
+    size_t j;
+
+    self->alias_probability = malloc(n * n * sizeof(*self->alias_probability));
+    self->alias = malloc(n * n * sizeof(*self->alias));
+    self->byte_allele_index = malloc(256 * sizeof(*self->byte_allele_index));
+    if (self->alias_probability == NULL || self->alias == NULL
+        || self->byte_allele_index == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < n; j++) {
+        ret = mutation_matrix_build_alias_table(n, self->transition_matrix + j * n,
+            self->alias_probability + j * n, self->alias + j * n);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    /* Go backwards so that the first of any duplicate alleles is found */
+    memset(self->byte_allele_index, 0xff, 256 * sizeof(*self->byte_allele_index));
+    for (j = n; j > 0; j--) {
+        if (self->allele_length[j - 1] == 1) {
+            self->byte_allele_index[(unsigned char) self->alleles[j - 1][0]]
+                = (tsk_id_t)(j - 1);
+        }
+    }
+out:
+    return ret;
+}
+
 static tsk_id_t
 mutation_matrix_allele_index(mutation_matrix_t *self, const char *allele, size_t length)
 {
     tsk_id_t ret = -1;
     tsk_size_t j;
 
+    if (length == 1) {
+        return self->byte_allele_index[(unsigned char) allele[0]];
+    }
     for (j = 0; j < self->num_alleles; j++) {
         if (length == self->allele_length[j]
             && memcmp(allele, self->alleles[j], length) == 0) {
@@ -249,30 +390,30 @@ mutation_matrix_transition(mutation_model_t *self, gsl_rng *rng,
     tsk_size_t MSP_UNUSED(parent_metadata_length), mutation_t *mutation)
 {
     int ret = 0;
-    mutation_matrix_t params = self->params.mutation_matrix;
-    double u = gsl_ran_flat(rng, 0.0, 1.0);
-    double *probs;
+    mutation_matrix_t *params = &self->params.mutation_matrix;
+    const size_t n = params->num_alleles;
+    double u = gsl_ran_flat(rng, 0.0, 1.0) * (double) n;
+    size_t column;
     tsk_id_t j, pi;
 
-    pi = mutation_matrix_allele_index(&params, parent_allele, parent_allele_length);
+    pi = mutation_matrix_allele_index(params, parent_allele, parent_allele_length);
     if (pi < 0) {
         /* only error if we are actually trying to mutate an unknown allele */
         ret = MSP_ERR_UNKNOWN_ALLELE;
         goto out;
     }
-    probs = params.transition_matrix + (tsk_size_t) pi * params.num_alleles;
-    j = 0;
-    while (u > probs[j]) {
-        u -= probs[j];
-        j++;
-        assert(j < (tsk_id_t) params.num_alleles);
+    /* Sample from the row of the transition matrix using its alias table */
+    column = GSL_MIN((size_t) u, n - 1);
+    j = (tsk_id_t) column;
+    if (u - (double) column >= params->alias_probability[(size_t) pi * n + column]) {
+        j = params->alias[(size_t) pi * n + column];
     }
     ret = 1;
     if (j != pi) {
         /* Only return 0 in the case where we perform an actual transition */
         ret = 0;
-        mutation->derived_state = params.alleles[j];
-        mutation->derived_state_length = params.allele_length[j];
+        mutation->derived_state = params->alleles[j];
+        mutation->derived_state_length = params->allele_length[j];
     }
 out:
     return ret;
@@ -293,6 +434,9 @@ mutation_matrix_free(mutation_model_t *self)
     msp_safe_free(params.allele_length);
     msp_safe_free(params.root_distribution);
     msp_safe_free(params.transition_matrix);
+    msp_safe_free(params.alias_probability);
+    msp_safe_free(params.alias);
+    msp_safe_free(params.byte_allele_index);
     return 0;
 }
 
@@ -315,34 +459,28 @@ mutation_matrix_free(mutation_model_t *self)
  * typedef struct __attribute__((__packed__))  but this is not available
  * in Windows compilers, so we're just copying the info in directly */
 
-#define SLIM_MUTATION_METADATA_SIZE 17 // = 4 + 4 + 4 + 4 + 1
-
+/* The record is the same for every mutation, so it is packed once when the
+ * model is allocated and copied for each mutation. */
 static void
-copy_slim_mutation_metadata(slim_mutator_t *params, char *dest)
-{
-    size_t n;
-    int32_t *mutation_type_id;
-    float *selection_coeff;
-    int32_t *subpop_index;
-    int32_t *origin_generation;
-    int8_t *nucleotide;
-
-    n = 0;
-    mutation_type_id = (int32_t *) (dest + n);
-    *mutation_type_id = params->mutation_type_id;
-    n += sizeof(int32_t);
-    selection_coeff = (float *) (dest + n);
-    *selection_coeff = 0.0;
-    n += sizeof(float);
-    subpop_index = (int32_t *) (dest + n);
-    *subpop_index = TSK_NULL;
-    n += sizeof(int32_t);
+pack_slim_mutation_metadata(slim_mutator_t *params)
+{
+    char *dest = params->metadata;
+    int32_t mutation_type_id = params->mutation_type_id;
+    float selection_coeff = 0.0;
+    int32_t subpop_index = TSK_NULL;
     // TODO: remove this when switch to mutation time
-    origin_generation = (int32_t *) (dest + n);
-    *origin_generation = 0.0;
-    n += sizeof(int32_t);
-    nucleotide = (int8_t *) (dest + n);
-    *nucleotide = -1;
+    int32_t origin_generation = 0;
+    int8_t nucleotide = -1;
+
+    memcpy(dest, &mutation_type_id, sizeof(mutation_type_id));
+    dest += sizeof(mutation_type_id);
+    memcpy(dest, &selection_coeff, sizeof(selection_coeff));
+    dest += sizeof(selection_coeff);
+    memcpy(dest, &subpop_index, sizeof(subpop_index));
+    dest += sizeof(subpop_index);
+    memcpy(dest, &origin_generation, sizeof(origin_generation));
+    dest += sizeof(origin_generation);
+    memcpy(dest, &nucleotide, sizeof(nucleotide));
 }
 
 static void
@@ -391,15 +529,11 @@ slim_mutator_transition(mutation_model_t *self, gsl_rng *MSP_UNUSED(rng),
     int ret = 0;
     slim_mutator_t *params = &self->params.slim_mutator;
     char *buff = NULL;
-    int len;
-    /* The maximum number of digits for a signed 64 bit integer (including
-     * the leading "-") */
-    const size_t max_digits = 20;
+    size_t len;
     /* We allow for a possible comma to separate the previous element
-     * in the list, as well as a NULL byte added by snprintf. We don't bother
-     * trying to alloc the exact number of bytes needed. */
-    const size_t alloc_size = parent_allele_length + max_digits + 2;
-    const char *sep = parent_allele_length == 0 ? "" : ",";
+     * in the list. We don't bother trying to alloc the exact number of
+     * bytes needed. */
+    const size_t alloc_size = parent_allele_length + MAX_UINT_BUFF_SIZE + 1;
 
     /* Append to derived_state */
     buff = tsk_blkalloc_get(&params->allocator, alloc_size);
@@ -407,15 +541,15 @@ slim_mutator_transition(mutation_model_t *self, gsl_rng *MSP_UNUSED(rng),
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
-    len = snprintf(buff, alloc_size, "%.*s%s%" PRId64, parent_allele_length,
-        parent_allele, sep, params->next_mutation_id);
-    if (len < 0) {
-        /* Technically this can happen. Returning TSK_ERR_IO should result
-         * in Python code checking errno. */
-        ret = TSK_ERR_IO;
-        goto out;
+    memcpy(buff, parent_allele, parent_allele_length);
+    len = parent_allele_length;
+    if (parent_allele_length > 0) {
+        buff[len] = ',';
+        len++;
     }
-    assert(len < (int) alloc_size);
+    /* next_mutation_id is checked to be non-negative */
+    len += encode_uint64((uint64_t) params->next_mutation_id, buff + len);
+    assert(len < alloc_size);
     if (params->next_mutation_id == INT64_MAX) {
         ret = MSP_ERR_MUTATION_ID_OVERFLOW;
         goto out;
@@ -432,7 +566,7 @@ slim_mutator_transition(mutation_model_t *self, gsl_rng *MSP_UNUSED(rng),
         goto out;
     }
     memcpy(buff, parent_metadata, parent_metadata_length);
-    copy_slim_mutation_metadata(params, buff + parent_metadata_length);
+    memcpy(buff + parent_metadata_length, params->metadata, SLIM_MUTATION_METADATA_SIZE);
 
     mutation->metadata = buff;
     mutation->metadata_length
@@ -460,9 +594,10 @@ infinite_alleles_print_state(mutation_model_t *self, FILE *out)
     fprintf(out, "\tstart_allele:%" PRIu64 "\n", params.start_allele);
 }
 
-/* The maximum number of digits for an unsigned 64 bit integer is 20
- * and one byte for the NULL terminator. */
-#define MAX_UINT_BUFF_SIZE 21
+/* Alleles are carved from a batch of memory large enough for
+ * INFINITE_ALLELES_BATCH_SIZE alleles of the maximum length, so that we only
+ * go to the allocator once per batch. */
+#define INFINITE_ALLELES_BATCH_SIZE 256
 
 static int
 infinite_alleles_make_allele(
@@ -470,30 +605,24 @@ infinite_alleles_make_allele(
 {
     int ret = 0;
     infinite_alleles_t *params = &self->params.infinite_alleles;
-    char tmp_buff[MAX_UINT_BUFF_SIZE];
-    char *buff = NULL;
-    int num_digits;
-    tsk_size_t len;
-
-    num_digits = snprintf(tmp_buff, MAX_UINT_BUFF_SIZE, "%" PRIu64, params->next_allele);
-    if (num_digits < 0) {
-        /* Technically this can happen. Returning TSK_ERR_IO should result
-         * in Python code checking errno. */
-        ret = TSK_ERR_IO;
-        goto out;
-    }
-    len = (tsk_size_t) num_digits;
-    assert(len < MAX_UINT_BUFF_SIZE);
+    const size_t batch_size = INFINITE_ALLELES_BATCH_SIZE * MAX_UINT_BUFF_SIZE;
+    size_t len;
 
-    buff = tsk_blkalloc_get(&params->allocator, len);
-    if (buff == NULL) {
-        ret = MSP_ERR_NO_MEMORY;
-        goto out;
+    if (params->batch_remaining < MAX_UINT_BUFF_SIZE) {
+        params->batch = tsk_blkalloc_get(&params->allocator, batch_size);
+        if (params->batch == NULL) {
+            params->batch_remaining = 0;
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        params->batch_remaining = batch_size;
     }
-    memcpy(buff, tmp_buff, len);
+    len = encode_uint64(params->next_allele, params->batch);
     params->next_allele++;
-    *dest = buff;
-    *dest_length = len;
+    *dest = params->batch;
+    *dest_length = (tsk_size_t) len;
+    params->batch += len;
+    params->batch_remaining -= len;
 out:
     return ret;
 }
@@ -572,11 +701,16 @@ matrix_mutation_model_alloc(mutation_model_t *self, size_t num_alleles, char **a
     self->transition = &mutation_matrix_transition;
     self->print_state = &mutation_matrix_print_state;
     self->free = &mutation_matrix_free;
+    self->thread_safe = true;
 
     ret = mutation_matrix_check_validity(params);
     if (ret != 0) {
         goto out;
     }
+    ret = mutation_matrix_build_indexes(params);
+    if (ret != 0) {
+        goto out;
+    }
 out:
     return ret;
 }
@@ -615,6 +749,7 @@ slim_mutation_model_alloc(mutation_model_t *self, int32_t mutation_type_id,
     if (ret != 0) {
         goto out;
     }
+    pack_slim_mutation_metadata(params);
 out:
     return ret;
 }
@@ -714,16 +849,213 @@ matrix_mutation_model_factory(mutation_model_t *self, int model)
 /***********************
  * Mutation generator */
 
+static int MSP_WARN_UNUSED
+mutgen_columns_alloc(mutgen_columns_t *self, size_t max_rows)
+{
+    int ret = 0;
+
+    memset(self, 0, sizeof(*self));
+    /* The tables require non-NULL columns, even when they are empty */
+    max_rows = GSL_MAX(max_rows, 1);
+    self->max_ancestral_state_length = 1024;
+    self->max_derived_state_length = 1024;
+    self->max_metadata_length = 1024;
+    self->ancestral_state = malloc(self->max_ancestral_state_length);
+    self->derived_state = malloc(self->max_derived_state_length);
+    self->metadata = malloc(self->max_metadata_length);
+    self->position = malloc(max_rows * sizeof(*self->position));
+    self->ancestral_state_offset
+        = malloc((max_rows + 1) * sizeof(*self->ancestral_state_offset));
+    self->site = malloc(max_rows * sizeof(*self->site));
+    self->node = malloc(max_rows * sizeof(*self->node));
+    self->parent = malloc(max_rows * sizeof(*self->parent));
+    self->derived_state_offset
+        = malloc((max_rows + 1) * sizeof(*self->derived_state_offset));
+    self->metadata_offset = malloc((max_rows + 1) * sizeof(*self->metadata_offset));
+    if (self->position == NULL || self->ancestral_state_offset == NULL
+        || self->site == NULL || self->node == NULL || self->parent == NULL
+        || self->derived_state_offset == NULL || self->metadata_offset == NULL
+        || self->ancestral_state == NULL || self->derived_state == NULL
+        || self->metadata == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    self->ancestral_state_offset[0] = 0;
+    self->derived_state_offset[0] = 0;
+    self->metadata_offset[0] = 0;
+out:
+    return ret;
+}
+
+static void
+mutgen_columns_free(mutgen_columns_t *self)
+{
+    msp_safe_free(self->position);
+    msp_safe_free(self->ancestral_state_offset);
+    msp_safe_free(self->ancestral_state);
+    msp_safe_free(self->site);
+    msp_safe_free(self->node);
+    msp_safe_free(self->parent);
+    msp_safe_free(self->derived_state_offset);
+    msp_safe_free(self->derived_state);
+    msp_safe_free(self->metadata_offset);
+    msp_safe_free(self->metadata);
+}
+
+/* Appends the specified string to the buffer, setting offset[1] from offset[0]. */
+static int MSP_WARN_UNUSED
+mutgen_columns_append_string(char **buffer, size_t *max_length, tsk_size_t *offset,
+    const char *source, tsk_size_t length)
+{
+    int ret = 0;
+    size_t new_length = (size_t) offset[0] + length;
+    size_t new_max;
+    char *p;
+
+    if (new_length > *max_length) {
+        new_max = GSL_MAX(2 * *max_length, new_length);
+        p = realloc(*buffer, new_max);
+        if (p == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        *buffer = p;
+        *max_length = new_max;
+    }
+    if (length > 0) {
+        memcpy(*buffer + offset[0], source, length);
+    }
+    offset[1] = (tsk_size_t) new_length;
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_columns_add_mutation(
+    mutgen_columns_t *self, tsk_id_t site, mutation_t *mutation)
+{
+    int ret = 0;
+    size_t j = self->num_mutations;
+
+    ret = mutgen_columns_append_string(&self->derived_state,
+        &self->max_derived_state_length, self->derived_state_offset + j,
+        mutation->derived_state, mutation->derived_state_length);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = mutgen_columns_append_string(&self->metadata, &self->max_metadata_length,
+        self->metadata_offset + j, mutation->metadata, mutation->metadata_length);
+    if (ret != 0) {
+        goto out;
+    }
+    self->site[j] = site;
+    self->node[j] = mutation->node;
+    self->parent[j] = mutation->parent == NULL ? TSK_NULL : mutation->parent->id;
+    assert(self->parent[j] < (tsk_id_t) j);
+    mutation->id = (tsk_id_t) j;
+    self->num_mutations++;
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_columns_add_site(mutgen_columns_t *self, site_t *site)
+{
+    int ret = 0;
+    size_t j = self->num_sites;
+
+    ret = mutgen_columns_append_string(&self->ancestral_state,
+        &self->max_ancestral_state_length, self->ancestral_state_offset + j,
+        site->ancestral_state, site->ancestral_state_length);
+    if (ret != 0) {
+        goto out;
+    }
+    self->position[j] = site->position;
+    self->num_sites++;
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_columns_write(mutgen_columns_t *self, tsk_table_collection_t *tables)
+{
+    int ret = 0;
+
+    ret = tsk_site_table_append_columns(&tables->sites, (tsk_size_t) self->num_sites,
+        self->position, self->ancestral_state, self->ancestral_state_offset, NULL,
+        NULL);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    ret = tsk_mutation_table_append_columns(&tables->mutations,
+        (tsk_size_t) self->num_mutations, self->site, self->node, self->parent,
+        self->derived_state, self->derived_state_offset, self->metadata,
+        self->metadata_offset);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+out:
+    return ret;
+}
+
+static void
+mutgen_chunk_free(mutgen_t *self, mutgen_chunk_t *chunk)
+{
+    if (chunk->rng != NULL && chunk->rng != self->rng) {
+        gsl_rng_free(chunk->rng);
+    }
+    chunk->rng = NULL;
+    msp_safe_free(chunk->placed);
+    msp_safe_free(chunk->placed_buffer);
+    msp_safe_free(chunk->site_mutations);
+    msp_safe_free(chunk->edge_mass);
+    msp_safe_free(chunk->overlap_edges);
+    mutgen_columns_free(&chunk->columns);
+}
+
+/* Iterates over the sites in position order, from either the site index
+ * or the AVL tree. */
+typedef struct {
+    avl_node_t *avl_node;
+    size_t index;
+} site_cursor_t;
+
+static void
+mutgen_site_cursor_init(mutgen_t *self, site_cursor_t *cursor)
+{
+    cursor->avl_node = self->sites.head;
+    cursor->index = 0;
+}
+
+static site_t *
+mutgen_site_cursor_next(mutgen_t *self, site_cursor_t *cursor)
+{
+    site_t *site = NULL;
+
+    if (self->site_index_size > 0) {
+        while (site == NULL && cursor->index < self->site_index_size) {
+            site = self->site_index[cursor->index];
+            cursor->index++;
+        }
+    } else if (cursor->avl_node != NULL) {
+        site = (site_t *) cursor->avl_node->item;
+        cursor->avl_node = cursor->avl_node->next;
+    }
+    return site;
+}
+
 static void
 mutgen_check_state(mutgen_t *self)
 {
     size_t j;
-    avl_node_t *a;
+    site_cursor_t cursor;
     site_t *s;
     mutation_t *m;
 
-    for (a = self->sites.head; a != NULL; a = a->next) {
-        s = (site_t *) a->item;
+    mutgen_site_cursor_init(self, &cursor);
+    while ((s = mutgen_site_cursor_next(self, &cursor)) != NULL) {
         m = s->mutations;
         for (j = 0; j < s->mutations_length; j++) {
             assert(m != NULL);
@@ -741,7 +1073,7 @@ mutgen_check_state(mutgen_t *self)
 void
 mutgen_print_state(mutgen_t *self, FILE *out)
 {
-    avl_node_t *a;
+    site_cursor_t cursor;
     site_t *s;
     mutation_t *m;
     tsk_id_t parent_id;
@@ -754,9 +1086,10 @@ mutgen_print_state(mutgen_t *self, FILE *out)
     fprintf(out, "\tmodel:\n");
     mutation_model_print_state(self->model, out);
     tsk_blkalloc_print_state(&self->allocator, out);
+    fprintf(out, "\tsite_index_size = %d\n", (int) self->site_index_size);
 
-    for (a = self->sites.head; a != NULL; a = a->next) {
-        s = (site_t *) a->item;
+    mutgen_site_cursor_init(self, &cursor);
+    while ((s = mutgen_site_cursor_next(self, &cursor)) != NULL) {
         fprintf(out, "site:\t%f\t'%.*s'\t'%.*s'\t(%d)\t%d\n", s->position,
             (int) s->ancestral_state_length, s->ancestral_state,
             (int) s->metadata_length, s->metadata, s->new, (int) s->mutations_length);
@@ -786,8 +1119,14 @@ mutgen_alloc(mutgen_t *self, gsl_rng *rng, interval_map_t *rate_map,
     self->start_time = -DBL_MAX;
     self->end_time = DBL_MAX;
     self->block_size = block_size;
+    self->num_threads = 1;
 
     avl_init_tree(&self->sites, cmp_site, NULL);
+    ret = tsk_edge_table_init(&self->stream_edges, 0);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
     if (block_size == 0) {
         block_size = 8192;
     }
@@ -798,6 +1137,11 @@ mutgen_alloc(mutgen_t *self, gsl_rng *rng, interval_map_t *rate_map,
         ret = msp_set_tsk_error(ret);
         goto out;
     }
+    self->map_mass = malloc(rate_map->size * sizeof(*self->map_mass));
+    if (self->map_mass == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
     for (j = 0; j < rate_map->size - 1; j++) {
         if (rate_map->value[j] < 0) {
             ret = MSP_ERR_BAD_MUTATION_MAP_RATE;
@@ -811,10 +1155,47 @@ out:
 int
 mutgen_free(mutgen_t *self)
 {
+    size_t j;
+
     tsk_blkalloc_free(&self->allocator);
+    for (j = 0; j < self->max_chunks; j++) {
+        mutgen_chunk_free(self, &self->chunks[j]);
+    }
+    msp_safe_free(self->chunks);
+    msp_safe_free(self->map_mass);
+    msp_safe_free(self->site_index);
+    tsk_edge_table_free(&self->stream_edges);
     return 0;
 }
 
+/* Release the memory retained between calls to generate, returning the
+ * allocator to its initial block size. */
+int MSP_WARN_UNUSED
+mutgen_trim(mutgen_t *self)
+{
+    int ret = 0;
+    size_t block_size = GSL_MAX(self->block_size == 0 ? 8192 : self->block_size, 128);
+    size_t j;
+
+    avl_clear_tree(&self->sites);
+    tsk_blkalloc_free(&self->allocator);
+    ret = tsk_blkalloc_init(&self->allocator, block_size);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    for (j = 0; j < self->max_chunks; j++) {
+        mutgen_chunk_free(self, &self->chunks[j]);
+    }
+    msp_safe_free(self->chunks);
+    self->max_chunks = 0;
+    msp_safe_free(self->site_index);
+    self->site_index_size = 0;
+    self->max_site_index_size = 0;
+out:
+    return ret;
+}
+
 int MSP_WARN_UNUSED
 mutgen_set_time_interval(mutgen_t *self, double start_time, double end_time)
 {
@@ -830,33 +1211,64 @@ out:
     return ret;
 }
 
+/* Split the genome into the specified number of chunks, each with its own
+ * random stream derived from the main generator. The output depends on the
+ * number of chunks but not on the number of threads. If num_chunks is zero,
+ * mutations are generated using the main generator only. */
+int MSP_WARN_UNUSED
+mutgen_set_num_chunks(mutgen_t *self, size_t num_chunks)
+{
+    self->num_chunks = num_chunks;
+    return 0;
+}
+
+int MSP_WARN_UNUSED
+mutgen_set_num_threads(mutgen_t *self, size_t num_threads)
+{
+    int ret = 0;
+
+    if (num_threads < 1) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    self->num_threads = num_threads;
+out:
+    return ret;
+}
+
+/* Prepare the allocator for a call to generate. The existing memory chunks
+ * are reused if they are large enough, so that repeatedly generating
+ * mutations on small tables does not reallocate; see also mutgen_trim. */
 static int MSP_WARN_UNUSED
 mutgen_init_allocator(mutgen_t *self, tsk_table_collection_t *tables)
 {
     int ret = -1;
+    size_t block_size = self->block_size;
 
-    tsk_blkalloc_free(&self->allocator);
-    if (self->block_size == 0) {
+    if (block_size == 0) {
         /* Default */
-        self->block_size = 8192;
+        block_size = 8192;
     }
     /* This is the effective minimum */
-    self->block_size = GSL_MAX(self->block_size, 128);
+    block_size = GSL_MAX(block_size, 128);
     /* Need to make sure we have enough space to store sites and mutations. We
      * allocate ancestral and derived states, as well as a list of mutations
      * for each site. This ensures that we can always allocate the required amount.
      * We need to add one because the assert trips when the block size is equal
      * to chunk size (probably wrongly).
      */
-    self->block_size
-        = GSL_MAX(self->block_size, 1 + tables->sites.ancestral_state_length);
-    self->block_size = GSL_MAX(self->block_size, 1 + tables->sites.metadata_length);
-    self->block_size
-        = GSL_MAX(self->block_size, 1 + tables->mutations.derived_state_length);
-    self->block_size = GSL_MAX(self->block_size, 1 + tables->mutations.metadata_length);
-    self->block_size = GSL_MAX(
-        self->block_size, (1 + tables->mutations.num_rows) * sizeof(mutation_t));
-    ret = tsk_blkalloc_init(&self->allocator, self->block_size);
+    block_size = GSL_MAX(block_size, 1 + tables->sites.ancestral_state_length);
+    block_size = GSL_MAX(block_size, 1 + tables->sites.metadata_length);
+    block_size = GSL_MAX(block_size, 1 + tables->mutations.derived_state_length);
+    block_size = GSL_MAX(block_size, 1 + tables->mutations.metadata_length);
+    block_size
+        = GSL_MAX(block_size, (1 + tables->mutations.num_rows) * sizeof(mutation_t));
+    if (block_size <= self->allocator.chunk_size) {
+        ret = tsk_blkalloc_reset(&self->allocator);
+    } else {
+        tsk_blkalloc_free(&self->allocator);
+        ret = tsk_blkalloc_init(&self->allocator, block_size);
+    }
     if (ret != 0) {
         ret = msp_set_tsk_error(ret);
         goto out;
@@ -871,10 +1283,10 @@ mutgen_add_new_site(mutgen_t *self, double position, site_t **new_site)
     int ret = 0;
     avl_node_t *avl_node;
     site_t *site;
+    size_t index;
 
-    avl_node = tsk_blkalloc_get(&self->allocator, sizeof(*avl_node));
     site = tsk_blkalloc_get(&self->allocator, sizeof(*site));
-    if (site == NULL || avl_node == NULL) {
+    if (site == NULL) {
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
@@ -882,17 +1294,91 @@ mutgen_add_new_site(mutgen_t *self, double position, site_t **new_site)
     site->position = position;
     site->new = true;
 
-    avl_init_node(avl_node, site);
-    avl_node = avl_insert_node(&self->sites, avl_node);
-    if (avl_node == NULL) {
-        ret = MSP_ERR_DUPLICATE_SITE_POSITION;
-        goto out;
+    if (self->site_index_size > 0) {
+        index = (size_t) position;
+        assert(index < self->site_index_size);
+        if (self->site_index[index] != NULL) {
+            ret = MSP_ERR_DUPLICATE_SITE_POSITION;
+            goto out;
+        }
+        self->site_index[index] = site;
+    } else {
+        avl_node = tsk_blkalloc_get(&self->allocator, sizeof(*avl_node));
+        if (avl_node == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        avl_init_node(avl_node, site);
+        avl_node = avl_insert_node(&self->sites, avl_node);
+        if (avl_node == NULL) {
+            ret = MSP_ERR_DUPLICATE_SITE_POSITION;
+            goto out;
+        }
     }
     *new_site = site;
 out:
     return ret;
 }
 
+static site_t *
+mutgen_find_site(mutgen_t *self, double position)
+{
+    site_t *site = NULL;
+    avl_node_t *avl_node;
+    site_t search;
+
+    if (self->site_index_size > 0) {
+        site = self->site_index[(size_t) position];
+    } else {
+        search.position = position;
+        avl_node = avl_search(&self->sites, &search);
+        if (avl_node != NULL) {
+            site = (site_t *) avl_node->item;
+        }
+    }
+    return site;
+}
+
+/* Indexing sites by position is much faster than the AVL tree for discrete
+ * sites, but needs one pointer per unit of sequence length. We only use it
+ * if all existing sites are at integer positions within the sequence and the
+ * sequence is not too long. */
+#define MUTGEN_MAX_SITE_INDEX_SIZE (1 << 26)
+
+static int MSP_WARN_UNUSED
+mutgen_init_site_index(mutgen_t *self, tsk_table_collection_t *tables)
+{
+    int ret = 0;
+    size_t size = (size_t) ceil(tables->sequence_length);
+    const double *position = tables->sites.position;
+    site_t **site_index;
+    size_t j;
+
+    self->site_index_size = 0;
+    if (tables->sequence_length > MUTGEN_MAX_SITE_INDEX_SIZE) {
+        goto out;
+    }
+    for (j = 0; j < tables->sites.num_rows; j++) {
+        if (position[j] != floor(position[j]) || position[j] < 0
+            || position[j] >= tables->sequence_length) {
+            goto out;
+        }
+    }
+    if (size > self->max_site_index_size) {
+        site_index = realloc(self->site_index, size * sizeof(*site_index));
+        if (site_index == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->site_index = site_index;
+        self->max_site_index_size = size;
+    }
+    memset(self->site_index, 0, size * sizeof(*self->site_index));
+    self->site_index_size = size;
+out:
+    return ret;
+}
+
 static int MSP_WARN_UNUSED
 mutgen_add_existing_site(mutgen_t *self, double position, char *ancestral_state,
     tsk_size_t ancestral_state_length, char *metadata, tsk_size_t metadata_length,
@@ -1037,14 +1523,14 @@ mutgen_populate_tables(
 {
     int ret = 0;
     tsk_id_t site_id, mutation_id, parent_id;
-    avl_node_t *a;
+    site_cursor_t cursor;
     site_t *site;
     mutation_t *m;
     size_t num_mutations;
 
     site_id = 0;
-    for (a = self->sites.head; a != NULL; a = a->next) {
-        site = (site_t *) a->item;
+    mutgen_site_cursor_init(self, &cursor);
+    while ((site = mutgen_site_cursor_next(self, &cursor)) != NULL) {
         num_mutations = 0;
         for (m = site->mutations; m != NULL; m = m->next) {
             if (m->keep) {
@@ -1082,40 +1568,147 @@ out:
 }
 
 static int MSP_WARN_UNUSED
-mutgen_place_mutations(
-    mutgen_t *self, tsk_table_collection_t *tables, bool discrete_sites)
+mutgen_chunk_add_placed_mutation(
+    mutgen_chunk_t *self, tsk_id_t edge, double position, double time)
 {
-    /* The mutation model for discrete sites is that there is
-     * a unit of "mutation mass" on each integer, so that
+    int ret = 0;
+    placed_mutation_t *p;
+    size_t max_placed;
+
+    if (self->num_placed == self->max_placed) {
+        max_placed = GSL_MAX(2 * self->max_placed, 1024);
+        p = realloc(self->placed, max_placed * sizeof(*p));
+        if (p == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->placed = p;
+        p = realloc(self->placed_buffer, max_placed * sizeof(*p));
+        if (p == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->placed_buffer = p;
+        self->max_placed = max_placed;
+    }
+    p = &self->placed[self->num_placed];
+    p->edge = edge;
+    p->position = position;
+    p->time = time;
+    self->num_placed++;
+out:
+    return ret;
+}
+
+/* Place mutations on the specified interval and time span of an edge, recording
+ * them in the chunk's placed array. */
+static int MSP_WARN_UNUSED
+mutgen_chunk_place_edge_mutations(mutgen_t *self, mutgen_chunk_t *chunk,
+    tsk_id_t edge, double left, double edge_right, double branch_start,
+    double branch_end, bool discrete_sites)
+{
+    int ret = 0;
+    const double *map_position = self->rate_map->position;
+    const double *map_rate = self->rate_map->value;
+    double right, site_left, site_right, mu, position, time;
+    size_t branch_mutations, map_index, k;
+
+    map_index = interval_map_get_index(self->rate_map, left);
+    right = 0;
+    while (right != edge_right) {
+        right = GSL_MIN(edge_right, map_position[map_index + 1]);
+        site_left = discrete_sites ? ceil(left) : left;
+        site_right = discrete_sites ? ceil(right) : right;
+        mu = (branch_end - branch_start) * (site_right - site_left) * map_rate[map_index];
+        branch_mutations = gsl_ran_poisson(chunk->rng, mu);
+        for (k = 0; k < branch_mutations; k++) {
+            position = gsl_ran_flat(chunk->rng, site_left, site_right);
+            if (discrete_sites) {
+                position = floor(position);
+            }
+            time = gsl_ran_flat(chunk->rng, branch_start, branch_end);
+            ret = mutgen_chunk_add_placed_mutation(chunk, edge, position, time);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+        map_index++;
+    }
+out:
+    return ret;
+}
+
+/* Returns the number of edges that need to be considered for the chunk,
+ * setting *edge_ids to the list of their IDs, or to NULL if all edges in
+ * the table must be considered. */
+static size_t
+mutgen_chunk_get_edges(
+    mutgen_chunk_t *chunk, tsk_table_collection_t *tables, const tsk_id_t **edge_ids)
+{
+    size_t num_edges = tables->edges.num_rows;
+
+    *edge_ids = NULL;
+    if (chunk != NULL && (chunk->left > 0 || chunk->right < tables->sequence_length)) {
+        *edge_ids = chunk->overlap_edges;
+        num_edges = chunk->num_overlap_edges;
+    }
+    return num_edges;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_place_mutations(mutgen_t *self, tsk_table_collection_t *tables,
+    bool discrete_sites, mutgen_chunk_t *chunk)
+{
+    /* The mutation model for discrete sites is that there is
+     * a unit of "mutation mass" on each integer, so that
      * in a segment [left, right) there can be mutations at the
      * integers {ceil(left), ceil(left) + 1, ..., ceil(right) - 1},
-     * and the total mutation "length" is ceil(right) - ceil(left). */
+     * and the total mutation "length" is ceil(right) - ceil(left).
+     *
+     * If chunk is not NULL we only consider the chunk's interval of the
+     * genome, and just record the mutations in its placed array; sites and
+     * duplicate positions are dealt with after sorting. */
     int ret = 0;
     const double *map_position = self->rate_map->position;
     const double *map_rate = self->rate_map->value;
     size_t branch_mutations, map_index;
-    size_t j, k;
+    size_t e, j, k;
     tsk_node_table_t *nodes = &tables->nodes;
     tsk_edge_table_t *edges = &tables->edges;
     double left, right, site_left, site_right, edge_right;
     double time, mu, position;
     double branch_start, branch_end, branch_length;
     node_id_t parent, child;
-    avl_node_t *avl_node;
     site_t *site;
     double start_time = self->start_time;
     double end_time = self->end_time;
-    site_t search;
-
-    for (j = 0; j < edges->num_rows; j++) {
-        left = edges->left[j];
-        edge_right = edges->right[j];
+    gsl_rng *rng = chunk == NULL ? self->rng : chunk->rng;
+    double chunk_left = chunk == NULL ? 0 : chunk->left;
+    double chunk_right = chunk == NULL ? tables->sequence_length : chunk->right;
+    const tsk_id_t *edge_ids;
+    size_t num_edges = mutgen_chunk_get_edges(chunk, tables, &edge_ids);
+
+    for (e = 0; e < num_edges; e++) {
+        j = edge_ids == NULL ? e : (size_t) edge_ids[e];
+        if (edges->right[j] <= chunk_left || edges->left[j] >= chunk_right) {
+            continue;
+        }
+        left = GSL_MAX(edges->left[j], chunk_left);
+        edge_right = GSL_MIN(edges->right[j], chunk_right);
         parent = edges->parent[j];
         child = edges->child[j];
         assert(child >= 0 && child < (node_id_t) nodes->num_rows);
         branch_start = GSL_MAX(start_time, nodes->time[child]);
         branch_end = GSL_MIN(end_time, nodes->time[parent]);
         branch_length = branch_end - branch_start;
+        if (chunk != NULL) {
+            ret = mutgen_chunk_place_edge_mutations(self, chunk, (tsk_id_t) j, left,
+                edge_right, branch_start, branch_end, discrete_sites);
+            if (ret != 0) {
+                goto out;
+            }
+            continue;
+        }
 
         map_index = interval_map_get_index(self->rate_map, left);
         right = 0;
@@ -1124,7 +1717,7 @@ mutgen_place_mutations(
             site_left = discrete_sites ? ceil(left) : left;
             site_right = discrete_sites ? ceil(right) : right;
             mu = branch_length * (site_right - site_left) * map_rate[map_index];
-            branch_mutations = gsl_ran_poisson(self->rng, mu);
+            branch_mutations = gsl_ran_poisson(rng, mu);
             for (k = 0; k < branch_mutations; k++) {
                 /* Rejection sample positions until we get one we haven't seen before,
                  * unless we are doing discrete sites. Note that in principle this
@@ -1132,20 +1725,17 @@ mutgen_place_mutations(
                  * use up all of the doubles before it could happen and so we'd
                  * certainly run out of memory first. */
                 do {
-                    position = gsl_ran_flat(self->rng, site_left, site_right);
+                    position = gsl_ran_flat(rng, site_left, site_right);
                     if (discrete_sites) {
                         position = floor(position);
                     }
-                    search.position = position;
-                    avl_node = avl_search(&self->sites, &search);
-                } while (avl_node != NULL && !discrete_sites);
+                    site = mutgen_find_site(self, position);
+                } while (site != NULL && !discrete_sites);
 
-                time = gsl_ran_flat(self->rng, branch_start, branch_end);
+                time = gsl_ran_flat(rng, branch_start, branch_end);
                 assert(site_left <= position && position < site_right);
                 assert(branch_start <= time && time < branch_end);
-                if (avl_node != NULL) {
-                    site = (site_t *) avl_node->item;
-                } else {
+                if (site == NULL) {
                     ret = mutgen_add_new_site(self, position, &site);
                     if (ret != 0) {
                         goto out;
@@ -1163,9 +1753,132 @@ out:
     return ret;
 }
 
+#define MUTGEN_RADIX_BITS 11
+#define MUTGEN_RADIX_SIZE (1 << MUTGEN_RADIX_BITS)
+#define MUTGEN_RADIX_KEY_PASSES ((64 + MUTGEN_RADIX_BITS - 1) / MUTGEN_RADIX_BITS)
+#define MUTGEN_RADIX_PASSES (2 * MUTGEN_RADIX_KEY_PASSES)
+
+/* Returns the radix sort digit of the specified placed mutation in the
+ * specified pass. The first passes are on the time and the remaining
+ * passes on the position. */
+static inline size_t
+placed_mutation_digit(const placed_mutation_t *p, size_t pass)
+{
+    uint64_t key;
+    unsigned int shift = (unsigned int) ((pass % MUTGEN_RADIX_KEY_PASSES) * MUTGEN_RADIX_BITS);
+
+    if (pass < MUTGEN_RADIX_KEY_PASSES) {
+        /* Flip the bits of the time so that the keys sort in decreasing
+         * order of time, allowing for negative values. */
+        memcpy(&key, &p->time, sizeof(key));
+        key = (key >> 63) ? key : ~key & ~(1ULL << 63);
+    } else {
+        /* The bit patterns of non-negative doubles sort in the same order
+         * as their values. */
+        memcpy(&key, &p->position, sizeof(key));
+    }
+    return (size_t)(key >> shift) & (MUTGEN_RADIX_SIZE - 1);
+}
+
+/* Sort the placed mutations by position, and by decreasing time within
+ * each position. Large inputs use a stable LSD radix sort on the time
+ * bits and then on the position bits, skipping digits that are the same
+ * for all mutations. */
+static int MSP_WARN_UNUSED
+mutgen_chunk_sort_placed_mutations(mutgen_chunk_t *self)
+{
+    int ret = 0;
+    const size_t n = self->num_placed;
+    size_t *count = NULL;
+    size_t j, k, pass, digit, offset, tmp;
+    placed_mutation_t *src, *dest, *swap;
+
+    if (n < MUTGEN_RADIX_SIZE) {
+        qsort(self->placed, n, sizeof(*self->placed), cmp_placed_mutation);
+        goto out;
+    }
+    count = calloc(MUTGEN_RADIX_PASSES * MUTGEN_RADIX_SIZE, sizeof(*count));
+    if (count == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < n; j++) {
+        for (pass = 0; pass < MUTGEN_RADIX_PASSES; pass++) {
+            digit = placed_mutation_digit(&self->placed[j], pass);
+            count[pass * MUTGEN_RADIX_SIZE + digit]++;
+        }
+    }
+    src = self->placed;
+    dest = self->placed_buffer;
+    for (pass = 0; pass < MUTGEN_RADIX_PASSES; pass++) {
+        digit = placed_mutation_digit(&src[0], pass);
+        if (count[pass * MUTGEN_RADIX_SIZE + digit] == n) {
+            continue;
+        }
+        offset = 0;
+        for (k = 0; k < MUTGEN_RADIX_SIZE; k++) {
+            tmp = count[pass * MUTGEN_RADIX_SIZE + k];
+            count[pass * MUTGEN_RADIX_SIZE + k] = offset;
+            offset += tmp;
+        }
+        for (j = 0; j < n; j++) {
+            digit = placed_mutation_digit(&src[j], pass);
+            dest[count[pass * MUTGEN_RADIX_SIZE + digit]++] = src[j];
+        }
+        swap = src;
+        src = dest;
+        dest = swap;
+    }
+    self->placed = src;
+    self->placed_buffer = dest;
+out:
+    msp_safe_free(count);
+    return ret;
+}
+
+/* With continuous coordinates each mutation must be at a distinct site, so
+ * we redraw the positions of any mutations that collide with the previous
+ * one. This is vanishingly rare, so we just sort again afterwards. */
 static int MSP_WARN_UNUSED
-mutgen_choose_alleles(mutgen_t *self, tsk_id_t *parent, mutation_t **bottom_mutation,
-    tsk_size_t num_nodes, site_t *site)
+mutgen_resolve_duplicate_positions(mutgen_t *self, mutgen_chunk_t *chunk)
+{
+    int ret = 0;
+    const double *map_position = self->rate_map->position;
+    const tsk_edge_table_t *edges = chunk->edges;
+    placed_mutation_t *p;
+    bool duplicates = true;
+    size_t j, map_index;
+    double left, right;
+
+    while (duplicates) {
+        duplicates = false;
+        for (j = 1; j < chunk->num_placed; j++) {
+            p = &chunk->placed[j];
+            if (p->position == chunk->placed[j - 1].position) {
+                duplicates = true;
+                map_index = interval_map_get_index(self->rate_map, p->position);
+                left = GSL_MAX(edges->left[p->edge], map_position[map_index]);
+                left = GSL_MAX(left, chunk->left);
+                right = GSL_MIN(edges->right[p->edge], map_position[map_index + 1]);
+                right = GSL_MIN(right, chunk->right);
+                p->position = gsl_ran_flat(chunk->rng, left, right);
+            }
+        }
+        if (duplicates) {
+            ret = mutgen_chunk_sort_placed_mutations(chunk);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+    }
+out:
+    return ret;
+}
+
+/* The mutations at the site must be sorted into time order. */
+static int MSP_WARN_UNUSED
+mutgen_choose_alleles(mutgen_t *self, gsl_rng *rng, tsk_id_t *parent,
+    mutation_t **bottom_mutation, tsk_size_t num_nodes, site_t *site)
 {
     int ret = 0;
     const char *pa, *pm;
@@ -1173,13 +1886,9 @@ mutgen_choose_alleles(mutgen_t *self, tsk_id_t *parent, mutation_t **bottom_muta
     mutation_t *mut, *parent_mut;
     tsk_id_t u;
 
-    ret = sort_mutations(site);
-    if (ret != 0) {
-        goto out;
-    }
     if (site->new) {
         assert(site->ancestral_state == NULL);
-        ret = mutation_model_choose_root_state(self->model, self->rng, site);
+        ret = mutation_model_choose_root_state(self->model, rng, site);
         if (ret != 0) {
             goto out;
         }
@@ -1218,7 +1927,7 @@ mutgen_choose_alleles(mutgen_t *self, tsk_id_t *parent, mutation_t **bottom_muta
         if (mut->new) {
             assert(mut->derived_state == NULL);
             ret = mutation_model_transition(
-                self->model, self->rng, pa, palen, pm, pmlen, mut);
+                self->model, rng, pa, palen, pm, pmlen, mut);
             if (ret < 0) {
                 goto out;
             }
@@ -1241,20 +1950,100 @@ out:
     return ret;
 }
 
+/* Choose alleles for the new site starting at the chunk's placed mutation
+ * *next, and append it to the columns if any of its mutations are kept. */
+static int MSP_WARN_UNUSED
+mutgen_apply_placed_site(mutgen_t *self, mutgen_chunk_t *chunk,
+    const tsk_edge_table_t *edges, tsk_id_t *parent, mutation_t **bottom_mutation,
+    tsk_size_t num_nodes, size_t *next)
+{
+    int ret = 0;
+    const placed_mutation_t *placed = chunk->placed + *next;
+    mutgen_columns_t *columns = &chunk->columns;
+    size_t j, num_mutations, max_site_mutations;
+    size_t num_kept = 0;
+    mutation_t *m;
+    site_t site;
+
+    num_mutations = 1;
+    while (*next + num_mutations < chunk->num_placed
+           && placed[num_mutations].position == placed[0].position) {
+        num_mutations++;
+    }
+    if (num_mutations > chunk->max_site_mutations) {
+        max_site_mutations = GSL_MAX(2 * chunk->max_site_mutations, num_mutations);
+        m = realloc(chunk->site_mutations, max_site_mutations * sizeof(*m));
+        if (m == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        chunk->site_mutations = m;
+        chunk->max_site_mutations = max_site_mutations;
+    }
+
+    memset(&site, 0, sizeof(site));
+    site.position = placed[0].position;
+    site.new = true;
+    site.mutations = chunk->site_mutations;
+    site.mutations_length = num_mutations;
+    memset(chunk->site_mutations, 0, num_mutations * sizeof(*chunk->site_mutations));
+    for (j = 0; j < num_mutations; j++) {
+        m = &chunk->site_mutations[j];
+        m->id = TSK_NULL;
+        m->node = edges->child[placed[j].edge];
+        m->time = placed[j].time;
+        m->new = true;
+        m->next = j == num_mutations - 1 ? NULL : m + 1;
+    }
+    ret = mutgen_choose_alleles(
+        self, chunk->rng, parent, bottom_mutation, num_nodes, &site);
+    if (ret != 0) {
+        goto out;
+    }
+    for (j = 0; j < num_mutations; j++) {
+        m = &chunk->site_mutations[j];
+        if (m->keep) {
+            ret = mutgen_columns_add_mutation(
+                columns, (tsk_id_t) columns->num_sites, m);
+            if (ret != 0) {
+                goto out;
+            }
+            num_kept++;
+        }
+    }
+    /* Omit any new sites that have no mutations */
+    if (num_kept > 0) {
+        ret = mutgen_columns_add_site(columns, &site);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    *next += num_mutations;
+out:
+    return ret;
+}
+
+/* Walk the trees choosing alleles at each site. If chunk is NULL we use
+ * the sites in the AVL tree, which are written to the tables afterwards by
+ * mutgen_populate_tables; otherwise the sites are built from the chunk's
+ * sorted placed mutations and appended to its columns directly. */
 static int MSP_WARN_UNUSED
-mutgen_apply_mutations(mutgen_t *self, tsk_table_collection_t *tables)
+mutgen_apply_mutations(
+    mutgen_t *self, tsk_table_collection_t *tables, mutgen_chunk_t *chunk)
 {
     int ret = 0;
     const tsk_id_t *I, *O;
     const tsk_edge_table_t edges = tables->edges;
     const tsk_node_table_t nodes = tables->nodes;
     const tsk_id_t M = (tsk_id_t) edges.num_rows;
-    tsk_id_t tj, tk;
+    tsk_id_t tj, tk, e;
     tsk_id_t *parent = NULL;
     mutation_t **bottom_mutation = NULL;
     double left, right;
-    avl_node_t *avl_node;
+    site_cursor_t cursor;
     site_t *site;
+    size_t next_placed = 0;
+    size_t j;
 
     parent = malloc(nodes.num_rows * sizeof(*parent));
     bottom_mutation = malloc(nodes.num_rows * sizeof(*bottom_mutation));
@@ -1265,19 +2054,27 @@ mutgen_apply_mutations(mutgen_t *self, tsk_table_collection_t *tables)
     memset(parent, 0xff, nodes.num_rows * sizeof(*parent));
     memset(bottom_mutation, 0, nodes.num_rows * sizeof(*bottom_mutation));
 
-    if (!tsk_table_collection_has_index(tables, 0)) {
-        ret = tsk_table_collection_build_index(tables, 0);
-        if (ret != 0) {
-            goto out;
-        }
-    }
-
+    /* The index is built up front, as chunks may be processed concurrently */
+    assert(tsk_table_collection_has_index(tables, 0));
     I = tables->indexes.edge_insertion_order;
     O = tables->indexes.edge_removal_order;
     tj = 0;
     tk = 0;
     left = 0;
-    avl_node = self->sites.head;
+    if (chunk != NULL && chunk->left > 0) {
+        /* Start from the tree at the left of the chunk */
+        for (j = 0; j < chunk->num_overlap_edges; j++) {
+            e = chunk->overlap_edges[j];
+            if (edges.left[e] <= chunk->left) {
+                parent[edges.child[e]] = edges.parent[e];
+            }
+        }
+        tj = chunk->start_insertion;
+        tk = chunk->start_removal;
+        left = chunk->left;
+    }
+    mutgen_site_cursor_init(self, &cursor);
+    site = mutgen_site_cursor_next(self, &cursor);
     while (tj < M || left < tables->sequence_length) {
         while (tk < M && edges.right[O[tk]] == left) {
             parent[edges.child[O[tk]]] = TSK_NULL;
@@ -1296,17 +2093,28 @@ mutgen_apply_mutations(mutgen_t *self, tsk_table_collection_t *tables)
         }
 
         /* Tree is now ready. We look at each site on this tree in turn */
-        while (avl_node != NULL) {
-            site = (site_t *) avl_node->item;
-            if (site->position >= right) {
-                break;
+        while (chunk != NULL && next_placed < chunk->num_placed
+               && chunk->placed[next_placed].position < right) {
+            ret = mutgen_apply_placed_site(self, chunk, chunk->edges, parent,
+                bottom_mutation, nodes.num_rows, &next_placed);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+        while (chunk == NULL && site != NULL && site->position < right) {
+            ret = sort_mutations(site);
+            if (ret != 0) {
+                goto out;
             }
             ret = mutgen_choose_alleles(
-                self, parent, bottom_mutation, nodes.num_rows, site);
+                self, self->rng, parent, bottom_mutation, nodes.num_rows, site);
             if (ret != 0) {
                 goto out;
             }
-            avl_node = avl_node->next;
+            site = mutgen_site_cursor_next(self, &cursor);
+        }
+        if (chunk != NULL && right >= chunk->right) {
+            break;
         }
         /* Move on to the next tree */
         left = right;
@@ -1318,11 +2126,507 @@ out:
     return ret;
 }
 
+/* Compute the cumulative mutation mass of the rate map at each breakpoint.
+ * With discrete sites, the mass of an interval is its rate times the number
+ * of integers it contains. */
+static void
+mutgen_init_map_mass(mutgen_t *self, bool discrete_sites)
+{
+    const double *position = self->rate_map->position;
+    const double *rate = self->rate_map->value;
+    double left, right;
+    size_t j;
+
+    self->map_mass[0] = 0;
+    for (j = 0; j < self->rate_map->size - 1; j++) {
+        left = discrete_sites ? ceil(position[j]) : position[j];
+        right = discrete_sites ? ceil(position[j + 1]) : position[j + 1];
+        self->map_mass[j + 1] = self->map_mass[j] + rate[j] * (right - left);
+    }
+}
+
+/* Returns the mutation mass of the rate map to the left of x. */
+static double
+mutgen_get_map_mass(mutgen_t *self, double x, bool discrete_sites)
+{
+    size_t index = interval_map_get_index(self->rate_map, x);
+    double left = self->rate_map->position[index];
+    double mass = self->map_mass[index];
+
+    if (index < self->rate_map->size - 1) {
+        if (discrete_sites) {
+            x = ceil(x);
+            left = ceil(left);
+        }
+        mass += self->rate_map->value[index] * (x - left);
+    }
+    return mass;
+}
+
+/* Returns the position at which the mutation mass of the rate map reaches
+ * the specified value, which must be less than the total mass. */
+static double
+mutgen_get_map_position(mutgen_t *self, double mass, bool discrete_sites)
+{
+    const double *map_mass = self->map_mass;
+    size_t l = 0;
+    size_t r = self->rate_map->size - 1;
+    size_t m;
+    double left, position;
+
+    /* Find the last breakpoint with map_mass <= mass. This is never the end
+     * of the map, and skips over intervals with zero rate. */
+    while (l < r) {
+        m = (l + r + 1) / 2;
+        if (map_mass[m] <= mass) {
+            l = m;
+        } else {
+            r = m - 1;
+        }
+    }
+    assert(l < self->rate_map->size - 1);
+    left = self->rate_map->position[l];
+    if (discrete_sites) {
+        left = ceil(left);
+    }
+    position = left + (mass - map_mass[l]) / self->rate_map->value[l];
+    if (discrete_sites) {
+        position = floor(position);
+    }
+    return position;
+}
+
+/* Place the chunk's mutations by drawing the total number from the total
+ * mutation mass, and then choosing an edge for each mutation using a binary
+ * search over the cumulative mass of the edges. The work done is linear in
+ * the number of edges and mutations, and logarithmic in the size of the
+ * rate map. */
+static int MSP_WARN_UNUSED
+mutgen_place_mutations_single_pass(mutgen_t *self, tsk_table_collection_t *tables,
+    bool discrete_sites, mutgen_chunk_t *chunk)
+{
+    int ret = 0;
+    const tsk_node_table_t *nodes = &tables->nodes;
+    const tsk_edge_table_t *edges = &tables->edges;
+    const tsk_id_t *edge_ids;
+    const size_t num_edges = mutgen_chunk_get_edges(chunk, tables, &edge_ids);
+    double *edge_mass;
+    double left, right, site_left, site_right, branch_start, branch_end;
+    double total_mass, mass, position, time;
+    size_t e, j, k, l, r, m, num_mutations;
+
+    if (num_edges + 1 > chunk->max_edges) {
+        edge_mass = realloc(chunk->edge_mass, (num_edges + 1) * sizeof(*edge_mass));
+        if (edge_mass == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        chunk->edge_mass = edge_mass;
+        chunk->max_edges = num_edges + 1;
+    }
+    edge_mass = chunk->edge_mass;
+
+    /* edge_mass[e] is the total mass of the edges before the e-th */
+    edge_mass[0] = 0;
+    for (e = 0; e < num_edges; e++) {
+        j = edge_ids == NULL ? e : (size_t) edge_ids[e];
+        mass = 0;
+        left = GSL_MAX(edges->left[j], chunk->left);
+        right = GSL_MIN(edges->right[j], chunk->right);
+        branch_start = GSL_MAX(self->start_time, nodes->time[edges->child[j]]);
+        branch_end = GSL_MIN(self->end_time, nodes->time[edges->parent[j]]);
+        if (left < right && branch_start < branch_end) {
+            mass = (branch_end - branch_start)
+                   * (mutgen_get_map_mass(self, right, discrete_sites)
+                         - mutgen_get_map_mass(self, left, discrete_sites));
+        }
+        edge_mass[e + 1] = edge_mass[e] + mass;
+    }
+    total_mass = edge_mass[num_edges];
+
+    num_mutations = total_mass > 0 ? gsl_ran_poisson(chunk->rng, total_mass) : 0;
+    for (k = 0; k < num_mutations; k++) {
+        /* Find the last edge with edge_mass[l] <= mass */
+        mass = gsl_ran_flat(chunk->rng, 0, total_mass);
+        l = 0;
+        r = num_edges - 1;
+        while (l < r) {
+            m = (l + r + 1) / 2;
+            if (edge_mass[m] <= mass) {
+                l = m;
+            } else {
+                r = m - 1;
+            }
+        }
+        j = edge_ids == NULL ? l : (size_t) edge_ids[l];
+        left = GSL_MAX(edges->left[j], chunk->left);
+        right = GSL_MIN(edges->right[j], chunk->right);
+        site_left = discrete_sites ? ceil(left) : left;
+        site_right = discrete_sites ? ceil(right) : right;
+        mass = gsl_ran_flat(chunk->rng, mutgen_get_map_mass(self, left, discrete_sites),
+            mutgen_get_map_mass(self, right, discrete_sites));
+        position = mutgen_get_map_position(self, mass, discrete_sites);
+        /* Guard against rounding taking us outside the edge */
+        if (position < site_left) {
+            position = site_left;
+        }
+        if (position >= site_right) {
+            position = discrete_sites ? site_right - 1 : nextafter(site_right, site_left);
+        }
+        branch_start = GSL_MAX(self->start_time, nodes->time[edges->child[j]]);
+        branch_end = GSL_MIN(self->end_time, nodes->time[edges->parent[j]]);
+        time = gsl_ran_flat(chunk->rng, branch_start, branch_end);
+        ret = mutgen_chunk_add_placed_mutation(chunk, (tsk_id_t) j, position, time);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+/* Derive the seed for a chunk's random stream from the base seed and the
+ * chunk index using the splitmix64 mixing function. */
+static unsigned long
+mutgen_chunk_seed(unsigned long seed, size_t chunk_index)
+{
+    uint64_t z = (uint64_t) seed + 0x9e3779b97f4a7c15ULL * ((uint64_t) chunk_index + 1);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (unsigned long) (z ^ (z >> 31));
+}
+
+static int MSP_WARN_UNUSED
+mutgen_alloc_chunks(mutgen_t *self, size_t num_chunks)
+{
+    int ret = 0;
+    mutgen_chunk_t *chunks;
+
+    if (num_chunks > self->max_chunks) {
+        chunks = realloc(self->chunks, num_chunks * sizeof(*chunks));
+        if (chunks == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->chunks = chunks;
+        memset(self->chunks + self->max_chunks, 0,
+            (num_chunks - self->max_chunks) * sizeof(*chunks));
+        self->max_chunks = num_chunks;
+    }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_init_chunks(mutgen_t *self, double sequence_length)
+{
+    int ret = 0;
+    size_t num_chunks = GSL_MAX(self->num_chunks, 1);
+    unsigned long seed = 0;
+    mutgen_chunk_t *chunk;
+    size_t j;
+
+    ret = mutgen_alloc_chunks(self, num_chunks);
+    if (ret != 0) {
+        goto out;
+    }
+    if (self->num_chunks > 0) {
+        seed = gsl_rng_get(self->rng);
+    }
+    for (j = 0; j < num_chunks; j++) {
+        chunk = &self->chunks[j];
+        chunk->left = sequence_length * (double) j / (double) num_chunks;
+        chunk->right = sequence_length * (double) (j + 1) / (double) num_chunks;
+        if (j == num_chunks - 1) {
+            chunk->right = sequence_length;
+        }
+        chunk->num_placed = 0;
+        chunk->ret = 0;
+        if (self->num_chunks == 0) {
+            if (chunk->rng != NULL && chunk->rng != self->rng) {
+                gsl_rng_free(chunk->rng);
+            }
+            chunk->rng = self->rng;
+        } else {
+            if (chunk->rng == NULL || chunk->rng == self->rng) {
+                chunk->rng = gsl_rng_alloc(self->rng->type);
+                if (chunk->rng == NULL) {
+                    ret = MSP_ERR_NO_MEMORY;
+                    goto out;
+                }
+            }
+            gsl_rng_set(chunk->rng, mutgen_chunk_seed(seed, j));
+        }
+    }
+out:
+    return ret;
+}
+
+/* Find the tree at the left of each chunk and the edges overlapping it in a
+ * single pass along the genome, so that each chunk only considers its own
+ * part of the edge table. The edges present in the current tree are kept in
+ * the present array, with the position of each edge in present_index. */
+static int MSP_WARN_UNUSED
+mutgen_seek_chunks(mutgen_t *self, tsk_table_collection_t *tables)
+{
+    int ret = 0;
+    const tsk_edge_table_t *edges = &tables->edges;
+    const tsk_id_t M = (tsk_id_t) edges->num_rows;
+    const tsk_id_t *I, *O;
+    tsk_id_t *present = NULL;
+    tsk_id_t *present_index = NULL;
+    tsk_id_t *overlap_edges;
+    size_t num_chunks = GSL_MAX(self->num_chunks, 1);
+    size_t num_present = 0;
+    size_t max_overlap, j, k;
+    tsk_id_t tj, tk, tl, e;
+    mutgen_chunk_t *chunk;
+
+    if (num_chunks == 1) {
+        /* A single chunk covers the whole genome */
+        goto out;
+    }
+    present = malloc(GSL_MAX((size_t) M, 1) * sizeof(*present));
+    present_index = malloc(GSL_MAX((size_t) M, 1) * sizeof(*present_index));
+    if (present == NULL || present_index == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    I = tables->indexes.edge_insertion_order;
+    O = tables->indexes.edge_removal_order;
+    tj = 0;
+    tk = 0;
+    for (j = 0; j < num_chunks; j++) {
+        chunk = &self->chunks[j];
+        /* Remove the edges ending at or before left and insert those
+         * starting at or before left, in genome order. */
+        while ((tk < M && edges->right[O[tk]] <= chunk->left)
+               || (tj < M && edges->left[I[tj]] <= chunk->left)) {
+            if (tk < M && edges->right[O[tk]] <= chunk->left
+                && (tj == M || edges->right[O[tk]] <= edges->left[I[tj]])) {
+                e = O[tk];
+                num_present--;
+                k = (size_t) present_index[e];
+                present[k] = present[num_present];
+                present_index[present[k]] = (tsk_id_t) k;
+                tk++;
+            } else {
+                e = I[tj];
+                present_index[e] = (tsk_id_t) num_present;
+                present[num_present] = e;
+                num_present++;
+                tj++;
+            }
+        }
+        chunk->start_insertion = tj;
+        chunk->start_removal = tk;
+
+        /* The overlapping edges are those in the tree at left and those
+         * inserted before right */
+        tl = tj;
+        while (tl < M && edges->left[I[tl]] < chunk->right) {
+            tl++;
+        }
+        max_overlap = num_present + (size_t) (tl - tj);
+        if (max_overlap > chunk->max_overlap_edges) {
+            overlap_edges = realloc(
+                chunk->overlap_edges, max_overlap * sizeof(*overlap_edges));
+            if (overlap_edges == NULL) {
+                ret = MSP_ERR_NO_MEMORY;
+                goto out;
+            }
+            chunk->overlap_edges = overlap_edges;
+            chunk->max_overlap_edges = max_overlap;
+        }
+        memcpy(chunk->overlap_edges, present, num_present * sizeof(*present));
+        memcpy(chunk->overlap_edges + num_present, I + tj,
+            (size_t) (tl - tj) * sizeof(*I));
+        chunk->num_overlap_edges = max_overlap;
+        /* Mutations are placed in edge table order */
+        qsort(chunk->overlap_edges, chunk->num_overlap_edges, sizeof(tsk_id_t),
+            cmp_edge_id);
+    }
+out:
+    msp_safe_free(present);
+    msp_safe_free(present_index);
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_generate_chunk(mutgen_t *self, tsk_table_collection_t *tables,
+    mutgen_chunk_t *chunk, int flags, bool choose_alleles)
+{
+    int ret = 0;
+    bool discrete_sites = flags & MSP_DISCRETE_SITES;
+
+    chunk->edges = &tables->edges;
+    if (flags & MSP_SINGLE_PASS_PLACEMENT) {
+        ret = mutgen_place_mutations_single_pass(self, tables, discrete_sites, chunk);
+    } else {
+        ret = mutgen_place_mutations(self, tables, discrete_sites, chunk);
+    }
+    if (ret != 0) {
+        goto out;
+    }
+    ret = mutgen_chunk_sort_placed_mutations(chunk);
+    if (ret != 0) {
+        goto out;
+    }
+    if (!discrete_sites) {
+        ret = mutgen_resolve_duplicate_positions(self, chunk);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    mutgen_columns_free(&chunk->columns);
+    ret = mutgen_columns_alloc(&chunk->columns, chunk->num_placed);
+    if (ret != 0) {
+        goto out;
+    }
+    if (choose_alleles) {
+        ret = mutgen_apply_mutations(self, tables, chunk);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+typedef struct {
+    mutgen_t *mutgen;
+    tsk_table_collection_t *tables;
+    int flags;
+    bool choose_alleles;
+    size_t thread_index;
+    size_t num_threads;
+} mutgen_worker_t;
+
+static void *
+mutgen_worker(void *arg)
+{
+    mutgen_worker_t *worker = (mutgen_worker_t *) arg;
+    mutgen_t *self = worker->mutgen;
+    size_t num_chunks = GSL_MAX(self->num_chunks, 1);
+    mutgen_chunk_t *chunk;
+    size_t j;
+
+    for (j = worker->thread_index; j < num_chunks; j += worker->num_threads) {
+        chunk = &self->chunks[j];
+        chunk->ret = mutgen_generate_chunk(
+            self, worker->tables, chunk, worker->flags, worker->choose_alleles);
+    }
+    return NULL;
+}
+
+/* Generate the chunks, using up to num_threads threads. Chunks are assigned
+ * to threads round-robin; if a thread cannot be started, its chunks are
+ * generated in the calling thread instead. */
+static int MSP_WARN_UNUSED
+mutgen_run_chunks(
+    mutgen_t *self, tsk_table_collection_t *tables, int flags, bool choose_alleles)
+{
+    int ret = 0;
+    size_t num_chunks = GSL_MAX(self->num_chunks, 1);
+    size_t num_threads = GSL_MIN(self->num_threads, num_chunks);
+    mutgen_worker_t *workers = NULL;
+    size_t j;
+#ifdef MSP_HAVE_PTHREADS
+    pthread_t *threads = NULL;
+    bool *started = NULL;
+#endif
+
+    workers = malloc(num_threads * sizeof(*workers));
+    if (workers == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < num_threads; j++) {
+        workers[j].mutgen = self;
+        workers[j].tables = tables;
+        workers[j].flags = flags;
+        workers[j].choose_alleles = choose_alleles;
+        workers[j].thread_index = j;
+        workers[j].num_threads = num_threads;
+    }
+#ifdef MSP_HAVE_PTHREADS
+    threads = malloc(num_threads * sizeof(*threads));
+    started = calloc(num_threads, sizeof(*started));
+    if (threads == NULL || started == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 1; j < num_threads; j++) {
+        started[j] = pthread_create(&threads[j], NULL, mutgen_worker, &workers[j]) == 0;
+    }
+    mutgen_worker(&workers[0]);
+    for (j = 1; j < num_threads; j++) {
+        if (started[j]) {
+            pthread_join(threads[j], NULL);
+        } else {
+            mutgen_worker(&workers[j]);
+        }
+    }
+#else
+    for (j = 0; j < num_threads; j++) {
+        mutgen_worker(&workers[j]);
+    }
+#endif
+    for (j = 0; j < num_chunks; j++) {
+        if (self->chunks[j].ret != 0) {
+            ret = self->chunks[j].ret;
+            goto out;
+        }
+    }
+out:
+    msp_safe_free(workers);
+#ifdef MSP_HAVE_PTHREADS
+    msp_safe_free(threads);
+    msp_safe_free(started);
+#endif
+    return ret;
+}
+
+/* Append the chunks' columns to the tables in genome order, offsetting the
+ * site and parent mutation IDs by the rows written by earlier chunks. */
+static int MSP_WARN_UNUSED
+mutgen_write_chunks(mutgen_t *self, tsk_table_collection_t *tables)
+{
+    int ret = 0;
+    size_t num_chunks = GSL_MAX(self->num_chunks, 1);
+    mutgen_columns_t *columns;
+    tsk_id_t site_offset, mutation_offset;
+    size_t j, k;
+
+    for (j = 0; j < num_chunks; j++) {
+        columns = &self->chunks[j].columns;
+        site_offset = (tsk_id_t) tables->sites.num_rows;
+        mutation_offset = (tsk_id_t) tables->mutations.num_rows;
+        for (k = 0; k < columns->num_mutations; k++) {
+            columns->site[k] += site_offset;
+            if (columns->parent[k] != TSK_NULL) {
+                columns->parent[k] += mutation_offset;
+            }
+        }
+        ret = mutgen_columns_write(columns, tables);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
 int MSP_WARN_UNUSED
 mutgen_generate(mutgen_t *self, tsk_table_collection_t *tables, int flags)
 {
     int ret = 0;
     bool discrete_sites = flags & MSP_DISCRETE_SITES;
+    /* When there are no existing sites to keep we can avoid building the AVL
+     * tree of sites, and write the tables directly from the placed mutations. */
+    bool columnar = !(flags & MSP_KEEP_SITES) || tables->sites.num_rows == 0;
+    size_t j;
 
     avl_clear_tree(&self->sites);
 
@@ -1339,7 +2643,21 @@ mutgen_generate(mutgen_t *self, tsk_table_collection_t *tables, int flags)
         ret = MSP_ERR_INCOMPATIBLE_MUTATION_MAP;
         goto out;
     }
-    if (flags & MSP_KEEP_SITES) {
+    if (!tsk_table_collection_has_index(tables, 0)) {
+        ret = tsk_table_collection_build_index(tables, 0);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+    }
+    self->site_index_size = 0;
+    if (!columnar) {
+        if (discrete_sites) {
+            ret = mutgen_init_site_index(self, tables);
+            if (ret != 0) {
+                goto out;
+            }
+        }
         ret = mutgen_initialise_sites(self, tables);
         if (ret != 0) {
             goto out;
@@ -1348,24 +2666,232 @@ mutgen_generate(mutgen_t *self, tsk_table_collection_t *tables, int flags)
 
     ret = tsk_site_table_clear(&tables->sites);
     if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
         goto out;
     }
     ret = tsk_mutation_table_clear(&tables->mutations);
     if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
         goto out;
     }
-    ret = mutgen_place_mutations(self, tables, discrete_sites);
+    if (columnar) {
+        ret = mutgen_init_chunks(self, tables->sequence_length);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = mutgen_seek_chunks(self, tables);
+        if (ret != 0) {
+            goto out;
+        }
+        mutgen_init_map_mass(self, discrete_sites);
+        ret = mutgen_run_chunks(self, tables, flags, self->model->thread_safe);
+        if (ret != 0) {
+            goto out;
+        }
+        if (!self->model->thread_safe) {
+            /* Models with shared state must choose alleles in genome order */
+            for (j = 0; j < GSL_MAX(self->num_chunks, 1); j++) {
+                ret = mutgen_apply_mutations(self, tables, &self->chunks[j]);
+                if (ret != 0) {
+                    goto out;
+                }
+            }
+        }
+        ret = mutgen_write_chunks(self, tables);
+        if (ret != 0) {
+            goto out;
+        }
+    } else {
+        ret = mutgen_place_mutations(self, tables, discrete_sites, NULL);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = mutgen_apply_mutations(self, tables, NULL);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = mutgen_populate_tables(self, &tables->sites, &tables->mutations);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+/* Mutations can also be placed on the edges of a simulation as they are
+ * produced, avoiding a second pass over the edge table once it is complete.
+ * Each edge that receives mutations is copied to stream_edges, since the
+ * simulation may reorder the edge table when it is finalised. Alleles are
+ * chosen in mutgen_stream_end. */
+int MSP_WARN_UNUSED
+mutgen_stream_edge(mutgen_t *self, tsk_table_collection_t *tables, tsk_id_t edge)
+{
+    int ret = 0;
+    const tsk_edge_table_t *edges = &tables->edges;
+    const double *node_time = tables->nodes.time;
+    bool discrete_sites = self->stream_flags & MSP_DISCRETE_SITES;
+    mutgen_chunk_t *chunk;
+    size_t num_placed;
+    double branch_start, branch_end;
+
+    if (!self->streaming) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    assert(edge >= 0 && edge < (tsk_id_t) edges->num_rows);
+    chunk = &self->chunks[0];
+    num_placed = chunk->num_placed;
+    branch_start = GSL_MAX(self->start_time, node_time[edges->child[edge]]);
+    branch_end = GSL_MIN(self->end_time, node_time[edges->parent[edge]]);
+    ret = mutgen_chunk_place_edge_mutations(self, chunk,
+        (tsk_id_t) self->stream_edges.num_rows, edges->left[edge], edges->right[edge],
+        branch_start, branch_end, discrete_sites);
     if (ret != 0) {
         goto out;
     }
-    ret = mutgen_apply_mutations(self, tables);
+    if (chunk->num_placed > num_placed) {
+        ret = tsk_edge_table_add_row(&self->stream_edges, edges->left[edge],
+            edges->right[edge], edges->parent[edge], edges->child[edge]);
+        if (ret < 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+        ret = 0;
+    }
+out:
+    return ret;
+}
+
+int MSP_WARN_UNUSED
+mutgen_stream_begin(mutgen_t *self, tsk_table_collection_t *tables, int flags)
+{
+    int ret = 0;
+    mutgen_chunk_t *chunk;
+    tsk_size_t j;
+
+    if (interval_map_get_sequence_length(self->rate_map) != tables->sequence_length) {
+        ret = MSP_ERR_INCOMPATIBLE_MUTATION_MAP;
+        goto out;
+    }
+    /* Existing sites and single pass placement need the complete edge table */
+    if (flags & (MSP_KEEP_SITES | MSP_SINGLE_PASS_PLACEMENT)) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    ret = mutgen_alloc_chunks(self, 1);
     if (ret != 0) {
         goto out;
     }
-    ret = mutgen_populate_tables(self, &tables->sites, &tables->mutations);
+    chunk = &self->chunks[0];
+    if (chunk->rng != NULL && chunk->rng != self->rng) {
+        gsl_rng_free(chunk->rng);
+    }
+    chunk->rng = self->rng;
+    chunk->left = 0;
+    chunk->right = tables->sequence_length;
+    chunk->num_placed = 0;
+    chunk->ret = 0;
+    chunk->edges = &self->stream_edges;
+    ret = tsk_edge_table_clear(&self->stream_edges);
     if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
         goto out;
     }
+    self->stream_flags = flags;
+    self->streaming = true;
+    for (j = 0; j < tables->edges.num_rows; j++) {
+        ret = mutgen_stream_edge(self, tables, (tsk_id_t) j);
+        if (ret != 0) {
+            goto out;
+        }
+    }
 out:
     return ret;
 }
+
+int MSP_WARN_UNUSED
+mutgen_stream_end(mutgen_t *self, tsk_table_collection_t *tables)
+{
+    int ret = 0;
+    bool discrete_sites = self->stream_flags & MSP_DISCRETE_SITES;
+    const tsk_size_t num_nodes = tables->nodes.num_rows;
+    tsk_id_t *parent = NULL;
+    mutation_t **bottom_mutation = NULL;
+    mutgen_chunk_t *chunk;
+    size_t next_placed = 0;
+
+    if (!self->streaming) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    self->streaming = false;
+    chunk = &self->chunks[0];
+    avl_clear_tree(&self->sites);
+    self->site_index_size = 0;
+
+    ret = tsk_site_table_clear(&tables->sites);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    ret = tsk_mutation_table_clear(&tables->mutations);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    ret = mutgen_chunk_sort_placed_mutations(chunk);
+    if (ret != 0) {
+        goto out;
+    }
+    if (!discrete_sites) {
+        ret = mutgen_resolve_duplicate_positions(self, chunk);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    mutgen_columns_free(&chunk->columns);
+    ret = mutgen_columns_alloc(&chunk->columns, chunk->num_placed);
+    if (ret != 0) {
+        goto out;
+    }
+    if (discrete_sites) {
+        /* There can be many mutations at a site, so we need the trees */
+        if (!tsk_table_collection_has_index(tables, 0)) {
+            ret = tsk_table_collection_build_index(tables, 0);
+            if (ret != 0) {
+                ret = msp_set_tsk_error(ret);
+                goto out;
+            }
+        }
+        ret = mutgen_apply_mutations(self, tables, chunk);
+        if (ret != 0) {
+            goto out;
+        }
+    } else {
+        /* Every site has exactly one mutation, so its parent is always the
+         * root state and we can choose alleles without building the trees. */
+        parent = malloc(GSL_MAX(num_nodes, 1) * sizeof(*parent));
+        bottom_mutation = calloc(GSL_MAX(num_nodes, 1), sizeof(*bottom_mutation));
+        if (parent == NULL || bottom_mutation == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        memset(parent, 0xff, num_nodes * sizeof(*parent));
+        while (next_placed < chunk->num_placed) {
+            ret = mutgen_apply_placed_site(self, chunk, chunk->edges, parent,
+                bottom_mutation, num_nodes, &next_placed);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+    }
+    ret = mutgen_columns_write(&chunk->columns, tables);
+    if (ret != 0) {
+        goto out;
+    }
+out:
+    msp_safe_free(parent);
+    msp_safe_free(bottom_mutation);
+    return ret;
+}
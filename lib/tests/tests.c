@@ -225,6 +225,125 @@ test_single_locus_two_populations(void)
     tsk_table_collection_free(&tables);
 }
 
+static void
+test_mass_migration_proportions(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    uint32_t n = 100;
+    sample_t *samples = calloc(n, sizeof(sample_t));
+    tsk_table_collection_t tables;
+    recomb_map_t recomb_map;
+    double proportions[] = { 0.0, 0.1, 0.5, 0.9, 1.0 };
+    size_t j, r, num_moved, total_moved;
+    size_t num_replicates = 20;
+    double mean_moved;
+    tsk_size_t k;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, 10.0, 0.1, false);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < sizeof(proportions) / sizeof(*proportions); j++) {
+        ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_num_populations(&msp, 2);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_store_migrations(&msp, true);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_add_mass_migration(&msp, 1e-6, 0, 1, proportions[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_add_simple_bottleneck(&msp, 0.5, 1, proportions[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_add_mass_migration(&msp, 1.0, 1, 0, 1.0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        total_moved = 0;
+        for (r = 0; r < num_replicates; r++) {
+            ret = msp_reset(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+            CU_ASSERT_EQUAL(ret, 0);
+            msp_verify(&msp, 0);
+
+            num_moved = 0;
+            for (k = 0; k < msp.tables->migrations.num_rows; k++) {
+                num_moved += msp.tables->migrations.time[k] == 1e-6;
+            }
+            if (proportions[j] == 0) {
+                CU_ASSERT_EQUAL(num_moved, 0);
+            } else if (proportions[j] == 1) {
+                CU_ASSERT_TRUE(num_moved >= n);
+            }
+            total_moved += num_moved;
+        }
+        /* The number moved is binomial(n, p), so over the replicates the
+         * mean should be well within 0.1n of the expected value. */
+        mean_moved = (double) total_moved / (double) num_replicates;
+        CU_ASSERT_TRUE(fabs(mean_moved - n * proportions[j]) < 0.1 * n);
+        msp_free(&msp);
+        tsk_table_collection_clear(&tables);
+    }
+    gsl_rng_free(rng);
+    free(samples);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+test_repeated_instantaneous_bottlenecks(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    uint32_t n = 200;
+    sample_t *samples = calloc(n, sizeof(sample_t));
+    tsk_table_collection_t tables;
+    recomb_map_t recomb_map;
+    size_t scratch_size;
+    int j;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, 10.0, 0.1, false);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 1; j <= 10; j++) {
+        ret = msp_add_instantaneous_bottleneck(&msp, j * 0.01, 0, 0.05);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL(ret, 0);
+    msp_verify(&msp, 0);
+    scratch_size = msp.scratch_size;
+    CU_ASSERT_TRUE(scratch_size > 0);
+
+    /* The scratch memory is reused across replicates */
+    ret = msp_reset(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL(ret, 0);
+    msp_verify(&msp, 0);
+    CU_ASSERT_TRUE(msp.scratch != NULL);
+
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    free(samples);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
+}
+
 static void
 test_single_locus_many_populations(void)
 {
@@ -607,6 +726,63 @@ test_single_locus_historical_sample_end_time(void)
     tsk_table_collection_free(&tables);
 }
 
+static void
+test_max_time_uncoalesced_edges(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    uint32_t n = 20;
+    sample_t *samples = calloc(n, sizeof(sample_t));
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    recomb_map_t recomb_map;
+    tsk_table_collection_t tables;
+    tsk_treeseq_t ts;
+    tsk_size_t j, num_migrations;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    for (j = 0; j < n / 2; j++) {
+        samples[j].population_id = 1;
+    }
+    ret = recomb_map_alloc_uniform(&recomb_map, 100.0, 0.1, false);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_num_populations(&msp, 2);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_migration_matrix(&msp, 4, migration_matrix);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_store_migrations(&msp, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = msp_run(&msp, 0.5, ULONG_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_TIME);
+    num_migrations = tables.migrations.num_rows;
+    CU_ASSERT_TRUE(num_migrations > 0);
+    ret = msp_finalise_tables(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* The migrations must be untouched and the edges must be sorted */
+    CU_ASSERT_EQUAL(tables.migrations.num_rows, num_migrations);
+    for (j = 1; j < num_migrations; j++) {
+        CU_ASSERT_TRUE(tables.migrations.time[j - 1] <= tables.migrations.time[j]);
+    }
+    ret = tsk_treeseq_init(&ts, &tables, TSK_BUILD_INDEXES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    tsk_treeseq_free(&ts);
+
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    free(samples);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
+}
+
 static void
 test_simulator_getters_setters(void)
 {
@@ -2978,626 +3154,1640 @@ test_simulation_replicates(void)
 }
 
 static void
-test_bottleneck_simulation(void)
+verify_simulation_streamed_mutations(int flags)
 {
     int ret;
-    uint32_t n = 100;
-    uint32_t m = 100;
-    long seed = 10;
-    sample_t *samples = malloc(n * sizeof(sample_t));
-    msp_t *msp = malloc(sizeof(msp_t));
+    uint32_t n = 20;
+    double m = 50;
+    size_t j;
+    sample_t *samples = calloc(n, sizeof(sample_t));
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    double t1 = 0.1;
-    double t2 = 0.5;
-    int t1_found = 0;
+    gsl_rng *mut_rng = gsl_rng_alloc(gsl_rng_default);
+    msp_t msp;
+    mutgen_t mutgen;
+    mutation_model_t mut_model;
+    tsk_table_collection_t tables, copy;
     recomb_map_t recomb_map;
-    tsk_table_collection_t tables;
+    interval_map_t mut_map;
 
-    CU_ASSERT_FATAL(msp != NULL);
     CU_ASSERT_FATAL(samples != NULL);
-    CU_ASSERT_FATAL(rng != NULL);
-
-    ret = recomb_map_alloc_uniform(&recomb_map, m, 1 / m, true);
+    CU_ASSERT_FATAL(rng != NULL && mut_rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, m, 0.05, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = interval_map_alloc_single(&mut_map, m, 0.5);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
     ret = tsk_table_collection_init(&tables, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&mutgen, mut_rng, &mut_map, &mut_model, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_mutation_generator(&msp, &mutgen, flags);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_mutation_generator(&msp, &mutgen, flags);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_STATE);
 
-    gsl_rng_set(rng, seed);
-    memset(samples, 0, n * sizeof(sample_t));
-    ret = msp_alloc(msp, n, samples, &recomb_map, &tables, rng);
-    CU_ASSERT_EQUAL(ret, 0);
-    /* set all the block sizes to something small to provoke the memory
-     * expansions. */
-    ret = msp_set_avl_node_block_size(msp, 2);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_set_node_mapping_block_size(msp, 2);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_set_segment_block_size(msp, 2);
-    CU_ASSERT_EQUAL(ret, 0);
-    /* Add a bottleneck that does nothing at time t1 */
-    ret = msp_add_simple_bottleneck(msp, t1, 0, 0);
-    CU_ASSERT_EQUAL(ret, 0);
-    /* Add a bottleneck that coalesces everything at t2 */
-    ret = msp_add_simple_bottleneck(msp, t2, 0, 1);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_initialise(msp);
-    CU_ASSERT_EQUAL(ret, 0);
-
-    ret = msp_run(msp, t1, ULONG_MAX);
-    CU_ASSERT_EQUAL(ret, 2);
-    CU_ASSERT_FALSE(msp_is_completed(msp));
-    msp_print_state(msp, _devnull);
+    for (j = 0; j < 3; j++) {
+        gsl_rng_set(mut_rng, j + 1);
+        ret = msp_run(&msp, DBL_MAX, SIZE_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_FATAL(tables.mutations.num_rows > 0);
+        ret = tsk_table_collection_check_integrity(&tables, TSK_CHECK_ALL);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        /* Finalising again must leave the tables unchanged */
+        ret = tsk_table_collection_copy(&tables, &copy, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_FATAL(tsk_table_collection_equals(&tables, &copy));
+        tsk_table_collection_free(&copy);
 
-    ret = msp_run(msp, DBL_MAX, ULONG_MAX);
-    CU_ASSERT_EQUAL(ret, 0);
-    CU_ASSERT_TRUE(msp_is_completed(msp));
-    CU_ASSERT_EQUAL(msp->time, t2);
-    msp_verify(msp, 0);
+        /* Generating mutations afterwards with the same seed gives the
+         * same result */
+        ret = tsk_table_collection_copy(&tables, &copy, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        gsl_rng_set(mut_rng, j + 1);
+        ret = mutgen_generate(&mutgen, &copy, flags);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_TRUE(tsk_site_table_equals(&tables.sites, &copy.sites));
+        CU_ASSERT_TRUE(tsk_mutation_table_equals(&tables.mutations, &copy.mutations));
+        tsk_table_collection_free(&copy);
 
-    msp_reset(msp);
-    while ((ret = msp_run(msp, DBL_MAX, 1)) == 1) {
-        msp_verify(msp, 0);
-        if (msp->time == 0.1) {
-            t1_found = 1;
-        }
-        CU_ASSERT_EQUAL(msp_get_time(msp), msp->time);
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
     }
+    ret = msp_free(&msp);
     CU_ASSERT_EQUAL(ret, 0);
-    CU_ASSERT_TRUE(t1_found);
-    CU_ASSERT_EQUAL(msp->time, t2);
-
-    ret = msp_free(msp);
-    CU_ASSERT_EQUAL(ret, 0);
+    mutgen_free(&mutgen);
+    mutation_model_free(&mut_model);
     gsl_rng_free(rng);
-    free(msp);
+    gsl_rng_free(mut_rng);
     free(samples);
-    recomb_map_free(&recomb_map);
     tsk_table_collection_free(&tables);
+    recomb_map_free(&recomb_map);
+    interval_map_free(&mut_map);
 }
 
-#define SIMPLE_BOTTLENECK 0
-#define INSTANTANEOUS_BOTTLENECK 1
-
-typedef struct {
-    int type;
-    double time;
-    uint32_t population_id;
-    double parameter;
-} bottleneck_desc_t;
+static void
+test_simulation_streamed_mutations(void)
+{
+    verify_simulation_streamed_mutations(0);
+    verify_simulation_streamed_mutations(MSP_DISCRETE_SITES);
+}
 
 static void
-test_large_bottleneck_simulation(void)
+test_simulation_clone(void)
 {
     int ret;
-    uint32_t j;
-    uint32_t n = 1000;
-    uint32_t m = 10;
-    long seed = 10;
-    sample_t *samples = malloc(n * sizeof(sample_t));
-    msp_t *msp = malloc(sizeof(msp_t));
-    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    uint32_t num_bottlenecks = 10;
-    bottleneck_desc_t bottlenecks[num_bottlenecks];
-    double t;
+    uint32_t n = 20;
+    size_t j, k;
+    sample_t *samples = calloc(n, sizeof(sample_t));
+    double migration_matrix[] = { 0, 0.5, 0.25, 0 };
+    gsl_rng *rngs[3];
+    msp_t sims[3];
+    tsk_table_collection_t tables[3];
     recomb_map_t recomb_map;
-    tsk_table_collection_t tables;
 
-    CU_ASSERT_FATAL(msp != NULL);
     CU_ASSERT_FATAL(samples != NULL);
-    CU_ASSERT_FATAL(rng != NULL);
-
-    ret = recomb_map_alloc_uniform(&recomb_map, m, m, true);
+    for (j = 0; j < n; j++) {
+        samples[j].population_id = (population_id_t)(j % 2);
+        samples[j].time = j < n / 2 ? 0 : 0.1;
+    }
+    ret = recomb_map_alloc_uniform(&recomb_map, 10, 0.5, false);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = tsk_table_collection_init(&tables, 0);
+    for (j = 0; j < 3; j++) {
+        rngs[j] = gsl_rng_alloc(gsl_rng_default);
+        CU_ASSERT_FATAL(rngs[j] != NULL);
+        ret = tsk_table_collection_init(&tables[j], 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+    ret = msp_alloc(&sims[0], n, samples, &recomb_map, &tables[0], rngs[0]);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-
-    t = 0.1;
-    for (j = 0; j < num_bottlenecks; j++) {
-        bottlenecks[j].type = SIMPLE_BOTTLENECK;
-        bottlenecks[j].time = t;
-        bottlenecks[j].parameter = 0.1;
-        t += 0.01;
+    ret = msp_set_num_populations(&sims[0], 2);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_population_configuration(&sims[0], 1, 2, 0.5);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_migration_matrix(&sims[0], 4, migration_matrix);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_store_migrations(&sims[0], true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_add_population_parameters_change(&sims[0], 0.2, 0, 0.5, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_add_migration_rate_change(&sims[0], 0.3, -1, -1, 1.0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_add_mass_migration(&sims[0], 0.5, 1, 0, 1.0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* The source must be initialised */
+    ret = msp_clone(&sims[1], &sims[0], &tables[1], rngs[1]);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_STATE);
+    msp_free(&sims[1]);
+    ret = msp_initialise(&sims[0]);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_clone(&sims[1], &sims[0], &tables[1], NULL);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    msp_free(&sims[1]);
+    ret = msp_clone(&sims[1], &sims[0], NULL, rngs[1]);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    msp_free(&sims[1]);
+
+    ret = msp_clone(&sims[1], &sims[0], &tables[1], rngs[1]);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* Clones of clones share the original's configuration */
+    ret = msp_clone(&sims[2], &sims[1], &tables[2], rngs[2]);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(sims[2].source, &sims[0]);
+    CU_ASSERT_EQUAL(sims[1].demographic_events_head, sims[0].demographic_events_head);
+
+    for (j = 0; j < 3; j++) {
+        for (k = 0; k < 3; k++) {
+            gsl_rng_set(rngs[k], j + 1);
+            ret = msp_run(&sims[k], DBL_MAX, ULONG_MAX);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            msp_verify(&sims[k], 0);
+            ret = msp_finalise_tables(&sims[k]);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        CU_ASSERT_TRUE(tables[0].migrations.num_rows > 0);
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1]));
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[2]));
+        for (k = 0; k < 3; k++) {
+            ret = msp_reset(&sims[k]);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
     }
-    /* Set the last bottleneck to be full intensity */
-    bottlenecks[num_bottlenecks - 1].parameter = 1.0;
 
-    gsl_rng_set(rng, seed);
-    memset(samples, 0, n * sizeof(sample_t));
-    ret = msp_alloc(msp, n, samples, &recomb_map, &tables, rng);
-    CU_ASSERT_EQUAL(ret, 0);
-    for (j = 0; j < num_bottlenecks; j++) {
-        ret = msp_add_simple_bottleneck(
-            msp, bottlenecks[j].time, 0, bottlenecks[j].parameter);
+    /* Clones are freed before their source */
+    for (j = 3; j > 0; j--) {
+        ret = msp_free(&sims[j - 1]);
         CU_ASSERT_EQUAL(ret, 0);
+        tsk_table_collection_free(&tables[j - 1]);
+        gsl_rng_free(rngs[j - 1]);
     }
-    ret = msp_set_population_configuration(msp, 0, 0.25, 0);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_initialise(msp);
-    CU_ASSERT_EQUAL(ret, 0);
+    recomb_map_free(&recomb_map);
+    free(samples);
+}
 
-    for (j = 0; j < num_bottlenecks - 1; j++) {
-        ret = msp_run(msp, bottlenecks[j].time + 1e-6, ULONG_MAX);
-        CU_ASSERT_EQUAL(ret, MSP_EXIT_MAX_TIME);
-        CU_ASSERT_FALSE(msp_is_completed(msp));
-        CU_ASSERT_EQUAL(msp->time, bottlenecks[j].time + 1e-6);
-        msp_verify(msp, 0);
-    }
-    ret = msp_run(msp, DBL_MAX, ULONG_MAX);
-    CU_ASSERT_EQUAL(ret, 0);
-    CU_ASSERT_TRUE(msp_is_completed(msp));
-    CU_ASSERT_EQUAL(msp->time, bottlenecks[num_bottlenecks - 1].time);
-    msp_verify(msp, 0);
+typedef struct {
+    tsk_table_collection_t *tables;
+    double *summaries;
+    size_t summary_size;
+    size_t start;
+    size_t num_delivered;
+    size_t stop_after;
+} replicate_results_t;
 
-    /* Test out resets on partially completed simulations. */
-    ret = msp_reset(msp);
-    CU_ASSERT_EQUAL(ret, 0);
-    for (j = 0; j < num_bottlenecks - 1; j++) {
-        ret = msp_run(msp, bottlenecks[j].time, ULONG_MAX);
-        CU_ASSERT_EQUAL(ret, 2);
-    }
-    ret = msp_reset(msp);
-    msp_verify(msp, 0);
+static int
+collect_replicate(size_t replicate, tsk_table_collection_t *tables,
+    const double *summary, void *arg)
+{
+    int ret = 0;
+    replicate_results_t *results = (replicate_results_t *) arg;
 
-    ret = msp_free(msp);
-    CU_ASSERT_EQUAL(ret, 0);
-    gsl_rng_free(rng);
-    free(msp);
-    free(samples);
-    recomb_map_free(&recomb_map);
-    tsk_table_collection_free(&tables);
+    CU_ASSERT_EQUAL_FATAL(replicate, results->start + results->num_delivered);
+    if (results->summaries != NULL) {
+        CU_ASSERT_FATAL(tables == NULL && summary != NULL);
+        memcpy(results->summaries + results->num_delivered * results->summary_size,
+            summary, results->summary_size * sizeof(double));
+    } else {
+        CU_ASSERT_FATAL(tables != NULL && summary == NULL);
+        ret = tsk_table_collection_copy(
+            tables, &results->tables[results->num_delivered], 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+    results->num_delivered++;
+    if (results->num_delivered == results->stop_after) {
+        ret = MSP_ERR_GENERIC;
+    }
+    return ret;
 }
 
 static void
-test_dirac_coalescent_bad_parameters(void)
+test_simulation_run_replicates(void)
 {
-    int j;
     int ret;
-    msp_t msp;
-    unsigned int n = 10;
-    double cs[] = { -1 };
-    double psis[] = { -1e6, 1e6 };
-    sample_t *samples = malloc(n * sizeof(sample_t));
-    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    uint32_t n = 10;
+    size_t num_sims = 3;
+    size_t num_replicates = 7;
+    size_t j;
+    sample_t *samples = calloc(n, sizeof(sample_t));
+    gsl_rng **rngs = calloc(num_sims, sizeof(*rngs));
+    msp_t *sims = calloc(num_sims, sizeof(*sims));
+    msp_t **sim_ptrs = calloc(num_sims, sizeof(*sim_ptrs));
+    tsk_table_collection_t *tables = calloc(num_sims, sizeof(*tables));
+    tsk_table_collection_t *serial = calloc(num_replicates, sizeof(*serial));
+    tsk_table_collection_t *parallel = calloc(num_replicates, sizeof(*parallel));
+    replicate_results_t results;
     recomb_map_t recomb_map;
-    tsk_table_collection_t tables;
 
-    ret = recomb_map_alloc_uniform(&recomb_map, 1.0, 1, true);
+    CU_ASSERT_FATAL(samples != NULL && rngs != NULL && sims != NULL);
+    CU_ASSERT_FATAL(sim_ptrs != NULL && tables != NULL);
+    CU_ASSERT_FATAL(serial != NULL && parallel != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, 10, 0.1, false);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = tsk_table_collection_init(&tables, 0);
+    for (j = 0; j < num_sims; j++) {
+        rngs[j] = gsl_rng_alloc(gsl_rng_default);
+        CU_ASSERT_FATAL(rngs[j] != NULL);
+        ret = tsk_table_collection_init(&tables[j], 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_alloc(&sims[j], n, samples, &recomb_map, &tables[j], rngs[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        sim_ptrs[j] = &sims[j];
+    }
+
+    /* Simulators must be initialised */
+    memset(&results, 0, sizeof(results));
+    results.tables = serial;
+    ret = msp_run_replicates(
+        sim_ptrs, 1, 0, num_replicates, 1, DBL_MAX, collect_replicate, &results);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_STATE);
+    for (j = 0; j < num_sims; j++) {
+        ret = msp_initialise(&sims[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+    ret = msp_run_replicates(
+        sim_ptrs, 0, 0, num_replicates, 1, DBL_MAX, collect_replicate, &results);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    ret = msp_run_replicates(sim_ptrs, 1, 0, num_replicates, 1, DBL_MAX, NULL, NULL);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+
+    ret = msp_run_replicates(
+        sim_ptrs, 1, 0, num_replicates, 1, DBL_MAX, collect_replicate, &results);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    CU_ASSERT_FATAL(samples != NULL);
-    CU_ASSERT_FATAL(rng != NULL);
-    memset(samples, 0, n * sizeof(sample_t));
-    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(results.num_delivered, num_replicates);
+    for (j = 0; j < num_replicates; j++) {
+        CU_ASSERT_TRUE(serial[j].edges.num_rows > 0);
+        ret = tsk_table_collection_check_integrity(&serial[j], TSK_CHECK_ALL);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        if (j > 0) {
+            CU_ASSERT_FALSE(tsk_table_collection_equals(&serial[j], &serial[j - 1]));
+        }
+    }
+
+    /* The results do not depend on the number of simulators */
+    memset(&results, 0, sizeof(results));
+    results.tables = parallel;
+    ret = msp_run_replicates(sim_ptrs, num_sims, 0, num_replicates, 1, DBL_MAX,
+        collect_replicate, &results);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(results.num_delivered, num_replicates);
+    for (j = 0; j < num_replicates; j++) {
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&serial[j], &parallel[j]));
+        tsk_table_collection_free(&parallel[j]);
+    }
 
-    for (j = 0; j < sizeof(cs) / sizeof(*cs); j++) {
-        ret = msp_set_simulation_model_dirac(&msp, 0.1, cs[j]);
-        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_C);
+    /* A replicate range gives the same replicates */
+    memset(&results, 0, sizeof(results));
+    results.tables = parallel;
+    results.start = 4;
+    ret = msp_run_replicates(
+        sim_ptrs, 2, 4, num_replicates - 4, 1, DBL_MAX, collect_replicate, &results);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(results.num_delivered, num_replicates - 4);
+    for (j = 0; j < num_replicates - 4; j++) {
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&serial[j + 4], &parallel[j]));
+        tsk_table_collection_free(&parallel[j]);
     }
-    for (j = 0; j < sizeof(psis) / sizeof(*psis); j++) {
-        ret = msp_set_simulation_model_dirac(&msp, psis[j], 10);
-        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PSI);
+
+    /* An error from the callback stops the run */
+    memset(&results, 0, sizeof(results));
+    results.tables = parallel;
+    results.stop_after = 2;
+    ret = msp_run_replicates(sim_ptrs, num_sims, 0, num_replicates, 1, DBL_MAX,
+        collect_replicate, &results);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_GENERIC);
+    CU_ASSERT_EQUAL_FATAL(results.num_delivered, 2);
+    for (j = 0; j < 2; j++) {
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&serial[j], &parallel[j]));
+        tsk_table_collection_free(&parallel[j]);
     }
 
-    msp_free(&msp);
+    CU_ASSERT_NOT_EQUAL(msp_derive_seed(1, 0), msp_derive_seed(1, 1));
+    CU_ASSERT_NOT_EQUAL(msp_derive_seed(1, 0), msp_derive_seed(2, 0));
+    CU_ASSERT_TRUE(msp_derive_seed(1, 0) <= UINT32_MAX);
+
+    for (j = 0; j < num_replicates; j++) {
+        tsk_table_collection_free(&serial[j]);
+    }
+    for (j = 0; j < num_sims; j++) {
+        ret = msp_free(&sims[j]);
+        CU_ASSERT_EQUAL(ret, 0);
+        tsk_table_collection_free(&tables[j]);
+        gsl_rng_free(rngs[j]);
+    }
     recomb_map_free(&recomb_map);
-    tsk_table_collection_free(&tables);
     free(samples);
-    gsl_rng_free(rng);
+    free(rngs);
+    free(sims);
+    free(sim_ptrs);
+    free(tables);
+    free(serial);
+    free(parallel);
 }
 
+/* Checks the branch stats against the edges of the finished simulation */
 static void
-test_beta_coalescent_bad_parameters(void)
+verify_branch_stats(msp_t *msp, branch_stats_t *stats, bool coalesced)
+{
+    tsk_table_collection_t *tables = msp->tables;
+    double L = tables->sequence_length;
+    double n = (double) stats->num_samples;
+    double *summary = malloc(branch_stats_get_summary_size(stats) * sizeof(double));
+    double *afs = summary + MSP_BRANCH_STATS_AFS;
+    double total = 0;
+    double pairwise = 0;
+    double max_time = 0;
+    double tol = 1e-9;
+    size_t j;
+    tsk_id_t parent, child;
+
+    CU_ASSERT_FATAL(summary != NULL);
+    CU_ASSERT_EQUAL_FATAL(branch_stats_get_summary_size(stats),
+        MSP_BRANCH_STATS_AFS + stats->num_samples + 1);
+    branch_stats_get_summary(stats, summary);
+    branch_stats_print_state(stats, _devnull);
+
+    for (j = 0; j < tables->edges.num_rows; j++) {
+        parent = tables->edges.parent[j];
+        child = tables->edges.child[j];
+        total += (tables->nodes.time[parent] - tables->nodes.time[child])
+                 * (tables->edges.right[j] - tables->edges.left[j]);
+    }
+    for (j = 0; j < tables->nodes.num_rows; j++) {
+        max_time = GSL_MAX(max_time, tables->nodes.time[j]);
+    }
+    CU_ASSERT_DOUBLE_EQUAL(
+        summary[MSP_BRANCH_STATS_SEGREGATING_SITES], total / L, tol * total);
+    CU_ASSERT_EQUAL(afs[0], 0);
+    CU_ASSERT_EQUAL(afs[stats->num_samples], 0);
+    total = 0;
+    for (j = 1; j < stats->num_samples; j++) {
+        CU_ASSERT_TRUE(afs[j] >= 0);
+        total += afs[j];
+        pairwise += afs[j] * (double) j * (n - (double) j) / (n * (n - 1) / 2);
+    }
+    CU_ASSERT_DOUBLE_EQUAL(
+        summary[MSP_BRANCH_STATS_SEGREGATING_SITES], total, tol * total);
+    CU_ASSERT_DOUBLE_EQUAL(summary[MSP_BRANCH_STATS_DIVERSITY], pairwise, tol * total);
+    CU_ASSERT_TRUE(summary[MSP_BRANCH_STATS_TMRCA] >= 0);
+    CU_ASSERT_TRUE(summary[MSP_BRANCH_STATS_TMRCA] <= max_time * (1 + tol));
+    if (coalesced) {
+        CU_ASSERT_TRUE(summary[MSP_BRANCH_STATS_TMRCA] > 0);
+    }
+    if (coalesced && recomb_map_get_total_recombination_rate(&msp->recomb_map) == 0) {
+        CU_ASSERT_DOUBLE_EQUAL(summary[MSP_BRANCH_STATS_TMRCA], max_time, tol);
+        /* The afs of a single tree with n = 2 is the branch length */
+        if (stats->num_samples == 2) {
+            CU_ASSERT_DOUBLE_EQUAL(afs[1], 2 * max_time, tol);
+        }
+    }
+    free(summary);
+}
+
+static void
+test_branch_stats_simulation(void)
 {
-    int j;
     int ret;
-    msp_t msp;
-    unsigned int n = 10;
-    double alphas[] = { -1e6, 0, 0.001, 1.0, 2.0, 1e6 };
-    double truncation_points[] = { -1e6, 0, 1.001, 1e6 };
-    sample_t *samples = malloc(n * sizeof(sample_t));
+    uint32_t n = 20;
+    size_t j, k;
+    double L = 100;
+    double recombination_rate[] = { 0, 0.1, 0.1, 0.1, 0 };
+    int model[] = { MSP_MODEL_HUDSON, MSP_MODEL_HUDSON, MSP_MODEL_HUDSON,
+        MSP_MODEL_DTWF, MSP_MODEL_HUDSON };
+    bool full_arg[] = { false, false, true, false, false };
+    uint32_t sample_size[] = { 20, 20, 20, 20, 2 };
+    sample_t *samples = calloc(n, sizeof(sample_t));
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    recomb_map_t recomb_map;
+    msp_t msp;
+    branch_stats_t stats;
     tsk_table_collection_t tables;
+    recomb_map_t recomb_map;
 
-    ret = recomb_map_alloc_uniform(&recomb_map, 1.0, 1, true);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = tsk_table_collection_init(&tables, 0);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
     CU_ASSERT_FATAL(samples != NULL);
     CU_ASSERT_FATAL(rng != NULL);
-    memset(samples, 0, n * sizeof(sample_t));
-    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-
-    for (j = 0; j < sizeof(alphas) / sizeof(*alphas); j++) {
-        ret = msp_set_simulation_model_beta(&msp, alphas[j], 1);
-        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_BETA_MODEL_ALPHA);
+    /* Include some ancient samples */
+    for (j = n / 2; j < n; j++) {
+        samples[j].time = 0.01 * (double) j;
     }
-    for (j = 0; j < sizeof(truncation_points) / sizeof(*truncation_points); j++) {
-        ret = msp_set_simulation_model_beta(&msp, 1.5, truncation_points[j]);
-        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_TRUNCATION_POINT);
+    for (j = 0; j < sizeof(model) / sizeof(*model); j++) {
+        gsl_rng_set(rng, j + 1);
+        ret = recomb_map_alloc_uniform(&recomb_map, L, recombination_rate[j], false);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = tsk_table_collection_init(&tables, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_alloc(&msp, sample_size[j], samples, &recomb_map, &tables, rng);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        if (model[j] == MSP_MODEL_DTWF) {
+            ret = msp_set_simulation_model_dtwf(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_population_configuration(&msp, 0, 100, 0);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        ret = msp_set_store_full_arg(&msp, full_arg[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        ret = branch_stats_alloc(&stats, sample_size[j] + 1, L);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_branch_stats(&msp, &stats);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+        branch_stats_free(&stats);
+        ret = branch_stats_alloc(&stats, sample_size[j], L / 2);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_branch_stats(&msp, &stats);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+        branch_stats_free(&stats);
+
+        ret = branch_stats_alloc(&stats, sample_size[j], L);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_branch_stats(&msp, &stats);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        for (k = 0; k < 3; k++) {
+            ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_branch_stats(&msp, NULL);
+            CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_STATE);
+            ret = msp_finalise_tables(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            verify_branch_stats(&msp, &stats, true);
+            ret = msp_reset(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        msp_free(&msp);
+        branch_stats_free(&stats);
+        tsk_table_collection_free(&tables);
+        recomb_map_free(&recomb_map);
     }
 
-    msp_free(&msp);
-    recomb_map_free(&recomb_map);
-    tsk_table_collection_free(&tables);
-    free(samples);
+    /* Bad parameters */
+    ret = branch_stats_alloc(&stats, 1, L);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    branch_stats_free(&stats);
+    ret = branch_stats_alloc(&stats, 2, 0);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    branch_stats_free(&stats);
+
     gsl_rng_free(rng);
+    free(samples);
 }
 
 static void
-test_multiple_mergers_simulation(void)
+test_branch_stats_time_limit(void)
 {
     int ret;
-    size_t j, k, o, p;
     uint32_t n = 10;
-    uint32_t m = 10;
-    long seed = 10;
-    bool store_full_arg[] = { true, false };
-    /* These simulations can be slow, so just choose a few param combinations */
-    double beta_params[][2] = { { 1.1, 0.5 }, { 1.99, 1 } };
-    /* TODO what are good psi parameters here? */
-    double psi_params[][2] = { { 0.9, 10 }, { 0.1, 1 } };
-    sample_t *samples = malloc(n * sizeof(sample_t));
-    msp_t *msp = malloc(sizeof(msp_t));
+    sample_t *samples = calloc(n, sizeof(sample_t));
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    recomb_map_t recomb_map;
+    msp_t msp;
+    branch_stats_t stats;
     tsk_table_collection_t tables;
+    recomb_map_t recomb_map;
 
-    CU_ASSERT_FATAL(msp != NULL);
     CU_ASSERT_FATAL(samples != NULL);
     CU_ASSERT_FATAL(rng != NULL);
-    ret = recomb_map_alloc_uniform(&recomb_map, m, m, true);
+    ret = recomb_map_alloc_uniform(&recomb_map, 10, 1, false);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
     ret = tsk_table_collection_init(&tables, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = branch_stats_alloc(&stats, n, 10);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_branch_stats(&msp, &stats);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    for (j = 0; j < 2; j++) {
-        if (j == 0) {
-            o = sizeof(psi_params) / sizeof(*psi_params);
-        } else if (j == 1) {
-            o = sizeof(beta_params) / sizeof(*beta_params);
-        }
-        for (k = 0; k < sizeof(store_full_arg) / sizeof(bool); k++) {
-            for (p = 0; p < o; p++) {
-                gsl_rng_set(rng, seed);
-                /* TODO check non-zero sample times here to make sure they fail. */
-                memset(samples, 0, n * sizeof(sample_t));
-                tsk_table_collection_clear(&tables);
-                ret = msp_alloc(msp, n, samples, &recomb_map, &tables, rng);
-                CU_ASSERT_EQUAL(ret, 0);
-                if (j == 0) {
-                    ret = msp_set_simulation_model_dirac(
-                        msp, psi_params[p][0], psi_params[p][1]);
-                } else {
-                    ret = msp_set_simulation_model_beta(
-                        msp, beta_params[p][0], beta_params[p][1]);
-                }
-                CU_ASSERT_EQUAL(ret, 0);
-                /* TODO check for adding various complications like multiple
-                 * populations etc to ensure they fail.
-                 */
-                ret = msp_set_store_full_arg(msp, store_full_arg[k]);
-                CU_ASSERT_EQUAL(ret, 0);
-                ret = msp_initialise(msp);
-                CU_ASSERT_EQUAL(ret, 0);
-                msp_print_state(msp, _devnull);
-
-                ret = msp_run(msp, DBL_MAX, ULONG_MAX);
-                CU_ASSERT_EQUAL_FATAL(ret, 0);
-                CU_ASSERT_TRUE(msp_is_completed(msp));
-                CU_ASSERT_TRUE(msp->time > 0);
-                msp_verify(msp, 0);
-
-                msp_reset(msp);
-                while ((ret = msp_run(msp, DBL_MAX, 1)) == 1) {
-                    msp_verify(msp, 0);
-                }
-                CU_ASSERT_EQUAL_FATAL(ret, 0);
-                CU_ASSERT_TRUE(msp_is_completed(msp));
+    /* Edges from the uncoalesced lineages to the end time are added when the
+     * tables are finalised, and the statistics include these branches */
+    ret = msp_run(&msp, 0.5, ULONG_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_TIME);
+    ret = msp_finalise_tables(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    verify_branch_stats(&msp, &stats, false);
 
-                ret = msp_free(msp);
-                CU_ASSERT_EQUAL(ret, 0);
-            }
-        }
-    }
+    msp_free(&msp);
+    branch_stats_free(&stats);
+    tsk_table_collection_free(&tables);
+    recomb_map_free(&recomb_map);
     gsl_rng_free(rng);
-    free(msp);
     free(samples);
-    recomb_map_free(&recomb_map);
-    tsk_table_collection_free(&tables);
 }
 
 static void
-test_multiple_mergers_growth_rate(void)
+test_branch_stats_replicates(void)
 {
     int ret;
-    size_t n = 10;
-    size_t m = 1;
-    int j;
+    uint32_t n = 10;
+    size_t num_sims = 3;
+    size_t num_replicates = 5;
+    size_t j, size;
     sample_t *samples = calloc(n, sizeof(sample_t));
-    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    msp_t msp;
+    gsl_rng **rngs = calloc(num_sims, sizeof(*rngs));
+    msp_t *sims = calloc(num_sims, sizeof(*sims));
+    msp_t **sim_ptrs = calloc(num_sims, sizeof(*sim_ptrs));
+    tsk_table_collection_t *tables = calloc(num_sims, sizeof(*tables));
+    branch_stats_t *stats = calloc(num_sims, sizeof(*stats));
+    double *serial, *parallel;
+    replicate_results_t results;
     recomb_map_t recomb_map;
-    tsk_table_collection_t tables;
 
-    CU_ASSERT_FATAL(samples != NULL);
-    CU_ASSERT_FATAL(rng != NULL);
-    ret = recomb_map_alloc_uniform(&recomb_map, m, m, true);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_FATAL(samples != NULL && rngs != NULL && sims != NULL);
+    CU_ASSERT_FATAL(sim_ptrs != NULL && tables != NULL && stats != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, 10, 0.1, false);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-
-    for (j = 0; j < 2; j++) {
-
-        ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
-        CU_ASSERT_EQUAL(ret, 0);
-        if (j == 0) {
-            ret = msp_set_simulation_model_dirac(&msp, 0.9, 100);
-            CU_ASSERT_EQUAL(ret, 0);
-        } else {
-            ret = msp_set_simulation_model_beta(&msp, 1.9, 1);
-            CU_ASSERT_EQUAL(ret, 0);
-        }
-
-        /* Set to a nonzero growth_rate */
-        ret = msp_set_population_configuration(&msp, 0, 1, -0.01);
+    for (j = 0; j < num_sims; j++) {
+        rngs[j] = gsl_rng_alloc(gsl_rng_default);
+        CU_ASSERT_FATAL(rngs[j] != NULL);
+        ret = tsk_table_collection_init(&tables[j], 0);
         CU_ASSERT_EQUAL_FATAL(ret, 0);
-        ret = msp_initialise(&msp);
+        ret = msp_alloc(&sims[j], n, samples, &recomb_map, &tables[j], rngs[j]);
         CU_ASSERT_EQUAL_FATAL(ret, 0);
-        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
-        CU_ASSERT_EQUAL(ret, 0);
+        ret = msp_initialise(&sims[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = branch_stats_alloc(&stats[j], n, 10);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        sim_ptrs[j] = &sims[j];
+    }
+    size = branch_stats_get_summary_size(&stats[0]);
+    serial = calloc(num_replicates * size, sizeof(double));
+    parallel = calloc(num_replicates * size, sizeof(double));
+    CU_ASSERT_FATAL(serial != NULL && parallel != NULL);
+    memset(&results, 0, sizeof(results));
+    results.summaries = serial;
+    results.summary_size = size;
+
+    /* All simulators must have a sink or none */
+    ret = msp_set_branch_stats(&sims[0], &stats[0]);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_run_replicates(sim_ptrs, num_sims, 0, num_replicates, 1, DBL_MAX,
+        collect_replicate, &results);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    CU_ASSERT_EQUAL(results.num_delivered, 0);
+    for (j = 1; j < num_sims; j++) {
+        ret = msp_set_branch_stats(&sims[j], &stats[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
 
-        msp_print_state(&msp, _devnull);
+    ret = msp_run_replicates(
+        sim_ptrs, 1, 0, num_replicates, 1, DBL_MAX, collect_replicate, &results);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(results.num_delivered, num_replicates);
+    for (j = 0; j < num_replicates; j++) {
+        CU_ASSERT_TRUE(serial[j * size + MSP_BRANCH_STATS_SEGREGATING_SITES] > 0);
+        CU_ASSERT_TRUE(serial[j * size + MSP_BRANCH_STATS_TMRCA] > 0);
+        if (j > 0) {
+            CU_ASSERT_NOT_EQUAL(serial[j * size], serial[(j - 1) * size]);
+        }
+    }
 
-        msp_free(&msp);
+    /* The results do not depend on the number of simulators */
+    memset(&results, 0, sizeof(results));
+    results.summaries = parallel;
+    results.summary_size = size;
+    ret = msp_run_replicates(sim_ptrs, num_sims, 0, num_replicates, 1, DBL_MAX,
+        collect_replicate, &results);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(results.num_delivered, num_replicates);
+    CU_ASSERT_EQUAL(memcmp(serial, parallel, num_replicates * size * sizeof(double)), 0);
 
-        tsk_table_collection_clear(&tables);
+    for (j = 0; j < num_sims; j++) {
+        ret = msp_free(&sims[j]);
+        CU_ASSERT_EQUAL(ret, 0);
+        branch_stats_free(&stats[j]);
+        tsk_table_collection_free(&tables[j]);
+        gsl_rng_free(rngs[j]);
     }
-    gsl_rng_free(rng);
-    free(samples);
     recomb_map_free(&recomb_map);
-    tsk_table_collection_free(&tables);
+    free(samples);
+    free(rngs);
+    free(sims);
+    free(sim_ptrs);
+    free(tables);
+    free(stats);
+    free(serial);
+    free(parallel);
 }
 
 static void
-test_simple_recomb_map(void)
+verify_ms_output(tsk_table_collection_t *tables, const double *breakpoints,
+    size_t num_breakpoints, int precision, tsk_flags_t options, const char *expected)
 {
     int ret;
-    recomb_map_t recomb_map;
-    double seq_length;
-    double positions[][2] = { { 0.0, 1.0 }, { 0.0, 100.0 }, { 0.0, 10000.0 } };
-    double rates[] = { 0.0, 1.0 };
-    size_t j;
-
-    for (j = 0; j < 3; j++) {
-        seq_length = positions[j][1];
-        ret = recomb_map_alloc(&recomb_map, 2, positions[j], rates, true);
-        CU_ASSERT_EQUAL_FATAL(ret, 0);
-        recomb_map_print_state(&recomb_map, _devnull);
-        CU_ASSERT_EQUAL(recomb_map_get_size(&recomb_map), 2);
-        CU_ASSERT_EQUAL(recomb_map_get_sequence_length(&recomb_map), seq_length);
-        ret = recomb_map_free(&recomb_map);
-        CU_ASSERT_EQUAL_FATAL(ret, 0);
-    }
+    FILE *f = tmpfile();
+    size_t length = strlen(expected);
+    char *output = malloc(length + 2);
+    size_t num_read;
+
+    CU_ASSERT_FATAL(f != NULL && output != NULL);
+    ret = msp_write_ms_replicate(
+        tables, f, breakpoints, num_breakpoints, precision, options);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    rewind(f);
+    num_read = fread(output, 1, length + 1, f);
+    CU_ASSERT_EQUAL_FATAL(num_read, length);
+    output[num_read] = '\0';
+    CU_ASSERT_STRING_EQUAL(output, expected);
+    fclose(f);
+    free(output);
 }
 
 static void
-verify_recomb_maps_equal(recomb_map_t *actual, recomb_map_t *expected)
+test_ms_output(void)
 {
-    size_t i;
+    int ret;
+    tsk_table_collection_t tables;
+    const double breakpoints[] = { 2, 5, 10 };
+    const char *tree_1 = "(3:2.00,(1:1.00,2:1.00):1.00);\n";
+    const char *tree_2 = "((1:1.00,3:1.00):1.00,2:2.00);\n";
+    const char *segsites = "segsites: 2\npositions: 0.250 0.750 \n10\n11\n00\n";
+    char expected[1024];
+    FILE *f = tmpfile();
+
+    CU_ASSERT_FATAL(f != NULL);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    tables.sequence_length = 10;
+    /* Two trees, ((0, 1), 2) over [0, 5) and ((0, 2), 1) over [5, 10) */
+    ret = tsk_node_table_add_row(
+        &tables.nodes, TSK_NODE_IS_SAMPLE, 0, TSK_NULL, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(
+        &tables.nodes, TSK_NODE_IS_SAMPLE, 0, TSK_NULL, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(
+        &tables.nodes, TSK_NODE_IS_SAMPLE, 0, TSK_NULL, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(&tables.nodes, 0, 1, TSK_NULL, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(&tables.nodes, 0, 2, TSK_NULL, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables.edges, 0, 10, 3, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables.edges, 0, 5, 3, 1);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables.edges, 5, 10, 3, 2);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables.edges, 5, 10, 4, 1);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables.edges, 0, 5, 4, 2);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables.edges, 0, 10, 4, 3);
+    CU_ASSERT_FATAL(ret >= 0);
 
-    CU_ASSERT_EQUAL(actual->map.size, expected->map.size);
-    CU_ASSERT_EQUAL(actual->discrete, expected->discrete);
-    for (i = 0; i < actual->map.size; i++) {
-        CU_ASSERT_DOUBLE_EQUAL(actual->map.position[i], expected->map.position[i], 0.0);
-        CU_ASSERT_DOUBLE_EQUAL(actual->map.value[i], expected->map.value[i], 0.0);
-        CU_ASSERT_DOUBLE_EQUAL(actual->cumulative[i], expected->cumulative[i], 1e-6);
-    }
-}
+    /* Without sites */
+    verify_ms_output(&tables, NULL, 0, 3, MSP_MS_OUTPUT_SEGSITES, "\n//\nsegsites: 0\n\n");
+    verify_ms_output(&tables, NULL, 0, 3, 0, "\n//\n");
 
-static double
-double_rate(void *_, double rate)
-{
-    return 2 * rate;
+    ret = tsk_site_table_add_row(&tables.sites, 2.5, "0", 1, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_site_table_add_row(&tables.sites, 7.5, "0", 1, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_mutation_table_add_row(&tables.mutations, 0, 3, TSK_NULL, "1", 1, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_mutation_table_add_row(&tables.mutations, 1, 1, TSK_NULL, "1", 1, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+
+    snprintf(expected, sizeof(expected), "\n//\n%s", segsites);
+    verify_ms_output(&tables, NULL, 0, 3, MSP_MS_OUTPUT_SEGSITES, expected);
+    snprintf(expected, sizeof(expected), "\n//\n%s%s", tree_1, tree_2);
+    verify_ms_output(&tables, NULL, 0, 2, MSP_MS_OUTPUT_TREES, expected);
+    /* Trees are repeated for breakpoints that don't change the tree */
+    snprintf(expected, sizeof(expected), "\n//\n[2]%s[3]%s[5]%s", tree_1, tree_1,
+        tree_2);
+    verify_ms_output(&tables, breakpoints, 3, 2, MSP_MS_OUTPUT_TREES, expected);
+    /* The precision applies to trees and positions */
+    verify_ms_output(&tables, NULL, 0, 1, MSP_MS_OUTPUT_TREES | MSP_MS_OUTPUT_SEGSITES,
+        "\n//\n(3:2.0,(1:1.0,2:1.0):1.0);\n((1:1.0,3:1.0):1.0,2:2.0);\n"
+        "segsites: 2\npositions: 0.2 0.8 \n10\n11\n00\n");
+
+    /* A second mutation at a site applies to the samples below it */
+    ret = tsk_mutation_table_add_row(&tables.mutations, 1, 1, 1, "0", 1, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    verify_ms_output(&tables, NULL, 0, 3, MSP_MS_OUTPUT_SEGSITES,
+        "\n//\nsegsites: 2\npositions: 0.250 0.750 \n10\n10\n00\n");
+
+    ret = msp_write_ms_replicate(&tables, f, NULL, 0, -1, 0);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    ret = tsk_site_table_add_row(&tables.sites, 8, "00", 2, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = msp_write_ms_replicate(&tables, f, NULL, 0, 3, MSP_MS_OUTPUT_SEGSITES);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_MS_OUTPUT_ALLELE_LENGTH);
+    tsk_site_table_truncate(&tables.sites, 2);
+    ret = tsk_mutation_table_add_row(&tables.mutations, 1, 2, TSK_NULL, "11", 2, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = msp_write_ms_replicate(&tables, f, NULL, 0, 3, MSP_MS_OUTPUT_SEGSITES);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_MS_OUTPUT_ALLELE_LENGTH);
+    tsk_mutation_table_clear(&tables.mutations);
+    tsk_site_table_clear(&tables.sites);
+
+    /* Trees must have a single root */
+    tsk_edge_table_truncate(&tables.edges, 5);
+    ret = msp_write_ms_replicate(&tables, f, NULL, 0, 3, MSP_MS_OUTPUT_TREES);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_MS_OUTPUT_MULTIPLE_ROOTS);
+    verify_ms_output(&tables, NULL, 0, 3, MSP_MS_OUTPUT_SEGSITES, "\n//\nsegsites: 0\n\n");
+
+    fclose(f);
+    tsk_table_collection_free(&tables);
 }
 
 static void
-test_recomb_map_copy(void)
+test_stamp_replicate_tables(void)
 {
-    int ret = 0;
-    recomb_map_t map, other, copy;
-    double positions[] = { 0.0, 1.0, 2.0 };
-    double rates[] = { 1.0, 2.0, 0.0 };
-    double other_rates[] = { 2.0, 4.0, 0.0 };
+    int ret;
+    tsk_table_collection_t tables;
+    msp_replicate_template_t template;
+    const char *record = "{\"index\": " MSP_REPLICATE_INDEX_PLACEHOLDER
+                         ", \"x\": " MSP_REPLICATE_INDEX_PLACEHOLDER "}";
+    const char *expected = "{\"index\": 1234, \"x\": 1234}";
+    const char *metadata = "abcd";
+    tsk_size_t metadata_offset[] = { 0, 1, 1, 4 };
+    tsk_population_table_t *populations = &tables.populations;
+    tsk_provenance_table_t *provenances = &tables.provenances;
 
-    ret = recomb_map_alloc(&map, 3, positions, rates, true);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = recomb_map_copy(&copy, &map);
+    ret = tsk_table_collection_init(&tables, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    verify_recomb_maps_equal(&copy, &map);
-    recomb_map_free(&map);
-    recomb_map_free(&copy);
+    memset(&template, 0, sizeof(template));
 
-    ret = recomb_map_alloc(&map, 3, positions, rates, true);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = recomb_map_alloc(&other, 3, positions, other_rates, true);
+    /* An empty template does nothing */
+    ret = msp_stamp_replicate_tables(&tables, &template, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    recomb_map_convert_rates(&map, double_rate, NULL);
-    verify_recomb_maps_equal(&map, &other);
-    recomb_map_free(&map);
-    recomb_map_free(&other);
+    CU_ASSERT_EQUAL(provenances->num_rows, 0);
+    CU_ASSERT_EQUAL(populations->num_rows, 0);
+
+    template.provenance_timestamp = "time";
+    template.provenance_timestamp_length = 4;
+    template.provenance_record = record;
+    template.provenance_record_length = (tsk_size_t) strlen(record);
+    template.population_metadata = metadata;
+    template.population_metadata_offset = metadata_offset;
+    template.num_populations = 3;
+    /* The number of populations must match */
+    ret = msp_stamp_replicate_tables(&tables, &template, 1234);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    CU_ASSERT_EQUAL(provenances->num_rows, 0);
+
+    CU_ASSERT_FATAL(tsk_population_table_add_row(populations, NULL, 0) == 0);
+    CU_ASSERT_FATAL(tsk_population_table_add_row(populations, NULL, 0) == 1);
+    CU_ASSERT_FATAL(tsk_population_table_add_row(populations, NULL, 0) == 2);
+    ret = msp_stamp_replicate_tables(&tables, &template, 1234);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(provenances->num_rows, 1);
+    CU_ASSERT_EQUAL(provenances->timestamp_length, 4);
+    CU_ASSERT_NSTRING_EQUAL(provenances->timestamp, "time", 4);
+    CU_ASSERT_EQUAL_FATAL(provenances->record_length, strlen(expected));
+    CU_ASSERT_NSTRING_EQUAL(provenances->record, expected, strlen(expected));
+    CU_ASSERT_EQUAL_FATAL(populations->num_rows, 3);
+    CU_ASSERT_EQUAL(populations->metadata_length, 4);
+    CU_ASSERT_NSTRING_EQUAL(populations->metadata, metadata, 4);
+    CU_ASSERT_EQUAL(populations->metadata_offset[1], 1);
+    CU_ASSERT_EQUAL(populations->metadata_offset[2], 1);
+
+    tsk_table_collection_free(&tables);
+}
+
+static int
+count_interrupt_polls(msp_t *MSP_UNUSED(sim), void *arg)
+{
+    size_t *num_polls = (size_t *) arg;
+
+    (*num_polls)++;
+    return *num_polls == 3;
 }
 
 static void
-test_recomb_map_errors(void)
+test_simulation_interrupt(void)
 {
     int ret;
+    uint32_t n = 100;
+    size_t j, num_polls;
+    sample_t *samples = calloc(n, sizeof(sample_t));
+    gsl_rng *rngs[2];
+    msp_t sims[2];
+    msp_t *sim = &sims[0];
+    replicate_results_t results;
+    tsk_table_collection_t tables[2];
     recomb_map_t recomb_map;
-    double positions[] = { 0.0, 1.0, 2.0 };
-    double rates[] = { 1.0, 2.0, 0.0 };
-    double short_positions[] = { 0.0, 0.25, 0.5 };
-
-    ret = recomb_map_alloc(&recomb_map, 0, positions, rates, true);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INSUFFICIENT_INTERVALS);
-    recomb_map_free(&recomb_map);
-
-    ret = recomb_map_alloc(&recomb_map, 3, short_positions, rates, true);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_RECOMBINATION_MAP);
-    recomb_map_free(&recomb_map);
-
-    ret = recomb_map_alloc(&recomb_map, 1, positions, rates, true);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INSUFFICIENT_INTERVALS);
-    recomb_map_free(&recomb_map);
-
-    positions[0] = 1;
-    ret = recomb_map_alloc(&recomb_map, 2, positions, rates, true);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INTERVAL_MAP_START_NON_ZERO);
-    recomb_map_free(&recomb_map);
-    positions[0] = 0;
-
-    positions[1] = 3.0;
-    ret = recomb_map_alloc(&recomb_map, 3, positions, rates, true);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INTERVAL_POSITIONS_UNSORTED);
-    recomb_map_free(&recomb_map);
-    positions[1] = 1.0;
 
-    positions[0] = -1;
-    ret = recomb_map_alloc(&recomb_map, 3, positions, rates, true);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INTERVAL_MAP_START_NON_ZERO);
-    recomb_map_free(&recomb_map);
-    positions[0] = 0.0;
+    CU_ASSERT_FATAL(samples != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, 1000, 1.0, false);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < 2; j++) {
+        rngs[j] = gsl_rng_alloc(gsl_rng_default);
+        CU_ASSERT_FATAL(rngs[j] != NULL);
+        gsl_rng_set(rngs[j], 5);
+        ret = tsk_table_collection_init(&tables[j], 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_alloc(&sims[j], n, samples, &recomb_map, &tables[j], rngs[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_initialise(&sims[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
 
-    rates[0] = -1;
-    ret = recomb_map_alloc(&recomb_map, 3, positions, rates, true);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_RECOMBINATION_MAP);
-    recomb_map_free(&recomb_map);
-    rates[0] = 1.0;
+    num_polls = 0;
+    ret = msp_set_interrupt_handler(&sims[0], count_interrupt_polls, &num_polls);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_run(&sims[0], DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_INTERRUPTED);
+    CU_ASSERT_EQUAL(num_polls, 3);
+    CU_ASSERT_EQUAL(sims[0].num_re_events + sims[0].num_ca_events,
+        3 * MSP_INTERRUPT_POLL_INTERVAL - 1);
+    msp_verify(&sims[0], 0);
 
-    ret = recomb_map_alloc(&recomb_map, 3, positions, rates, true);
+    /* Removing the handler lets the simulation run to completion, and
+     * the result is the same as if it had never been interrupted */
+    ret = msp_set_interrupt_handler(&sims[0], NULL, NULL);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    recomb_map_free(&recomb_map);
+    ret = msp_run(&sims[0], DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(num_polls, 3);
+    ret = msp_run(&sims[1], DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < 2; j++) {
+        msp_verify(&sims[j], 0);
+        ret = msp_finalise_tables(&sims[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+    CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1]));
 
-    ret = recomb_map_alloc(&recomb_map, 3, short_positions, rates, false);
+    /* Interrupted replicates are reported as an error */
+    num_polls = 0;
+    ret = msp_set_interrupt_handler(&sims[0], count_interrupt_polls, &num_polls);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
+    memset(&results, 0, sizeof(results));
+    ret = msp_run_replicates(&sim, 1, 0, 1, 1, DBL_MAX, collect_replicate, &results);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_INTERRUPTED);
+    CU_ASSERT_EQUAL(results.num_delivered, 0);
+
+    for (j = 0; j < 2; j++) {
+        msp_free(&sims[j]);
+        tsk_table_collection_free(&tables[j]);
+        gsl_rng_free(rngs[j]);
+    }
     recomb_map_free(&recomb_map);
+    free(samples);
 }
 
 static void
-verify_recomb_map(double length, double *positions, double *rates, size_t size)
+test_bottleneck_simulation(void)
 {
-
     int ret;
+    uint32_t n = 100;
+    uint32_t m = 100;
+    long seed = 10;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    msp_t *msp = malloc(sizeof(msp_t));
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    double t1 = 0.1;
+    double t2 = 0.5;
+    int t1_found = 0;
     recomb_map_t recomb_map;
-    size_t j;
-    double *ret_rates, *ret_positions;
-
-    ret_rates = malloc(size * sizeof(double));
-    ret_positions = malloc(size * sizeof(double));
+    tsk_table_collection_t tables;
 
-    CU_ASSERT_FATAL(ret_rates != NULL);
-    CU_ASSERT_FATAL(ret_positions != NULL);
+    CU_ASSERT_FATAL(msp != NULL);
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
 
-    ret = recomb_map_alloc(&recomb_map, size, positions, rates, true);
+    ret = recomb_map_alloc_uniform(&recomb_map, m, 1 / m, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    recomb_map_print_state(&recomb_map, _devnull);
-    CU_ASSERT_EQUAL(recomb_map_get_size(&recomb_map), size);
 
-    ret = recomb_map_get_positions(&recomb_map, ret_positions);
+    gsl_rng_set(rng, seed);
+    memset(samples, 0, n * sizeof(sample_t));
+    ret = msp_alloc(msp, n, samples, &recomb_map, &tables, rng);
     CU_ASSERT_EQUAL(ret, 0);
-    ret = recomb_map_get_rates(&recomb_map, ret_rates);
+    /* set all the block sizes to something small to provoke the memory
+     * expansions. */
+    ret = msp_set_avl_node_block_size(msp, 2);
     CU_ASSERT_EQUAL(ret, 0);
-    for (j = 0; j < size; j++) {
-        CU_ASSERT_EQUAL(ret_rates[j], rates[j]);
-        CU_ASSERT_EQUAL(ret_positions[j], positions[j]);
+    ret = msp_set_node_mapping_block_size(msp, 2);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_set_segment_block_size(msp, 2);
+    CU_ASSERT_EQUAL(ret, 0);
+    /* Add a bottleneck that does nothing at time t1 */
+    ret = msp_add_simple_bottleneck(msp, t1, 0, 0);
+    CU_ASSERT_EQUAL(ret, 0);
+    /* Add a bottleneck that coalesces everything at t2 */
+    ret = msp_add_simple_bottleneck(msp, t2, 0, 1);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_initialise(msp);
+    CU_ASSERT_EQUAL(ret, 0);
+
+    ret = msp_run(msp, t1, ULONG_MAX);
+    CU_ASSERT_EQUAL(ret, 2);
+    CU_ASSERT_FALSE(msp_is_completed(msp));
+    msp_print_state(msp, _devnull);
+
+    ret = msp_run(msp, DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL(ret, 0);
+    CU_ASSERT_TRUE(msp_is_completed(msp));
+    CU_ASSERT_EQUAL(msp->time, t2);
+    msp_verify(msp, 0);
+
+    msp_reset(msp);
+    while ((ret = msp_run(msp, DBL_MAX, 1)) == 1) {
+        msp_verify(msp, 0);
+        if (msp->time == 0.1) {
+            t1_found = 1;
+        }
+        CU_ASSERT_EQUAL(msp_get_time(msp), msp->time);
     }
-    ret = recomb_map_free(&recomb_map);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    free(ret_rates);
-    free(ret_positions);
+    CU_ASSERT_EQUAL(ret, 0);
+    CU_ASSERT_TRUE(t1_found);
+    CU_ASSERT_EQUAL(msp->time, t2);
+
+    ret = msp_free(msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    gsl_rng_free(rng);
+    free(msp);
+    free(samples);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
 }
 
+#define SIMPLE_BOTTLENECK 0
+#define INSTANTANEOUS_BOTTLENECK 1
+
+typedef struct {
+    int type;
+    double time;
+    uint32_t population_id;
+    double parameter;
+} bottleneck_desc_t;
+
 static void
-test_recomb_map_examples(void)
+test_large_bottleneck_simulation(void)
 {
-    double p1[] = { 0, 0.05019838393314813, 0.36933662489552865, 1 };
-    double r1[] = { 3.5510784169955434, 4.184964179610539, 3.800808140657212, 0 };
-    double p2[] = { 0, 0.125, 0.875, 1, 4, 8, 16 };
-    double r2[] = { 0.1, 6.0, 3.333, 2.1, 0.0, 2.2, 0 };
+    int ret;
+    uint32_t j;
+    uint32_t n = 1000;
+    uint32_t m = 10;
+    long seed = 10;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    msp_t *msp = malloc(sizeof(msp_t));
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    uint32_t num_bottlenecks = 10;
+    bottleneck_desc_t bottlenecks[num_bottlenecks];
+    double t;
+    recomb_map_t recomb_map;
+    tsk_table_collection_t tables;
 
-    verify_recomb_map(1.0, p1, r1, 4);
-    verify_recomb_map(1.0, p1, r1, 4);
-    verify_recomb_map(1.0, p1, r1, 4);
+    CU_ASSERT_FATAL(msp != NULL);
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
 
-    verify_recomb_map(16.0, p2, r2, 7);
-    verify_recomb_map(16.0, p2, r2, 7);
-    verify_recomb_map(16.0, p2, r2, 7);
-}
+    ret = recomb_map_alloc_uniform(&recomb_map, m, m, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-static void
-test_translate_position_and_recomb_mass(void)
-{
-    recomb_map_t map;
-    double p1[] = { 0, 6, 13, 20 };
-    double r1[] = { 3, 0, 1, 0 };
-    recomb_map_alloc(&map, 4, p1, r1, true);
+    t = 0.1;
+    for (j = 0; j < num_bottlenecks; j++) {
+        bottlenecks[j].type = SIMPLE_BOTTLENECK;
+        bottlenecks[j].time = t;
+        bottlenecks[j].parameter = 0.1;
+        t += 0.01;
+    }
+    /* Set the last bottleneck to be full intensity */
+    bottlenecks[num_bottlenecks - 1].parameter = 1.0;
 
-    /* interval edges */
-    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 0), 0);
-    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 6), 18);
-    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 13), 18);
-    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 19), 24);
-    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 0), 0);
-    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 18), 6);
-    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 24), 19);
+    gsl_rng_set(rng, seed);
+    memset(samples, 0, n * sizeof(sample_t));
+    ret = msp_alloc(msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL(ret, 0);
+    for (j = 0; j < num_bottlenecks; j++) {
+        ret = msp_add_simple_bottleneck(
+            msp, bottlenecks[j].time, 0, bottlenecks[j].parameter);
+        CU_ASSERT_EQUAL(ret, 0);
+    }
+    ret = msp_set_population_configuration(msp, 0, 0.25, 0);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_initialise(msp);
+    CU_ASSERT_EQUAL(ret, 0);
 
-    /* intervals with recombination */
-    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 4), 12);
-    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 14), 19);
-    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 16), 21);
-    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 12), 4);
-    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 19), 14);
-    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 21), 16);
+    for (j = 0; j < num_bottlenecks - 1; j++) {
+        ret = msp_run(msp, bottlenecks[j].time + 1e-6, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, MSP_EXIT_MAX_TIME);
+        CU_ASSERT_FALSE(msp_is_completed(msp));
+        CU_ASSERT_EQUAL(msp->time, bottlenecks[j].time + 1e-6);
+        msp_verify(msp, 0);
+    }
+    ret = msp_run(msp, DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL(ret, 0);
+    CU_ASSERT_TRUE(msp_is_completed(msp));
+    CU_ASSERT_EQUAL(msp->time, bottlenecks[num_bottlenecks - 1].time);
+    msp_verify(msp, 0);
 
-    /* inside recombination interval */
-    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 8), 18);
+    /* Test out resets on partially completed simulations. */
+    ret = msp_reset(msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    for (j = 0; j < num_bottlenecks - 1; j++) {
+        ret = msp_run(msp, bottlenecks[j].time, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, 2);
+    }
+    ret = msp_reset(msp);
+    msp_verify(msp, 0);
 
-    recomb_map_free(&map);
+    ret = msp_free(msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    gsl_rng_free(rng);
+    free(msp);
+    free(samples);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
 }
 
 static void
-test_recomb_map_mass_between(void)
+test_dirac_coalescent_bad_parameters(void)
 {
-    recomb_map_t discrete_map;
-    recomb_map_t cont_map;
-    double p1[] = { 0, 6, 13, 20 };
-    double r1[] = { 3, 0, 1, 0 };
-    double tol = 1e-9;
+    int j;
+    int ret;
+    msp_t msp;
+    unsigned int n = 10;
+    double cs[] = { -1 };
+    double psis[] = { -1e6, 1e6 };
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    recomb_map_t recomb_map;
+    tsk_table_collection_t tables;
 
-    recomb_map_alloc(&discrete_map, 4, p1, r1, true);
-    recomb_map_alloc(&cont_map, 4, p1, r1, false);
+    ret = recomb_map_alloc_uniform(&recomb_map, 1.0, 1, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    memset(samples, 0, n * sizeof(sample_t));
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    CU_ASSERT_DOUBLE_EQUAL_FATAL(recomb_map_mass_between(&discrete_map, 0, 2), 6, tol);
-    CU_ASSERT_DOUBLE_EQUAL_FATAL(recomb_map_mass_between(&cont_map, 0, 2), 6, tol);
-    CU_ASSERT_DOUBLE_EQUAL_FATAL(
-        recomb_map_mass_between_left_exclusive(&discrete_map, 0, 2), 3, tol);
-    CU_ASSERT_DOUBLE_EQUAL_FATAL(
-        recomb_map_mass_between_left_exclusive(&cont_map, 0, 2), 6, tol);
+    for (j = 0; j < sizeof(cs) / sizeof(*cs); j++) {
+        ret = msp_set_simulation_model_dirac(&msp, 0.1, cs[j]);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_C);
+    }
+    for (j = 0; j < sizeof(psis) / sizeof(*psis); j++) {
+        ret = msp_set_simulation_model_dirac(&msp, psis[j], 10);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PSI);
+    }
 
-    recomb_map_free(&discrete_map);
-    recomb_map_free(&cont_map);
+    msp_free(&msp);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
+    free(samples);
+    gsl_rng_free(rng);
 }
 
 static void
-test_msp_binary_interval_search(void)
+test_beta_coalescent_bad_parameters(void)
 {
-    double values[] = { -10, 10, 20, 30 };
-    size_t size = 4;
-    size_t idx;
+    int j;
+    int ret;
+    msp_t msp;
+    unsigned int n = 10;
+    double alphas[] = { -1e6, 0, 0.001, 1.0, 2.0, 1e6 };
+    double truncation_points[] = { -1e6, 0, 1.001, 1e6 };
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    recomb_map_t recomb_map;
+    tsk_table_collection_t tables;
 
-    // Search from bottom
+    ret = recomb_map_alloc_uniform(&recomb_map, 1.0, 1, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    memset(samples, 0, n * sizeof(sample_t));
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < sizeof(alphas) / sizeof(*alphas); j++) {
+        ret = msp_set_simulation_model_beta(&msp, alphas[j], 1);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_BETA_MODEL_ALPHA);
+    }
+    for (j = 0; j < sizeof(truncation_points) / sizeof(*truncation_points); j++) {
+        ret = msp_set_simulation_model_beta(&msp, 1.5, truncation_points[j]);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_TRUNCATION_POINT);
+    }
+
+    msp_free(&msp);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
+    free(samples);
+    gsl_rng_free(rng);
+}
+
+static void
+test_multiple_mergers_simulation(void)
+{
+    int ret;
+    size_t j, k, o, p;
+    uint32_t n = 10;
+    uint32_t m = 10;
+    long seed = 10;
+    bool store_full_arg[] = { true, false };
+    /* These simulations can be slow, so just choose a few param combinations */
+    double beta_params[][2] = { { 1.1, 0.5 }, { 1.99, 1 } };
+    /* TODO what are good psi parameters here? */
+    double psi_params[][2] = { { 0.9, 10 }, { 0.1, 1 } };
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    msp_t *msp = malloc(sizeof(msp_t));
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    recomb_map_t recomb_map;
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(msp != NULL);
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, m, m, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < 2; j++) {
+        if (j == 0) {
+            o = sizeof(psi_params) / sizeof(*psi_params);
+        } else if (j == 1) {
+            o = sizeof(beta_params) / sizeof(*beta_params);
+        }
+        for (k = 0; k < sizeof(store_full_arg) / sizeof(bool); k++) {
+            for (p = 0; p < o; p++) {
+                gsl_rng_set(rng, seed);
+                /* TODO check non-zero sample times here to make sure they fail. */
+                memset(samples, 0, n * sizeof(sample_t));
+                tsk_table_collection_clear(&tables);
+                ret = msp_alloc(msp, n, samples, &recomb_map, &tables, rng);
+                CU_ASSERT_EQUAL(ret, 0);
+                if (j == 0) {
+                    ret = msp_set_simulation_model_dirac(
+                        msp, psi_params[p][0], psi_params[p][1]);
+                } else {
+                    ret = msp_set_simulation_model_beta(
+                        msp, beta_params[p][0], beta_params[p][1]);
+                }
+                CU_ASSERT_EQUAL(ret, 0);
+                /* TODO check for adding various complications like multiple
+                 * populations etc to ensure they fail.
+                 */
+                ret = msp_set_store_full_arg(msp, store_full_arg[k]);
+                CU_ASSERT_EQUAL(ret, 0);
+                ret = msp_initialise(msp);
+                CU_ASSERT_EQUAL(ret, 0);
+                msp_print_state(msp, _devnull);
+
+                ret = msp_run(msp, DBL_MAX, ULONG_MAX);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                CU_ASSERT_TRUE(msp_is_completed(msp));
+                CU_ASSERT_TRUE(msp->time > 0);
+                msp_verify(msp, 0);
+
+                msp_reset(msp);
+                while ((ret = msp_run(msp, DBL_MAX, 1)) == 1) {
+                    msp_verify(msp, 0);
+                }
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                CU_ASSERT_TRUE(msp_is_completed(msp));
+
+                ret = msp_free(msp);
+                CU_ASSERT_EQUAL(ret, 0);
+            }
+        }
+    }
+    gsl_rng_free(rng);
+    free(msp);
+    free(samples);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+test_multiple_mergers_growth_rate(void)
+{
+    int ret;
+    size_t n = 10;
+    size_t m = 1;
+    int j;
+    sample_t *samples = calloc(n, sizeof(sample_t));
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    msp_t msp;
+    recomb_map_t recomb_map;
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, m, m, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < 2; j++) {
+
+        ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+        CU_ASSERT_EQUAL(ret, 0);
+        if (j == 0) {
+            ret = msp_set_simulation_model_dirac(&msp, 0.9, 100);
+            CU_ASSERT_EQUAL(ret, 0);
+        } else {
+            ret = msp_set_simulation_model_beta(&msp, 1.9, 1);
+            CU_ASSERT_EQUAL(ret, 0);
+        }
+
+        /* Set to a nonzero growth_rate */
+        ret = msp_set_population_configuration(&msp, 0, 1, -0.01);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, 0);
+
+        msp_print_state(&msp, _devnull);
+
+        msp_free(&msp);
+
+        tsk_table_collection_clear(&tables);
+    }
+    gsl_rng_free(rng);
+    free(samples);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+test_multiple_mergers_direct_sampling(void)
+{
+    int ret;
+    uint32_t n = 10;
+    double m = 10;
+    int j;
+    size_t k, max_lineages[] = { 0, 5, 100 };
+    sample_t *samples = calloc(n, sizeof(sample_t));
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    msp_t msp;
+    recomb_map_t recomb_map;
+    tsk_table_collection_t tables;
+    double psi = 0.5;
+    double c = 1;
+    double multi_prob;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, m, 0.1, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < 2; j++) {
+        for (k = 0; k < sizeof(max_lineages) / sizeof(*max_lineages); k++) {
+            ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_max_merger_table_lineages(&msp, max_lineages[k]);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            if (j == 0) {
+                ret = msp_set_simulation_model_dirac(&msp, psi, c);
+            } else {
+                ret = msp_set_simulation_model_beta(&msp, 1.1, 0.5);
+            }
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_initialise(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+            CU_ASSERT_EQUAL(ret, 0);
+            msp_verify(&msp, 0);
+
+            if (max_lineages[k] == 0) {
+                CU_ASSERT_EQUAL(msp.merger_rate, NULL);
+            } else {
+                CU_ASSERT_FATAL(msp.merger_rate != NULL);
+                CU_ASSERT_EQUAL(msp.merger_rate[1], 0);
+                if (j == 0) {
+                    /* Binary mergers plus multiple mergers with >= 2 lineages */
+                    multi_prob = 1 - pow(1 - psi, n) - n * psi * pow(1 - psi, n - 1);
+                    CU_ASSERT_DOUBLE_EQUAL(msp.merger_rate[n],
+                        2 * (n * (n - 1) / 2.0 + c * multi_prob), 1e-9);
+                } else {
+                    /* Events are a subset of the rejection sampler's proposals */
+                    CU_ASSERT_TRUE(msp.merger_rate[n] > 0);
+                    CU_ASSERT_TRUE(msp.merger_rate[n] <= 4.0 * n * (n - 1));
+                }
+            }
+            /* Tables are kept across replicates */
+            ret = msp_reset(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+            CU_ASSERT_EQUAL(ret, 0);
+            msp_verify(&msp, 0);
+
+            msp_free(&msp);
+            tsk_table_collection_clear(&tables);
+        }
+    }
+    gsl_rng_free(rng);
+    free(samples);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+test_beta_timescale_population_size_change(void)
+{
+    int ret;
+    size_t n = 10;
+    sample_t *samples = calloc(n, sizeof(sample_t));
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    msp_t msp;
+    recomb_map_t recomb_map;
+    tsk_table_collection_t tables;
+    double timescale;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, 1, 1, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_simulation_model_beta(&msp, 1.5, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_add_population_parameters_change(&msp, 0.01, -1, 10, GSL_NAN);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL(ret, 0);
+    msp_verify(&msp, 0);
+    /* The cached timescale must correspond to the final population size */
+    timescale = msp.populations[0].timescale;
+    CU_ASSERT_DOUBLE_EQUAL(timescale,
+        msp.model.params.beta_coalescent.timescale_factor
+            * pow(msp.populations[0].initial_size, 0.5),
+        1e-9);
+
+    /* Resetting restores the initial sizes and so also clears the cache */
+    ret = msp_reset(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(msp.populations[0].timescale, 0);
+    ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL(ret, 0);
+    msp_verify(&msp, 0);
+    timescale = msp.populations[0].timescale;
+    CU_ASSERT_DOUBLE_EQUAL(timescale,
+        msp.model.params.beta_coalescent.timescale_factor
+            * pow(msp.populations[0].initial_size, 0.5),
+        1e-9);
+
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    free(samples);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+test_simple_recomb_map(void)
+{
+    int ret;
+    recomb_map_t recomb_map;
+    double seq_length;
+    double positions[][2] = { { 0.0, 1.0 }, { 0.0, 100.0 }, { 0.0, 10000.0 } };
+    double rates[] = { 0.0, 1.0 };
+    size_t j;
+
+    for (j = 0; j < 3; j++) {
+        seq_length = positions[j][1];
+        ret = recomb_map_alloc(&recomb_map, 2, positions[j], rates, true);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        recomb_map_print_state(&recomb_map, _devnull);
+        CU_ASSERT_EQUAL(recomb_map_get_size(&recomb_map), 2);
+        CU_ASSERT_EQUAL(recomb_map_get_sequence_length(&recomb_map), seq_length);
+        ret = recomb_map_free(&recomb_map);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+}
+
+static void
+verify_recomb_maps_equal(recomb_map_t *actual, recomb_map_t *expected)
+{
+    size_t i;
+
+    CU_ASSERT_EQUAL(actual->map.size, expected->map.size);
+    CU_ASSERT_EQUAL(actual->discrete, expected->discrete);
+    for (i = 0; i < actual->map.size; i++) {
+        CU_ASSERT_DOUBLE_EQUAL(actual->map.position[i], expected->map.position[i], 0.0);
+        CU_ASSERT_DOUBLE_EQUAL(actual->map.value[i], expected->map.value[i], 0.0);
+        CU_ASSERT_DOUBLE_EQUAL(actual->cumulative[i], expected->cumulative[i], 1e-6);
+    }
+}
+
+static double
+double_rate(void *_, double rate)
+{
+    return 2 * rate;
+}
+
+static void
+test_recomb_map_copy(void)
+{
+    int ret = 0;
+    recomb_map_t map, other, copy;
+    double positions[] = { 0.0, 1.0, 2.0 };
+    double rates[] = { 1.0, 2.0, 0.0 };
+    double other_rates[] = { 2.0, 4.0, 0.0 };
+
+    ret = recomb_map_alloc(&map, 3, positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = recomb_map_copy(&copy, &map);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    verify_recomb_maps_equal(&copy, &map);
+    recomb_map_free(&map);
+    recomb_map_free(&copy);
+
+    ret = recomb_map_alloc(&map, 3, positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = recomb_map_alloc(&other, 3, positions, other_rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    recomb_map_convert_rates(&map, double_rate, NULL);
+    verify_recomb_maps_equal(&map, &other);
+    recomb_map_free(&map);
+    recomb_map_free(&other);
+}
+
+static void
+test_recomb_map_errors(void)
+{
+    int ret;
+    recomb_map_t recomb_map;
+    double positions[] = { 0.0, 1.0, 2.0 };
+    double rates[] = { 1.0, 2.0, 0.0 };
+    double short_positions[] = { 0.0, 0.25, 0.5 };
+
+    ret = recomb_map_alloc(&recomb_map, 0, positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INSUFFICIENT_INTERVALS);
+    recomb_map_free(&recomb_map);
+
+    ret = recomb_map_alloc(&recomb_map, 3, short_positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_RECOMBINATION_MAP);
+    recomb_map_free(&recomb_map);
+
+    ret = recomb_map_alloc(&recomb_map, 1, positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INSUFFICIENT_INTERVALS);
+    recomb_map_free(&recomb_map);
+
+    positions[0] = 1;
+    ret = recomb_map_alloc(&recomb_map, 2, positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INTERVAL_MAP_START_NON_ZERO);
+    recomb_map_free(&recomb_map);
+    positions[0] = 0;
+
+    positions[1] = 3.0;
+    ret = recomb_map_alloc(&recomb_map, 3, positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INTERVAL_POSITIONS_UNSORTED);
+    recomb_map_free(&recomb_map);
+    positions[1] = 1.0;
+
+    positions[0] = -1;
+    ret = recomb_map_alloc(&recomb_map, 3, positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INTERVAL_MAP_START_NON_ZERO);
+    recomb_map_free(&recomb_map);
+    positions[0] = 0.0;
+
+    rates[0] = -1;
+    ret = recomb_map_alloc(&recomb_map, 3, positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_RECOMBINATION_MAP);
+    recomb_map_free(&recomb_map);
+    rates[0] = 1.0;
+
+    ret = recomb_map_alloc(&recomb_map, 3, positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    recomb_map_free(&recomb_map);
+
+    ret = recomb_map_alloc(&recomb_map, 3, short_positions, rates, false);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    recomb_map_free(&recomb_map);
+}
+
+static void
+verify_recomb_map(double length, double *positions, double *rates, size_t size)
+{
+
+    int ret;
+    recomb_map_t recomb_map;
+    size_t j;
+    double *ret_rates, *ret_positions;
+
+    ret_rates = malloc(size * sizeof(double));
+    ret_positions = malloc(size * sizeof(double));
+
+    CU_ASSERT_FATAL(ret_rates != NULL);
+    CU_ASSERT_FATAL(ret_positions != NULL);
+
+    ret = recomb_map_alloc(&recomb_map, size, positions, rates, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    recomb_map_print_state(&recomb_map, _devnull);
+    CU_ASSERT_EQUAL(recomb_map_get_size(&recomb_map), size);
+
+    ret = recomb_map_get_positions(&recomb_map, ret_positions);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = recomb_map_get_rates(&recomb_map, ret_rates);
+    CU_ASSERT_EQUAL(ret, 0);
+    for (j = 0; j < size; j++) {
+        CU_ASSERT_EQUAL(ret_rates[j], rates[j]);
+        CU_ASSERT_EQUAL(ret_positions[j], positions[j]);
+    }
+    ret = recomb_map_free(&recomb_map);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    free(ret_rates);
+    free(ret_positions);
+}
+
+static void
+test_recomb_map_examples(void)
+{
+    double p1[] = { 0, 0.05019838393314813, 0.36933662489552865, 1 };
+    double r1[] = { 3.5510784169955434, 4.184964179610539, 3.800808140657212, 0 };
+    double p2[] = { 0, 0.125, 0.875, 1, 4, 8, 16 };
+    double r2[] = { 0.1, 6.0, 3.333, 2.1, 0.0, 2.2, 0 };
+
+    verify_recomb_map(1.0, p1, r1, 4);
+    verify_recomb_map(1.0, p1, r1, 4);
+    verify_recomb_map(1.0, p1, r1, 4);
+
+    verify_recomb_map(16.0, p2, r2, 7);
+    verify_recomb_map(16.0, p2, r2, 7);
+    verify_recomb_map(16.0, p2, r2, 7);
+}
+
+static void
+test_translate_position_and_recomb_mass(void)
+{
+    recomb_map_t map;
+    double p1[] = { 0, 6, 13, 20 };
+    double r1[] = { 3, 0, 1, 0 };
+    recomb_map_alloc(&map, 4, p1, r1, true);
+
+    /* interval edges */
+    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 0), 0);
+    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 6), 18);
+    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 13), 18);
+    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 19), 24);
+    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 0), 0);
+    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 18), 6);
+    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 24), 19);
+
+    /* intervals with recombination */
+    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 4), 12);
+    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 14), 19);
+    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 16), 21);
+    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 12), 4);
+    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 19), 14);
+    CU_ASSERT_EQUAL(recomb_map_mass_to_position(&map, 21), 16);
+
+    /* inside recombination interval */
+    CU_ASSERT_EQUAL(recomb_map_position_to_mass(&map, 8), 18);
+
+    recomb_map_free(&map);
+}
+
+static void
+test_recomb_map_mass_between(void)
+{
+    recomb_map_t discrete_map;
+    recomb_map_t cont_map;
+    double p1[] = { 0, 6, 13, 20 };
+    double r1[] = { 3, 0, 1, 0 };
+    double tol = 1e-9;
+
+    recomb_map_alloc(&discrete_map, 4, p1, r1, true);
+    recomb_map_alloc(&cont_map, 4, p1, r1, false);
+
+    CU_ASSERT_DOUBLE_EQUAL_FATAL(recomb_map_mass_between(&discrete_map, 0, 2), 6, tol);
+    CU_ASSERT_DOUBLE_EQUAL_FATAL(recomb_map_mass_between(&cont_map, 0, 2), 6, tol);
+    CU_ASSERT_DOUBLE_EQUAL_FATAL(
+        recomb_map_mass_between_left_exclusive(&discrete_map, 0, 2), 3, tol);
+    CU_ASSERT_DOUBLE_EQUAL_FATAL(
+        recomb_map_mass_between_left_exclusive(&cont_map, 0, 2), 6, tol);
+
+    recomb_map_free(&discrete_map);
+    recomb_map_free(&cont_map);
+}
+
+static void
+test_msp_binary_interval_search(void)
+{
+    double values[] = { -10, 10, 20, 30 };
+    size_t size = 4;
+    size_t idx;
+
+    // Search from bottom
     idx = msp_binary_interval_search(-11, values, size);
     CU_ASSERT_EQUAL(idx, 0);
     // Exact match returns index of value
@@ -3632,751 +4822,1240 @@ test_msp_binary_interval_search(void)
 }
 
 static void
-test_msp_binary_interval_search_repeating(void)
+test_msp_binary_interval_search_repeating(void)
+{
+    double values_repeating[] = { 0, 10, 10, 30 };
+    size_t size = 4;
+    size_t idx;
+
+    // Same as above
+    idx = msp_binary_interval_search(-1, values_repeating, size);
+    CU_ASSERT_EQUAL(idx, 0);
+    // Want leftmost interval
+    idx = msp_binary_interval_search(10, values_repeating, size);
+    CU_ASSERT_EQUAL(idx, 1);
+    // Same as above
+    idx = msp_binary_interval_search(11, values_repeating, size);
+    CU_ASSERT_EQUAL(idx, 3);
+}
+
+static void
+test_msp_binary_interval_search_edge_cases(void)
+{
+    double values_empty[] = {};
+    size_t idx;
+
+    // Empty list
+    idx = msp_binary_interval_search(0, values_empty, 0);
+    CU_ASSERT_EQUAL(idx, 0);
+
+    // Size 1 list
+    double values_one[] = { 10 };
+
+    // below
+    idx = msp_binary_interval_search(9, values_one, 1);
+    CU_ASSERT_EQUAL(idx, 0);
+    // exact
+    idx = msp_binary_interval_search(10, values_one, 1);
+    CU_ASSERT_EQUAL(idx, 0);
+    // above
+    idx = msp_binary_interval_search(11, values_one, 1);
+    CU_ASSERT_EQUAL(idx, 0);
+
+    // Size 2 list
+    double values_two[] = { 10, 20 };
+    idx = msp_binary_interval_search(9, values_two, 2);
+    CU_ASSERT_EQUAL(idx, 0);
+    idx = msp_binary_interval_search(10, values_two, 2);
+    CU_ASSERT_EQUAL(idx, 0);
+    idx = msp_binary_interval_search(15, values_two, 2);
+    CU_ASSERT_EQUAL(idx, 1);
+    idx = msp_binary_interval_search(20, values_two, 2);
+    CU_ASSERT_EQUAL(idx, 1);
+    idx = msp_binary_interval_search(21, values_two, 2);
+    CU_ASSERT_EQUAL(idx, 1);
+
+    // All zeros
+    double values_zeros[] = { 0, 0, 0 };
+    idx = msp_binary_interval_search(-1, values_zeros, 3);
+    CU_ASSERT_EQUAL(idx, 0);
+    idx = msp_binary_interval_search(0, values_zeros, 3);
+    CU_ASSERT_EQUAL(idx, 0);
+    idx = msp_binary_interval_search(1, values_zeros, 3);
+    CU_ASSERT_EQUAL(idx, 2);
+}
+
+static void
+verify_simulate_from(int model, recomb_map_t *recomb_map,
+    tsk_table_collection_t *from_tables, size_t num_replicates)
+{
+    int ret;
+    size_t j;
+    tsk_bookmark_t pos;
+    tsk_table_collection_t tables, clone_tables;
+    tsk_treeseq_t final;
+    tsk_tree_t tree;
+    msp_t msp, clone;
+    size_t num_ancestors;
+    double total_mass;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    gsl_rng *clone_rng = gsl_rng_alloc(gsl_rng_default);
+
+    CU_ASSERT_FATAL(rng != NULL && clone_rng != NULL);
+    ret = tsk_table_collection_copy(from_tables, &tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_alloc(&msp, 0, NULL, recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    if (model == MSP_MODEL_DTWF) {
+        ret = msp_set_simulation_model_dtwf(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+    }
+    ret = msp_set_population_configuration(&msp, 0, 10, 0);
+    CU_ASSERT_EQUAL(ret, 0);
+    /* TODO add dirac and other models */
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    num_ancestors = msp_get_num_ancestors(&msp);
+    total_mass = fenwick_get_total(&msp.links[0]);
+    /* A clone starts from the same tables and state */
+    ret = tsk_table_collection_init(&clone_tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_clone(&clone, &msp, &clone_tables, clone_rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_TRUE(tsk_table_collection_equals(from_tables, &clone_tables));
+    CU_ASSERT_EQUAL(msp_get_num_ancestors(&clone), num_ancestors);
+
+    for (j = 0; j < num_replicates; j++) {
+        gsl_rng_set(rng, j + 1);
+        gsl_rng_set(clone_rng, j + 1);
+        msp_verify(&msp, 0);
+        /* Each reset must restore the same initial state */
+        CU_ASSERT_EQUAL(msp_get_num_ancestors(&msp), num_ancestors);
+        CU_ASSERT_DOUBLE_EQUAL(fenwick_get_total(&msp.links[0]), total_mass, 1e-9);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, 0);
+        CU_ASSERT_TRUE(msp_is_completed(&msp));
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&clone, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, 0);
+        ret = msp_finalise_tables(&clone);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&tables, &clone_tables));
+        ret = msp_reset(&clone);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = tsk_treeseq_init(&final, &tables, TSK_BUILD_INDEXES);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        ret = tsk_tree_init(&tree, &final, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        for (ret = tsk_tree_first(&tree); ret == 1; ret = tsk_tree_next(&tree)) {
+            CU_ASSERT_EQUAL_FATAL(tsk_tree_get_num_roots(&tree), 1);
+        }
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        ret = tsk_table_collection_record_num_rows(from_tables, &pos);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = tsk_table_collection_truncate(&tables, &pos);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_TRUE(tsk_table_collection_equals(from_tables, &tables));
+
+        tsk_treeseq_free(&final);
+
+        tsk_tree_free(&tree);
+        ret = msp_reset(&msp);
+        /* printf("ret = %s\n", msp_strerror(ret)); */
+        CU_ASSERT_EQUAL(ret, 0);
+    }
+    msp_free(&clone);
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    gsl_rng_free(clone_rng);
+    tsk_table_collection_free(&tables);
+    tsk_table_collection_free(&clone_tables);
+}
+
+/* Verify that the initial state we get in a new simulator from calling
+ * with from_ts is equivalent to the state in the original simulator */
+static void
+verify_initial_simulate_from_state(
+    msp_t *msp_source, recomb_map_t *recomb_map, tsk_table_collection_t *from_tables)
+{
+    int ret;
+    msp_t msp_dest;
+    size_t num_ancestors;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+
+    ret = msp_alloc(&msp_dest, 0, NULL, recomb_map, from_tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp_dest);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    msp_print_state(&msp_dest, _devnull);
+
+    /* In principle we can examine the generated ancestors to ensure
+     * that we have correctly translated the segments. In practise this
+     * is quite tricky, so we content ourselves with checking the number
+     * is the same. */
+
+    num_ancestors = msp_get_num_ancestors(msp_source);
+    CU_ASSERT_EQUAL_FATAL(num_ancestors, msp_get_num_ancestors(&msp_dest));
+
+    msp_free(&msp_dest);
+    gsl_rng_free(rng);
+}
+
+static void
+verify_simple_simulate_from(int model, uint32_t n, size_t num_loci,
+    double sequence_length, double recombination_rate, size_t num_events,
+    size_t num_replicates)
+{
+    int ret;
+    tsk_table_collection_t tables;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    msp_t msp;
+    recomb_map_t recomb_map;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(
+        &recomb_map, sequence_length, recombination_rate, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    memset(samples, 0, n * sizeof(sample_t));
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+
+    /* Partially run the simulation */
+    ret = msp_run(&msp, DBL_MAX, num_events);
+    CU_ASSERT_EQUAL_FATAL(ret, 1);
+    CU_ASSERT_FALSE(msp_is_completed(&msp));
+    ret = msp_finalise_tables(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* Add some provenances */
+    ret = tsk_provenance_table_add_row(&tables.provenances, "time", 4, "record", 6);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    verify_initial_simulate_from_state(&msp, &recomb_map, &tables);
+    verify_simulate_from(model, &recomb_map, &tables, num_replicates);
+
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    tsk_table_collection_free(&tables);
+    recomb_map_free(&recomb_map);
+    free(samples);
+}
+
+static void
+test_simulate_from_single_locus(void)
 {
-    double values_repeating[] = { 0, 10, 10, 30 };
-    size_t size = 4;
-    size_t idx;
+    verify_simple_simulate_from(MSP_MODEL_HUDSON, 10, 1, 1.0, 0, 5, 1);
+    verify_simple_simulate_from(MSP_MODEL_DTWF, 10, 1, 1.0, 0, 5, 1);
+
+    verify_simple_simulate_from(MSP_MODEL_HUDSON, 10, 1, 1.0, 1, 5, 1);
+    verify_simple_simulate_from(MSP_MODEL_DTWF, 10, 1, 1.0, 1, 5, 1);
+}
+
+static void
+test_simulate_from_single_locus_replicates(void)
+{
+    verify_simple_simulate_from(MSP_MODEL_HUDSON, 10, 1, 1.0, 0, 5, 10);
+    verify_simple_simulate_from(MSP_MODEL_DTWF, 10, 1, 1.0, 0, 5, 10);
+}
+
+static void
+test_simulate_from_multi_locus_replicates(void)
+{
+    verify_simple_simulate_from(MSP_MODEL_HUDSON, 10, 100, 100.0, 0.1, 5, 10);
+    verify_simple_simulate_from(MSP_MODEL_DTWF, 10, 100, 100.0, 0.1, 5, 10);
+}
+
+static void
+test_simulate_from_empty(void)
+{
+    verify_simple_simulate_from(MSP_MODEL_HUDSON, 10, 1, 1.0, 0, 0, 1);
+    verify_simple_simulate_from(MSP_MODEL_DTWF, 10, 1, 1.0, 0, 0, 1);
+}
+
+static void
+test_simulate_from_completed(void)
+{
+    int ret;
+    uint32_t n = 25;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    msp_t msp;
+    recomb_map_t recomb_map;
+    tsk_table_collection_t tables;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    double recombination_rate = 2;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, 1.0, recombination_rate, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    memset(samples, 0, n * sizeof(sample_t));
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+
+    ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_TRUE(msp_is_completed(&msp));
+    ret = msp_finalise_tables(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    verify_simulate_from(MSP_MODEL_HUDSON, &recomb_map, &tables, 1);
+
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    tsk_table_collection_free(&tables);
+    recomb_map_free(&recomb_map);
+    free(samples);
+}
+
+static void
+test_simulate_from_incompatible(void)
+{
+    int ret;
+    msp_t msp;
+    recomb_map_t recomb_map;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    tsk_table_collection_t from_tables;
+
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, 10.0, 1, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&from_tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    from_tables.sequence_length = 1.0;
+    /* Add a node so that we get past the first check */
+    ret = tsk_population_table_add_row(&from_tables.populations, NULL, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_node_table_add_row(&from_tables.nodes, 0, 0.0, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* Malformed tree sequence */
+    from_tables.nodes.individual[0] = 100;
+    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    CU_ASSERT_FATAL(msp_is_tsk_error(ret));
+    CU_ASSERT_EQUAL_FATAL(
+        ret ^ (1 << MSP_TSK_ERR_BIT), TSK_ERR_INDIVIDUAL_OUT_OF_BOUNDS);
+    CU_ASSERT_STRING_EQUAL(
+        msp_strerror(ret), tsk_strerror(TSK_ERR_INDIVIDUAL_OUT_OF_BOUNDS));
+    from_tables.nodes.individual[0] = -1;
+    msp_free(&msp);
+
+    /* Sequence length mismatch */
+    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INCOMPATIBLE_FROM_TS);
+    msp_free(&msp);
+
+    /* zero samples */
+    from_tables.sequence_length = 10.0;
+    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_INSUFFICIENT_SAMPLES);
+    msp_free(&msp);
+
+    /* older nodes */
+    from_tables.sequence_length = 10.0;
+    ret = tsk_node_table_add_row(
+        &from_tables.nodes, TSK_NODE_IS_SAMPLE, 1.0, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(
+        &from_tables.nodes, TSK_NODE_IS_SAMPLE, 2.0, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_set_start_time(&msp, 1.999);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_START_TIME_FROM_TS);
+    msp_free(&msp);
+
+    /* Num populations should be 1 */
+    tsk_population_table_add_row(&from_tables.populations, NULL, 0);
+    ret = msp_set_start_time(&msp, 0);
+    CU_ASSERT_EQUAL(ret, 0);
+    from_tables.sequence_length = 10.0;
+    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_INCOMPATIBLE_FROM_TS);
+    msp_free(&msp);
+
+    tsk_population_table_clear(&from_tables.populations);
+    tsk_population_table_add_row(&from_tables.populations, NULL, 0);
+    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_start_time(&msp, 1.999);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_START_TIME_FROM_TS);
+    msp_free(&msp);
+
+    /* Must have legitimate population references */
+    from_tables.nodes.population[0] = -1;
+    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_set_start_time(&msp, 2.0);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_POPULATION_OUT_OF_BOUNDS);
+    msp_free(&msp);
+
+    /* Check to make sure we can run this correctly */
+    from_tables.nodes.population[0] = 0;
+    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_set_start_time(&msp, 2.0);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    msp_free(&msp);
+
+    /* Make a tree sequence that we cannot recover trees from. This only happens
+     * at initialisation time. */
+    ret = tsk_edge_table_add_row(&from_tables.edges, 0, 1, 1, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    tsk_edge_table_add_row(&from_tables.edges, 0, 1, 2, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_FATAL(msp_is_tsk_error(ret));
+    CU_ASSERT_EQUAL_FATAL(
+        ret ^ (1 << MSP_TSK_ERR_BIT), TSK_ERR_BAD_EDGES_CONTRADICTORY_CHILDREN);
+    CU_ASSERT_STRING_EQUAL(
+        msp_strerror(ret), tsk_strerror(TSK_ERR_BAD_EDGES_CONTRADICTORY_CHILDREN));
+    msp_free(&msp);
+
+    gsl_rng_free(rng);
+    recomb_map_free(&recomb_map);
+    tsk_table_collection_free(&from_tables);
+}
+
+static void
+test_simulate_init_errors(void)
+{
+    int ret;
+    uint32_t n = 25;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    msp_t msp;
+    recomb_map_t recomb_map;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, 1.0, 1, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    tables.sequence_length = 1.0;
+
+    memset(samples, 0, n * sizeof(sample_t));
+    ret = msp_alloc(&msp, 0, samples, &recomb_map, NULL, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    msp_free(&msp);
+    ret = msp_alloc(&msp, n, samples, &recomb_map, NULL, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    msp_free(&msp);
+    ret = msp_alloc(&msp, n, NULL, &recomb_map, NULL, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    msp_free(&msp);
+    ret = msp_alloc(&msp, n, NULL, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    msp_free(&msp);
+
+    tsk_table_collection_clear(&tables);
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = msp_set_start_time(&msp, -1);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_START_TIME);
+
+    ret = msp_set_gene_conversion_rate(&msp, -1, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    ret = msp_set_gene_conversion_rate(&msp, 1, -1);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    ret = msp_set_gene_conversion_rate(&msp, 1, 2);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
 
-    // Same as above
-    idx = msp_binary_interval_search(-1, values_repeating, size);
-    CU_ASSERT_EQUAL(idx, 0);
-    // Want leftmost interval
-    idx = msp_binary_interval_search(10, values_repeating, size);
-    CU_ASSERT_EQUAL(idx, 1);
-    // Same as above
-    idx = msp_binary_interval_search(11, values_repeating, size);
-    CU_ASSERT_EQUAL(idx, 3);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    recomb_map_free(&recomb_map);
+    free(samples);
+    tsk_table_collection_free(&tables);
 }
 
 static void
-test_msp_binary_interval_search_edge_cases(void)
+insert_single_tree(tsk_table_collection_t *tables, int alphabet)
 {
-    double values_empty[] = {};
-    size_t idx;
+    /*
+    const char *nodes =
+        "1  0   0\n"
+        "1  0   0\n"
+        "1  0   0\n"
+        "1  0   0\n"
+        "0  1   0\n"
+        "0  2   0\n"
+        "0  3   0\n";
+    const char *edges =
+        "0  1   4   0,1\n"
+        "0  1   5   2,3\n"
+        "0  1   6   4,5\n";
+    */
+    int ret;
+    tables->sequence_length = 1.0;
+    ret = tsk_node_table_add_row(
+        &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_node_table_add_row(
+        &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(
+        &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(
+        &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(&tables->nodes, 0, 1.0, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(&tables->nodes, 0, 2.0, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(&tables->nodes, 0, 3.0, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
 
-    // Empty list
-    idx = msp_binary_interval_search(0, values_empty, 0);
-    CU_ASSERT_EQUAL(idx, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 4, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 4, 1);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 5, 2);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 5, 3);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 6, 4);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 6, 5);
+    CU_ASSERT_FATAL(ret >= 0);
 
-    // Size 1 list
-    double values_one[] = { 10 };
+    ret = tsk_population_table_add_row(&tables->populations, NULL, 0);
+    CU_ASSERT_FATAL(ret == 0);
 
-    // below
-    idx = msp_binary_interval_search(9, values_one, 1);
-    CU_ASSERT_EQUAL(idx, 0);
-    // exact
-    idx = msp_binary_interval_search(10, values_one, 1);
-    CU_ASSERT_EQUAL(idx, 0);
-    // above
-    idx = msp_binary_interval_search(11, values_one, 1);
-    CU_ASSERT_EQUAL(idx, 0);
+    /* Add a site and a mutation */
+    if (alphabet == ALPHABET_BINARY) {
+        ret = tsk_site_table_add_row(&tables->sites, 0.1, "0", 1, NULL, 0);
+        CU_ASSERT_FATAL(ret >= 0);
+        ret = tsk_mutation_table_add_row(&tables->mutations, 0, 0, -1, "1", 1, NULL, 0);
+        CU_ASSERT_FATAL(ret >= 0);
+    } else if (alphabet == ALPHABET_NUCLEOTIDE) {
+        ret = tsk_site_table_add_row(&tables->sites, 0.1, "A", 1, NULL, 0);
+        CU_ASSERT_FATAL(ret >= 0);
+        ret = tsk_mutation_table_add_row(&tables->mutations, 0, 0, -1, "C", 1, NULL, 0);
+        CU_ASSERT_FATAL(ret >= 0);
+    }
 
-    // Size 2 list
-    double values_two[] = { 10, 20 };
-    idx = msp_binary_interval_search(9, values_two, 2);
-    CU_ASSERT_EQUAL(idx, 0);
-    idx = msp_binary_interval_search(10, values_two, 2);
-    CU_ASSERT_EQUAL(idx, 0);
-    idx = msp_binary_interval_search(15, values_two, 2);
-    CU_ASSERT_EQUAL(idx, 1);
-    idx = msp_binary_interval_search(20, values_two, 2);
-    CU_ASSERT_EQUAL(idx, 1);
-    idx = msp_binary_interval_search(21, values_two, 2);
-    CU_ASSERT_EQUAL(idx, 1);
+    ret = tsk_table_collection_check_integrity(tables, TSK_CHECK_OFFSETS);
 
-    // All zeros
-    double values_zeros[] = { 0, 0, 0 };
-    idx = msp_binary_interval_search(-1, values_zeros, 3);
-    CU_ASSERT_EQUAL(idx, 0);
-    idx = msp_binary_interval_search(0, values_zeros, 3);
-    CU_ASSERT_EQUAL(idx, 0);
-    idx = msp_binary_interval_search(1, values_zeros, 3);
-    CU_ASSERT_EQUAL(idx, 2);
+    CU_ASSERT_FATAL(ret == 0);
 }
 
 static void
-verify_simulate_from(int model, recomb_map_t *recomb_map,
-    tsk_table_collection_t *from_tables, size_t num_replicates)
+test_mutgen_simple_map(void)
 {
-    int ret;
-    size_t j;
-    tsk_bookmark_t pos;
-    tsk_table_collection_t tables;
-    tsk_treeseq_t final;
-    tsk_tree_t tree;
-    msp_t msp;
+    int ret = 0;
+    mutgen_t mutgen;
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    mutation_model_t mut_model;
+    tsk_table_collection_t tables;
+    interval_map_t rate_map;
+    double pos[] = { 0, 0.1, 0.2, 0.3, 0.4, 1.0 };
+    double rate[] = { 0, 0.01, 0.02, 0.03, 0.04, 0.0 };
 
-    ret = tsk_table_collection_copy(from_tables, &tables, 0);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = msp_alloc(&msp, 0, NULL, recomb_map, &tables, rng);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = tsk_table_collection_init(&tables, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
+    insert_single_tree(&tables, ALPHABET_NUCLEOTIDE);
 
-    if (model == MSP_MODEL_DTWF) {
-        ret = msp_set_simulation_model_dtwf(&msp);
-        CU_ASSERT_EQUAL(ret, 0);
-    }
-    ret = msp_set_population_configuration(&msp, 0, 10, 0);
-    CU_ASSERT_EQUAL(ret, 0);
-    /* TODO add dirac and other models */
-    ret = msp_initialise(&msp);
+    ret = interval_map_alloc(&rate_map, 6, pos, rate);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    for (j = 0; j < num_replicates; j++) {
-        msp_verify(&msp, 0);
-        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
-        CU_ASSERT_EQUAL(ret, 0);
-        CU_ASSERT_TRUE(msp_is_completed(&msp));
-        ret = msp_finalise_tables(&msp);
-        CU_ASSERT_EQUAL_FATAL(ret, 0);
-        ret = tsk_treeseq_init(&final, &tables, TSK_BUILD_INDEXES);
-        CU_ASSERT_EQUAL_FATAL(ret, 0);
-
-        ret = tsk_tree_init(&tree, &final, 0);
-        CU_ASSERT_EQUAL_FATAL(ret, 0);
-        for (ret = tsk_tree_first(&tree); ret == 1; ret = tsk_tree_next(&tree)) {
-            CU_ASSERT_EQUAL_FATAL(tsk_tree_get_num_roots(&tree), 1);
-        }
-        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->size, 6);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[0], 0);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[1], 0.1);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[2], 0.2);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[3], 0.3);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[4], 0.4);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[5], 1.0);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[0], 0);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[1], 0.01);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[2], 0.02);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[3], 0.03);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[4], 0.04);
+    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[5], 0);
 
-        ret = tsk_table_collection_record_num_rows(from_tables, &pos);
-        CU_ASSERT_EQUAL_FATAL(ret, 0);
-        ret = tsk_table_collection_truncate(&tables, &pos);
-        CU_ASSERT_EQUAL_FATAL(ret, 0);
-        CU_ASSERT_TRUE(tsk_table_collection_equals(from_tables, &tables));
+    ret = mutgen_generate(&mutgen, &tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-        tsk_treeseq_free(&final);
+    tables.sequence_length = 2.0;
+    ret = mutgen_generate(&mutgen, &tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INCOMPATIBLE_MUTATION_MAP);
 
-        tsk_tree_free(&tree);
-        ret = msp_reset(&msp);
-        /* printf("ret = %s\n", msp_strerror(ret)); */
-        CU_ASSERT_EQUAL(ret, 0);
-    }
-    msp_free(&msp);
-    gsl_rng_free(rng);
+    mutgen_free(&mutgen);
+    interval_map_free(&rate_map);
+    mutation_model_free(&mut_model);
     tsk_table_collection_free(&tables);
+    gsl_rng_free(rng);
 }
 
-/* Verify that the initial state we get in a new simulator from calling
- * with from_ts is equivalent to the state in the original simulator */
 static void
-verify_initial_simulate_from_state(
-    msp_t *msp_source, recomb_map_t *recomb_map, tsk_table_collection_t *from_tables)
+test_mutgen_errors(void)
 {
-    int ret;
-    msp_t msp_dest;
-    size_t num_ancestors;
+    int ret = 0;
+    mutgen_t mutgen;
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    tsk_table_collection_t tables;
+    interval_map_t rate_map;
+    mutation_model_t mut_model, mut_model_binary;
 
-    ret = msp_alloc(&msp_dest, 0, NULL, recomb_map, from_tables, rng);
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    insert_single_tree(&tables, ALPHABET_NUCLEOTIDE);
+
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = matrix_mutation_model_factory(&mut_model_binary, ALPHABET_BINARY);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = interval_map_alloc_single(&rate_map, 1, -1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_MUTATION_MAP_RATE);
+    interval_map_free(&rate_map);
+    mutgen_free(&mutgen);
+
+    ret = interval_map_alloc_single(&rate_map, 5, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_generate(&mutgen, &tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INCOMPATIBLE_MUTATION_MAP);
+
+    tables.sequence_length = 0.1;
+    ret = mutgen_generate(&mutgen, &tables, 0);
+    CU_ASSERT_FATAL(msp_is_tsk_error(ret));
+    tables.sequence_length = 1.0;
+    interval_map_free(&rate_map);
+    mutgen_free(&mutgen);
+
+    /* mix of binary and nucleotide alleles */
+    ret = interval_map_alloc_single(&rate_map, 1, 20);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model_binary, 1);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = msp_initialise(&msp_dest);
+    ret = mutgen_set_time_interval(&mutgen, 0.5, 10.0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    msp_print_state(&msp_dest, _devnull);
-
-    /* In principle we can examine the generated ancestors to ensure
-     * that we have correctly translated the segments. In practise this
-     * is quite tricky, so we content ourselves with checking the number
-     * is the same. */
-
-    num_ancestors = msp_get_num_ancestors(msp_source);
-    CU_ASSERT_EQUAL_FATAL(num_ancestors, msp_get_num_ancestors(&msp_dest));
+    /* we shouldn't error the first time since existing site is nucleotide
+     * but not at an integer loction */
+    ret = mutgen_generate(&mutgen, &tables, MSP_DISCRETE_SITES | MSP_KEEP_SITES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    mutgen_free(&mutgen);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_set_time_interval(&mutgen, 0.0, 0.5);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_generate(&mutgen, &tables, MSP_DISCRETE_SITES | MSP_KEEP_SITES);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_UNKNOWN_ALLELE);
 
-    msp_free(&msp_dest);
+    mutgen_free(&mutgen);
+    interval_map_free(&rate_map);
+    mutation_model_free(&mut_model);
+    mutation_model_free(&mut_model_binary);
+    tsk_table_collection_free(&tables);
     gsl_rng_free(rng);
 }
 
 static void
-verify_simple_simulate_from(int model, uint32_t n, size_t num_loci,
-    double sequence_length, double recombination_rate, size_t num_events,
-    size_t num_replicates)
+test_mutgen_bad_mutation_order(void)
 {
-    int ret;
-    tsk_table_collection_t tables;
-    sample_t *samples = malloc(n * sizeof(sample_t));
-    msp_t msp;
-    recomb_map_t recomb_map;
+    int ret = 0;
+    mutgen_t mutgen;
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    tsk_table_collection_t tables;
+    interval_map_t rate_map;
+    mutation_model_t mut_model;
 
-    CU_ASSERT_FATAL(samples != NULL);
     CU_ASSERT_FATAL(rng != NULL);
-    ret = recomb_map_alloc_uniform(
-        &recomb_map, sequence_length, recombination_rate, true);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
     ret = tsk_table_collection_init(&tables, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
+    insert_single_tree(&tables, ALPHABET_NUCLEOTIDE);
+    ret = interval_map_alloc_single(&rate_map, 1, 20);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    memset(samples, 0, n * sizeof(sample_t));
-    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_initialise(&msp);
-    CU_ASSERT_EQUAL(ret, 0);
-
-    /* Partially run the simulation */
-    ret = msp_run(&msp, DBL_MAX, num_events);
-    CU_ASSERT_EQUAL_FATAL(ret, 1);
-    CU_ASSERT_FALSE(msp_is_completed(&msp));
-    ret = msp_finalise_tables(&msp);
+    /* bad mutation generation order */
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 1);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    /* Add some provenances */
-    ret = tsk_provenance_table_add_row(&tables.provenances, "time", 4, "record", 6);
+    ret = mutgen_set_time_interval(&mutgen, 0.0, 0.5);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    verify_initial_simulate_from_state(&msp, &recomb_map, &tables);
-    verify_simulate_from(model, &recomb_map, &tables, num_replicates);
+    ret = mutgen_generate(&mutgen, &tables, MSP_DISCRETE_SITES | MSP_KEEP_SITES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_set_time_interval(&mutgen, 0.5, 1.0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_generate(&mutgen, &tables, MSP_DISCRETE_SITES | MSP_KEEP_SITES);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_MUTATION_GENERATION_OUT_OF_ORDER);
 
-    msp_free(&msp);
-    gsl_rng_free(rng);
+    mutgen_free(&mutgen);
+    interval_map_free(&rate_map);
+    mutation_model_free(&mut_model);
     tsk_table_collection_free(&tables);
-    recomb_map_free(&recomb_map);
-    free(samples);
-}
-
-static void
-test_simulate_from_single_locus(void)
-{
-    verify_simple_simulate_from(MSP_MODEL_HUDSON, 10, 1, 1.0, 0, 5, 1);
-    verify_simple_simulate_from(MSP_MODEL_DTWF, 10, 1, 1.0, 0, 5, 1);
-
-    verify_simple_simulate_from(MSP_MODEL_HUDSON, 10, 1, 1.0, 1, 5, 1);
-    verify_simple_simulate_from(MSP_MODEL_DTWF, 10, 1, 1.0, 1, 5, 1);
-}
-
-static void
-test_simulate_from_single_locus_replicates(void)
-{
-    verify_simple_simulate_from(MSP_MODEL_HUDSON, 10, 1, 1.0, 0, 5, 10);
-    verify_simple_simulate_from(MSP_MODEL_DTWF, 10, 1, 1.0, 0, 5, 10);
-}
-
-static void
-test_simulate_from_empty(void)
-{
-    verify_simple_simulate_from(MSP_MODEL_HUDSON, 10, 1, 1.0, 0, 0, 1);
-    verify_simple_simulate_from(MSP_MODEL_DTWF, 10, 1, 1.0, 0, 0, 1);
+    gsl_rng_free(rng);
 }
 
 static void
-test_simulate_from_completed(void)
+test_single_tree_mutgen(void)
 {
-    int ret;
-    uint32_t n = 25;
-    sample_t *samples = malloc(n * sizeof(sample_t));
-    msp_t msp;
-    recomb_map_t recomb_map;
-    tsk_table_collection_t tables;
+    int ret = 0;
+    size_t j;
+    mutgen_t mutgen;
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    double recombination_rate = 2;
+    tsk_table_collection_t tables1, tables2;
+    mutation_model_t mut_model;
+    interval_map_t rate_map;
 
-    CU_ASSERT_FATAL(samples != NULL);
     CU_ASSERT_FATAL(rng != NULL);
-    ret = recomb_map_alloc_uniform(&recomb_map, 1.0, recombination_rate, true);
+    ret = tsk_table_collection_init(&tables1, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = tsk_table_collection_init(&tables, 0);
+    ret = tsk_table_collection_init(&tables2, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    insert_single_tree(&tables1, ALPHABET_BINARY);
+    insert_single_tree(&tables2, ALPHABET_BINARY);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_BINARY);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    memset(samples, 0, n * sizeof(sample_t));
-    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_initialise(&msp);
-    CU_ASSERT_EQUAL(ret, 0);
+    ret = interval_map_alloc_single(&rate_map, 1, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 100);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_generate(&mutgen, &tables1, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_TRUE(tables1.mutations.num_rows == 0);
+    mutgen_print_state(&mutgen, _devnull);
+    ret = mutgen_free(&mutgen);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+    gsl_rng_set(rng, 1);
+    /* Cheat a bit to avoid reallocating a new rate_map */
+    rate_map.value[0] = 10;
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 100);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    CU_ASSERT_TRUE(msp_is_completed(&msp));
-    ret = msp_finalise_tables(&msp);
+    ret = mutgen_generate(&mutgen, &tables1, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    mutgen_print_state(&mutgen, _devnull);
+    CU_ASSERT_TRUE(tables1.mutations.num_rows > 0);
+    CU_ASSERT_TRUE(tables1.mutations.num_rows == tables1.sites.num_rows);
+    for (j = 0; j < tables1.mutations.num_rows; j++) {
+        CU_ASSERT_TRUE(tables1.mutations.site[j] == j);
+        CU_ASSERT_TRUE(tables1.sites.position[j] <= 1.0);
+        CU_ASSERT_TRUE(tables1.mutations.node[j] < 6);
+        CU_ASSERT_EQUAL(tables1.sites.ancestral_state[j], '0');
+        CU_ASSERT_EQUAL(tables1.mutations.derived_state[j], '1');
+    }
+    ret = mutgen_free(&mutgen);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    verify_simulate_from(MSP_MODEL_HUDSON, &recomb_map, &tables, 1);
+    /* Test the reallocing behavior by setting a very small
+     * block size.
+     */
+    gsl_rng_set(rng, 1);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_generate(&mutgen, &tables2, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_TRUE(tsk_table_collection_equals(&tables1, &tables2));
+    ret = mutgen_free(&mutgen);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    msp_free(&msp);
+    tsk_table_collection_free(&tables1);
+    tsk_table_collection_free(&tables2);
+    mutation_model_free(&mut_model);
+    interval_map_free(&rate_map);
     gsl_rng_free(rng);
-    tsk_table_collection_free(&tables);
-    recomb_map_free(&recomb_map);
-    free(samples);
 }
 
 static void
-test_simulate_from_incompatible(void)
+test_single_tree_mutgen_columnar(void)
 {
-    int ret;
-    msp_t msp;
-    recomb_map_t recomb_map;
+    int ret = 0;
+    size_t j;
+    mutgen_t mutgen;
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    tsk_table_collection_t from_tables;
+    tsk_table_collection_t tables1, tables2;
+    mutation_model_t mut_model;
+    interval_map_t rate_map;
 
     CU_ASSERT_FATAL(rng != NULL);
-    ret = recomb_map_alloc_uniform(&recomb_map, 10.0, 1, true);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = tsk_table_collection_init(&from_tables, 0);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    from_tables.sequence_length = 1.0;
-    /* Add a node so that we get past the first check */
-    ret = tsk_population_table_add_row(&from_tables.populations, NULL, 0);
+    ret = tsk_table_collection_init(&tables1, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = tsk_node_table_add_row(&from_tables.nodes, 0, 0.0, 0, TSK_NULL, NULL, 0);
+    ret = tsk_table_collection_init(&tables2, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-
-    /* Malformed tree sequence */
-    from_tables.nodes.individual[0] = 100;
-    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
-    CU_ASSERT_FATAL(msp_is_tsk_error(ret));
-    CU_ASSERT_EQUAL_FATAL(
-        ret ^ (1 << MSP_TSK_ERR_BIT), TSK_ERR_INDIVIDUAL_OUT_OF_BOUNDS);
-    CU_ASSERT_STRING_EQUAL(
-        msp_strerror(ret), tsk_strerror(TSK_ERR_INDIVIDUAL_OUT_OF_BOUNDS));
-    from_tables.nodes.individual[0] = -1;
-    msp_free(&msp);
-
-    /* Sequence length mismatch */
-    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INCOMPATIBLE_FROM_TS);
-    msp_free(&msp);
-
-    /* zero samples */
-    from_tables.sequence_length = 10.0;
-    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_initialise(&msp);
-    CU_ASSERT_EQUAL(ret, MSP_ERR_INSUFFICIENT_SAMPLES);
-    msp_free(&msp);
-
-    /* older nodes */
-    from_tables.sequence_length = 10.0;
-    ret = tsk_node_table_add_row(
-        &from_tables.nodes, TSK_NODE_IS_SAMPLE, 1.0, 0, TSK_NULL, NULL, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_node_table_add_row(
-        &from_tables.nodes, TSK_NODE_IS_SAMPLE, 2.0, 0, TSK_NULL, NULL, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_set_start_time(&msp, 1.999);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_initialise(&msp);
-    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_START_TIME_FROM_TS);
-    msp_free(&msp);
-
-    /* Num populations should be 1 */
-    tsk_population_table_add_row(&from_tables.populations, NULL, 0);
-    ret = msp_set_start_time(&msp, 0);
-    CU_ASSERT_EQUAL(ret, 0);
-    from_tables.sequence_length = 10.0;
-    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    insert_single_tree(&tables1, ALPHABET_BINARY);
+    insert_single_tree(&tables2, ALPHABET_BINARY);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_BINARY);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = msp_initialise(&msp);
-    CU_ASSERT_EQUAL(ret, MSP_ERR_INCOMPATIBLE_FROM_TS);
-    msp_free(&msp);
-
-    tsk_population_table_clear(&from_tables.populations);
-    tsk_population_table_add_row(&from_tables.populations, NULL, 0);
-    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    /* Enough mutations to use the radix sort */
+    ret = interval_map_alloc_single(&rate_map, 1, 1000);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = msp_set_start_time(&msp, 1.999);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_initialise(&msp);
-    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_START_TIME_FROM_TS);
-    msp_free(&msp);
 
-    /* Must have legitimate population references */
-    from_tables.nodes.population[0] = -1;
-    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_set_start_time(&msp, 2.0);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_initialise(&msp);
-    CU_ASSERT_EQUAL(ret, MSP_ERR_POPULATION_OUT_OF_BOUNDS);
-    msp_free(&msp);
+    gsl_rng_set(rng, 5);
+    ret = mutgen_generate(&mutgen, &tables1, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_FATAL(tables1.mutations.num_rows > 2048);
+    CU_ASSERT_EQUAL_FATAL(tables1.mutations.num_rows, tables1.sites.num_rows);
+    for (j = 1; j < tables1.sites.num_rows; j++) {
+        CU_ASSERT_FATAL(tables1.sites.position[j - 1] < tables1.sites.position[j]);
+    }
+    ret = tsk_table_collection_check_integrity(&tables1, TSK_CHECK_ALL);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    /* Check to make sure we can run this correctly */
-    from_tables.nodes.population[0] = 0;
-    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_set_start_time(&msp, 2.0);
-    CU_ASSERT_EQUAL(ret, 0);
-    ret = msp_initialise(&msp);
-    CU_ASSERT_EQUAL(ret, 0);
-    msp_free(&msp);
+    /* An existing site with no mutations forces the general path, which
+     * should consume the same random numbers. */
+    ret = tsk_site_table_add_row(&tables2.sites, 0.0, "0", 1, NULL, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    gsl_rng_set(rng, 5);
+    ret = mutgen_generate(&mutgen, &tables2, MSP_KEEP_SITES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(tables2.sites.num_rows, tables1.sites.num_rows + 1);
+    CU_ASSERT_EQUAL_FATAL(tables2.mutations.num_rows, tables1.mutations.num_rows);
+    for (j = 0; j < tables1.mutations.num_rows; j++) {
+        CU_ASSERT_EQUAL_FATAL(tables1.sites.position[j], tables2.sites.position[j + 1]);
+        CU_ASSERT_EQUAL_FATAL(tables1.mutations.site[j] + 1, tables2.mutations.site[j]);
+        CU_ASSERT_EQUAL_FATAL(tables1.mutations.node[j], tables2.mutations.node[j]);
+    }
 
-    /* Make a tree sequence that we cannot recover trees from. This only happens
-     * at initialisation time. */
-    ret = tsk_edge_table_add_row(&from_tables.edges, 0, 1, 1, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-    tsk_edge_table_add_row(&from_tables.edges, 0, 1, 2, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = msp_alloc(&msp, 0, NULL, &recomb_map, &from_tables, rng);
+    /* With discrete sites all the mutations are at position 0 */
+    rate_map.value[0] = 300;
+    ret = mutgen_generate(&mutgen, &tables1, MSP_DISCRETE_SITES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(tables1.sites.num_rows, 1);
+    CU_ASSERT_FATAL(tables1.mutations.num_rows > 2048);
+    ret = tsk_table_collection_check_integrity(&tables1, TSK_CHECK_ALL);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = msp_initialise(&msp);
-    CU_ASSERT_FATAL(msp_is_tsk_error(ret));
-    CU_ASSERT_EQUAL_FATAL(
-        ret ^ (1 << MSP_TSK_ERR_BIT), TSK_ERR_BAD_EDGES_CONTRADICTORY_CHILDREN);
-    CU_ASSERT_STRING_EQUAL(
-        msp_strerror(ret), tsk_strerror(TSK_ERR_BAD_EDGES_CONTRADICTORY_CHILDREN));
-    msp_free(&msp);
 
+    mutgen_free(&mutgen);
+    tsk_table_collection_free(&tables1);
+    tsk_table_collection_free(&tables2);
+    mutation_model_free(&mut_model);
+    interval_map_free(&rate_map);
     gsl_rng_free(rng);
-    recomb_map_free(&recomb_map);
-    tsk_table_collection_free(&from_tables);
 }
 
 static void
-test_simulate_init_errors(void)
+verify_mutgen_chunks(mutation_model_t *mut_model, int flags)
 {
-    int ret;
-    uint32_t n = 25;
-    sample_t *samples = malloc(n * sizeof(sample_t));
-    msp_t msp;
-    recomb_map_t recomb_map;
+    int ret = 0;
+    mutgen_t mutgen;
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    tsk_table_collection_t tables;
+    tsk_table_collection_t tables1, tables2;
+    interval_map_t rate_map;
+    size_t num_threads;
 
-    CU_ASSERT_FATAL(samples != NULL);
     CU_ASSERT_FATAL(rng != NULL);
-    ret = recomb_map_alloc_uniform(&recomb_map, 1.0, 1, true);
+    ret = tsk_table_collection_init(&tables1, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = tsk_table_collection_init(&tables, 0);
+    ret = tsk_table_collection_init(&tables2, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    tables.sequence_length = 1.0;
-
-    memset(samples, 0, n * sizeof(sample_t));
-    ret = msp_alloc(&msp, 0, samples, &recomb_map, NULL, rng);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
-    msp_free(&msp);
-    ret = msp_alloc(&msp, n, samples, &recomb_map, NULL, rng);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
-    msp_free(&msp);
-    ret = msp_alloc(&msp, n, NULL, &recomb_map, NULL, rng);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
-    msp_free(&msp);
-    ret = msp_alloc(&msp, n, NULL, &recomb_map, &tables, rng);
+    insert_single_tree(&tables1, ALPHABET_NUCLEOTIDE);
+    insert_single_tree(&tables2, ALPHABET_NUCLEOTIDE);
+    ret = interval_map_alloc_single(&rate_map, 1, 50);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, mut_model, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_set_num_threads(&mutgen, 0);
     CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
-    msp_free(&msp);
-
-    tsk_table_collection_clear(&tables);
-    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
+    ret = mutgen_set_num_chunks(&mutgen, 7);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    ret = msp_set_start_time(&msp, -1);
-    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_START_TIME);
+    gsl_rng_set(rng, 42);
+    ret = mutgen_generate(&mutgen, &tables1, flags);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_FATAL(tables1.mutations.num_rows > 0);
+    ret = tsk_table_collection_check_integrity(&tables1, TSK_CHECK_ALL);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    ret = msp_set_gene_conversion_rate(&msp, -1, 1);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
-    ret = msp_set_gene_conversion_rate(&msp, 1, -1);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
-    ret = msp_set_gene_conversion_rate(&msp, 1, 2);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    /* The output depends only on the number of chunks */
+    for (num_threads = 2; num_threads < 10; num_threads += 3) {
+        ret = mutgen_set_num_threads(&mutgen, num_threads);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        gsl_rng_set(rng, 42);
+        ret = mutgen_generate(&mutgen, &tables2, flags);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&tables1, &tables2));
+    }
 
-    ret = msp_initialise(&msp);
-    CU_ASSERT_EQUAL(ret, 0);
+    /* Going back to a single stream works */
+    ret = mutgen_set_num_chunks(&mutgen, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_generate(&mutgen, &tables2, flags);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_check_integrity(&tables2, TSK_CHECK_ALL);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    msp_free(&msp);
+    mutgen_free(&mutgen);
+    interval_map_free(&rate_map);
+    tsk_table_collection_free(&tables1);
+    tsk_table_collection_free(&tables2);
     gsl_rng_free(rng);
-    recomb_map_free(&recomb_map);
-    free(samples);
-    tsk_table_collection_free(&tables);
 }
 
 static void
-insert_single_tree(tsk_table_collection_t *tables, int alphabet)
+test_mutgen_chunks(void)
 {
-    /*
-    const char *nodes =
-        "1  0   0\n"
-        "1  0   0\n"
-        "1  0   0\n"
-        "1  0   0\n"
-        "0  1   0\n"
-        "0  2   0\n"
-        "0  3   0\n";
-    const char *edges =
-        "0  1   4   0,1\n"
-        "0  1   5   2,3\n"
-        "0  1   6   4,5\n";
-    */
-    int ret;
-    tables->sequence_length = 1.0;
-    ret = tsk_node_table_add_row(
-        &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = tsk_node_table_add_row(
-        &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_node_table_add_row(
-        &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_node_table_add_row(
-        &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_node_table_add_row(&tables->nodes, 0, 1.0, 0, TSK_NULL, NULL, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_node_table_add_row(&tables->nodes, 0, 2.0, 0, TSK_NULL, NULL, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_node_table_add_row(&tables->nodes, 0, 3.0, 0, TSK_NULL, NULL, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-
-    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 4, 0);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 4, 1);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 5, 2);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 5, 3);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 6, 4);
-    CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 6, 5);
-    CU_ASSERT_FATAL(ret >= 0);
-
-    ret = tsk_population_table_add_row(&tables->populations, NULL, 0);
-    CU_ASSERT_FATAL(ret == 0);
-
-    /* Add a site and a mutation */
-    if (alphabet == ALPHABET_BINARY) {
-        ret = tsk_site_table_add_row(&tables->sites, 0.1, "0", 1, NULL, 0);
-        CU_ASSERT_FATAL(ret >= 0);
-        ret = tsk_mutation_table_add_row(&tables->mutations, 0, 0, -1, "1", 1, NULL, 0);
-        CU_ASSERT_FATAL(ret >= 0);
-    } else if (alphabet == ALPHABET_NUCLEOTIDE) {
-        ret = tsk_site_table_add_row(&tables->sites, 0.1, "A", 1, NULL, 0);
-        CU_ASSERT_FATAL(ret >= 0);
-        ret = tsk_mutation_table_add_row(&tables->mutations, 0, 0, -1, "C", 1, NULL, 0);
-        CU_ASSERT_FATAL(ret >= 0);
-    }
+    int ret = 0;
+    mutation_model_t mut_model;
 
-    ret = tsk_table_collection_check_integrity(tables, TSK_CHECK_OFFSETS);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    verify_mutgen_chunks(&mut_model, 0);
+    verify_mutgen_chunks(&mut_model, MSP_DISCRETE_SITES);
+    mutation_model_free(&mut_model);
 
-    CU_ASSERT_FATAL(ret == 0);
+    ret = infinite_alleles_mutation_model_alloc(&mut_model, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    verify_mutgen_chunks(&mut_model, 0);
+    mutation_model_free(&mut_model);
 }
 
+/* Each chunk starts from the tree at its left end rather than walking the
+ * trees from the start of the genome, so check that the mutation parents it
+ * assigns agree with a single pass over all of the trees. */
 static void
-test_mutgen_simple_map(void)
+verify_mutgen_chunks_many_trees(mutation_model_t *mut_model)
 {
-    int ret = 0;
-    mutgen_t mutgen;
+    int ret;
+    uint32_t n = 20;
+    double m = 50;
+    size_t num_chunks[] = { 2, 7, 64 };
+    size_t j, k, num_parents;
+    sample_t *samples = calloc(n, sizeof(sample_t));
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    mutation_model_t mut_model;
-    tsk_table_collection_t tables;
-    interval_map_t rate_map;
-    double pos[] = { 0, 0.1, 0.2, 0.3, 0.4, 1.0 };
-    double rate[] = { 0, 0.01, 0.02, 0.03, 0.04, 0.0 };
+    msp_t msp;
+    mutgen_t mutgen, rerun;
+    tsk_table_collection_t tables, copy;
+    recomb_map_t recomb_map;
+    interval_map_t mut_map, zero_map;
 
+    CU_ASSERT_FATAL(samples != NULL);
     CU_ASSERT_FATAL(rng != NULL);
+    ret = recomb_map_alloc_uniform(&recomb_map, m, 0.1, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = interval_map_alloc_single(&mut_map, m, 2);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = interval_map_alloc_single(&zero_map, m, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
     ret = tsk_table_collection_init(&tables, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    insert_single_tree(&tables, ALPHABET_NUCLEOTIDE);
-
-    ret = interval_map_alloc(&rate_map, 6, pos, rate);
+    ret = msp_alloc(&msp, n, samples, &recomb_map, &tables, rng);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
+    ret = msp_initialise(&msp);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_run(&msp, DBL_MAX, SIZE_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_finalise_tables(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_FATAL(msp_get_num_breakpoints(&msp) > 20);
 
-    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 0);
+    ret = mutgen_alloc(&mutgen, rng, &mut_map, mut_model, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->size, 6);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[0], 0);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[1], 0.1);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[2], 0.2);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[3], 0.3);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[4], 0.4);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->position[5], 1.0);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[0], 0);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[1], 0.01);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[2], 0.02);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[3], 0.03);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[4], 0.04);
-    CU_ASSERT_EQUAL_FATAL(mutgen.rate_map->value[5], 0);
+    ret = mutgen_set_num_threads(&mutgen, 3);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&rerun, rng, &zero_map, mut_model, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < sizeof(num_chunks) / sizeof(*num_chunks); j++) {
+        ret = mutgen_set_num_chunks(&mutgen, num_chunks[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = mutgen_generate(&mutgen, &tables, MSP_DISCRETE_SITES);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = tsk_table_collection_check_integrity(&tables, TSK_CHECK_ALL);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        num_parents = 0;
+        for (k = 0; k < tables.mutations.num_rows; k++) {
+            num_parents += tables.mutations.parent[k] != TSK_NULL;
+        }
+        CU_ASSERT_FATAL(num_parents > 0);
+
+        /* Keeping the sites without adding any mutations recomputes the
+         * mutation parents in one pass over the whole genome. */
+        ret = tsk_table_collection_copy(&tables, &copy, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        for (k = 0; k < copy.mutations.num_rows; k++) {
+            copy.mutations.parent[k] = TSK_NULL;
+        }
+        ret = mutgen_generate(&rerun, &copy, MSP_KEEP_SITES | MSP_DISCRETE_SITES);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_TRUE(tsk_site_table_equals(&tables.sites, &copy.sites));
+        CU_ASSERT_TRUE(tsk_mutation_table_equals(&tables.mutations, &copy.mutations));
+        tsk_table_collection_free(&copy);
+    }
+
+    ret = msp_free(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    mutgen_free(&mutgen);
+    mutgen_free(&rerun);
+    gsl_rng_free(rng);
+    free(samples);
+    tsk_table_collection_free(&tables);
+    recomb_map_free(&recomb_map);
+    interval_map_free(&mut_map);
+    interval_map_free(&zero_map);
+}
 
-    ret = mutgen_generate(&mutgen, &tables, 0);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
+static void
+test_mutgen_chunks_many_trees(void)
+{
+    int ret = 0;
+    mutation_model_t mut_model;
 
-    tables.sequence_length = 2.0;
-    ret = mutgen_generate(&mutgen, &tables, 0);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INCOMPATIBLE_MUTATION_MAP);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    verify_mutgen_chunks_many_trees(&mut_model);
+    mutation_model_free(&mut_model);
 
-    mutgen_free(&mutgen);
-    interval_map_free(&rate_map);
+    ret = infinite_alleles_mutation_model_alloc(&mut_model, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    verify_mutgen_chunks_many_trees(&mut_model);
     mutation_model_free(&mut_model);
-    tsk_table_collection_free(&tables);
-    gsl_rng_free(rng);
 }
 
 static void
-test_mutgen_errors(void)
+verify_mutgen_trim(size_t num_chunks, int flags)
 {
     int ret = 0;
+    size_t j;
     mutgen_t mutgen;
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    tsk_table_collection_t tables;
+    tsk_table_collection_t base, tables, first;
+    mutation_model_t mut_model;
     interval_map_t rate_map;
-    mutation_model_t mut_model, mut_model_binary;
 
     CU_ASSERT_FATAL(rng != NULL);
-    ret = tsk_table_collection_init(&tables, 0);
+    ret = tsk_table_collection_init(&base, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    insert_single_tree(&tables, ALPHABET_NUCLEOTIDE);
-
-    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
+    insert_single_tree(&base, ALPHABET_NUCLEOTIDE);
+    ret = tsk_site_table_add_row(&base.sites, 0.0, "A", 1, NULL, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = matrix_mutation_model_factory(&mut_model_binary, ALPHABET_BINARY);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-
-    ret = interval_map_alloc_single(&rate_map, 1, -1);
+    ret = interval_map_alloc_single(&rate_map, 1, 10);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 1);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_BAD_MUTATION_MAP_RATE);
-    interval_map_free(&rate_map);
-    mutgen_free(&mutgen);
-
-    ret = interval_map_alloc_single(&rate_map, 5, 1);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 1);
+    ret = mutgen_set_num_chunks(&mutgen, num_chunks);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_generate(&mutgen, &tables, 0);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_INCOMPATIBLE_MUTATION_MAP);
 
-    tables.sequence_length = 0.1;
-    ret = mutgen_generate(&mutgen, &tables, 0);
-    CU_ASSERT_FATAL(msp_is_tsk_error(ret));
-    tables.sequence_length = 1.0;
-    interval_map_free(&rate_map);
-    mutgen_free(&mutgen);
-
-    /* mix of binary and nucleotide alleles */
-    ret = interval_map_alloc_single(&rate_map, 1, 20);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model_binary, 1);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_set_time_interval(&mutgen, 0.5, 10.0);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    /* we shouldn't error the first time since existing site is nucleotide
-     * but not at an integer loction */
-    ret = mutgen_generate(&mutgen, &tables, MSP_DISCRETE_SITES | MSP_KEEP_SITES);
+    ret = tsk_table_collection_copy(&base, &first, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    mutgen_free(&mutgen);
-    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 1);
+    gsl_rng_set(rng, 7);
+    ret = mutgen_generate(&mutgen, &first, flags);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_set_time_interval(&mutgen, 0.0, 0.5);
+    CU_ASSERT_FATAL(first.mutations.num_rows > 0);
+
+    /* Memory retained between calls, or released by trim, must not change
+     * the output. */
+    for (j = 0; j < 4; j++) {
+        if (j == 2) {
+            ret = mutgen_trim(&mutgen);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        ret = tsk_table_collection_copy(&base, &tables, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        gsl_rng_set(rng, 7);
+        ret = mutgen_generate(&mutgen, &tables, flags);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&tables, &first));
+        tsk_table_collection_free(&tables);
+    }
+    ret = mutgen_trim(&mutgen);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_generate(&mutgen, &tables, MSP_DISCRETE_SITES | MSP_KEEP_SITES);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_UNKNOWN_ALLELE);
 
     mutgen_free(&mutgen);
-    interval_map_free(&rate_map);
+    tsk_table_collection_free(&base);
+    tsk_table_collection_free(&first);
     mutation_model_free(&mut_model);
-    mutation_model_free(&mut_model_binary);
-    tsk_table_collection_free(&tables);
+    interval_map_free(&rate_map);
     gsl_rng_free(rng);
 }
 
 static void
-test_mutgen_bad_mutation_order(void)
+test_mutgen_trim(void)
+{
+    verify_mutgen_trim(0, 0);
+    verify_mutgen_trim(4, 0);
+    verify_mutgen_trim(0, MSP_KEEP_SITES);
+    verify_mutgen_trim(0, MSP_KEEP_SITES | MSP_DISCRETE_SITES);
+}
+
+static void
+verify_mutgen_single_pass(interval_map_t *rate_map, size_t num_chunks, int flags)
 {
     int ret = 0;
     mutgen_t mutgen;
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
     tsk_table_collection_t tables;
-    interval_map_t rate_map;
     mutation_model_t mut_model;
+    size_t j, index;
 
     CU_ASSERT_FATAL(rng != NULL);
     ret = tsk_table_collection_init(&tables, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    insert_single_tree(&tables, ALPHABET_NUCLEOTIDE);
-    ret = interval_map_alloc_single(&rate_map, 1, 20);
+    insert_single_tree(&tables, ALPHABET_BINARY);
+    tables.sequence_length = 100;
+    for (j = 0; j < tables.edges.num_rows; j++) {
+        tables.edges.right[j] = 100;
+    }
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_BINARY);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
+    ret = mutgen_alloc(&mutgen, rng, rate_map, &mut_model, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-
-    /* bad mutation generation order */
-    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 1);
+    ret = mutgen_set_num_chunks(&mutgen, num_chunks);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_set_time_interval(&mutgen, 0.0, 0.5);
+    ret = mutgen_set_time_interval(&mutgen, 0.5, 2.5);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_generate(&mutgen, &tables, MSP_DISCRETE_SITES | MSP_KEEP_SITES);
+
+    ret = mutgen_generate(&mutgen, &tables, flags | MSP_SINGLE_PASS_PLACEMENT);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_set_time_interval(&mutgen, 0.5, 1.0);
+    CU_ASSERT_FATAL(tables.mutations.num_rows > 0);
+    ret = tsk_table_collection_check_integrity(&tables, TSK_CHECK_ALL);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_generate(&mutgen, &tables, MSP_DISCRETE_SITES | MSP_KEEP_SITES);
-    CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_MUTATION_GENERATION_OUT_OF_ORDER);
+    /* No mutations in the zero rate intervals */
+    for (j = 0; j < tables.sites.num_rows; j++) {
+        index = interval_map_get_index(rate_map, tables.sites.position[j]);
+        CU_ASSERT_FATAL(rate_map->value[index] > 0);
+        if (flags & MSP_DISCRETE_SITES) {
+            CU_ASSERT_EQUAL_FATAL(
+                tables.sites.position[j], floor(tables.sites.position[j]));
+        }
+    }
 
     mutgen_free(&mutgen);
-    interval_map_free(&rate_map);
     mutation_model_free(&mut_model);
     tsk_table_collection_free(&tables);
     gsl_rng_free(rng);
 }
 
 static void
-test_single_tree_mutgen(void)
+test_mutgen_single_pass_placement(void)
 {
     int ret = 0;
+    interval_map_t rate_map;
+    double position[21];
+    double rate[21];
     size_t j;
+
+    for (j = 0; j < 21; j++) {
+        position[j] = 5 * (double) j;
+        rate[j] = (double) (j % 2);
+    }
+    /* Use some non-integer breakpoints */
+    position[7] = 34.5;
+    position[10] = 50.25;
+    ret = interval_map_alloc(&rate_map, 21, position, rate);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    verify_mutgen_single_pass(&rate_map, 0, 0);
+    verify_mutgen_single_pass(&rate_map, 0, MSP_DISCRETE_SITES);
+    verify_mutgen_single_pass(&rate_map, 3, 0);
+    verify_mutgen_single_pass(&rate_map, 3, MSP_DISCRETE_SITES);
+
+    interval_map_free(&rate_map);
+}
+
+static void
+verify_mutgen_discrete_keep_sites(double existing_position)
+{
+    int ret = 0;
     mutgen_t mutgen;
     gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
-    tsk_table_collection_t tables1, tables2;
+    tsk_table_collection_t tables;
     mutation_model_t mut_model;
     interval_map_t rate_map;
+    bool found = false;
+    size_t j;
 
     CU_ASSERT_FATAL(rng != NULL);
-    ret = tsk_table_collection_init(&tables1, 0);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = tsk_table_collection_init(&tables2, 0);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    insert_single_tree(&tables1, ALPHABET_BINARY);
-    insert_single_tree(&tables2, ALPHABET_BINARY);
-    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_BINARY);
+    ret = tsk_table_collection_init(&tables, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-
-    ret = interval_map_alloc_single(&rate_map, 1, 0);
+    insert_single_tree(&tables, ALPHABET_NUCLEOTIDE);
+    tables.sequence_length = 1000;
+    for (j = 0; j < tables.edges.num_rows; j++) {
+        tables.edges.right[j] = 1000;
+    }
+    ret = tsk_site_table_add_row(&tables.sites, existing_position, "A", 1, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_mutation_table_add_row(&tables.mutations, 0, 4, -1, "C", 1, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 100);
+    ret = interval_map_alloc_single(&rate_map, 1000, 1);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_generate(&mutgen, &tables1, 0);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    CU_ASSERT_TRUE(tables1.mutations.num_rows == 0);
-    mutgen_print_state(&mutgen, _devnull);
-    ret = mutgen_free(&mutgen);
+    ret = mutgen_set_time_interval(&mutgen, 0, 1);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
 
-    gsl_rng_set(rng, 1);
-    /* Cheat a bit to avoid reallocating a new rate_map */
-    rate_map.value[0] = 10;
-    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 100);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_generate(&mutgen, &tables1, 0);
+    ret = mutgen_generate(&mutgen, &tables, MSP_KEEP_SITES | MSP_DISCRETE_SITES);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
     mutgen_print_state(&mutgen, _devnull);
-    CU_ASSERT_TRUE(tables1.mutations.num_rows > 0);
-    CU_ASSERT_TRUE(tables1.mutations.num_rows == tables1.sites.num_rows);
-    for (j = 0; j < tables1.mutations.num_rows; j++) {
-        CU_ASSERT_TRUE(tables1.mutations.site[j] == j);
-        CU_ASSERT_TRUE(tables1.sites.position[j] <= 1.0);
-        CU_ASSERT_TRUE(tables1.mutations.node[j] < 6);
-        CU_ASSERT_EQUAL(tables1.sites.ancestral_state[j], '0');
-        CU_ASSERT_EQUAL(tables1.mutations.derived_state[j], '1');
-    }
-    ret = mutgen_free(&mutgen);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-
-    /* Test the reallocing behavior by setting a very small
-     * block size.
-     */
-    gsl_rng_set(rng, 1);
-    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 1);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    ret = mutgen_generate(&mutgen, &tables2, 0);
-    CU_ASSERT_EQUAL_FATAL(ret, 0);
-    CU_ASSERT_TRUE(tsk_table_collection_equals(&tables1, &tables2));
-    ret = mutgen_free(&mutgen);
+    CU_ASSERT_FATAL(tables.sites.num_rows > 100);
+    ret = tsk_table_collection_check_integrity(&tables, TSK_CHECK_ALL);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < tables.sites.num_rows; j++) {
+        if (tables.sites.position[j] == existing_position) {
+            found = true;
+        } else {
+            CU_ASSERT_EQUAL_FATAL(
+                tables.sites.position[j], floor(tables.sites.position[j]));
+        }
+    }
+    CU_ASSERT_TRUE(found);
 
-    tsk_table_collection_free(&tables1);
-    tsk_table_collection_free(&tables2);
+    mutgen_free(&mutgen);
     mutation_model_free(&mut_model);
     interval_map_free(&rate_map);
+    tsk_table_collection_free(&tables);
     gsl_rng_free(rng);
 }
 
+static void
+test_mutgen_discrete_keep_sites(void)
+{
+    /* Integer positions use the site index, others the AVL tree */
+    verify_mutgen_discrete_keep_sites(500);
+    verify_mutgen_discrete_keep_sites(999);
+    verify_mutgen_discrete_keep_sites(500.5);
+}
+
 static void
 test_single_tree_mutgen_keep_sites(void)
 {
@@ -5042,6 +6721,56 @@ test_mutgen_infinite_alleles(void)
     gsl_rng_free(rng);
 }
 
+static void
+test_mutgen_infinite_alleles_many_values(void)
+{
+    int ret = 0;
+    mutgen_t mutgen;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    tsk_table_collection_t tables;
+    interval_map_t rate_map;
+    mutation_model_t mut_model;
+    tsk_site_t site;
+    tsk_mutation_t mutation;
+    tsk_size_t j;
+    char buff[100];
+
+    CU_ASSERT_FATAL(rng != NULL);
+    /* Enough mutations to span several batches of alleles */
+    ret = interval_map_alloc_single(&rate_map, 1, 100);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    insert_single_tree(&tables, -1);
+
+    ret = infinite_alleles_mutation_model_alloc(&mut_model, 95, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&mutgen, rng, &rate_map, &mut_model, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_generate(&mutgen, &tables, MSP_DISCRETE_SITES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_TRUE(tables.mutations.num_rows > 512);
+    CU_ASSERT_TRUE(tables.sites.num_rows == 1);
+
+    ret = tsk_site_table_get_row(&tables.sites, 0, &site);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_NSTRING_EQUAL("95", site.ancestral_state, site.ancestral_state_length);
+    for (j = 0; j < tables.mutations.num_rows; j++) {
+        ret = tsk_mutation_table_get_row(&tables.mutations, j, &mutation);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        sprintf(buff, "%d", (int) j + 96);
+        CU_ASSERT_EQUAL_FATAL(mutation.derived_state_length, strlen(buff));
+        CU_ASSERT_NSTRING_EQUAL(
+            buff, mutation.derived_state, mutation.derived_state_length);
+    }
+
+    mutgen_free(&mutgen);
+    interval_map_free(&rate_map);
+    mutation_model_free(&mut_model);
+    tsk_table_collection_free(&tables);
+    gsl_rng_free(rng);
+}
+
 static void
 test_mutgen_infinite_alleles_large_values(void)
 {
@@ -5545,6 +7274,75 @@ test_matrix_mutation_model_properties(void)
     mutation_model_free(&model);
 }
 
+static void
+test_matrix_mutation_model_alias_tables(void)
+{
+    int ret;
+    mutation_model_t model;
+    mutation_matrix_t *params;
+    const char *alleles[] = { "A", "C", "G", "TT" };
+    size_t lengths[] = { 1, 1, 1, 2 };
+    double dist[] = { 0.25, 0.25, 0.25, 0.25 };
+    double matrix[] = { 0.0, 0.5, 0.5, 0.0, 0.1, 0.2, 0.3, 0.4, 0.0, 0.0, 1.0, 0.0,
+        0.7, 0.0, 0.2, 0.1 };
+    double reconstructed[4];
+    size_t n = 4;
+    size_t j, k;
+    int count[4];
+    tsk_id_t row;
+    mutation_t mutation;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+
+    ret = matrix_mutation_model_alloc(
+        &model, n, (char **) (uintptr_t) alleles, lengths, dist, matrix);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    params = &model.params.mutation_matrix;
+
+    /* The alias tables must reproduce each row of the matrix */
+    for (row = 0; row < (tsk_id_t) n; row++) {
+        memset(reconstructed, 0, sizeof(reconstructed));
+        for (j = 0; j < n; j++) {
+            k = (size_t) row * n + j;
+            CU_ASSERT_FATAL(params->alias[k] >= 0 && params->alias[k] < (tsk_id_t) n);
+            reconstructed[j] += params->alias_probability[k] / (double) n;
+            reconstructed[params->alias[k]]
+                += (1.0 - params->alias_probability[k]) / (double) n;
+        }
+        for (j = 0; j < n; j++) {
+            CU_ASSERT_DOUBLE_EQUAL(reconstructed[j], matrix[(size_t) row * n + j], 1e-12);
+        }
+    }
+    CU_ASSERT_EQUAL(params->byte_allele_index['A'], 0);
+    CU_ASSERT_EQUAL(params->byte_allele_index['C'], 1);
+    CU_ASSERT_EQUAL(params->byte_allele_index['G'], 2);
+    CU_ASSERT_EQUAL(params->byte_allele_index['T'], -1);
+
+    /* Transitions never go to alleles with zero probability */
+    memset(count, 0, sizeof(count));
+    for (j = 0; j < 1000; j++) {
+        memset(&mutation, 0, sizeof(mutation));
+        ret = model.transition(&model, rng, "TT", 2, NULL, 0, &mutation);
+        CU_ASSERT_FATAL(ret == 0 || ret == 1);
+        if (ret == 1) {
+            count[3]++;
+        } else {
+            CU_ASSERT_FATAL(mutation.derived_state_length == 1);
+            count[params->byte_allele_index[(unsigned char) mutation.derived_state[0]]]++;
+        }
+    }
+    CU_ASSERT_EQUAL(count[1], 0);
+    CU_ASSERT(count[0] > 0);
+    CU_ASSERT(count[2] > 0);
+    CU_ASSERT(count[3] > 0);
+    ret = model.transition(&model, rng, "G", 1, NULL, 0, &mutation);
+    CU_ASSERT_EQUAL(ret, 1);
+    ret = model.transition(&model, rng, "T", 1, NULL, 0, &mutation);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_UNKNOWN_ALLELE);
+
+    mutation_model_free(&model);
+    gsl_rng_free(rng);
+}
+
 static void
 test_slim_mutation_model_errors(void)
 {
@@ -5667,6 +7465,9 @@ main(int argc, char **argv)
         { "test_fenwick_expand", test_fenwick_expand },
         { "test_single_locus_two_populations", test_single_locus_two_populations },
         { "test_single_locus_many_populations", test_single_locus_many_populations },
+        { "test_mass_migration_proportions", test_mass_migration_proportions },
+        { "test_repeated_instantaneous_bottlenecks",
+            test_repeated_instantaneous_bottlenecks },
         { "test_single_locus_historical_sample", test_single_locus_historical_sample },
         { "test_single_locus_multiple_historical_samples",
             test_single_locus_multiple_historical_samples },
@@ -5676,6 +7477,7 @@ main(int argc, char **argv)
             test_single_locus_historical_sample_start_time },
         { "test_single_locus_historical_sample_end_time",
             test_single_locus_historical_sample_end_time },
+        { "test_max_time_uncoalesced_edges", test_max_time_uncoalesced_edges },
         { "test_simulator_getters_setters", test_simulator_getters_setters },
         { "test_demographic_events", test_demographic_events },
         { "test_demographic_events_start_time", test_demographic_events_start_time },
@@ -5710,11 +7512,24 @@ main(int argc, char **argv)
         { "test_dtwf_multi_locus_simulation", test_dtwf_multi_locus_simulation },
         { "test_gene_conversion_simulation", test_gene_conversion_simulation },
         { "test_simulation_replicates", test_simulation_replicates },
+        { "test_simulation_streamed_mutations", test_simulation_streamed_mutations },
+        { "test_simulation_clone", test_simulation_clone },
+        { "test_simulation_run_replicates", test_simulation_run_replicates },
+        { "test_simulation_interrupt", test_simulation_interrupt },
+        { "test_stamp_replicate_tables", test_stamp_replicate_tables },
+        { "test_branch_stats_simulation", test_branch_stats_simulation },
+        { "test_branch_stats_time_limit", test_branch_stats_time_limit },
+        { "test_branch_stats_replicates", test_branch_stats_replicates },
+        { "test_ms_output", test_ms_output },
         { "test_bottleneck_simulation", test_bottleneck_simulation },
         { "test_dirac_coalescent_bad_parameters", test_dirac_coalescent_bad_parameters },
         { "test_beta_coalescent_bad_parameters", test_beta_coalescent_bad_parameters },
         { "test_multiple_mergers_simulation", test_multiple_mergers_simulation },
         { "test_multiple_mergers_growth_rate", test_multiple_mergers_growth_rate },
+        { "test_multiple_mergers_direct_sampling",
+            test_multiple_mergers_direct_sampling },
+        { "test_beta_timescale_population_size_change",
+            test_beta_timescale_population_size_change },
         { "test_large_bottleneck_simulation", test_large_bottleneck_simulation },
         { "test_simple_recombination_map", test_simple_recomb_map },
         { "test_recombination_map_copy", test_recomb_map_copy },
@@ -5732,6 +7547,8 @@ main(int argc, char **argv)
         { "test_simulate_from_single_locus", test_simulate_from_single_locus },
         { "test_simulate_from_single_locus_replicates",
             test_simulate_from_single_locus_replicates },
+        { "test_simulate_from_multi_locus_replicates",
+            test_simulate_from_multi_locus_replicates },
         { "test_simulate_from_empty", test_simulate_from_empty },
         { "test_simulate_from_completed", test_simulate_from_completed },
         { "test_simulate_from_incompatible", test_simulate_from_incompatible },
@@ -5741,6 +7558,12 @@ main(int argc, char **argv)
         { "test_mutgen_errors", test_mutgen_errors },
         { "test_mutgen_bad_mutation_order", test_mutgen_bad_mutation_order },
         { "test_single_tree_mutgen", test_single_tree_mutgen },
+        { "test_single_tree_mutgen_columnar", test_single_tree_mutgen_columnar },
+        { "test_mutgen_chunks", test_mutgen_chunks },
+        { "test_mutgen_chunks_many_trees", test_mutgen_chunks_many_trees },
+        { "test_mutgen_trim", test_mutgen_trim },
+        { "test_mutgen_single_pass_placement", test_mutgen_single_pass_placement },
+        { "test_mutgen_discrete_keep_sites", test_mutgen_discrete_keep_sites },
         { "test_single_tree_mutgen_keep_sites", test_single_tree_mutgen_keep_sites },
         { "test_single_tree_mutgen_discrete_sites",
             test_single_tree_mutgen_discrete_sites },
@@ -5756,6 +7579,8 @@ main(int argc, char **argv)
         { "test_mutgen_slim_mutation_large_values",
             test_mutgen_slim_mutation_large_values },
         { "test_mutgen_infinite_alleles", test_mutgen_infinite_alleles },
+        { "test_mutgen_infinite_alleles_many_values",
+            test_mutgen_infinite_alleles_many_values },
         { "test_mutgen_infinite_alleles_large_values",
             test_mutgen_infinite_alleles_large_values },
 
@@ -5774,6 +7599,8 @@ main(int argc, char **argv)
         { "test_matrix_mutation_model_errors", test_matrix_mutation_model_errors },
         { "test_matrix_mutation_model_properties",
             test_matrix_mutation_model_properties },
+        { "test_matrix_mutation_model_alias_tables",
+            test_matrix_mutation_model_alias_tables },
         { "test_slim_mutation_model_errors", test_slim_mutation_model_errors },
         { "test_slim_mutation_model_properties", test_slim_mutation_model_properties },
 
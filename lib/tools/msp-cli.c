@@ -0,0 +1,1056 @@
+/*
+** Copyright (C) 2020 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Command line interface for running batches of simulation replicates
+ * directly from the C library. The simulation is described by a libconfig
+ * file (see tools/example.cfg), and the replicates are run on a pool of
+ * threads by msp_run_replicates. Each replicate can be written to its own
+ * trees file, to a single indexed archive, and summarised in a JSON file.
+ *
+ * The archive is a sequence of complete trees files followed by an index,
+ * with all integers stored as unsigned 64 bit little endian values:
+ *
+ *     magic (8 bytes) | trees file 0 | ... | trees file n - 1
+ *     | offset[0] ... offset[n] | n | index offset | magic (8 bytes)
+ *
+ * Replicate j occupies bytes [offset[j], offset[j + 1]) of the file, and
+ * the index starts at the index offset. The last 24 bytes of the file
+ * therefore locate any replicate.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <time.h>
+
+#include <regex.h>
+#include <libconfig.h>
+#include <gsl/gsl_math.h>
+#include "argtable3.h"
+
+#include "msprime.h"
+#include "util.h"
+
+#ifndef MSP_CLI_VERSION
+#define MSP_CLI_VERSION "1.0.0"
+#endif
+
+#define CLI_ARCHIVE_MAGIC "MSPARCH1"
+#define CLI_ARCHIVE_MAGIC_LENGTH 8
+#define CLI_COPY_BUFFER_SIZE 65536
+
+typedef struct {
+    FILE *file;
+    char *tmp_path;
+    uint64_t *offsets;
+    size_t num_replicates;
+} cli_archive_t;
+
+/* The state used when receiving each replicate from msp_run_replicates */
+typedef struct {
+    unsigned long seed;
+    const char *output_prefix;
+    char *output_path;
+    cli_archive_t *archive;
+    FILE *stats;
+    size_t summary_size;
+    mutgen_t *mutgen;
+    gsl_rng *mutation_rng;
+    const msp_replicate_template_t *replicate_template;
+} cli_sink_t;
+
+static void
+fatal_error(const char *msg, ...)
+{
+    va_list argp;
+    fprintf(stderr, "msp-cli: ");
+    va_start(argp, msg);
+    vfprintf(stderr, msg, argp);
+    va_end(argp);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+static void
+fatal_msprime_error(int err, const char *context)
+{
+    fatal_error("%s: %s", context, msp_strerror(err));
+}
+
+static void
+fatal_tskit_error(int err, const char *context)
+{
+    fatal_error("%s: %s", context, tsk_strerror(err));
+}
+
+/* Returns a newly allocated copy of the string with the characters that
+ * must be escaped in a JSON string escaped. */
+static char *
+json_escape(const char *str)
+{
+    size_t j, k;
+    size_t length = strlen(str);
+    char *ret = malloc(6 * length + 1);
+
+    if (ret == NULL) {
+        fatal_error("Out of memory");
+    }
+    k = 0;
+    for (j = 0; j < length; j++) {
+        if (str[j] == '"' || str[j] == '\\') {
+            ret[k++] = '\\';
+            ret[k++] = str[j];
+        } else if ((unsigned char) str[j] < 0x20) {
+            k += (size_t) sprintf(ret + k, "\\u%04x", (unsigned char) str[j]);
+        } else {
+            ret[k++] = str[j];
+        }
+    }
+    ret[k] = '\0';
+    return ret;
+}
+
+static void
+write_json_double(FILE *out, double value)
+{
+    if (isfinite(value)) {
+        fprintf(out, "%.17g", value);
+    } else {
+        fputs("null", out);
+    }
+}
+
+/*===================================================================
+ * Configuration
+ *===================================================================
+ */
+
+static double
+get_member_float(const config_setting_t *setting, const char *name, const char *context)
+{
+    double value;
+
+    if (config_setting_lookup_float(setting, name, &value) == CONFIG_FALSE) {
+        fatal_error("%s: %s must be specified as a number", context, name);
+    }
+    return value;
+}
+
+static int
+get_member_int(const config_setting_t *setting, const char *name, const char *context)
+{
+    int value;
+
+    if (config_setting_lookup_int(setting, name, &value) == CONFIG_FALSE) {
+        fatal_error("%s: %s must be specified as an integer", context, name);
+    }
+    return value;
+}
+
+static double
+lookup_float(const config_t *config, const char *path, double default_value)
+{
+    double value = default_value;
+
+    if (config_lookup(config, path) != NULL
+        && config_lookup_float(config, path, &value) == CONFIG_FALSE) {
+        fatal_error("%s must be a number", path);
+    }
+    return value;
+}
+
+static int
+lookup_int(const config_t *config, const char *path, int default_value)
+{
+    int value = default_value;
+
+    if (config_lookup(config, path) != NULL
+        && config_lookup_int(config, path, &value) == CONFIG_FALSE) {
+        fatal_error("%s must be an integer", path);
+    }
+    return value;
+}
+
+static void
+load_tables(tsk_table_collection_t *tables, const char *filename)
+{
+    int ret;
+    tsk_table_collection_t tmp;
+
+    /* tsk_table_collection_load gives read-only tables, so we copy them. */
+    ret = tsk_table_collection_load(&tmp, filename, 0);
+    if (ret != 0) {
+        fatal_tskit_error(ret, filename);
+    }
+    ret = tsk_table_collection_copy(&tmp, tables, 0);
+    if (ret != 0) {
+        fatal_tskit_error(ret, filename);
+    }
+    tsk_table_collection_free(&tmp);
+}
+
+/* Samples are either given individually as a list of groups with a
+ * population and a time, or as a sample_size taken from population 0 at
+ * time zero. */
+static void
+read_samples(const config_t *config, size_t *num_samples, sample_t **samples)
+{
+    size_t j, n;
+    int sample_size;
+    sample_t *ret_samples = NULL;
+    config_setting_t *s;
+    config_setting_t *setting = config_lookup(config, "samples");
+
+    if (setting != NULL) {
+        if (config_setting_is_list(setting) == CONFIG_FALSE) {
+            fatal_error("samples must be a list");
+        }
+        n = (size_t) config_setting_length(setting);
+    } else {
+        sample_size = lookup_int(config, "sample_size", 0);
+        if (sample_size < 0) {
+            fatal_error("sample_size must be positive");
+        }
+        n = (size_t) sample_size;
+    }
+    ret_samples = malloc(GSL_MAX(n, 1) * sizeof(*ret_samples));
+    if (ret_samples == NULL) {
+        fatal_error("Out of memory");
+    }
+    for (j = 0; j < n; j++) {
+        ret_samples[j].population_id = 0;
+        ret_samples[j].time = 0;
+        if (setting != NULL) {
+            s = config_setting_get_elem(setting, (unsigned int) j);
+            if (s == NULL || config_setting_is_group(s) == CONFIG_FALSE) {
+                fatal_error("samples[%d] must be a group", (int) j);
+            }
+            ret_samples[j].population_id
+                = (population_id_t) get_member_int(s, "population", "samples");
+            ret_samples[j].time = get_member_float(s, "time", "samples");
+        }
+    }
+    *samples = ret_samples;
+    *num_samples = n;
+}
+
+/* The recombination map is either a list of [position, rate] pairs, or a
+ * uniform map given by the sequence_length and recombination_rate. */
+static void
+read_recomb_map(const config_t *config, recomb_map_t *recomb_map)
+{
+    int ret;
+    size_t j, size;
+    double *rates = NULL;
+    double *positions = NULL;
+    config_setting_t *row, *s;
+    config_setting_t *setting = config_lookup(config, "recombination_map");
+    bool discrete = lookup_int(config, "discrete", 0) != 0;
+
+    if (setting == NULL) {
+        ret = recomb_map_alloc_uniform(recomb_map,
+            lookup_float(config, "sequence_length", 1.0),
+            lookup_float(config, "recombination_rate", 0.0), discrete);
+        if (ret != 0) {
+            fatal_msprime_error(ret, "recombination map");
+        }
+        return;
+    }
+    if (config_setting_is_list(setting) == CONFIG_FALSE) {
+        fatal_error("recombination_map must be a list");
+    }
+    size = (size_t) config_setting_length(setting);
+    rates = malloc(GSL_MAX(size, 1) * sizeof(*rates));
+    positions = malloc(GSL_MAX(size, 1) * sizeof(*positions));
+    if (rates == NULL || positions == NULL) {
+        fatal_error("Out of memory");
+    }
+    for (j = 0; j < size; j++) {
+        row = config_setting_get_elem(setting, (unsigned int) j);
+        if (row == NULL || config_setting_is_array(row) == CONFIG_FALSE
+            || config_setting_length(row) != 2) {
+            fatal_error("recombination_map entries must be [position, rate] pairs");
+        }
+        s = config_setting_get_elem(row, 0);
+        positions[j] = config_setting_get_float(s);
+        s = config_setting_get_elem(row, 1);
+        rates[j] = config_setting_get_float(s);
+    }
+    ret = recomb_map_alloc(recomb_map, size, positions, rates, discrete);
+    if (ret != 0) {
+        fatal_msprime_error(ret, "recombination map");
+    }
+    free(rates);
+    free(positions);
+}
+
+static void
+read_model(msp_t *msp, const config_t *config)
+{
+    int ret = 0;
+    const char *name;
+    config_setting_t *setting = config_lookup(config, "model");
+
+    if (setting == NULL) {
+        /* The standard coalescent is the default */
+        return;
+    }
+    if (config_setting_is_group(setting) == CONFIG_FALSE) {
+        fatal_error("model must be a group");
+    }
+    if (config_setting_lookup_string(setting, "name", &name) == CONFIG_FALSE) {
+        fatal_error("model: name must be specified");
+    }
+    if (strcmp(name, "hudson") == 0) {
+        ret = msp_set_simulation_model_hudson(msp);
+    } else if (strcmp(name, "smc") == 0) {
+        ret = msp_set_simulation_model_smc(msp);
+    } else if (strcmp(name, "smc_prime") == 0) {
+        ret = msp_set_simulation_model_smc_prime(msp);
+    } else if (strcmp(name, "dtwf") == 0) {
+        ret = msp_set_simulation_model_dtwf(msp);
+    } else if (strcmp(name, "dirac") == 0) {
+        ret = msp_set_simulation_model_dirac(msp,
+            get_member_float(setting, "psi", "model"),
+            get_member_float(setting, "c", "model"));
+    } else if (strcmp(name, "beta") == 0) {
+        ret = msp_set_simulation_model_beta(msp,
+            get_member_float(setting, "alpha", "model"),
+            get_member_float(setting, "truncation_point", "model"));
+    } else if (strcmp(name, "sweep_genic_selection") == 0) {
+        ret = msp_set_simulation_model_sweep_genic_selection(msp,
+            get_member_float(setting, "position", "model"),
+            get_member_float(setting, "start_frequency", "model"),
+            get_member_float(setting, "end_frequency", "model"),
+            get_member_float(setting, "alpha", "model"),
+            get_member_float(setting, "dt", "model"));
+    } else {
+        fatal_error("Unknown simulation model '%s'", name);
+    }
+    if (ret != 0) {
+        fatal_msprime_error(ret, "model");
+    }
+}
+
+static void
+read_populations(msp_t *msp, const config_t *config)
+{
+    int ret;
+    int j, num_populations;
+    config_setting_t *s;
+    config_setting_t *setting = config_lookup(config, "population_configuration");
+    int num_labels = lookup_int(config, "num_labels", 1);
+
+    num_populations = 1;
+    if (setting != NULL) {
+        if (config_setting_is_list(setting) == CONFIG_FALSE) {
+            fatal_error("population_configuration must be a list");
+        }
+        num_populations = config_setting_length(setting);
+    }
+    if (num_populations < 1 || num_labels < 1) {
+        fatal_error("There must be at least one population and label");
+    }
+    ret = msp_set_dimensions(msp, (size_t) num_populations, (size_t) num_labels);
+    if (ret != 0) {
+        fatal_msprime_error(ret, "population_configuration");
+    }
+    if (setting == NULL) {
+        return;
+    }
+    for (j = 0; j < num_populations; j++) {
+        s = config_setting_get_elem(setting, (unsigned int) j);
+        if (s == NULL || config_setting_is_group(s) == CONFIG_FALSE) {
+            fatal_error("population_configuration[%d] must be a group", j);
+        }
+        ret = msp_set_population_configuration(msp, j,
+            get_member_float(s, "initial_size", "population_configuration"),
+            get_member_float(s, "growth_rate", "population_configuration"));
+        if (ret != 0) {
+            fatal_msprime_error(ret, "population_configuration");
+        }
+    }
+}
+
+static void
+read_migration_matrix(msp_t *msp, const config_t *config)
+{
+    int ret;
+    size_t j, size;
+    double *migration_matrix = NULL;
+    config_setting_t *setting = config_lookup(config, "migration_matrix");
+
+    if (setting == NULL) {
+        return;
+    }
+    if (config_setting_is_array(setting) == CONFIG_FALSE) {
+        fatal_error("migration_matrix must be an array");
+    }
+    size = (size_t) config_setting_length(setting);
+    migration_matrix = malloc(GSL_MAX(size, 1) * sizeof(*migration_matrix));
+    if (migration_matrix == NULL) {
+        fatal_error("Out of memory");
+    }
+    for (j = 0; j < size; j++) {
+        migration_matrix[j]
+            = config_setting_get_float(config_setting_get_elem(setting, (unsigned int) j));
+    }
+    ret = msp_set_migration_matrix(msp, size, migration_matrix);
+    if (ret != 0) {
+        fatal_msprime_error(ret, "migration_matrix");
+    }
+    free(migration_matrix);
+}
+
+static void
+read_demographic_events(msp_t *msp, const config_t *config)
+{
+    int ret;
+    int j, num_events;
+    const char *type;
+    const char *ctx = "demographic_events";
+    double time, initial_size, growth_rate;
+    config_setting_t *s;
+    config_setting_t *setting = config_lookup(config, "demographic_events");
+
+    if (setting == NULL) {
+        return;
+    }
+    if (config_setting_is_list(setting) == CONFIG_FALSE) {
+        fatal_error("demographic_events must be a list");
+    }
+    num_events = config_setting_length(setting);
+    for (j = 0; j < num_events; j++) {
+        s = config_setting_get_elem(setting, (unsigned int) j);
+        if (s == NULL || config_setting_is_group(s) == CONFIG_FALSE) {
+            fatal_error("demographic_events[%d] must be a group", j);
+        }
+        time = get_member_float(s, "time", ctx);
+        if (config_setting_lookup_string(s, "type", &type) == CONFIG_FALSE) {
+            fatal_error("demographic_events[%d]: type must be specified", j);
+        }
+        if (strcmp(type, "population_parameters_change") == 0) {
+            /* Parameters that are not specified are left unchanged */
+            initial_size = GSL_NAN;
+            growth_rate = GSL_NAN;
+            config_setting_lookup_float(s, "initial_size", &initial_size);
+            config_setting_lookup_float(s, "growth_rate", &growth_rate);
+            ret = msp_add_population_parameters_change(msp, time,
+                get_member_int(s, "population_id", ctx), initial_size, growth_rate);
+        } else if (strcmp(type, "migration_rate_change") == 0) {
+            ret = msp_add_migration_rate_change(msp, time,
+                get_member_int(s, "source", ctx), get_member_int(s, "dest", ctx),
+                get_member_float(s, "migration_rate", ctx));
+        } else if (strcmp(type, "mass_migration") == 0) {
+            ret = msp_add_mass_migration(msp, time, get_member_int(s, "source", ctx),
+                get_member_int(s, "dest", ctx), get_member_float(s, "proportion", ctx));
+        } else if (strcmp(type, "simple_bottleneck") == 0) {
+            ret = msp_add_simple_bottleneck(msp, time,
+                get_member_int(s, "population_id", ctx),
+                get_member_float(s, "intensity", ctx));
+        } else if (strcmp(type, "instantaneous_bottleneck") == 0) {
+            ret = msp_add_instantaneous_bottleneck(msp, time,
+                get_member_int(s, "population_id", ctx),
+                get_member_float(s, "strength", ctx));
+        } else if (strcmp(type, "census_event") == 0) {
+            ret = msp_add_census_event(msp, time);
+        } else {
+            fatal_error("unknown demographic event type '%s'", type);
+        }
+        if (ret != 0) {
+            fatal_msprime_error(ret, "demographic_events");
+        }
+    }
+}
+
+/* Allocates and configures the simulator from the configuration file. The
+ * tables are used as the initial state if the config names a trees file
+ * to start from. */
+static void
+read_simulator(msp_t *msp, tsk_table_collection_t *tables, gsl_rng *rng,
+    const config_t *config)
+{
+    int ret;
+    size_t num_samples;
+    sample_t *samples = NULL;
+    recomb_map_t recomb_map;
+    const char *from_path;
+    double start_time;
+
+    read_samples(config, &num_samples, &samples);
+    if (config_lookup_string(config, "from", &from_path) == CONFIG_TRUE) {
+        load_tables(tables, from_path);
+    } else if (num_samples == 0) {
+        fatal_error("Either samples, sample_size or from must be specified");
+    }
+    read_recomb_map(config, &recomb_map);
+    ret = msp_alloc(msp, num_samples, samples, &recomb_map, tables, rng);
+    if (ret != 0) {
+        fatal_msprime_error(ret, "simulator");
+    }
+    recomb_map_free(&recomb_map);
+    free(samples);
+
+    read_model(msp, config);
+    read_populations(msp, config);
+    read_migration_matrix(msp, config);
+    read_demographic_events(msp, config);
+    ret = msp_set_gene_conversion_rate(msp,
+        lookup_float(config, "gene_conversion_rate", 0.0),
+        lookup_float(config, "gene_conversion_track_length", 1.0));
+    if (ret != 0) {
+        fatal_msprime_error(ret, "gene conversion");
+    }
+    start_time = lookup_float(config, "start_time", -1);
+    if (start_time >= 0) {
+        ret = msp_set_start_time(msp, start_time);
+        if (ret != 0) {
+            fatal_msprime_error(ret, "start_time");
+        }
+    }
+    ret = msp_set_store_migrations(msp, lookup_int(config, "store_migrations", 0) != 0);
+    if (ret != 0) {
+        fatal_msprime_error(ret, "store_migrations");
+    }
+    ret = msp_set_store_full_arg(msp, lookup_int(config, "store_full_arg", 0) != 0);
+    if (ret != 0) {
+        fatal_msprime_error(ret, "store_full_arg");
+    }
+    ret = msp_set_avl_node_block_size(
+        msp, (size_t) lookup_int(config, "avl_node_block_size", 1024));
+    if (ret != 0) {
+        fatal_msprime_error(ret, "avl_node_block_size");
+    }
+    ret = msp_set_segment_block_size(
+        msp, (size_t) lookup_int(config, "segment_block_size", 1024));
+    if (ret != 0) {
+        fatal_msprime_error(ret, "segment_block_size");
+    }
+    ret = msp_set_node_mapping_block_size(
+        msp, (size_t) lookup_int(config, "node_mapping_block_size", 1024));
+    if (ret != 0) {
+        fatal_msprime_error(ret, "node_mapping_block_size");
+    }
+    if (config_lookup(config, "max_merger_table_lineages") != NULL) {
+        ret = msp_set_max_merger_table_lineages(
+            msp, (size_t) lookup_int(config, "max_merger_table_lineages", 0));
+        if (ret != 0) {
+            fatal_msprime_error(ret, "max_merger_table_lineages");
+        }
+    }
+    ret = msp_initialise(msp);
+    if (ret != 0) {
+        fatal_msprime_error(ret, "simulator");
+    }
+}
+
+/*===================================================================
+ * Output
+ *===================================================================
+ */
+
+static void
+write_uint64(uint64_t value, FILE *out)
+{
+    unsigned char buff[8];
+    int j;
+
+    for (j = 0; j < 8; j++) {
+        buff[j] = (unsigned char) (value >> (8 * j));
+    }
+    fwrite(buff, 1, sizeof(buff), out);
+}
+
+static void
+cli_archive_open(cli_archive_t *self, const char *path, size_t num_replicates)
+{
+    memset(self, 0, sizeof(*self));
+    self->file = fopen(path, "wb");
+    if (self->file == NULL) {
+        fatal_error("Cannot open %s for writing", path);
+    }
+    self->tmp_path = malloc(strlen(path) + 5);
+    self->offsets = malloc((num_replicates + 1) * sizeof(*self->offsets));
+    if (self->tmp_path == NULL || self->offsets == NULL) {
+        fatal_error("Out of memory");
+    }
+    sprintf(self->tmp_path, "%s.tmp", path);
+    fwrite(CLI_ARCHIVE_MAGIC, 1, CLI_ARCHIVE_MAGIC_LENGTH, self->file);
+    self->offsets[0] = CLI_ARCHIVE_MAGIC_LENGTH;
+}
+
+/* Appends the tables to the archive. Trees files can only be written to a
+ * named file, so we go through a temporary file alongside the archive. */
+static int MSP_WARN_UNUSED
+cli_archive_append(cli_archive_t *self, tsk_table_collection_t *tables)
+{
+    int ret = 0;
+    FILE *tmp = NULL;
+    char buff[CLI_COPY_BUFFER_SIZE];
+    size_t num_read;
+    uint64_t offset = self->offsets[self->num_replicates];
+
+    ret = tsk_table_collection_dump(tables, self->tmp_path, 0);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    tmp = fopen(self->tmp_path, "rb");
+    if (tmp == NULL) {
+        ret = MSP_ERR_IO;
+        goto out;
+    }
+    while ((num_read = fread(buff, 1, sizeof(buff), tmp)) > 0) {
+        if (fwrite(buff, 1, num_read, self->file) != num_read) {
+            ret = MSP_ERR_IO;
+            goto out;
+        }
+        offset += num_read;
+    }
+    if (ferror(tmp)) {
+        ret = MSP_ERR_IO;
+        goto out;
+    }
+    self->num_replicates++;
+    self->offsets[self->num_replicates] = offset;
+out:
+    if (tmp != NULL) {
+        fclose(tmp);
+    }
+    return ret;
+}
+
+static void
+cli_archive_close(cli_archive_t *self)
+{
+    size_t j;
+    uint64_t index_offset = self->offsets[self->num_replicates];
+
+    for (j = 0; j <= self->num_replicates; j++) {
+        write_uint64(self->offsets[j], self->file);
+    }
+    write_uint64(self->num_replicates, self->file);
+    write_uint64(index_offset, self->file);
+    fwrite(CLI_ARCHIVE_MAGIC, 1, CLI_ARCHIVE_MAGIC_LENGTH, self->file);
+    if (ferror(self->file) || fclose(self->file) != 0) {
+        fatal_error("Error writing archive: %s", msp_strerror(MSP_ERR_IO));
+    }
+    remove(self->tmp_path);
+    free(self->tmp_path);
+    free(self->offsets);
+}
+
+static void
+write_replicate_stats(cli_sink_t *self, size_t replicate,
+    tsk_table_collection_t *tables, const double *summary)
+{
+    size_t j;
+    FILE *out = self->stats;
+
+    fprintf(out, "%s    {\"index\": %zu", replicate == 0 ? "" : ",\n", replicate);
+    if (tables != NULL) {
+        fprintf(out, ", \"num_nodes\": %lu, \"num_edges\": %lu",
+            (unsigned long) tables->nodes.num_rows,
+            (unsigned long) tables->edges.num_rows);
+        fprintf(out, ", \"num_sites\": %lu, \"num_mutations\": %lu}",
+            (unsigned long) tables->sites.num_rows,
+            (unsigned long) tables->mutations.num_rows);
+    } else {
+        fputs(", \"segregating_sites\": ", out);
+        write_json_double(out, summary[MSP_BRANCH_STATS_SEGREGATING_SITES]);
+        fputs(", \"diversity\": ", out);
+        write_json_double(out, summary[MSP_BRANCH_STATS_DIVERSITY]);
+        fputs(", \"tmrca\": ", out);
+        write_json_double(out, summary[MSP_BRANCH_STATS_TMRCA]);
+        fputs(", \"afs\": [", out);
+        for (j = MSP_BRANCH_STATS_AFS; j < self->summary_size; j++) {
+            if (j > MSP_BRANCH_STATS_AFS) {
+                fputs(", ", out);
+            }
+            write_json_double(out, summary[j]);
+        }
+        fputs("]}", out);
+    }
+}
+
+static int
+cli_sink_receive(
+    size_t replicate, tsk_table_collection_t *tables, const double *summary, void *arg)
+{
+    int ret = 0;
+    cli_sink_t *self = (cli_sink_t *) arg;
+
+    if (tables != NULL) {
+        if (self->mutgen != NULL) {
+            /* Replicates are delivered one at a time, so mutations are
+             * generated serially on the delivering thread. Seeded as the
+             * mutations of msprime.simulate with num_threads. */
+            gsl_rng_set(self->mutation_rng,
+                msp_derive_seed(msp_derive_seed(self->seed, replicate), 0));
+            ret = mutgen_generate(self->mutgen, tables, 0);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+        ret = msp_stamp_replicate_tables(tables, self->replicate_template, replicate);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = tsk_table_collection_build_index(tables, 0);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+        if (self->output_prefix != NULL) {
+            sprintf(self->output_path, "%s_%zu.trees", self->output_prefix, replicate);
+            ret = tsk_table_collection_dump(tables, self->output_path, 0);
+            if (ret != 0) {
+                ret = msp_set_tsk_error(ret);
+                goto out;
+            }
+        }
+        if (self->archive != NULL) {
+            ret = cli_archive_append(self->archive, tables);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+    }
+    if (self->stats != NULL) {
+        write_replicate_stats(self, replicate, tables, summary);
+        if (ferror(self->stats)) {
+            ret = MSP_ERR_IO;
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+/*===================================================================
+ * Simulate
+ *===================================================================
+ */
+
+typedef struct {
+    const char *config_file;
+    const char *output_prefix;
+    const char *archive;
+    const char *stats;
+    unsigned long seed;
+    size_t num_replicates;
+    size_t num_threads;
+    bool branch_stats;
+} cli_options_t;
+
+static double
+get_time(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + 1e-9 * (double) t.tv_nsec;
+}
+
+static void
+run_simulate(const cli_options_t *opts)
+{
+    int ret;
+    long long seed_tmp;
+    size_t j;
+    size_t T = opts->num_threads;
+    unsigned long seed = opts->seed;
+    config_t config;
+    msp_t *sims = NULL;
+    msp_t **sim_ptrs = NULL;
+    gsl_rng **rngs = NULL;
+    tsk_table_collection_t *tables = NULL;
+    branch_stats_t *branch_stats = NULL;
+    interval_map_t mut_map;
+    mutation_model_t mut_model;
+    mutgen_t mutgen;
+    double mutation_rate, end_time;
+    cli_archive_t archive;
+    cli_sink_t sink;
+    msp_replicate_template_t replicate_template;
+    char *escaped_config = json_escape(opts->config_file);
+    char *provenance = NULL;
+    char timestamp[64];
+    time_t now = time(NULL);
+    double start = get_time();
+
+    memset(&sink, 0, sizeof(sink));
+    memset(&replicate_template, 0, sizeof(replicate_template));
+    config_init(&config);
+    config_set_auto_convert(&config, CONFIG_TRUE);
+    if (config_read_file(&config, opts->config_file) == CONFIG_FALSE) {
+        fatal_error("%s:%d: %s", opts->config_file, config_error_line(&config),
+            config_error_text(&config));
+    }
+    if (seed == 0) {
+        if (config_lookup_int64(&config, "random_seed", &seed_tmp) == CONFIG_FALSE
+            || seed_tmp <= 0 || seed_tmp > UINT32_MAX) {
+            fatal_error("A random_seed greater than 0 and less than 2^32 must be "
+                        "given in the config or with --seed");
+        }
+        seed = (unsigned long) seed_tmp;
+    }
+    mutation_rate = lookup_float(&config, "mutation_rate", 0.0);
+    end_time = lookup_float(&config, "end_time", DBL_MAX);
+    if (opts->branch_stats && mutation_rate > 0) {
+        fatal_error("--branch-stats cannot be used with a mutation_rate, as no "
+                    "tables are kept to add the mutations to");
+    }
+
+    sims = calloc(T, sizeof(*sims));
+    sim_ptrs = calloc(T, sizeof(*sim_ptrs));
+    rngs = calloc(T + 1, sizeof(*rngs));
+    tables = calloc(T, sizeof(*tables));
+    branch_stats = calloc(T, sizeof(*branch_stats));
+    if (sims == NULL || sim_ptrs == NULL || rngs == NULL || tables == NULL
+        || branch_stats == NULL) {
+        fatal_error("Out of memory");
+    }
+    /* The extra generator is used for mutations */
+    for (j = 0; j <= T; j++) {
+        rngs[j] = gsl_rng_alloc(gsl_rng_default);
+        if (rngs[j] == NULL) {
+            fatal_error("Out of memory");
+        }
+    }
+    for (j = 0; j < T; j++) {
+        ret = tsk_table_collection_init(&tables[j], 0);
+        if (ret != 0) {
+            fatal_tskit_error(ret, "tables");
+        }
+        sim_ptrs[j] = &sims[j];
+    }
+    read_simulator(&sims[0], &tables[0], rngs[0], &config);
+    for (j = 1; j < T; j++) {
+        ret = msp_clone(&sims[j], &sims[0], &tables[j], rngs[j]);
+        if (ret != 0) {
+            fatal_msprime_error(ret, "simulator");
+        }
+    }
+    if (opts->branch_stats) {
+        for (j = 0; j < T; j++) {
+            ret = branch_stats_alloc(&branch_stats[j], sims[0].num_samples,
+                recomb_map_get_sequence_length(&sims[0].recomb_map));
+            if (ret != 0) {
+                fatal_msprime_error(ret, "branch statistics");
+            }
+            ret = msp_set_branch_stats(&sims[j], &branch_stats[j]);
+            if (ret != 0) {
+                fatal_msprime_error(ret, "branch statistics");
+            }
+        }
+        sink.summary_size = branch_stats_get_summary_size(&branch_stats[0]);
+    } else if (mutation_rate > 0) {
+        ret = interval_map_alloc_single(
+            &mut_map, recomb_map_get_sequence_length(&sims[0].recomb_map), mutation_rate);
+        if (ret != 0) {
+            fatal_msprime_error(ret, "mutation rate");
+        }
+        ret = matrix_mutation_model_factory(
+            &mut_model, lookup_int(&config, "mutation_alphabet", 0));
+        if (ret != 0) {
+            fatal_msprime_error(ret, "mutation_alphabet");
+        }
+        ret = mutgen_alloc(&mutgen, rngs[T], &mut_map, &mut_model, 0);
+        if (ret != 0) {
+            fatal_msprime_error(ret, "mutations");
+        }
+        sink.mutgen = &mutgen;
+        sink.mutation_rng = rngs[T];
+    }
+    config_destroy(&config);
+
+    /* Each replicate gets a provenance record giving its index */
+    provenance = malloc(strlen(escaped_config) + 512);
+    if (provenance == NULL) {
+        fatal_error("Out of memory");
+    }
+    sprintf(provenance,
+        "{\"schema_version\": \"1.0.0\", "
+        "\"software\": {\"name\": \"msp-cli\", \"version\": \"%s\"}, "
+        "\"parameters\": {\"command\": \"simulate\", \"config\": \"%s\", "
+        "\"random_seed\": %lu, \"replicate_index\": %s}, \"environment\": {}}",
+        MSP_CLI_VERSION, escaped_config, seed, MSP_REPLICATE_INDEX_PLACEHOLDER);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    replicate_template.provenance_record = provenance;
+    replicate_template.provenance_record_length = (tsk_size_t) strlen(provenance);
+    replicate_template.provenance_timestamp = timestamp;
+    replicate_template.provenance_timestamp_length = (tsk_size_t) strlen(timestamp);
+
+    sink.seed = seed;
+    sink.replicate_template = &replicate_template;
+    if (opts->output_prefix != NULL) {
+        sink.output_prefix = opts->output_prefix;
+        sink.output_path = malloc(strlen(opts->output_prefix) + 32);
+        if (sink.output_path == NULL) {
+            fatal_error("Out of memory");
+        }
+    }
+    if (opts->archive != NULL) {
+        cli_archive_open(&archive, opts->archive, opts->num_replicates);
+        sink.archive = &archive;
+    }
+    if (opts->stats != NULL) {
+        sink.stats = fopen(opts->stats, "w");
+        if (sink.stats == NULL) {
+            fatal_error("Cannot open %s for writing", opts->stats);
+        }
+        fprintf(sink.stats,
+            "{\n  \"software\": {\"name\": \"msp-cli\", \"version\": \"%s\"},\n"
+            "  \"config\": \"%s\",\n  \"random_seed\": %lu,\n"
+            "  \"num_replicates\": %zu,\n  \"num_threads\": %zu,\n"
+            "  \"replicates\": [\n",
+            MSP_CLI_VERSION, escaped_config, seed, opts->num_replicates, T);
+    }
+
+    ret = msp_run_replicates(
+        sim_ptrs, T, 0, opts->num_replicates, seed, end_time, cli_sink_receive, &sink);
+    if (ret != 0) {
+        fatal_msprime_error(ret, "Error running replicates");
+    }
+
+    if (sink.archive != NULL) {
+        cli_archive_close(&archive);
+    }
+    if (sink.stats != NULL) {
+        fputs("\n  ],\n  \"elapsed_seconds\": ", sink.stats);
+        write_json_double(sink.stats, get_time() - start);
+        fputs("\n}\n", sink.stats);
+        if (ferror(sink.stats) || fclose(sink.stats) != 0) {
+            fatal_error("Error writing %s: %s", opts->stats, msp_strerror(MSP_ERR_IO));
+        }
+    }
+
+    /* Clones share configuration with the first simulator, so go first */
+    for (j = T; j > 0; j--) {
+        msp_free(&sims[j - 1]);
+        tsk_table_collection_free(&tables[j - 1]);
+        if (opts->branch_stats) {
+            branch_stats_free(&branch_stats[j - 1]);
+        }
+    }
+    if (sink.mutgen != NULL) {
+        mutgen_free(&mutgen);
+        mutation_model_free(&mut_model);
+        interval_map_free(&mut_map);
+    }
+    for (j = 0; j <= T; j++) {
+        gsl_rng_free(rngs[j]);
+    }
+    free(sims);
+    free(sim_ptrs);
+    free(rngs);
+    free(tables);
+    free(branch_stats);
+    free(sink.output_path);
+    free(provenance);
+    free(escaped_config);
+}
+
+static unsigned long
+parse_seed(const char *str)
+{
+    char *end;
+    unsigned long long value;
+
+    errno = 0;
+    value = strtoull(str, &end, 10);
+    if (errno != 0 || *end != '\0' || value == 0 || value > UINT32_MAX) {
+        fatal_error("seeds must be integers greater than 0 and less than 2^32");
+    }
+    return (unsigned long) value;
+}
+
+int
+main(int argc, char **argv)
+{
+    /* SYNTAX: simulate <config-file> [options] */
+    struct arg_rex *cmd = arg_rex1(NULL, NULL, "simulate", NULL, REG_ICASE, NULL);
+    struct arg_file *config_file = arg_file1(NULL, NULL, "<config-file>", NULL);
+    struct arg_int *replicates
+        = arg_int0("r", "replicates", "<n>", "number of replicates to run (1)");
+    struct arg_int *threads
+        = arg_int0("t", "threads", "<n>",
+            "number of threads simulating replicates (1); mutations are added "
+            "to each replicate in turn on a single thread");
+    struct arg_str *seed
+        = arg_str0("s", "seed", "<seed>", "random seed, overriding the config");
+    struct arg_str *output = arg_str0("o", "output", "<prefix>",
+        "write replicate j to the trees file <prefix>_j.trees");
+    struct arg_file *archive = arg_file0(
+        "a", "archive", "<file>", "write all replicates to an indexed archive");
+    struct arg_file *stats = arg_file0(
+        "S", "stats", "<file>", "write a JSON summary of the replicates");
+    struct arg_lit *branch_stats = arg_lit0("b", "branch-stats",
+        "record branch statistics in the summary instead of keeping the tables");
+    struct arg_lit *help = arg_lit0("h", "help", "print this help and exit");
+    struct arg_lit *version = arg_lit0(NULL, "version", "print the version and exit");
+    struct arg_end *end = arg_end(20);
+    void *argtable[] = { cmd, config_file, replicates, threads, seed, output, archive,
+        stats, branch_stats, help, version, end };
+    const char *progname = "msp-cli";
+    int exitcode = EXIT_SUCCESS;
+    int nerrors;
+    cli_options_t opts;
+
+    replicates->ival[0] = 1;
+    threads->ival[0] = 1;
+    nerrors = arg_parse(argc, argv, argtable);
+
+    if (help->count > 0) {
+        printf("usage: %s", progname);
+        arg_print_syntax(stdout, argtable, "\n");
+        arg_print_glossary(stdout, argtable, "  %-28s %s\n");
+    } else if (version->count > 0) {
+        printf("%s %s\n", progname, MSP_CLI_VERSION);
+    } else if (nerrors > 0) {
+        arg_print_errors(stderr, end, progname);
+        fprintf(stderr, "usage: %s", progname);
+        arg_print_syntax(stderr, argtable, "\n");
+        exitcode = EXIT_FAILURE;
+    } else {
+        memset(&opts, 0, sizeof(opts));
+        if (replicates->ival[0] < 1 || threads->ival[0] < 1) {
+            fatal_error("The numbers of replicates and threads must be positive");
+        }
+        if (branch_stats->count > 0
+            && (output->count > 0 || archive->count > 0 || stats->count == 0)) {
+            fatal_error("--branch-stats requires --stats and no tables output");
+        }
+        opts.config_file = config_file->filename[0];
+        opts.output_prefix = output->count > 0 ? output->sval[0] : NULL;
+        opts.archive = archive->count > 0 ? archive->filename[0] : NULL;
+        opts.stats = stats->count > 0 ? stats->filename[0] : NULL;
+        opts.seed = seed->count > 0 ? parse_seed(seed->sval[0]) : 0;
+        opts.num_replicates = (size_t) replicates->ival[0];
+        opts.num_threads = (size_t) threads->ival[0];
+        opts.branch_stats = branch_stats->count > 0;
+        run_simulate(&opts);
+    }
+    arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+    return exitcode;
+}
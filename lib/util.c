@@ -214,6 +214,18 @@ msp_strerror_internal(int err)
         case MSP_ERR_MUTATION_ID_OVERFLOW:
             ret = "Mutation ID overflow.";
             break;
+        case MSP_ERR_INTERRUPTED:
+            ret = "Simulation interrupted.";
+            break;
+        case MSP_ERR_MS_OUTPUT_ALLELE_LENGTH:
+            ret = "ms format output requires single character alleles.";
+            break;
+        case MSP_ERR_MS_OUTPUT_MULTIPLE_ROOTS:
+            ret = "ms format output requires trees with a single root.";
+            break;
+        case MSP_ERR_IO:
+            ret = "Error writing output.";
+            break;
         default:
             ret = "Error occurred generating error string. Please file a bug "
                   "report!";
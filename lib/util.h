@@ -35,6 +35,12 @@
 #define MSP_UNUSED(x) MSP_UNUSED_##x
 #endif
 
+/* Threads are used for optional parallelism where pthreads are available;
+ * elsewhere the same work is done sequentially, with identical results. */
+#if !defined(_WIN32) && !defined(MSP_NO_PTHREADS)
+#define MSP_HAVE_PTHREADS 1
+#endif
+
 /* clang-format off */
 /* Error codes */
 #define MSP_ERR_GENERIC                                             -1
@@ -94,6 +100,10 @@
 #define MSP_ERR_BAD_TRANSITION_MATRIX                               -55
 #define MSP_ERR_BAD_SLIM_PARAMETERS                                 -57
 #define MSP_ERR_MUTATION_ID_OVERFLOW                                -58
+#define MSP_ERR_INTERRUPTED                                         -59
+#define MSP_ERR_MS_OUTPUT_ALLELE_LENGTH                             -60
+#define MSP_ERR_MS_OUTPUT_MULTIPLE_ROOTS                            -61
+#define MSP_ERR_IO                                                  -62
 
 /* clang-format on */
 /* This bit is 0 for any errors originating from tskit */
@@ -22,6 +22,7 @@ Module responsible for defining and running ancestry simulations.
 import bisect
 import collections
 import copy
+import datetime
 import gzip
 import inspect
 import logging
@@ -173,29 +174,97 @@ def _replicate_generator(
     Generator function for the many-replicates case of the simulate
     function.
     """
-    encoded_provenance = None
-    # The JSON is modified for each replicate to insert the replicate number.
-    # To avoid repeatedly encoding the same JSON (which can take milliseconds)
-    # we insert a replaceable string.
-    placeholder = "@@_MSPRIME_REPLICATE_INDEX_@@"
-    if provenance_dict is not None:
-        provenance_dict["parameters"]["replicate_index"] = placeholder
-        encoded_provenance = provenance.json_encode_provenance(
-            provenance_dict, num_replicates
-        )
-
+    # The provenance record is encoded once, and the replicate index is
+    # substituted for the placeholder by the low-level code, as encoding the
+    # JSON can take milliseconds.
+    encoded_provenance = _encode_replicate_provenance(provenance_dict, num_replicates)
     for j in range(num_replicates):
         sim.run(end_time)
-        replicate_provenance = None
-        if encoded_provenance is not None:
-            replicate_provenance = encoded_provenance.replace(
-                f'"{placeholder}"', str(j)
+        summary = sim.branch_statistics
+        if summary is not None:
+            yield summary
+        else:
+            # The simulator is reset before it is used again, so the tables
+            # can be moved out rather than copied.
+            yield sim.get_tree_sequence(
+                mutation_generator, encoded_provenance, j, move=True
             )
-        tree_sequence = sim.get_tree_sequence(mutation_generator, replicate_provenance)
-        yield tree_sequence
         sim.reset()
 
 
+def _parallel_replicate_generator(
+    sims, seed, mutation_rate, start, num_replicates, provenance_dict, end_time
+):
+    """
+    Generator function for the many-replicates case of the simulate function
+    when num_threads is specified. Replicates are run concurrently on the
+    simulators in batches, and replicate j is seeded from
+    ``derive_seed(seed, j)``, so that it does not depend on the number of
+    threads.
+    """
+    encoded_provenance = _encode_replicate_provenance(provenance_dict, num_replicates)
+    end_time = np.inf if end_time is None else end_time
+    sim = sims[0]
+    batch_size = 4 * len(sims)
+    stop = start + num_replicates
+    for batch_start in range(start, stop, batch_size):
+        batch = _msprime.run_replicates(
+            sims,
+            batch_start,
+            min(batch_size, stop - batch_start),
+            seed,
+            end_time=end_time,
+            provenance_record=encoded_provenance,
+            provenance_timestamp=(
+                None if encoded_provenance is None else _provenance_timestamp()
+            ),
+            population_metadata=sim.encoded_population_metadata,
+        )
+        if sim.branch_statistics is not None:
+            # The batch is a matrix with one row of statistics per replicate.
+            yield from batch
+            continue
+        for k in range(len(batch)):
+            j = batch_start + k
+            # Release each replicate's tables as soon as we're done with them.
+            tables_dict = batch[k]
+            batch[k] = None
+            if mutation_rate is not None:
+                rng = _msprime.RandomGenerator(
+                    _msprime.derive_seed(_msprime.derive_seed(seed, j), 0)
+                )
+                mutation_generator = mutations._simple_mutation_generator(
+                    mutation_rate, sim.sequence_length, rng
+                )
+                lwt = _msprime.LightweightTableCollection()
+                lwt.fromdict(tables_dict)
+                del tables_dict
+                mutation_generator.generate(lwt)
+                tables_dict = lwt.asdict(move=True)
+            tables = tskit.TableCollection.fromdict(tables_dict)
+            del tables_dict
+            yield tables.tree_sequence()
+
+
+def _encode_replicate_provenance(provenance_dict, num_replicates):
+    """
+    Returns the JSON encoding of the specified provenance with the replicate
+    index left as the low-level placeholder, or None if provenance_dict is None.
+    """
+    if provenance_dict is None:
+        return None
+    # The placeholder is a quoted JSON string, so we put it in without quotes.
+    provenance_dict["parameters"]["replicate_index"] = (
+        _msprime.REPLICATE_INDEX_PLACEHOLDER[1:-1]
+    )
+    return provenance.json_encode_provenance(provenance_dict, num_replicates)
+
+
+def _provenance_timestamp():
+    # Matches the timestamp that tskit records by default.
+    return datetime.datetime.now().isoformat()
+
+
 def samples_factory(sample_size, samples, pedigree, population_configurations):
     """
     Returns a list of Sample objects, given the specified inputs.
@@ -294,6 +363,7 @@ def simulator_factory(
     gene_conversion_rate=None,
     gene_conversion_track_length=None,
     demography=None,
+    branch_statistics=False,
 ):
     """
     Convenience method to create a simulator instance using the same
@@ -421,6 +491,7 @@ def simulator_factory(
         gene_conversion_track_length=gene_conversion_track_length,
         demography=demography,
         model_change_events=model_change_events,
+        branch_statistics=branch_statistics,
     )
     return sim
 
@@ -453,6 +524,8 @@ def simulate(
     gene_conversion_rate=None,
     gene_conversion_track_length=None,
     demography=None,
+    num_threads=None,
+    branch_statistics=False,
 ):
     """
     Simulates the coalescent with recombination under the specified model
@@ -562,10 +635,25 @@ def simulate(
     :param bool record_provenance: If True, record all configuration and parameters
         required to recreate the tree sequence. These can be accessed
         via ``TreeSequence.provenances()``).
+    :param int num_threads: If specified, run replicates concurrently using
+        this many threads. Each replicate is then seeded from the random seed
+        and its index, so the results are the same for any number of threads
+        (but differ from those obtained without ``num_threads``). Not
+        supported with changes of simulation model.
+    :param bool branch_statistics: If True, return a numpy array of branch
+        length statistics for each replicate instead of a tree sequence.
+        The statistics are accumulated as the simulation records each edge,
+        so no tree sequence is ever built. The array holds the segregating
+        sites, diversity and mean TMRCA (as computed by the corresponding
+        ``mode="branch"`` statistics in tskit), followed by the polarised
+        allele frequency spectrum of length ``n + 1``. Not supported with
+        ``mutation_rate``, ``from_ts`` or pedigrees.
     :return: The :class:`tskit.TreeSequence` object representing the results
         of the simulation if no replication is performed, or an
         iterator over the independent replicates simulated if the
-        :obj:`num_replicates` parameter has been used.
+        :obj:`num_replicates` parameter has been used. If ``branch_statistics``
+        is True, numpy arrays of statistics are returned in place of the
+        tree sequences.
     :rtype: :class:`tskit.TreeSequence` or an iterator over
         :class:`tskit.TreeSequence` replicates.
     :warning: If using replication, do not store the results of the
@@ -596,6 +684,15 @@ def simulate(
         parameters["random_seed"] = seed
         provenance_dict = provenance.get_provenance_dict(parameters)
 
+    if branch_statistics:
+        if mutation_rate is not None:
+            raise ValueError(
+                "Cannot specify mutation rate with branch_statistics; branch "
+                "statistics are the expected values of the site statistics"
+            )
+        if from_ts is not None:
+            raise ValueError("Cannot compute branch_statistics with from_ts")
+
     sim = simulator_factory(
         sample_size=sample_size,
         random_generator=rng,
@@ -617,6 +714,7 @@ def simulate(
         gene_conversion_rate=gene_conversion_rate,
         gene_conversion_track_length=gene_conversion_track_length,
         demography=demography,
+        branch_statistics=branch_statistics,
     )
 
     if mutation_generator is not None:
@@ -664,6 +762,35 @@ def simulate(
             "Cannot specify replicate_index with num_replicates as only "
             "the replicate_index specified will be returned."
         )
+    if num_threads is not None:
+        num_threads = int(num_threads)
+        if num_threads < 1:
+            raise ValueError("num_threads must be >= 1")
+        if len(sim.model_change_events) > 0:
+            raise ValueError("num_threads is not supported with model changes")
+        # Each thread needs its own simulator, tables and random generator;
+        # clones share the configuration of the original.
+        sims = [sim] + [
+            _msprime.clone_simulator(
+                sim,
+                _msprime.RandomGenerator(seed),
+                _msprime.LightweightTableCollection(),
+            )
+            for _ in range(num_threads - 1)
+        ]
+        start = 0 if replicate_index is None else replicate_index
+        iterator = _parallel_replicate_generator(
+            sims,
+            seed,
+            mutation_rate,
+            start,
+            1 if num_replicates is None else num_replicates,
+            provenance_dict,
+            end_time,
+        )
+        if num_replicates is None:
+            return next(iterator)
+        return iterator
     if num_replicates is None and replicate_index is None:
         replicate_index = 0
     if replicate_index is not None:
@@ -701,6 +828,7 @@ class Simulator(_msprime.Simulator):
         num_labels=None,
         gene_conversion_rate=0,
         gene_conversion_track_length=1,
+        branch_statistics=False,
     ):
         # We always need at least n segments, so no point in making
         # allocation any smaller than this.
@@ -755,6 +883,7 @@ class Simulator(_msprime.Simulator):
             node_mapping_block_size=node_mapping_block_size,
             gene_conversion_rate=gene_conversion_rate,
             gene_conversion_track_length=gene_conversion_track_length,
+            branch_statistics=branch_statistics,
         )
         # attributes that are internal to the highlevel Simulator class
         self._hl_from_ts = from_ts
@@ -762,12 +891,25 @@ class Simulator(_msprime.Simulator):
         self.model_change_events = model_change_events
         self.demography = demography
         self.recombination_map = recombination_map
+        # The metadata written into the population table of each replicate;
+        # populations inherited from the initial tree sequence are kept as is.
+        self.encoded_population_metadata = None
+        if from_ts is None:
+            self.encoded_population_metadata = [
+                population.temporary_hack_for_encoding_old_style_metadata()
+                for population in demography.populations
+            ]
 
     @property
     def tables(self):
         # convert lowlevel tables to highlevel tables
         return tskit.TableCollection.fromdict(super().tables.asdict())
 
+    @property
+    def ll_tables(self):
+        # The lowlevel tables that the simulation writes to
+        return super().tables
+
     @property
     def sample_configuration(self):
         """
@@ -836,18 +978,18 @@ class Simulator(_msprime.Simulator):
         return num_labels
 
     def _run_until(self, end_time, event_chunk=None):
-        # This is a pretty big default event chunk so that we don't spend
-        # too much time going back and forth into Python. We could imagine
-        # doing something a bit more sophisticated where we try to tune the
-        # number of events so that we end up with roughly 10 second slices
-        # (say).
-        if event_chunk is None:
-            event_chunk = 10 ** 4
-        if event_chunk <= 0:
+        # The low-level run polls for CTRL-C itself, so by default we run
+        # until end_time in a single call. An explicit event_chunk is still
+        # useful for getting progress logging at regular intervals.
+        if event_chunk is not None and event_chunk <= 0:
             raise ValueError("Must have at least 1 event per chunk")
         logger.info("Running model %s until max time: %f", self.model, end_time)
-        while super().run(end_time, event_chunk) == _msprime.EXIT_MAX_EVENTS:
-            logger.debug("time=%g ancestors=%d", self.time, self.num_ancestors)
+        if event_chunk is None:
+            while super().run(end_time) == _msprime.EXIT_MAX_EVENTS:
+                logger.debug("time=%g ancestors=%d", self.time, self.num_ancestors)
+        else:
+            while super().run(end_time, event_chunk) == _msprime.EXIT_MAX_EVENTS:
+                logger.debug("time=%g ancestors=%d", self.time, self.num_ancestors)
 
     def run(self, end_time=None, event_chunk=None):
         """
@@ -883,23 +1025,35 @@ class Simulator(_msprime.Simulator):
             self.num_edges,
         )
 
-    def get_tree_sequence(self, mutation_generator=None, provenance_record=None):
+    def get_tree_sequence(
+        self,
+        mutation_generator=None,
+        provenance_record=None,
+        replicate_index=0,
+        move=False,
+    ):
         """
         Returns a TreeSequence representing the state of the simulation.
+        Any REPLICATE_INDEX_PLACEHOLDER in the provenance record is replaced
+        by replicate_index.
+
+        If move is True and the simulation did not start from existing
+        tables, the low-level tables are handed over to tskit without copying
+        and are left empty, so the simulator must be reset straight away.
         """
+        ll_tables = super().tables
         if mutation_generator is not None:
-            mutation_generator.generate(super().tables)
-        tables = self.tables
-        if provenance_record is not None:
-            tables.provenances.add_row(provenance_record)
-        if self._hl_from_ts is None:
-            # Add the populations with metadata
-            assert len(tables.populations) == self.demography.num_populations
-            tables.populations.clear()
-            for population in self.demography.populations:
-                tables.populations.add_row(
-                    metadata=population.temporary_hack_for_encoding_old_style_metadata()
-                )
+            mutation_generator.generate(ll_tables)
+        ll_tables.stamp_replicate(
+            replicate_index,
+            provenance_record=provenance_record,
+            provenance_timestamp=(
+                None if provenance_record is None else _provenance_timestamp()
+            ),
+            population_metadata=self.encoded_population_metadata,
+        )
+        move = move and self._hl_from_ts is None
+        tables = tskit.TableCollection.fromdict(ll_tables.asdict(move=move))
         return tables.tree_sequence()
 
 
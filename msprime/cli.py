@@ -20,12 +20,17 @@
 Command line interfaces to the msprime library.
 """
 import argparse
+import collections
+import concurrent.futures
 import hashlib
+import io
 import json
 import os
 import random
+import shutil
 import signal
 import sys
+import tempfile
 
 import tskit
 
@@ -208,6 +213,7 @@ class SimulationRunner:
         scaled_gene_conversion_rate=0,
         gene_conversion_track_length=1,
         hotspots=None,
+        num_threads=None,
     ):
         self._sample_size = sample_size
         self._num_loci = num_loci
@@ -231,6 +237,8 @@ class SimulationRunner:
         seed = get_single_seed(ms_seeds)
         self._random_generator = _msprime.RandomGenerator(seed)
         self._ms_random_seeds = ms_seeds
+        self._seed = seed
+        self._num_threads = num_threads
 
         # If we have specified any population_configurations we don't want
         # to give the overall sample size.
@@ -283,70 +291,103 @@ class SimulationRunner:
         """
         return self._recomb_map
 
-    def print_trees(self, tree_sequence, output):
-        """
-        Print out the trees in ms-format from the specified tree sequence.
-        When 'invisible' recombinations occur ms prints out copies of the
-        same tree. Therefore, we must keep track of all breakpoints from the
-        simulation and write out a tree for each one.
-        """
-        breakpoints = list(self._simulator.breakpoints) + [self._num_loci]
-        if self._num_loci == 1:
-            tree = next(tree_sequence.trees())
-            newick = tree.newick(precision=self._precision)
-            print(newick, file=output)
-        else:
-            j = 0
-            for tree in tree_sequence.trees():
-                newick = tree.newick(precision=self._precision)
-                left, right = tree.interval
-                while j < len(breakpoints) and breakpoints[j] <= right:
-                    length = breakpoints[j] - left
-                    left = breakpoints[j]
-                    j += 1
-                    # Print these seperately to avoid the cost of creating
-                    # another string.
-                    print("[{}]".format(int(length)), end="", file=output)
-                    print(newick, file=output)
-
     def run(self, output):
         """
         Runs the simulations and writes the output to the specified
         file handle.
         """
+        try:
+            output.fileno()
+        except (AttributeError, io.UnsupportedOperation):
+            # The replicates are written by the low-level code to the file
+            # descriptor of the output, so we go through a temporary file
+            # for in-memory streams.
+            with tempfile.TemporaryFile("w+") as f:
+                self.run(f)
+                f.seek(0)
+                shutil.copyfileobj(f, output)
+            return
         # The first line of ms's output is the command line.
         print(" ".join(sys.argv), file=output)
         print(" ".join(str(s) for s in self._ms_random_seeds), file=output)
+        output.flush()
+        if self._num_threads is None:
+            self._run_serial(output)
+        else:
+            self._run_parallel(output)
+
+    def _get_breakpoints(self, simulator):
+        if self._print_trees and self._num_loci > 1:
+            # When 'invisible' recombinations occur ms prints out copies
+            # of the same tree, so we write out a tree for each of the
+            # breakpoints in the simulation.
+            return list(simulator.breakpoints) + [self._num_loci]
+        return None
+
+    def _write_replicate(self, output, tables, breakpoints):
+        _msprime.write_ms_replicate(
+            output,
+            tables,
+            self._precision,
+            breakpoints=breakpoints,
+            trees=self._print_trees,
+            segsites=self._mutation_rate > 0,
+        )
+
+    def _run_serial(self, output):
         for _ in range(self._num_replicates):
             self._simulator.run()
-            tree_sequence = self._simulator.get_tree_sequence(self._mutation_generator)
-            print(file=output)
-            print("//", file=output)
-            if self._print_trees:
-                self.print_trees(tree_sequence, output)
-            if self._mutation_rate > 0:
-                s = tree_sequence.get_num_mutations()
-                print("segsites:", s, file=output)
-                if s != 0:
-                    print("positions: ", end="", file=output)
-                    positions = [
-                        mutation.position / self._num_loci
-                        for mutation in tree_sequence.mutations()
-                    ]
-                    positions.sort()
-                    for position in positions:
-                        print(
-                            "{0:.{1}f}".format(position, self._precision),
-                            end=" ",
-                            file=output,
-                        )
-                    print(file=output)
-                    for h in tree_sequence.haplotypes():
-                        print(h, file=output)
-                else:
-                    print(file=output)
+            tables = self._simulator.ll_tables
+            if self._mutation_generator is not None:
+                self._mutation_generator.generate(tables)
+            breakpoints = self._get_breakpoints(self._simulator)
+            self._write_replicate(output, tables, breakpoints)
             self._simulator.reset()
 
+    def _run_parallel(self, output):
+        """
+        Runs the replicates on a pool of worker threads and writes them in
+        order. Replicate j is seeded from ``derive_seed(seed, j)``, as in
+        msprime.simulate, so the output does not depend on the number of
+        threads.
+        """
+        # Each replicate that is running or waiting to be written holds a
+        # simulator clone, which is reused once the replicate is written.
+        window = 2 * self._num_threads
+        contexts = []
+        for _ in range(window):
+            rng = _msprime.RandomGenerator(self._seed)
+            sim = _msprime.clone_simulator(
+                self._simulator, rng, _msprime.LightweightTableCollection()
+            )
+            contexts.append((sim, rng))
+
+        def run_replicate(j):
+            sim, rng = contexts[j % window]
+            seed = _msprime.derive_seed(self._seed, j)
+            sim.reset()
+            rng.set_seed(seed)
+            while sim.run() == _msprime.EXIT_MAX_EVENTS:
+                pass
+            sim.finalise_tables()
+            if self._mutation_rate > 0:
+                mutation_generator = mutations._simple_mutation_generator(
+                    self._mutation_rate,
+                    sim.sequence_length,
+                    _msprime.RandomGenerator(_msprime.derive_seed(seed, 0)),
+                )
+                mutation_generator.generate(sim.tables)
+            return sim.tables, self._get_breakpoints(sim)
+
+        pending = collections.deque()
+        with concurrent.futures.ThreadPoolExecutor(self._num_threads) as executor:
+            for j in range(self._num_replicates):
+                if len(pending) == window:
+                    self._write_replicate(output, *pending.popleft().result())
+                pending.append(executor.submit(run_replicate, j))
+            while len(pending) > 0:
+                self._write_replicate(output, *pending.popleft().result())
+
 
 def convert_int(value, parser):
     """
@@ -684,6 +725,7 @@ def create_simulation_runner(parser, arg_list):
         print_trees=args.trees,
         random_seeds=args.random_seeds,
         hotspots=args.hotspots,
+        num_threads=args.threads,
     )
     return runner
 
@@ -987,6 +1029,16 @@ def get_mspms_parser(error_handler=None):
         default=3,
         help="Number of values after decimal place to print",
     )
+    group.add_argument(
+        "--threads",
+        type=positive_int,
+        default=None,
+        help=(
+            "Run the replicates on this many threads. Replicates are seeded "
+            "independently of the number of threads, so the output differs "
+            "from the default single-threaded output for the same seeds."
+        ),
+    )
 
     # now for the parser that gets called first
     init_parser = argparse.ArgumentParser(
@@ -30,6 +30,11 @@ from . import core
 from . import provenance
 from _msprime import BaseMutationModel
 
+# The number of independent chunks the genome is split into when generating
+# mutations with multiple threads. This is fixed so that results do not
+# depend on the number of threads.
+MUTATION_CHUNKS = 64
+
 _ACGT_ALLELES = ["A", "C", "G", "T"]
 _AMINO_ACIDS = [
     "A",
@@ -759,6 +764,7 @@ def mutate(
     start_time=None,
     end_time=None,
     discrete=False,
+    num_threads=None,
 ):
     """
     Simulates mutations on the specified ancestry and returns the resulting
@@ -811,6 +817,12 @@ def mutate(
     :param bool discrete: Whether to generate mutations at only integer positions
         along the genome.  Default is False, which produces infinite-sites
         mutations at floating-point positions.
+    :param int num_threads: If specified, the genome is split into a fixed
+        number of chunks, each with its own random stream derived from the
+        seed, which are generated using this many threads. The results for
+        a given seed are the same for any number of threads, but differ from
+        those when ``num_threads`` is None. Existing sites kept with ``keep``
+        are always processed by a single thread.
     :return: The :class:`tskit.TreeSequence` object  resulting from overlaying
         mutations on the input tree sequence.
     :rtype: :class:`tskit.TreeSequence`
@@ -849,6 +861,14 @@ def mutate(
         raise ValueError("start_time must be <= end_time")
     keep = bool(keep)
     discrete = bool(discrete)
+    num_chunks = 0
+    if num_threads is None:
+        num_threads = 1
+    else:
+        num_threads = int(num_threads)
+        if num_threads < 1:
+            raise ValueError("num_threads must be >= 1")
+        num_chunks = MUTATION_CHUNKS
 
     if model is None:
         model = BinaryMutations()
@@ -871,10 +891,19 @@ def mutate(
     )
     lwt = _msprime.LightweightTableCollection()
     lwt.fromdict(tables.asdict())
+    # Drop our copy of the input so that only the low-level tables are live
+    # while generating.
+    del tables
     mutation_generator.generate(
-        lwt, keep=keep, start_time=start_time, end_time=end_time, discrete=discrete
+        lwt,
+        keep=keep,
+        start_time=start_time,
+        end_time=end_time,
+        discrete=discrete,
+        num_chunks=num_chunks,
+        num_threads=num_threads,
     )
 
-    tables = tskit.TableCollection.fromdict(lwt.asdict())
+    tables = tskit.TableCollection.fromdict(lwt.asdict(move=True))
     tables.provenances.add_row(encoded_provenance)
     return tables.tree_sequence()
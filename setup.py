@@ -97,6 +97,8 @@ msp_source_files = [
     "mutgen.c",
     "likelihood.c",
     "interval_map.c",
+    "branch_stats.c",
+    "ms_output.c",
 ]
 tsk_source_files = ["core.c", "tables.c", "trees.c"]
 kas_source_files = ["kastore.c"]
@@ -119,6 +121,8 @@ if IS_WINDOWS:
         ("GSL_DLL", None),
         ("WIN32", None),
     ]
+else:
+    libraries.append("pthread")
 
 _msprime_module = Extension(
     "_msprime",
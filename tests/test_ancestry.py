@@ -19,12 +19,14 @@
 """
 Test cases for basic ancestry simulation operations.
 """
+import _thread
 import datetime
 import json
 import logging
 import os
 import random
 import tempfile
+import threading
 import unittest
 
 import numpy as np
@@ -190,6 +192,20 @@ class TestSimulator(unittest.TestCase):
             r = random.random()
             self.verify_simulation(n, m, r)
 
+    def test_get_tree_sequence_repeated(self):
+        sim = msprime.simulator_factory(10, recombination_rate=1, random_seed=2)
+        sim.run()
+        ts1 = sim.get_tree_sequence()
+        self.assertGreater(ts1.num_edges, 0)
+        # The simulator's tables are left intact by default.
+        self.assertEqual(ts1.tables, sim.get_tree_sequence().tables)
+        # Moving the tables out leaves them empty until we reset.
+        self.assertEqual(ts1.tables, sim.get_tree_sequence(move=True).tables)
+        self.assertEqual(sim.num_edges, 0)
+        sim.reset()
+        sim.run()
+        self.assertGreater(sim.get_tree_sequence().num_edges, 0)
+
     def test_perf_parameters(self):
         sim = msprime.simulator_factory(10)
         sim.run()
@@ -207,6 +223,21 @@ class TestSimulator(unittest.TestCase):
         sim.reset()
         sim.run(event_chunk=2 ** 64 + 1)
 
+    def test_interrupt(self):
+        # A simulation that takes far longer than the timer to complete
+        sim = msprime.simulator_factory(
+            1000, Ne=10 ** 4, length=10 ** 9, recombination_rate=1e-8
+        )
+        timer = threading.Timer(0.1, _thread.interrupt_main)
+        timer.start()
+        try:
+            with self.assertRaises(KeyboardInterrupt):
+                sim.run()
+        finally:
+            timer.cancel()
+        self.assertGreater(sim.num_ancestors, 0)
+        self.assertGreater(sim.time, 0)
+
     def test_info_logging(self):
         sim = msprime.simulator_factory(10)
         with self.assertLogs("msprime.ancestry", logging.INFO) as log:
@@ -831,6 +862,153 @@ class TestSimulateInterface(unittest.TestCase):
             str(cm.exception),
         )
 
+    def get_threaded_tables(self, num_threads, **kwargs):
+        ret = []
+        for ts in msprime.simulate(num_threads=num_threads, random_seed=5, **kwargs):
+            tables = ts.dump_tables()
+            tables.provenances.clear()
+            ret.append(tables)
+        return ret
+
+    def test_num_threads_replicates(self):
+        kwargs = {"sample_size": 10, "recombination_rate": 1, "num_replicates": 11}
+        tables = self.get_threaded_tables(1, **kwargs)
+        self.assertEqual(len(tables), 11)
+        self.assertNotEqual(tables[0], tables[1])
+        for num_threads in [2, 3, 16]:
+            self.assertEqual(tables, self.get_threaded_tables(num_threads, **kwargs))
+
+    def test_num_threads_mutations(self):
+        kwargs = {"sample_size": 10, "mutation_rate": 2, "num_replicates": 5}
+        tables = self.get_threaded_tables(1, **kwargs)
+        self.assertGreater(len(tables[0].mutations), 0)
+        self.assertEqual(tables, self.get_threaded_tables(4, **kwargs))
+
+    def test_num_threads_replicate_index(self):
+        tables = self.get_threaded_tables(2, sample_size=10, num_replicates=5)
+        for j in [0, 4]:
+            other = msprime.simulate(
+                10, num_threads=3, random_seed=5, replicate_index=j
+            ).dump_tables()
+            other.provenances.clear()
+            self.assertEqual(tables[j], other)
+
+    def test_num_threads_provenance(self):
+        for ts in msprime.simulate(10, num_replicates=3, num_threads=2):
+            self.assertEqual(ts.num_provenances, 1)
+            self.verify_provenance(ts.provenance(0))
+
+    def test_num_threads_end_time(self):
+        ts = msprime.simulate(
+            15, recombination_rate=2, random_seed=8, end_time=0.1, num_threads=2
+        )
+        for tree in ts.trees():
+            for root in tree.roots:
+                self.assertEqual(tree.time(root), 0.1)
+
+    def test_num_threads_errors(self):
+        for bad_value in [0, -1]:
+            with self.assertRaises(ValueError):
+                msprime.simulate(10, num_threads=bad_value)
+        with self.assertRaises(ValueError):
+            msprime.simulate(
+                10, model=[None, (0.1, "smc")], num_threads=2, random_seed=1
+            )
+
+
+class TestBranchStatistics(unittest.TestCase):
+    """
+    Tests for the statistics-only simulation mode.
+    """
+
+    def verify(self, summary, ts):
+        n = ts.num_samples
+        self.assertEqual(summary.shape, (_msprime.BRANCH_STATS_AFS + n + 1,))
+        self.assertAlmostEqual(
+            summary[_msprime.BRANCH_STATS_SEGREGATING_SITES],
+            ts.segregating_sites(mode="branch"),
+        )
+        self.assertAlmostEqual(
+            summary[_msprime.BRANCH_STATS_DIVERSITY], ts.diversity(mode="branch")
+        )
+        tmrca = 0
+        for tree in ts.trees():
+            if tree.num_roots == 1:
+                tmrca += tree.time(tree.root) * tree.span
+        self.assertAlmostEqual(
+            summary[_msprime.BRANCH_STATS_TMRCA], tmrca / ts.sequence_length
+        )
+        afs = ts.allele_frequency_spectrum(mode="branch", polarised=True)
+        np.testing.assert_array_almost_equal(
+            summary[_msprime.BRANCH_STATS_AFS :], afs
+        )
+
+    def verify_simulation(self, **kwargs):
+        summary = msprime.simulate(branch_statistics=True, random_seed=3, **kwargs)
+        ts = msprime.simulate(random_seed=3, **kwargs)
+        self.verify(summary, ts)
+
+    def test_single_tree(self):
+        self.verify_simulation(sample_size=10)
+
+    def test_recombination(self):
+        self.verify_simulation(sample_size=10, length=10, recombination_rate=1)
+
+    def test_full_arg(self):
+        self.verify_simulation(
+            sample_size=5, recombination_rate=2, record_full_arg=True
+        )
+
+    def test_ancient_samples(self):
+        samples = [msprime.Sample(0, 0.2 * j) for j in range(8)]
+        self.verify_simulation(samples=samples, recombination_rate=1)
+
+    def test_end_time(self):
+        self.verify_simulation(sample_size=10, recombination_rate=1, end_time=0.1)
+
+    def test_dtwf(self):
+        self.verify_simulation(
+            sample_size=10, Ne=20, recombination_rate=0.1, model="dtwf"
+        )
+
+    def test_model_change(self):
+        self.verify_simulation(
+            sample_size=10,
+            Ne=20,
+            recombination_rate=0.1,
+            model=["dtwf", (50, "hudson")],
+        )
+
+    def test_replicates(self):
+        kwargs = {"sample_size": 6, "recombination_rate": 1, "num_replicates": 5}
+        summaries = list(
+            msprime.simulate(branch_statistics=True, random_seed=4, **kwargs)
+        )
+        self.assertEqual(len(summaries), 5)
+        for summary, ts in zip(summaries, msprime.simulate(random_seed=4, **kwargs)):
+            self.verify(summary, ts)
+
+    def test_threads(self):
+        kwargs = {"sample_size": 6, "recombination_rate": 1, "random_seed": 5}
+        tree_sequences = msprime.simulate(num_replicates=5, num_threads=2, **kwargs)
+        summaries = msprime.simulate(
+            num_replicates=5, num_threads=3, branch_statistics=True, **kwargs
+        )
+        for summary, ts in zip(summaries, tree_sequences):
+            self.verify(summary, ts)
+        summary = msprime.simulate(
+            replicate_index=3, num_threads=2, branch_statistics=True, **kwargs
+        )
+        ts = msprime.simulate(replicate_index=3, num_threads=2, **kwargs)
+        self.verify(summary, ts)
+
+    def test_errors(self):
+        with self.assertRaises(ValueError):
+            msprime.simulate(10, mutation_rate=1, branch_statistics=True)
+        ts = msprime.simulate(10, end_time=0.1, random_seed=1)
+        with self.assertRaises(ValueError):
+            msprime.simulate(from_ts=ts, branch_statistics=True)
+
 
 class TestRecombinationMap(unittest.TestCase):
     """
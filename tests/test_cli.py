@@ -31,6 +31,7 @@ import newick
 import numpy as np
 import tskit
 
+import _msprime
 import msprime
 import msprime.cli as cli
 
@@ -252,6 +253,12 @@ class TestMspmsArgumentParser(unittest.TestCase):
         self.assertEqual(args.recombination, [1, 100])
         self.assertEqual(args.gene_conversion, [5, 12])
 
+    def test_threads(self):
+        args = self.parse_args("10 1".split())
+        self.assertIsNone(args.threads)
+        args = self.parse_args("10 1 --threads 4".split())
+        self.assertEqual(args.threads, 4)
+
 
 class CustomExceptionForTesting(Exception):
     """
@@ -975,6 +982,7 @@ class TestMspmsOutput(TestCli):
         print_trees=True,
         precision=3,
         random_seeds=(1, 2, 3),
+        num_threads=None,
     ):
         """
         Runs the UI for the specified parameters, and parses the output
@@ -992,6 +1000,7 @@ class TestMspmsOutput(TestCli):
             print_trees=print_trees,
             precision=precision,
             random_seeds=random_seeds,
+            num_threads=num_threads,
         )
         with open(self.temp_file, "w+") as f:
             sr.run(f)
@@ -1177,6 +1186,146 @@ class TestMspmsOutput(TestCli):
             output2 = f.read()
         self.assertEqual(output1, output2)
 
+    def test_threads_output(self):
+        for num_threads in [1, 2, 5]:
+            self.verify_output(
+                sample_size=10,
+                mutation_rate=10,
+                num_replicates=7,
+                num_threads=num_threads,
+            )
+            self.verify_output(
+                sample_size=5,
+                mutation_rate=5,
+                num_loci=100,
+                recombination_rate=10,
+                num_replicates=12,
+                num_threads=num_threads,
+            )
+
+    def get_threads_output(self, num_threads):
+        sr = cli.SimulationRunner(
+            sample_size=10,
+            num_loci=50,
+            scaled_recombination_rate=5,
+            scaled_mutation_rate=5,
+            num_replicates=11,
+            print_trees=True,
+            random_seeds=(1, 2, 3),
+            num_threads=num_threads,
+        )
+        with tempfile.TemporaryFile("w+") as f:
+            sr.run(f)
+            f.seek(0)
+            return f.read()
+
+    def test_threads_equivalence(self):
+        # Replicates are seeded independently of the number of threads.
+        output = self.get_threads_output(1)
+        for num_threads in [2, 3, 8]:
+            self.assertEqual(output, self.get_threads_output(num_threads))
+        self.assertNotEqual(output, self.get_threads_output(None))
+
+
+class TestMsOutputWriter(unittest.TestCase):
+    """
+    Tests the low-level writer for ms format output against the equivalent
+    output formatted from the tree sequence.
+    """
+
+    def python_ms_output(self, ts, breakpoints, precision, trees, segsites):
+        lines = ["", "//"]
+        if trees:
+            j = 0
+            for tree in ts.trees():
+                newick = tree.newick(precision=precision)
+                if breakpoints is None:
+                    lines.append(newick)
+                    continue
+                left, right = tree.interval
+                while j < len(breakpoints) and breakpoints[j] <= right:
+                    lines.append(f"[{int(breakpoints[j] - left)}]{newick}")
+                    left = breakpoints[j]
+                    j += 1
+        if segsites:
+            lines.append(f"segsites: {ts.num_sites}")
+            if ts.num_sites == 0:
+                lines.append("")
+            else:
+                positions = [
+                    "{0:.{1}f} ".format(site.position / ts.sequence_length, precision)
+                    for site in ts.sites()
+                ]
+                lines.append("positions: " + "".join(positions))
+                lines.extend(ts.haplotypes())
+        return "\n".join(lines) + "\n"
+
+    def get_ll_tables(self, ts):
+        lwt = _msprime.LightweightTableCollection()
+        lwt.fromdict(ts.dump_tables().asdict())
+        return lwt
+
+    def verify(self, ts, breakpoints=None, precision=3, trees=True, segsites=True):
+        lwt = self.get_ll_tables(ts)
+        with tempfile.TemporaryFile("w+") as f:
+            _msprime.write_ms_replicate(
+                f,
+                lwt,
+                precision,
+                breakpoints=breakpoints,
+                trees=trees,
+                segsites=segsites,
+            )
+            f.seek(0)
+            output = f.read()
+        self.assertEqual(
+            output,
+            self.python_ms_output(ts, breakpoints, precision, trees, segsites),
+        )
+
+    def test_single_tree(self):
+        ts = msprime.simulate(10, mutation_rate=2, random_seed=1)
+        self.assertGreater(ts.num_sites, 0)
+        for precision in [0, 1, 3, 10]:
+            self.verify(ts, precision=precision)
+        self.verify(ts, trees=False)
+        self.verify(ts, segsites=False)
+
+    def test_no_sites(self):
+        ts = msprime.simulate(5, random_seed=2)
+        self.verify(ts)
+
+    def test_many_trees(self):
+        recomb_map = msprime.RecombinationMap.uniform_map(100, 0.1, discrete=True)
+        ts = msprime.simulate(
+            20, recombination_map=recomb_map, mutation_rate=0.1, random_seed=3
+        )
+        self.assertGreater(ts.num_trees, 1)
+        breakpoints = list(ts.breakpoints())[1:]
+        self.verify(ts, breakpoints=breakpoints)
+        # Extra breakpoints repeat the tree
+        extra = sorted(set(breakpoints) | {1, 2, 3, 50})
+        self.verify(ts, breakpoints=extra)
+
+    def test_errors(self):
+        ts = msprime.simulate(5, random_seed=2)
+        lwt = self.get_ll_tables(ts)
+        with tempfile.TemporaryFile("w+") as f:
+            with self.assertRaises(ValueError):
+                _msprime.write_ms_replicate(f, lwt, -1)
+            with self.assertRaises(TypeError):
+                _msprime.write_ms_replicate(f, None, 3)
+            with self.assertRaises(ValueError):
+                _msprime.write_ms_replicate(f, lwt, 3, breakpoints=[[1]])
+        with self.assertRaises(io.UnsupportedOperation):
+            _msprime.write_ms_replicate(io.StringIO(), lwt, 3)
+        tables = ts.dump_tables()
+        tables.edges.clear()
+        lwt = self.get_ll_tables(tables.tree_sequence())
+        with tempfile.TemporaryFile("w+") as f:
+            with self.assertRaises(_msprime.LibraryError):
+                _msprime.write_ms_replicate(f, lwt, 3, trees=True)
+
 
 class TestMspArgumentParser(unittest.TestCase):
     """
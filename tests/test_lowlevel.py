@@ -23,11 +23,13 @@ import collections
 import heapq
 import io
 import itertools
+import json
 import math
 import pathlib
 import platform
 import random
 import tempfile
+import threading
 import unittest
 
 import _tskit
@@ -226,7 +228,12 @@ def get_migration_matrix(num_populations, value=1.0):
 
 
 def get_example_simulator(
-    num_samples=10, Ne=0.25, random_seed=1, num_populations=1, store_migrations=False
+    num_samples=10,
+    Ne=0.25,
+    random_seed=1,
+    num_populations=1,
+    store_migrations=False,
+    branch_statistics=False,
 ):
     tables = _msprime.LightweightTableCollection()
     samples = [(j % num_populations, 0) for j in range(num_samples)]
@@ -243,6 +250,7 @@ def get_example_simulator(
         migration_matrix=migration_matrix,
         store_migrations=store_migrations,
         model=get_simulation_model(reference_size=Ne),
+        branch_statistics=branch_statistics,
     )
     return sim
 
@@ -958,6 +966,34 @@ class TestSimulator(LowLevelTestCase):
         sim.run(max_events=1)
         self.assertGreater(sim.time, 0)
 
+    def test_branch_statistics(self):
+        sim = get_example_simulator()
+        self.assertIsNone(sim.branch_statistics)
+        sim = get_example_simulator(branch_statistics=True)
+        self.assertEqual(list(sim.branch_statistics), [0] * 14)
+        for _ in range(2):
+            sim.run()
+            sim.finalise_tables()
+            ts = tskit.TableCollection.fromdict(sim.tables.asdict()).tree_sequence()
+            summary = sim.branch_statistics
+            self.assertAlmostEqual(
+                summary[_msprime.BRANCH_STATS_DIVERSITY], ts.diversity(mode="branch")
+            )
+            self.assertGreater(summary[_msprime.BRANCH_STATS_TMRCA], 0)
+            sim.reset()
+            self.assertEqual(list(sim.branch_statistics), [0] * 14)
+
+        tables = _msprime.LightweightTableCollection()
+        tables.fromdict(ts.dump_tables().asdict())
+        with self.assertRaises(_msprime.InputError):
+            _msprime.Simulator(
+                [],
+                uniform_recombination_map(10),
+                _msprime.RandomGenerator(1),
+                tables,
+                branch_statistics=True,
+            )
+
     def test_print_state(self):
         sim = _msprime.Simulator(
             get_samples(10),
@@ -2312,6 +2348,21 @@ class TestRandomGenerator(unittest.TestCase):
             rng = _msprime.RandomGenerator(s)
             self.assertEqual(rng.get_seed(), s)
 
+    def test_set_seed(self):
+        rng = _msprime.RandomGenerator(1)
+        self.assertRaises(TypeError, rng.set_seed)
+        for bad_type in ["x", 1.0, None]:
+            self.assertRaises(TypeError, rng.set_seed, bad_type)
+        for bad_value in [-1, 0, 2 ** 32]:
+            self.assertRaises(ValueError, rng.set_seed, bad_value)
+        self.assertEqual(rng.get_seed(), 1)
+        for s in [1, 10, 2 ** 32 - 1]:
+            rng.flat(0, 1)
+            rng.set_seed(s)
+            self.assertEqual(rng.get_seed(), s)
+            other = _msprime.RandomGenerator(s)
+            self.assertEqual(rng.flat(0, 1), other.flat(0, 1))
+
     def test_flat_errors(self):
         rng = _msprime.RandomGenerator(1)
         self.assertRaises(TypeError, rng.flat)
@@ -2665,6 +2716,25 @@ class TestMutationGenerator(unittest.TestCase):
             tables = _msprime.LightweightTableCollection(1)
             mutgen.generate(tables)
 
+    def test_num_chunks_num_threads(self):
+        rng = _msprime.RandomGenerator(1)
+        imap = _msprime.IntervalMap([0, 1], [1, 0])
+        mutgen = _msprime.MutationGenerator(rng, imap, get_mutation_model())
+        tables = _msprime.LightweightTableCollection(1)
+        for bad_type in ["x", {}, None, 0.5]:
+            with self.assertRaises(TypeError):
+                mutgen.generate(tables, num_chunks=bad_type)
+            with self.assertRaises(TypeError):
+                mutgen.generate(tables, num_threads=bad_type)
+        with self.assertRaises(ValueError):
+            mutgen.generate(tables, num_chunks=-1)
+        for bad_value in [0, -1]:
+            with self.assertRaises(ValueError):
+                mutgen.generate(tables, num_threads=bad_value)
+        for num_chunks in [0, 1, 5]:
+            for num_threads in [1, 2, 8]:
+                mutgen.generate(tables, num_chunks=num_chunks, num_threads=num_threads)
+
     def test_time_interval(self):
         rng = _msprime.RandomGenerator(1)
         imap = _msprime.IntervalMap([0, 1], [0, 0])
@@ -2724,6 +2794,305 @@ class TestMutationGenerator(unittest.TestCase):
         self.verify_block_size(tables)
 
 
+class TestRunReplicates(unittest.TestCase):
+    """
+    Tests for running replicates on several simulators.
+    """
+
+    def test_results(self):
+        sims = [get_example_simulator(random_seed=j + 1) for j in range(3)]
+        serial = sims[0:1]
+        d1 = _msprime.run_replicates(serial, 0, 6, 42)
+        self.assertEqual(len(d1), 6)
+        t1 = [tskit.TableCollection.fromdict(d) for d in d1]
+        for tables in t1:
+            self.assertGreater(len(tables.edges), 0)
+        self.assertNotEqual(t1[0], t1[1])
+        d2 = _msprime.run_replicates(sims, 0, 6, 42)
+        self.assertEqual(t1, [tskit.TableCollection.fromdict(d) for d in d2])
+        d3 = _msprime.run_replicates(sims[1:], 3, 3, 42, end_time=np.inf)
+        self.assertEqual(t1[3:], [tskit.TableCollection.fromdict(d) for d in d3])
+        self.assertEqual(_msprime.run_replicates(sims, 0, 0, 42), [])
+
+    def test_stamp_replicates(self):
+        sims = [get_example_simulator(num_populations=2, random_seed=j) for j in [1, 2]]
+        placeholder = _msprime.REPLICATE_INDEX_PLACEHOLDER
+        batch = _msprime.run_replicates(
+            sims,
+            5,
+            4,
+            42,
+            provenance_record=f'{{"replicate_index": {placeholder}}}',
+            provenance_timestamp="now",
+            population_metadata=[b"a", b"b"],
+        )
+        for j, d in enumerate(batch):
+            tables = tskit.TableCollection.fromdict(d)
+            self.assertEqual(len(tables.provenances), 1)
+            self.assertEqual(tables.provenances[0].timestamp, "now")
+            record = json.loads(tables.provenances[0].record)
+            self.assertEqual(record, {"replicate_index": 5 + j})
+            self.assertEqual(
+                [population.metadata for population in tables.populations],
+                [b"a", b"b"],
+            )
+        with self.assertRaises(_msprime.LibraryError):
+            _msprime.run_replicates(sims, 0, 1, 1, population_metadata=[b"a"])
+        with self.assertRaises(ValueError):
+            _msprime.run_replicates(sims, 0, 1, 1, provenance_record="x")
+
+    def test_branch_statistics(self):
+        sims = [get_example_simulator(random_seed=j) for j in [1, 2]]
+        d1 = _msprime.run_replicates(sims, 2, 4, 42)
+        t1 = [tskit.TableCollection.fromdict(d) for d in d1]
+        sims = [
+            get_example_simulator(random_seed=j, branch_statistics=True) for j in [1, 2]
+        ]
+        clone = _msprime.clone_simulator(
+            sims[0], _msprime.RandomGenerator(1), _msprime.LightweightTableCollection()
+        )
+        self.assertIsNotNone(clone.branch_statistics)
+        for batch in [
+            _msprime.run_replicates(sims, 2, 4, 42),
+            _msprime.run_replicates([sims[0], clone], 2, 4, 42),
+        ]:
+            self.assertIsInstance(batch, np.ndarray)
+            self.assertEqual(batch.shape, (4, _msprime.BRANCH_STATS_AFS + 11))
+            for summary, tables in zip(batch, t1):
+                ts = tables.tree_sequence()
+                self.assertAlmostEqual(
+                    summary[_msprime.BRANCH_STATS_SEGREGATING_SITES],
+                    ts.segregating_sites(mode="branch"),
+                )
+                np.testing.assert_array_almost_equal(
+                    summary[_msprime.BRANCH_STATS_AFS :],
+                    ts.allele_frequency_spectrum(mode="branch", polarised=True),
+                )
+        self.assertEqual(_msprime.run_replicates(sims, 0, 0, 42).shape, (0, 14))
+        # Simulators must all accumulate statistics, or none of them.
+        with self.assertRaises(_msprime.LibraryError):
+            _msprime.run_replicates([sims[0], get_example_simulator()], 0, 1, 1)
+
+    def test_concurrent_calls_different_orders(self):
+        # Calls sharing simulators listed in different orders must not
+        # deadlock waiting for each other's locks.
+        sims = [get_example_simulator(random_seed=j + 1) for j in range(3)]
+        orders = [sims, sims[::-1], sims[1:] + sims[:1]]
+        results = [None for _ in orders]
+
+        def worker(j):
+            results[j] = _msprime.run_replicates(orders[j], 0, 6, 42)
+
+        threads = [
+            threading.Thread(target=worker, args=(j,)) for j in range(len(orders))
+        ]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join(60)
+            self.assertFalse(thread.is_alive())
+        t1 = [tskit.TableCollection.fromdict(d) for d in results[0]]
+        for batch in results[1:]:
+            self.assertEqual(t1, [tskit.TableCollection.fromdict(d) for d in batch])
+
+    def test_seed(self):
+        sims = [get_example_simulator()]
+        d1 = _msprime.run_replicates(sims, 0, 1, 1)[0]
+        d2 = _msprime.run_replicates(sims, 0, 1, 2)[0]
+        t1 = tskit.TableCollection.fromdict(d1)
+        self.assertNotEqual(t1, tskit.TableCollection.fromdict(d2))
+        self.assertNotEqual(_msprime.derive_seed(1, 0), _msprime.derive_seed(1, 1))
+        self.assertEqual(_msprime.derive_seed(1, 0), _msprime.derive_seed(1, 0))
+
+    def test_bad_args(self):
+        sim = get_example_simulator()
+        with self.assertRaises(TypeError):
+            _msprime.run_replicates()
+        for bad_type in [None, "x", sim]:
+            with self.assertRaises(TypeError):
+                _msprime.run_replicates(bad_type, 0, 1, 1)
+        for bad_list in [[None], ["x"], [sim, None]]:
+            with self.assertRaises(TypeError):
+                _msprime.run_replicates(bad_list, 0, 1, 1)
+        with self.assertRaises(ValueError):
+            _msprime.run_replicates([], 0, 1, 1)
+        with self.assertRaises(ValueError):
+            _msprime.run_replicates([sim], -1, 1, 1)
+        with self.assertRaises(ValueError):
+            _msprime.run_replicates([sim], 0, -1, 1)
+        with self.assertRaises(ValueError):
+            _msprime.run_replicates([sim], 0, 1, 1, end_time=-1)
+        with self.assertRaises(ValueError):
+            _msprime.run_replicates([sim, sim], 0, 1, 1)
+
+    def test_clones(self):
+        sim = get_example_simulator(num_populations=2, store_migrations=True)
+        clones = [
+            _msprime.clone_simulator(
+                sim, _msprime.RandomGenerator(1), _msprime.LightweightTableCollection()
+            )
+            for _ in range(3)
+        ]
+        d1 = _msprime.run_replicates([sim], 0, 5, 42)
+        t1 = [tskit.TableCollection.fromdict(d) for d in d1]
+        self.assertGreater(len(t1[0].migrations), 0)
+        d2 = _msprime.run_replicates(clones, 0, 5, 42)
+        self.assertEqual(t1, [tskit.TableCollection.fromdict(d) for d in d2])
+        # Clones keep their source alive
+        del sim
+        d3 = _msprime.run_replicates(clones[:1], 0, 5, 42)
+        self.assertEqual(t1, [tskit.TableCollection.fromdict(d) for d in d3])
+
+    def test_clone_bad_args(self):
+        sim = get_example_simulator()
+        rng = _msprime.RandomGenerator(1)
+        tables = _msprime.LightweightTableCollection()
+        with self.assertRaises(TypeError):
+            _msprime.clone_simulator()
+        for bad_type in [None, "x", {}]:
+            with self.assertRaises(TypeError):
+                _msprime.clone_simulator(bad_type, rng, tables)
+            with self.assertRaises(TypeError):
+                _msprime.clone_simulator(sim, bad_type, tables)
+            with self.assertRaises(TypeError):
+                _msprime.clone_simulator(sim, rng, bad_type)
+        with self.assertRaises(ValueError):
+            _msprime.clone_simulator(sim, sim.random_generator, tables)
+        with self.assertRaises(ValueError):
+            _msprime.clone_simulator(sim, rng, sim.tables)
+
+    def test_shared_random_generator(self):
+        rng = _msprime.RandomGenerator(1)
+        sims = [
+            _msprime.Simulator(
+                get_samples(4),
+                uniform_recombination_map(),
+                rng,
+                _msprime.LightweightTableCollection(),
+            )
+            for _ in range(2)
+        ]
+        with self.assertRaises(ValueError):
+            _msprime.run_replicates(sims, 0, 1, 1)
+
+
+class TestLightweightTableCollection(unittest.TestCase):
+    """
+    Tests for handing tables between the low-level module and tskit.
+    """
+
+    def get_tables(self):
+        tables = tskit.TableCollection(1)
+        for _ in range(4):
+            tables.nodes.add_row(flags=tskit.NODE_IS_SAMPLE, time=0)
+        tables.nodes.add_row(time=1, metadata=b"abc")
+        tables.nodes.add_row(time=2)
+        tables.edges.add_row(0, 1, 4, 0)
+        tables.edges.add_row(0, 1, 4, 1)
+        tables.edges.add_row(0, 1, 5, 2)
+        tables.edges.add_row(0, 1, 5, 3)
+        tables.sites.add_row(0.25, "A")
+        tables.mutations.add_row(0, node=4, derived_state="T")
+        tables.provenances.add_row("record")
+        return tables
+
+    def test_asdict_round_trip(self):
+        tables = self.get_tables()
+        lwt = _msprime.LightweightTableCollection()
+        lwt.fromdict(tables.asdict())
+        self.assertEqual(tables, tskit.TableCollection.fromdict(lwt.asdict()))
+        # The tables are left untouched.
+        self.assertEqual(tables, tskit.TableCollection.fromdict(lwt.asdict()))
+
+    def test_asdict_copies(self):
+        tables = self.get_tables()
+        lwt = _msprime.LightweightTableCollection()
+        lwt.fromdict(tables.asdict())
+        d = lwt.asdict()
+        # Changing or freeing the tables afterwards must not affect the dict.
+        other = tskit.TableCollection(tables.sequence_length)
+        other.nodes.add_row(time=1.5)
+        lwt.fromdict(other.asdict())
+        self.assertEqual(tables, tskit.TableCollection.fromdict(d))
+        lwt.asdict(move=True)
+        del lwt
+        self.assertEqual(tables, tskit.TableCollection.fromdict(d))
+
+    def test_asdict_move(self):
+        tables = self.get_tables()
+        lwt = _msprime.LightweightTableCollection()
+        lwt.fromdict(tables.asdict())
+        d = lwt.asdict(move=True)
+        self.assertEqual(tables, tskit.TableCollection.fromdict(d))
+        empty = tskit.TableCollection.fromdict(lwt.asdict())
+        self.assertEqual(empty.sequence_length, tables.sequence_length)
+        self.assertEqual(empty.nodes.num_rows, 0)
+        self.assertEqual(empty.edges.num_rows, 0)
+        self.assertEqual(empty.mutations.num_rows, 0)
+        # The moved arrays outlive the source and the tables can be refilled.
+        del lwt
+        self.assertEqual(tables, tskit.TableCollection.fromdict(d))
+
+    def test_asdict_move_refill(self):
+        tables = self.get_tables()
+        lwt = _msprime.LightweightTableCollection()
+        for _ in range(3):
+            lwt.fromdict(tables.asdict())
+            other = tskit.TableCollection.fromdict(lwt.asdict(move=True))
+            self.assertEqual(tables, other)
+
+    def test_asdict_bad_args(self):
+        lwt = _msprime.LightweightTableCollection()
+        for bad_type in ["x", {}, None]:
+            with self.assertRaises(TypeError):
+                lwt.asdict(move=bad_type)
+
+    def test_stamp_replicate(self):
+        tables = self.get_tables()
+        tables.populations.add_row()
+        tables.populations.add_row()
+        lwt = _msprime.LightweightTableCollection()
+        lwt.fromdict(tables.asdict())
+        placeholder = _msprime.REPLICATE_INDEX_PLACEHOLDER
+        lwt.stamp_replicate(
+            123,
+            provenance_record=f'{{"a": {placeholder}, "b": [{placeholder}]}}',
+            provenance_timestamp="now",
+            population_metadata=[b"x", b""],
+        )
+        stamped = tskit.TableCollection.fromdict(lwt.asdict())
+        self.assertEqual(len(stamped.provenances), 2)
+        self.assertEqual(stamped.provenances[1].timestamp, "now")
+        self.assertEqual(stamped.provenances[1].record, '{"a": 123, "b": [123]}')
+        self.assertEqual(
+            [population.metadata for population in stamped.populations], [b"x", b""]
+        )
+        self.assertEqual(stamped.nodes, tables.nodes)
+        # With no arguments the tables are left as they are.
+        lwt.stamp_replicate(0)
+        self.assertEqual(stamped, tskit.TableCollection.fromdict(lwt.asdict()))
+
+    def test_stamp_replicate_bad_args(self):
+        lwt = _msprime.LightweightTableCollection()
+        lwt.fromdict(self.get_tables().asdict())
+        with self.assertRaises(TypeError):
+            lwt.stamp_replicate()
+        with self.assertRaises(ValueError):
+            lwt.stamp_replicate(-1)
+        with self.assertRaises(ValueError):
+            lwt.stamp_replicate(0, provenance_record="x")
+        with self.assertRaises(ValueError):
+            lwt.stamp_replicate(0, provenance_timestamp="x")
+        with self.assertRaises(TypeError):
+            lwt.stamp_replicate(0, provenance_record=b"x", provenance_timestamp="x")
+        for bad_metadata in [1, ["x"], [None]]:
+            with self.assertRaises(TypeError):
+                lwt.stamp_replicate(0, population_metadata=bad_metadata)
+        # The number of populations must match
+        with self.assertRaises(_msprime.LibraryError):
+            lwt.stamp_replicate(0, population_metadata=[b"x"])
+
+
 class TestDemographyDebugger(unittest.TestCase):
     """
     Tests for the demography debugging interface.
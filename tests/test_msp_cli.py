@@ -0,0 +1,176 @@
+#
+# Copyright (C) 2020 University of Oxford
+#
+# This file is part of msprime.
+#
+# msprime is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# msprime is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Test cases for the batch command line interface to the C library, msp-cli.
+These are skipped unless the MSP_CLI environment variable gives the path to
+the msp-cli executable.
+"""
+import json
+import os
+import struct
+import subprocess
+import tempfile
+import unittest
+
+import tskit
+
+MSP_CLI = os.environ.get("MSP_CLI")
+
+CONFIG = """
+random_seed = 5;
+sample_size = 10;
+sequence_length = 10.0;
+recombination_rate = 0.5;
+mutation_rate = {mutation_rate};
+"""
+
+ARCHIVE_MAGIC = b"MSPARCH1"
+
+
+def read_archive(path):
+    """
+    Returns the list of replicates in the specified archive as bytes, using
+    the index at the end of the file.
+    """
+    with open(path, "rb") as f:
+        data = f.read()
+    assert data[:8] == ARCHIVE_MAGIC
+    assert data[-8:] == ARCHIVE_MAGIC
+    num_replicates, index_offset = struct.unpack("<QQ", data[-24:-8])
+    offsets = struct.unpack(
+        "<{}Q".format(num_replicates + 1),
+        data[index_offset : index_offset + 8 * (num_replicates + 1)],
+    )
+    assert offsets[0] == 8
+    assert offsets[-1] == index_offset
+    return [data[offsets[j] : offsets[j + 1]] for j in range(num_replicates)]
+
+
+def without_timestamps(tables):
+    """
+    Returns a copy of the tables with the provenance timestamps cleared, as
+    these depend on when the replicates were run.
+    """
+    tables = tables.copy()
+    records = [provenance.record for provenance in tables.provenances]
+    tables.provenances.clear()
+    for record in records:
+        tables.provenances.add_row(record=record, timestamp="")
+    return tables
+
+
+@unittest.skipIf(MSP_CLI is None, "MSP_CLI not set")
+class TestMspCli(unittest.TestCase):
+    """
+    Tests for the output of msp-cli.
+    """
+
+    num_replicates = 6
+
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory(prefix="msp_cli_")
+        self.dir = self.temp_dir.name
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def write_config(self, mutation_rate=0.5):
+        path = os.path.join(self.dir, "sim.cfg")
+        with open(path, "w") as f:
+            f.write(CONFIG.format(mutation_rate=mutation_rate))
+        return path
+
+    def run_cli(self, *args):
+        return subprocess.run(
+            [MSP_CLI, "simulate"] + list(args),
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+        )
+
+    def run_simulate(self, num_threads):
+        """
+        Runs the replicates on the specified number of threads, returning the
+        replicates from the archive, the trees files and the statistics.
+        """
+        prefix = os.path.join(self.dir, "rep_{}".format(num_threads))
+        archive = os.path.join(self.dir, "{}.msparch".format(num_threads))
+        stats = os.path.join(self.dir, "{}.json".format(num_threads))
+        result = self.run_cli(
+            self.write_config(),
+            "-r",
+            str(self.num_replicates),
+            "-t",
+            str(num_threads),
+            "-o",
+            prefix,
+            "-a",
+            archive,
+            "-S",
+            stats,
+        )
+        self.assertEqual(result.returncode, 0, result.stderr)
+        files = []
+        for j in range(self.num_replicates):
+            with open("{}_{}.trees".format(prefix, j), "rb") as f:
+                files.append(f.read())
+        with open(stats) as f:
+            summary = json.load(f)
+        return read_archive(archive), files, summary
+
+    def load(self, data):
+        path = os.path.join(self.dir, "tmp.trees")
+        with open(path, "wb") as f:
+            f.write(data)
+        return tskit.load(path).dump_tables()
+
+    def test_archive_matches_trees_files(self):
+        for num_threads in [1, 4]:
+            replicates, files, summary = self.run_simulate(num_threads)
+            self.assertEqual(len(replicates), self.num_replicates)
+            for j in range(self.num_replicates):
+                self.assertEqual(replicates[j], files[j])
+                tables = self.load(replicates[j])
+                self.assertEqual(summary["replicates"][j]["index"], j)
+                self.assertEqual(
+                    summary["replicates"][j]["num_edges"], tables.edges.num_rows
+                )
+                self.assertEqual(
+                    summary["replicates"][j]["num_mutations"],
+                    tables.mutations.num_rows,
+                )
+
+    def test_threads_equivalence(self):
+        replicates1, _, summary1 = self.run_simulate(1)
+        replicates4, _, summary4 = self.run_simulate(4)
+        self.assertEqual(summary1["replicates"], summary4["replicates"])
+        num_mutations = 0
+        for data1, data4 in zip(replicates1, replicates4):
+            tables1 = without_timestamps(self.load(data1))
+            tables4 = without_timestamps(self.load(data4))
+            self.assertEqual(tables1, tables4)
+            num_mutations += tables1.mutations.num_rows
+        self.assertGreater(num_mutations, 0)
+
+    def test_branch_stats_mutation_rate(self):
+        stats = os.path.join(self.dir, "stats.json")
+        result = self.run_cli(self.write_config(), "-b", "-S", stats)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn(b"mutation_rate", result.stderr)
+        result = self.run_cli(self.write_config(0), "-b", "-S", stats)
+        self.assertEqual(result.returncode, 0, result.stderr)
@@ -263,6 +263,26 @@ class TestMutate(unittest.TestCase, MutateMixin):
                 for mutation in site.mutations:
                     self.assertEqual(mutation.derived_state, alleles[1])
 
+    def test_num_threads(self):
+        ts = msprime.simulate(10, recombination_rate=2, random_seed=1)
+        for discrete in [False, True]:
+            t1 = msprime.mutate(
+                ts, rate=5, random_seed=2, discrete=discrete, num_threads=1
+            ).dump_tables()
+            self.assertGreater(len(t1.mutations), 0)
+            for num_threads in [2, 3, 16]:
+                t2 = msprime.mutate(
+                    ts, rate=5, random_seed=2, discrete=discrete, num_threads=num_threads
+                ).dump_tables()
+                self.assertEqual(t1.sites, t2.sites)
+                self.assertEqual(t1.mutations, t2.mutations)
+
+    def test_bad_num_threads(self):
+        ts = msprime.simulate(10, random_seed=1)
+        for bad_value in [0, -1]:
+            with self.assertRaises(ValueError):
+                msprime.mutate(ts, rate=1, num_threads=bad_value)
+
     def test_zero_mutation_rate(self):
         ts = msprime.simulate(10, random_seed=1)
         mutated = msprime.mutate(ts, 0)
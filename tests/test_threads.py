@@ -23,6 +23,9 @@ import platform
 import threading
 import unittest
 
+import tskit
+
+import _msprime
 import msprime
 
 IS_WINDOWS = platform.system() == "Windows"
@@ -76,3 +79,124 @@ class TestSimulatorThreads(unittest.TestCase):
         self.assertGreater(len(results[0][0]), 0)
         for result in results[1:]:
             self.assertEqual(results[0], result)
+
+
+class TestMutationGeneratorThreads(unittest.TestCase):
+    """
+    Tests that we can generate mutations in separate threads, and that
+    concurrent use of the same low-level objects is safe.
+    """
+
+    num_threads = 10
+
+    def get_tree_sequence(self):
+        return msprime.simulate(20, recombination_rate=1, random_seed=2)
+
+    def test_mutate_equality(self):
+        ts = self.get_tree_sequence()
+
+        def worker(thread_index, results):
+            results[thread_index] = msprime.mutate(ts, rate=2, random_seed=5)
+
+        results = run_threads(worker, self.num_threads)
+        tables = results[0].tables
+        self.assertGreater(len(tables.mutations), 0)
+        for mts in results[1:]:
+            self.assertEqual(tables.sites, mts.tables.sites)
+            self.assertEqual(tables.mutations, mts.tables.mutations)
+
+    def test_shared_mutation_generator(self):
+        ts = self.get_tree_sequence()
+        rng = _msprime.RandomGenerator(5)
+        rate_map = _msprime.IntervalMap([0, 1], [2, 0])
+        mutgen = _msprime.MutationGenerator(rng, rate_map, msprime.BinaryMutations())
+        tables_dict = ts.dump_tables().asdict()
+
+        def worker(thread_index, results):
+            lw_tables = _msprime.LightweightTableCollection()
+            lw_tables.fromdict(tables_dict)
+            for _ in range(5):
+                mutgen.generate(lw_tables)
+            results[thread_index] = lw_tables.asdict()
+
+        results = run_threads(worker, self.num_threads)
+        for result in results:
+            tables = tskit.TableCollection.fromdict(result)
+            self.assertGreater(len(tables.mutations), 0)
+            self.assertEqual(len(tables.sites), len(tables.mutations))
+            tables.tree_sequence()
+
+    def test_shared_tables(self):
+        ts = self.get_tree_sequence()
+        lw_tables = _msprime.LightweightTableCollection()
+        lw_tables.fromdict(ts.dump_tables().asdict())
+        rate_map = _msprime.IntervalMap([0, 1], [2, 0])
+
+        def worker(thread_index, results):
+            mutgen = _msprime.MutationGenerator(
+                _msprime.RandomGenerator(thread_index + 1),
+                rate_map,
+                msprime.BinaryMutations(),
+            )
+            for _ in range(5):
+                mutgen.generate(lw_tables)
+                tables = tskit.TableCollection.fromdict(lw_tables.asdict())
+                self.assertEqual(len(tables.sites), len(tables.mutations))
+            results[thread_index] = True
+
+        results = run_threads(worker, self.num_threads)
+        self.assertTrue(all(results))
+        tables = tskit.TableCollection.fromdict(lw_tables.asdict())
+        self.assertGreater(len(tables.mutations), 0)
+        tables.tree_sequence()
+
+    def test_shared_infinite_alleles_model(self):
+        # The infinite alleles model is not thread safe, as it keeps the next
+        # allele to use, so generators sharing it must take turns.
+        ts = self.get_tree_sequence()
+        model = _msprime.InfiniteAllelesMutationModel()
+        rate_map = _msprime.IntervalMap([0, 1], [2, 0])
+        tables_dict = ts.dump_tables().asdict()
+
+        def worker(thread_index, results):
+            mutgen = _msprime.MutationGenerator(
+                _msprime.RandomGenerator(thread_index + 1), rate_map, model
+            )
+            lw_tables = _msprime.LightweightTableCollection()
+            results[thread_index] = []
+            for _ in range(5):
+                lw_tables.fromdict(tables_dict)
+                mutgen.generate(lw_tables, discrete=True)
+                results[thread_index].append(lw_tables.asdict())
+
+        results = run_threads(worker, self.num_threads)
+        for result in results:
+            for tables_dict in result:
+                mts = tskit.TableCollection.fromdict(tables_dict).tree_sequence()
+                self.assertGreater(mts.num_mutations, 0)
+                for site in mts.sites():
+                    # Each site numbers its alleles from the start allele
+                    self.assertEqual(site.ancestral_state, "0")
+                    alleles = sorted(int(mut.derived_state) for mut in site.mutations)
+                    self.assertEqual(alleles, list(range(1, len(alleles) + 1)))
+
+
+class TestLikelihoodThreads(unittest.TestCase):
+    """
+    Tests that we can compute likelihoods in separate threads and
+    get the same results.
+    """
+
+    num_threads = 10
+
+    def test_log_arg_likelihood_equality(self):
+        ts = msprime.simulate(
+            10, recombination_rate=1, record_full_arg=True, random_seed=3
+        )
+
+        def worker(thread_index, results):
+            results[thread_index] = msprime.log_arg_likelihood(ts, 1)
+
+        results = run_threads(worker, self.num_threads)
+        for result in results[1:]:
+            self.assertEqual(results[0], result)